@@ -0,0 +1,66 @@
+#pragma once
+
+#include "pplx/pplxtasks.h"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+namespace TestClient {
+
+/**
+ * \brief Counting semaphore whose waiters are tasks, not threads
+ *
+ * Acquire() returns a task that completes once a permit is granted, so work
+ * limited by the semaphore is chained onto it instead of blocking a thread
+ * of the pplx pool. Permits are granted in the order they were requested.
+ */
+class AsyncSemaphore {
+    std::mutex                                      mutex_;
+    size_t                                          available_;
+    std::deque<pplx::task_completion_event<void>>   waiters_;
+
+public:
+    AsyncSemaphore() = delete;
+    AsyncSemaphore(const AsyncSemaphore&) = delete;
+    AsyncSemaphore& operator=(const AsyncSemaphore&) = delete;
+
+    explicit AsyncSemaphore(size_t permits);
+
+    /**
+     * \brief Completes when a permit is granted, at once if one is available
+     */
+    pplx::task<void> Acquire();
+
+    /**
+     * \brief Takes a permit if one is available without waiting
+     */
+    bool TryAcquire();
+
+    /**
+     * \brief Returns a permit, handing it to the oldest waiter if there is one
+     */
+    void Release();
+
+    size_t Available();
+}; // AsyncSemaphore
+
+/**
+ * \brief Starts one operation of a bounded run
+ * @return completes when the operation has finished
+ */
+typedef std::function<pplx::task<void>(uint64_t index)> BoundedOperation;
+
+/**
+ * \brief Runs operation(0) to operation(count - 1) with at most inFlight of them outstanding
+ *
+ * Admission is a chain of continuations on an AsyncSemaphore: each operation
+ * starts as soon as a permit frees up, so only about inFlight tasks exist at a
+ * time and no thread waits, whatever the count. An operation that throws
+ * counts as finished.
+ * @return completes when every operation has finished
+ */
+pplx::task<void> RunBounded(uint64_t count, size_t inFlight, BoundedOperation operation);
+
+} // namespace TestClient
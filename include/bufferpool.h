@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace TestClient {
+
+class BufferPool;
+
+/**
+ * \brief A buffer checked out of a BufferPool, returned to it on destruction
+ *
+ * Move-only. An empty PooledBuffer owns nothing.
+ */
+class PooledBuffer {
+    std::shared_ptr<BufferPool> pool_;
+    uint8_t*                    data_;
+    size_t                      size_;
+    size_t                      sizeClass_;
+
+    friend class BufferPool;
+    PooledBuffer(std::shared_ptr<BufferPool> pool, uint8_t* data, size_t size, size_t sizeClass);
+
+public:
+    PooledBuffer();
+    PooledBuffer(PooledBuffer&& other);
+    PooledBuffer& operator=(PooledBuffer&& other);
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+    ~PooledBuffer();
+
+    /**
+     * \brief Returns the buffer to its pool early
+     */
+    void Release();
+
+    uint8_t* Data() const { return data_; }
+    size_t Size() const { return size_; }
+    size_t Capacity() const;
+    bool Empty() const { return data_ == nullptr; }
+}; // PooledBuffer
+
+/**
+ * \brief Size-classed pool of page-aligned buffers
+ *
+ * Buffers are rounded up to one of four size classes per power of two, so at
+ * most 25% of a buffer is unused, and returned buffers are kept for the next
+ * request of the same class. Memory therefore stays at the peak number of
+ * concurrent buffers instead of growing with the number of requests. Must be
+ * owned by a std::shared_ptr, checked out buffers keep the pool alive.
+ */
+class BufferPool : public std::enable_shared_from_this<BufferPool> {
+public:
+    static const size_t MIN_BUFFER_SIZE = 64 * 1024;
+    static const size_t CLASSES_PER_DOUBLING = 4;
+    static const size_t NUM_SIZE_CLASSES = CLASSES_PER_DOUBLING * 32;
+
+private:
+    struct SizeClass {
+        std::mutex              mutex_;
+        std::vector<uint8_t*>   free_;
+    }; // SizeClass
+
+    SizeClass               classes_[NUM_SIZE_CLASSES];
+    bool                    hugePages_;
+    std::atomic<uint64_t>   hits_;
+    std::atomic<uint64_t>   misses_;
+    std::atomic<uint64_t>   residentBytes_;
+    std::atomic<uint64_t>   peakResidentBytes_;
+
+    friend class PooledBuffer;
+    void Return(uint8_t* data, size_t sizeClass);
+
+    uint8_t* Allocate(size_t bytes);
+    static void Free(uint8_t* data, size_t bytes);
+
+public:
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    /**
+     * \brief Creates an empty pool
+     * @param hugePages back large buffers with huge pages where the OS allows it
+     */
+    explicit BufferPool(bool hugePages = false);
+    ~BufferPool();
+
+    /**
+     * \brief Size of the buffers of a size class
+     */
+    static size_t ClassSize(size_t sizeClass);
+
+    /**
+     * \brief Smallest size class holding size bytes
+     */
+    static size_t ClassOf(size_t size);
+
+    /**
+     * \brief Checks out a buffer of at least size bytes, reusing a returned one if possible
+     * @throw std::bad_alloc if the memory cannot be allocated
+     */
+    PooledBuffer Acquire(size_t size);
+
+    /**
+     * \brief Frees every buffer not checked out
+     */
+    void Trim();
+
+    bool HugePages() const { return hugePages_; }
+
+    /**
+     * \brief Number of requests served by a returned buffer
+     */
+    uint64_t Hits() const { return hits_.load(std::memory_order_relaxed); }
+
+    /**
+     * \brief Number of requests that had to allocate
+     */
+    uint64_t Misses() const { return misses_.load(std::memory_order_relaxed); }
+
+    /**
+     * \brief Bytes allocated by the pool, checked out or not
+     */
+    uint64_t ResidentBytes() const { return residentBytes_.load(std::memory_order_relaxed); }
+    uint64_t PeakResidentBytes() const { return peakResidentBytes_.load(std::memory_order_relaxed); }
+}; // BufferPool
+
+} // namespace TestClient
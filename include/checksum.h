@@ -0,0 +1,100 @@
+#pragma once
+
+#include "cpprest/streams.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace TestClient {
+
+/**
+ * \brief CRC32C (Castagnoli) of a block of data
+ *
+ * Uses the SSE4.2 crc32 instruction when the CPU has it and a slicing-by-8
+ * table otherwise. Pass the previous result as crc to continue a checksum
+ * over consecutive blocks, e.g. Crc32c(b, nb, Crc32c(a, na)).
+ */
+uint32_t Crc32c(const uint8_t* data, size_t length, uint32_t crc = 0);
+
+/**
+ * \brief CRC32C of the concatenation of two blocks from their own CRCs
+ * @param crc1      CRC32C of the first block
+ * @param crc2      CRC32C of the second block
+ * @param length2   length of the second block
+ */
+uint32_t Crc32cCombine(uint32_t crc1, uint32_t crc2, uint64_t length2);
+
+/**
+ * \brief CRC32C on the slicing-by-8 table whatever the CPU, e.g. to check Crc32c() against
+ */
+uint32_t Crc32cPortable(const uint8_t* data, size_t length, uint32_t crc = 0);
+
+/**
+ * \brief Whether Crc32c() runs on the SSE4.2 instruction
+ */
+bool Crc32cHardware();
+
+/**
+ * \brief CRC32C of a whole file
+ * @return false if the file cannot be read
+ */
+bool Crc32cFile(const std::string& fileName, uint32_t& crc);
+
+/**
+ * \brief Wraps writable cpprest buffers to checksum the bytes written through them
+ */
+class ChecksumStream {
+public:
+    /**
+     * \brief Returns a write-only buffer that updates crc and forwards every write to target
+     *
+     * Pass the result to read_to_end() to verify a response body while it streams
+     * in, without a second pass over the data.
+     * @param target    buffer receiving the data, e.g. a file_buffer
+     * @param crc       running CRC32C of the bytes written so far
+     */
+    static Concurrency::streams::streambuf<uint8_t> Wrap(
+        Concurrency::streams::streambuf<uint8_t> target,
+        std::shared_ptr<uint32_t> crc);
+}; // ChecksumStream
+
+/**
+ * \brief Checksums recorded at upload time, keyed by blob uuid
+ *
+ * Shared by every task of a run, so a download can be verified against the
+ * upload of any task.
+ */
+class ChecksumRegistry {
+    mutable std::mutex                                  mutex_;
+    std::unordered_map<utility::string_t, uint32_t>     checksums_;
+    std::atomic<uint64_t>                               verified_;
+    std::atomic<uint64_t>                               mismatches_;
+    std::atomic<uint64_t>                               unknown_;
+
+public:
+    ChecksumRegistry();
+    ChecksumRegistry(const ChecksumRegistry&) = delete;
+    ChecksumRegistry& operator=(const ChecksumRegistry&) = delete;
+
+    void Record(const utility::string_t& uuid, uint32_t crc);
+
+    /**
+     * \brief Checks a downloaded blob against its recorded checksum
+     * @return false only on a mismatch, blobs without a recorded checksum pass
+     */
+    bool Verify(const utility::string_t& uuid, uint32_t crc);
+
+    uint64_t Verified() const { return verified_.load(std::memory_order_relaxed); }
+    uint64_t Mismatches() const { return mismatches_.load(std::memory_order_relaxed); }
+
+    /**
+     * \brief Number of downloads of blobs uploaded without a checksum
+     */
+    uint64_t Unknown() const { return unknown_.load(std::memory_order_relaxed); }
+}; // ChecksumRegistry
+
+} // namespace TestClient
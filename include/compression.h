@@ -0,0 +1,137 @@
+#pragma once
+
+#include "cpprest/streams.h"
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+namespace TestClient {
+
+static const int MAX_GZIP_LEVEL = 9;
+
+/**
+ * \brief Compressed transfers of a run
+ */
+struct CompressionOptions {
+    std::vector<int>    levels_;        // gzip levels whole-blob uploads rotate over, empty = raw uploads
+    bool                acceptGzip_;    // downloads ask for gzip and decode it
+
+    CompressionOptions()
+        : acceptGzip_(false)
+    { }
+
+    bool Enabled() const { return !levels_.empty() || acceptGzip_; }
+}; // CompressionOptions
+
+/**
+ * \brief Bytes and CPU time of one compressed body, updated by a GzipStream as it streams
+ */
+struct CompressionCounters {
+    uint64_t    rawBytes_;      // uncompressed
+    uint64_t    wireBytes_;     // gzip
+    uint64_t    cpuNS_;         // thread CPU time spent in the gzip filter
+
+    CompressionCounters()
+        : rawBytes_(0), wireBytes_(0), cpuNS_(0)
+    { }
+}; // CompressionCounters
+
+/**
+ * \brief Wraps cpprest streams to gzip a body while it streams, one chunk at a time
+ *
+ * Built on the Boost.Iostreams gzip filters. Only a chunk of input and the
+ * output it produced are held at any time, never a whole body.
+ */
+class GzipStream {
+public:
+    static const size_t CHUNK_SIZE = 64 * 1024;
+
+    /**
+     * \brief Returns a read-only stream of the gzip of source
+     *
+     * The length is unknown up front, send it without a Content-Length, i.e.,
+     * with chunked transfer encoding.
+     * @param level     0 (stored) and 1 (fastest) to MAX_GZIP_LEVEL (smallest)
+     */
+    static Concurrency::streams::basic_istream<uint8_t> Compress(
+        Concurrency::streams::basic_istream<uint8_t> source,
+        int level,
+        std::shared_ptr<CompressionCounters> counters);
+
+    /**
+     * \brief Returns a write-only buffer that decodes the gzip written to it into target
+     *
+     * sync() the returned buffer after the last write, it flushes the last
+     * decoded bytes and fails on a truncated or corrupt body.
+     * @param target    receives the decoded bytes, null to decode and discard them
+     */
+    static Concurrency::streams::streambuf<uint8_t> Decompress(
+        Concurrency::streams::streambuf<uint8_t> target,
+        std::shared_ptr<CompressionCounters> counters);
+}; // GzipStream
+
+/**
+ * \brief Level of the next compressed upload, rotating over options.levels_
+ */
+int NextCompressionLevel(const CompressionOptions& options);
+
+/**
+ * \brief Totals of the compressed transfers of one level or of the downloads
+ */
+struct CompressionStats {
+    uint64_t    transfers_;
+    uint64_t    rawBytes_;
+    uint64_t    wireBytes_;
+    uint64_t    cpuNS_;
+    uint64_t    transferNS_;    // summed over the transfers, request sent to completion
+
+    CompressionStats()
+        : transfers_(0), rawBytes_(0), wireBytes_(0), cpuNS_(0), transferNS_(0)
+    { }
+
+    double Ratio() const { return wireBytes_ > 0 ? (double)rawBytes_ / (double)wireBytes_ : 0.0; }
+
+    /**
+     * \brief Uncompressed bytes per CPU second of the gzip filter
+     */
+    double CpuBytesPerS() const { return cpuNS_ > 0 ? (double)rawBytes_ * 1e9 / (double)cpuNS_ : 0.0; }
+
+    /**
+     * \brief Uncompressed bytes per second of one transfer, what the application sees
+     */
+    double EffectiveBytesPerS() const { return transferNS_ > 0 ? (double)rawBytes_ * 1e9 / (double)transferNS_ : 0.0; }
+
+    /**
+     * \brief Compressed bytes per second of one transfer, what the network carries
+     */
+    double WireBytesPerS() const { return transferNS_ > 0 ? (double)wireBytes_ * 1e9 / (double)transferNS_ : 0.0; }
+}; // CompressionStats
+
+/**
+ * \brief Adds a completed upload compressed at level
+ */
+void RecordCompressedUpload(int level, const CompressionCounters& counters, uint64_t transferNS);
+
+/**
+ * \brief Adds a completed download decoded from gzip
+ */
+void RecordCompressedDownload(const CompressionCounters& counters, uint64_t transferNS);
+
+/**
+ * \brief Totals of the uploads compressed at level
+ */
+CompressionStats CompressedUploads(int level);
+
+/**
+ * \brief Totals of the downloads decoded from gzip
+ */
+CompressionStats CompressedDownloads();
+
+/**
+ * \brief Prints ratio, CPU time and effective versus wire throughput of every level used
+ */
+void PrintCompressionStats(std::wostream& os);
+
+} // namespace TestClient
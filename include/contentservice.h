@@ -1,6 +1,15 @@
 #pragma once
 
 #include "testparameters.h"
+#include "httpclientpool.h"
+#include "endpointrouter.h"
+#include "bufferpool.h"
+#include "checksum.h"
+#include "compression.h"
+#include "metadatacache.h"
+#include "mappedsource.h"
+#include "uuidprefetcher.h"
+#include "testinputstream.h"
 
 #include "cpprest/http_client.h"
 #include "cpprest/streams.h"
@@ -17,39 +26,237 @@ const utility::string_t STRING_GET_BLOB_SUCCESS(U("Get data blob success"));
 static const int CONTENT_SERVICE_TASK_SUCCESS = 1;
 static const int CONTENT_SERVICE_TASK_FAIL = -1;
 
+static const uint64_t DEFAULT_DOWNLOAD_CHUNK_SIZE = 8 * 1024 * 1024;
+static const uint64_t DEFAULT_UPLOAD_CHUNK_SIZE = 8 * 1024 * 1024;
+
 /**
  * \brief Information for connecting to a content service instance
  */
 struct ContentServiceConnection {
-    utility::string_t   serverURI_;
-    int                 port_;
+    utility::string_t               serverURI_;
+    int                             port_;
+    std::shared_ptr<EndpointRouter> router_;    // nodes and their clients, shared by all copies of the connection
+    std::shared_ptr<ChecksumRegistry> checksums_;
+    std::shared_ptr<BufferPool>     buffers_;   // in-memory downloads
+    std::shared_ptr<BlobMetadataCache> metadata_;
+    std::shared_ptr<UuidPrefetcher> prefetcher_;    // pre-created blobs, started by ContentService::StartUuidPrefetch()
+    CompressionOptions              compression_;   // gzip of whole-blob transfers, set before the connection is copied
+    bool                            verifyDownloads_;   // check downloads against upload checksums, set before the connection is copied
 
-    ContentServiceConnection() 
-        : serverURI_(U("")),
-        port_(80)
-    { }
-    ContentServiceConnection(const utility::string_t& serverURI, int port)
-        : serverURI_(serverURI), port_(port)
-    { }
+    // every accessor dereferences the shared parts, a connection always has them
+    ContentServiceConnection() = delete;
+
+    ContentServiceConnection(const utility::string_t& serverURI, int port, size_t poolSize = DEFAULT_CONNECTION_POOL_SIZE, bool hugePages = false,
+        size_t metadataCacheSize = DEFAULT_METADATA_CACHE_SIZE)
+        : serverURI_(serverURI), port_(port), verifyDownloads_(true)
+    {
+        router_ = std::make_shared<EndpointRouter>(std::vector<utility::string_t>(1, GetURI()), poolSize, ROUTING_ROUND_ROBIN);
+        checksums_ = std::make_shared<ChecksumRegistry>();
+        buffers_ = std::make_shared<BufferPool>(hugePages);
+        metadata_ = std::make_shared<BlobMetadataCache>(metadataCacheSize);
+        prefetcher_ = std::make_shared<UuidPrefetcher>();
+    }
+
+    /**
+     * \brief Connects to a cluster of content service nodes
+     * @param endpoints base URI of each node, i.e., server:port, the first one is reported by GetURI()
+     * @param routing   how requests are spread over the nodes
+     */
+    ContentServiceConnection(const std::vector<utility::string_t>& endpoints, RoutingPolicy routing,
+        size_t poolSize = DEFAULT_CONNECTION_POOL_SIZE, bool hugePages = false,
+        size_t metadataCacheSize = DEFAULT_METADATA_CACHE_SIZE)
+        : serverURI_(endpoints.front()), port_(0), verifyDownloads_(true)
+    {
+        router_ = std::make_shared<EndpointRouter>(endpoints, poolSize, routing);
+        checksums_ = std::make_shared<ChecksumRegistry>();
+        buffers_ = std::make_shared<BufferPool>(hugePages);
+        metadata_ = std::make_shared<BlobMetadataCache>(metadataCacheSize);
+        prefetcher_ = std::make_shared<UuidPrefetcher>();
+    }
 
     utility::string_t GetURI() const {
+        if (port_ == 0) {
+            return serverURI_;
+        }
+
         utility::stringstream_t ss;
         ss << serverURI_ << U(":") << port_;
         
         return ss.str();
     }
+
+    /**
+     * \brief Sends a request about a blob to the node the routing policy picks
+     * @param uuid  the blob, empty when creating one
+     */
+    pplx::task<web::http::http_response> Send(const utility::string_t& uuid, const web::http::http_request& request) const {
+        return router_->Send(uuid, request);
+    }
+
+    /**
+     * \brief Nodes of this connection with their client pools and request statistics
+     */
+    const EndpointRouter& Router() const { return *router_; }
+
+    /**
+     * \brief Checksums of the blobs uploaded over this connection
+     */
+    ChecksumRegistry& Checksums() const { return *checksums_; }
+
+    /**
+     * \brief Buffers that in-memory downloads are checked out of
+     */
+    BufferPool& Buffers() const { return *buffers_; }
+
+    /**
+     * \brief Content lengths of known blobs, saves the metadata request of a download
+     */
+    BlobMetadataCache& Metadata() const { return *metadata_; }
+
+    /**
+     * \brief Blob uuids created ahead of the uploads that take them
+     */
+    UuidPrefetcher& Prefetcher() const { return *prefetcher_; }
 }; // ContentServiceConnection
 
+/**
+ * \brief Payload of an upload, either a file on disk or generated data
+ */
+struct UploadSource {
+    utility::string_t                       fileName_;  // empty for generated data
+    uint64_t                                size_;
+    std::shared_ptr<const TestDataPattern>  pattern_;   // set for generated data
+    std::shared_ptr<const MappedSourceFile> mapping_;   // set once the file is mapped, shared by every upload
+    uint32_t                                checksum_;  // CRC32C, valid if hasChecksum_
+    bool                                    hasChecksum_;
+
+    UploadSource()
+        : size_(0), checksum_(0), hasChecksum_(false)
+    { }
+    UploadSource(const utility::string_t& fileName, uint64_t size)
+        : fileName_(fileName), size_(size), checksum_(0), hasChecksum_(false)
+    { }
+    UploadSource(std::shared_ptr<const TestDataPattern> pattern, uint64_t size)
+        : size_(size), pattern_(pattern), checksum_(0), hasChecksum_(false)
+    { }
+
+    /**
+     * \brief Computes the CRC32C that downloads of this payload are verified against
+     *
+     * Done once per source before the run, every upload of it then records the
+     * checksum under its uuid.
+     * @return false if the file cannot be read
+     */
+    bool ComputeChecksum();
+
+    /**
+     * \brief Maps the file once, every upload of this source then sends from the mapping
+     * @return false if the file cannot be mapped, uploads then stream it from disk
+     */
+    bool Map();
+
+    bool IsGenerated() const { return pattern_ != nullptr; }
+    bool IsMapped() const { return mapping_ != nullptr; }
+
+    /**
+     * \brief File name, or a short description of generated data for reports
+     */
+    utility::string_t Name() const {
+        if (!IsGenerated()) {
+            return fileName_;
+        }
+
+        utility::stringstream_t ss;
+        ss << (pattern_->Type() == PAYLOAD_RANDOM ? U("random") : U("pattern"))
+            << U("[") << size_ << U("]");
+        return ss.str();
+    }
+}; // UploadSource
+
+/**
+ * \brief Settings of a ranged, multi-stream download
+ */
+struct RangedDownloadOptions {
+    size_t      streams_;       // number of concurrent range requests
+    uint64_t    chunkSize_;     // bytes per range request
+
+    RangedDownloadOptions()
+        : streams_(1), chunkSize_(DEFAULT_DOWNLOAD_CHUNK_SIZE)
+    { }
+    RangedDownloadOptions(size_t streams, uint64_t chunkSize)
+        : streams_(streams), chunkSize_(chunkSize)
+    { }
+}; // RangedDownloadOptions
+
+/**
+ * \brief Timing of one range request
+ */
+struct ChunkStats {
+    uint64_t    offset_;
+    uint64_t    length_;
+    int64_t     timeUS_;    // request sent to last byte received
+}; // ChunkStats
+
+/**
+ * \brief Result of a ranged, multi-stream download
+ */
+struct RangedDownloadStats {
+    int64_t                 contentLength_;
+    int64_t                 timeUS_;        // first request sent to last chunk received
+    std::vector<ChunkStats> chunks_;
+
+    RangedDownloadStats()
+        : contentLength_(CONTENT_SERVICE_TASK_FAIL), timeUS_(0)
+    { }
+}; // RangedDownloadStats
+
+/**
+ * \brief Settings of a chunked, resumable upload
+ */
+struct ChunkedUploadOptions {
+    uint64_t    chunkSize_;     // bytes per Content-Range chunk, 0 = single PUT
+    size_t      chunksInFlight_; // chunks read ahead of the one being sent, or sent at once if outOfOrder_
+    size_t      maxResumes_;    // resume attempts before giving up
+    bool        outOfOrder_;    // send chunks concurrently, only for services buffering ranges past the committed offset
+
+    ChunkedUploadOptions()
+        : chunkSize_(0), chunksInFlight_(1), maxResumes_(3), outOfOrder_(false)
+    { }
+    ChunkedUploadOptions(uint64_t chunkSize, size_t chunksInFlight, size_t maxResumes, bool outOfOrder = false)
+        : chunkSize_(chunkSize), chunksInFlight_(chunksInFlight), maxResumes_(maxResumes), outOfOrder_(outOfOrder)
+    { }
+}; // ChunkedUploadOptions
+
+/**
+ * \brief Result of a chunked, resumable upload
+ */
+struct ChunkedUploadStats {
+    utility::string_t   uuid_;          // empty on failure
+    int64_t             contentLength_;
+    size_t              chunks_;        // chunk requests sent, including resent ones
+    size_t              resumes_;
+    uint64_t            resentBytes_;   // bytes of chunks sent again after resuming
+    int64_t             recoveryUS_;    // failure detected to upload resumed, summed over resumes
+    int64_t             timeUS_;        // blob creation to last chunk committed
+
+    ChunkedUploadStats()
+        : contentLength_(CONTENT_SERVICE_TASK_FAIL), chunks_(0), resumes_(0),
+        resentBytes_(0), recoveryUS_(0), timeUS_(0)
+    { }
+}; // ChunkedUploadStats
+
 /**
  * \brief Output error message
  */
 void ErrorMessage(const char*);
 void WErrorMessage(const wchar_t*);
 
-// TODO: - resumable upload
-
 /**
  * \brief Handles uploading and downloading from content service
+ *
+ * Every operation returns a task and none blocks a thread while waiting for
+ * the service, continuations chain onto responses and body reads instead.
+ * Tasks do not depend on the service object, which may go away before they finish.
  */
 class ContentService {
     ContentServiceConnection    connection_;
@@ -60,7 +267,15 @@ class ContentService {
      * @return uuid
      */
     pplx::task<utility::string_t> GetBlobUUID(
-        const utility::string_t serverURI,
+        uint64_t size,
+        std::function<void(char const *)> error,
+        std::function<void(const wchar_t*)> wErrorFunc);
+
+    /**
+     * \brief Takes a pre-created blob of the size, or creates one when none is ready
+     * @return uuid
+     */
+    pplx::task<utility::string_t> AcquireBlobUUID(
         uint64_t size,
         std::function<void(char const *)> error,
         std::function<void(const wchar_t*)> wErrorFunc);
@@ -72,22 +287,62 @@ class ContentService {
      * @param content-length of the blob
      */
     pplx::task<int64_t> GetBlobContentLength(
-        const utility::string_t serverURI,
         const utility::string_t& uuid,
         std::function<void(const char*)> errorFunc,
         std::function<void(const wchar_t*)> wErrorFunc);
 
     /**
-     * \brief Async upload a file to content service
-     * @param connection
-     * @param filename
+     * \brief Gets the length of the data blob from the metadata cache, or from the service on a miss
+     *
+     * A length from the cache is checked against the Content-Length of the download.
+     */
+    pplx::task<int64_t> LookupContentLength(
+        const utility::string_t& uuid,
+        std::function<void(const char*)> errorFunc,
+        std::function<void(const wchar_t*)> wErrorFunc);
+
+    /**
+     * \brief Gets the length of the data blob from the service and caches it
+     */
+    pplx::task<int64_t> RefreshContentLength(
+        const utility::string_t& uuid,
+        std::function<void(const char*)> errorFunc,
+        std::function<void(const wchar_t*)> wErrorFunc);
+
+    /**
+     * \brief Downloads a blob of the given length to a file
+     * @param retry  on a Content-Length mismatch, refresh the length and download once more
+     */
+    pplx::task<web::json::value> DownloadFileAsync(
+        const utility::string_t& uuid,
+        const utility::string_t& outFileName,
+        int64_t dataLength,
+        bool retry,
+        std::function<void(const char*)> errorFunc,
+        std::function<void(const wchar_t*)> wErrorFunc);
+
+    /**
+     * \brief Downloads a blob of the given length into a pooled buffer
+     * @param retry  on a Content-Length mismatch, refresh the length and download once more
+     */
+    pplx::task<web::json::value> DownloadBufferAsync(
+        const utility::string_t& uuid,
+        std::shared_ptr<PooledBuffer> buffer,
+        int64_t dataLength,
+        bool retry,
+        std::function<void(const char*)> errorFunc,
+        std::function<void(const wchar_t*)> wErrorFunc);
+
+    /**
+     * \brief Async upload a file or generated payload to content service
+     * @param source
      * @param errorFunc
      * @param wErrorFunc
      * @param token
      * @return success: the uuid string of the uploaded blob; fail: an empty string
      */
     pplx::task<web::json::value> UploadAsync(
-        const utility::string_t& filename,
+        const UploadSource& source,
         std::function<void(const char*)> errorFunc,
         std::function<void(const wchar_t*)> wErrorFunc,
         const pplx::cancellation_token& token = pplx::cancellation_token::none());
@@ -110,10 +365,9 @@ class ContentService {
         const pplx::cancellation_token& token = pplx::cancellation_token::none());
 
     /**
-     * \brief Async download a file from content service
-     * @param connection
+     * \brief Async download from content service to a pooled buffer
      * @param uuid
-     * @param outFileName
+     * @param buffer    receives a buffer of the blob's size checked out of the connection's pool
      * @param errorFunc
      * @param wErrorFunc
      * @param token
@@ -121,15 +375,47 @@ class ContentService {
      */
     pplx::task<web::json::value> DownloadAsync(
         const utility::string_t& uuid,
-        uint8_t* data,
+        std::shared_ptr<PooledBuffer> buffer,
         std::function<void(const char*)> errorFunc,
         std::function<void(const wchar_t*)> wErrorFunc,
         const pplx::cancellation_token& token = pplx::cancellation_token::none());
 
+    /**
+     * \brief Async download of a blob as concurrent HTTP range requests
+     *
+     * Each range is written straight to its offset in data, which must hold at
+     * least dataLength bytes.
+     * @param uuid
+     * @param data          preallocated output of dataLength bytes
+     * @param dataLength    content-length of the blob
+     * @param options       number of streams and chunk size
+     * @param errorFunc
+     * @param wErrorFunc
+     * @return timing of every chunk and of the whole download
+     */
+    pplx::task<RangedDownloadStats> DownloadRangesAsync(
+        const utility::string_t& uuid,
+        uint8_t* data,
+        int64_t dataLength,
+        const RangedDownloadOptions& options,
+        std::function<void(const char*)> errorFunc,
+        std::function<void(const wchar_t*)> wErrorFunc);
+
 public:
     ContentService() = delete;
     ContentService(const utility::string_t& serverURI, int port);
 
+    /**
+     * \brief Creates a service sharing the connection pool of an existing connection
+     */
+    explicit ContentService(const ContentServiceConnection& connection);
+
+    /**
+     * \brief Starts pre-creating blobs of the sizes for the uploads of every copy of the connection
+     * @return false if prefetching is off or already started
+     */
+    bool StartUuidPrefetch(const std::vector<uint64_t>& sizes, const UuidPrefetchOptions& options);
+
     /**
      * \brief Upload a file to content service
      * @param fileName
@@ -142,6 +428,42 @@ public:
         std::function<void(const char*)> errorFunc,
         std::function<void(const wchar_t*)> wErrorFunc);
 
+    /**
+     * \brief Upload a file or generated payload to content service
+     *
+     * Generated payloads are streamed from memory without touching the disk.
+     * @param source
+     * @param errorFunc
+     * @param wErrorFunc
+     * @return uuid, empty on failure
+     */
+    pplx::task<utility::string_t> Upload(
+        const UploadSource& source,
+        std::function<void(const char*)> errorFunc,
+        std::function<void(const wchar_t*)> wErrorFunc);
+
+    /**
+     * \brief Upload a file as a sequence of Content-Range chunks
+     *
+     * Chunks are sent one at a time at the committed offset, as resumable
+     * upload services only accept the next chunk, while the following
+     * chunksInFlight - 1 chunks of a file are read ahead. With outOfOrder_, up
+     * to chunksInFlight chunks are sent concurrently instead, which only a
+     * service buffering out-of-order ranges such as the mock accepts. When a
+     * chunk fails, the upload waits for the others, asks the service for the
+     * committed offset and resumes from there.
+     * @param source        file or generated payload
+     * @param options       chunk size, chunks in flight or read ahead, ordering and resume attempts
+     * @param errorFunc
+     * @param wErrorFunc
+     * @return uuid_ : uuid on success, empty on failure
+     */
+    pplx::task<ChunkedUploadStats> UploadChunked(
+        const UploadSource& source,
+        const ChunkedUploadOptions& options,
+        std::function<void(const char*)> errorFunc,
+        std::function<void(const wchar_t*)> wErrorFunc);
+
     /**
      * \brief Download data from content service to a file
      * @param uuid
@@ -150,23 +472,61 @@ public:
      * @param wErrorFunc
      * @return file size : success, -1 : fail
     */
-    int64_t Download(
+    pplx::task<int64_t> Download(
         const utility::string_t& uuid,
         const utility::string_t& outFileName,
         std::function<void(const char*)> errorFunc,
         std::function<void(const wchar_t*)> wErrorFunc);
 
     /**
-     * \brief Download from content service to a data buffer
+     * \brief Download from content service to memory
+     *
+     * The buffer is checked out of the connection's buffer pool and goes back to
+     * it when released, so repeated downloads reuse the same memory.
      * @param uuid
-     * @param data  Downloaded data
+     * @param buffer    receives the downloaded data, Size() is the blob size
      * @param errorFunc
      * @param wErrorFunc
      * @return file size : success, -1 : fail
      */
-    int64_t Download(
+    pplx::task<int64_t> Download(
         const utility::string_t& uuid,
-        uint8_t* data,
+        std::shared_ptr<PooledBuffer> buffer,
+        std::function<void(const char*)> errorFunc,
+        std::function<void(const wchar_t*)> wErrorFunc);
+
+    /**
+     * \brief Download a blob to a file using concurrent range requests
+     *
+     * The output file is preallocated to the blob's content-length and memory
+     * mapped, each range lands directly at its offset.
+     * @param uuid
+     * @param outFileName   Name of the file storing downloaded data
+     * @param options       number of streams and chunk size
+     * @param errorFunc
+     * @param wErrorFunc
+     * @return contentLength_ : file size on success, -1 on failure
+     */
+    pplx::task<RangedDownloadStats> DownloadRanged(
+        const utility::string_t& uuid,
+        const utility::string_t& outFileName,
+        const RangedDownloadOptions& options,
+        std::function<void(const char*)> errorFunc,
+        std::function<void(const wchar_t*)> wErrorFunc);
+
+    /**
+     * \brief Download a blob to memory using concurrent range requests
+     * @param uuid
+     * @param buffer        receives a buffer checked out of the connection's buffer pool, Size() is the blob size
+     * @param options       number of streams and chunk size
+     * @param errorFunc
+     * @param wErrorFunc
+     * @return contentLength_ : data size on success, -1 on failure
+     */
+    pplx::task<RangedDownloadStats> DownloadRanged(
+        const utility::string_t& uuid,
+        std::shared_ptr<PooledBuffer> buffer,
+        const RangedDownloadOptions& options,
         std::function<void(const char*)> errorFunc,
         std::function<void(const wchar_t*)> wErrorFunc);
 }; // ContentService
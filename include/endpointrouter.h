@@ -0,0 +1,162 @@
+#pragma once
+
+#include "httpclientpool.h"
+#include "latencyhistogram.h"
+
+#include "cpprest/http_client.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace TestClient {
+
+/**
+ * \brief How requests are spread over the endpoints of a cluster
+ */
+enum RoutingPolicy {
+    ROUTING_ROUND_ROBIN = 0,        // endpoints take turns
+    ROUTING_LEAST_OUTSTANDING,      // the endpoint with the fewest requests awaiting a response
+    ROUTING_CONSISTENT_HASH,        // requests for a blob go to the endpoint that created it, else to the owner of its uuid on a hash ring
+    NUM_ROUTING_POLICIES
+};
+
+/**
+ * \brief Parses "round-robin", "least-outstanding" or "consistent-hash"
+ * @return NUM_ROUTING_POLICIES if the name is unknown
+ */
+RoutingPolicy RoutingPolicyFromName(const std::string& name);
+
+/**
+ * \brief One content service node, its clients and its request statistics
+ *
+ * Like PhaseStats, each thread records latencies into a histogram of its own,
+ * Latency() merges them. The first MAX_SLOTS endpoints of the process get a
+ * slot in every thread's table of those histograms, later ones share one
+ * histogram under a lock.
+ */
+class Endpoint {
+    typedef std::chrono::steady_clock Clock;
+
+    HttpClientPool                                  pool_;
+    std::atomic<uint64_t>                           outstanding_;
+    std::atomic<uint64_t>                           requests_;
+    std::atomic<uint64_t>                           failures_;
+    size_t                                          slot_;          // index into each thread's histograms, process-wide
+    mutable std::mutex                              mutex_;
+    std::vector<std::unique_ptr<LatencyHistogram>>  threadLatency_; // request sent to response headers, one per thread, guarded by mutex_
+    LatencyHistogram                                latency_;       // the same without a slot, guarded by mutex_
+
+    void RecordLatency(uint64_t latencyNS);
+
+public:
+    static const size_t MAX_SLOTS = 64;
+
+public:
+    Endpoint() = delete;
+    Endpoint(const Endpoint&) = delete;
+    Endpoint& operator=(const Endpoint&) = delete;
+
+    Endpoint(const utility::string_t& uri, size_t poolSize);
+
+    std::shared_ptr<web::http::client::http_client> Client() { return pool_.Acquire(); }
+
+    const HttpClientPool& Pool() const { return pool_; }
+    const utility::string_t& URI() const { return pool_.URI(); }
+
+    /**
+     * \brief Sends a request, counting it outstanding until its response headers arrive
+     *
+     * A request failing or answered with an error status counts as a failure.
+     */
+    pplx::task<web::http::http_response> Send(const web::http::http_request& request);
+
+    uint64_t Outstanding() const { return outstanding_.load(std::memory_order_relaxed); }
+    uint64_t Requests() const { return requests_.load(std::memory_order_relaxed); }
+    uint64_t Failures() const { return failures_.load(std::memory_order_relaxed); }
+
+    /**
+     * \brief Latency histograms of all threads merged, named after the endpoint
+     */
+    LatencyHistogram Latency() const;
+}; // Endpoint
+
+/**
+ * \brief Picks the endpoint of each request of a multi-node content service
+ *
+ * With consistent hashing every request naming a blob, i.e. its upload and all
+ * its downloads, goes to the same node. Requests creating a blob have no uuid
+ * yet and go round-robin, the router then remembers which node answered and
+ * sends the later requests for the blob there. Blobs created by another
+ * process, e.g. listed in a manifest, go to the owner of their uuid on a ring
+ * hashed with FNV-1a, which is the same in every process given the same
+ * endpoint list; across processes the nodes must share a blob store.
+ */
+class EndpointRouter : public std::enable_shared_from_this<EndpointRouter> {
+    static const size_t VIRTUAL_NODES = 64;     // ring points per endpoint, evens out the shares
+    static const size_t CREATOR_SHARDS = 64;    // locks over the creator map, picked by uuid hash
+
+    /**
+     * \brief Endpoint index of the blobs created on a node other than their ring owner
+     */
+    struct CreatorShard {
+        std::mutex                                      mutex_;
+        std::unordered_map<utility::string_t, size_t>   creators_;
+    };
+
+    RoutingPolicy                               policy_;
+    std::vector<std::unique_ptr<Endpoint>>      endpoints_;
+    std::vector<std::pair<uint64_t, size_t>>    ring_;      // sorted (hash, endpoint index)
+    std::atomic<size_t>                         next_;
+    CreatorShard                                creators_[CREATOR_SHARDS];
+
+    size_t NextRoundRobin();
+    size_t RingOwner(uint64_t hash) const;
+    size_t SelectIndex(const utility::string_t& uuid);
+
+public:
+    EndpointRouter() = delete;
+    EndpointRouter(const EndpointRouter&) = delete;
+    EndpointRouter& operator=(const EndpointRouter&) = delete;
+
+    /**
+     * @param uris      base URI of each node, i.e., server:port
+     * @param poolSize  http clients per node
+     */
+    EndpointRouter(const std::vector<utility::string_t>& uris, size_t poolSize, RoutingPolicy policy);
+
+    /**
+     * \brief Endpoint for a request about a blob
+     * @param uuid  the blob, empty when creating one
+     */
+    Endpoint& Select(const utility::string_t& uuid);
+
+    /**
+     * \brief Sends a request to the endpoint selected for uuid
+     */
+    pplx::task<web::http::http_response> Send(const utility::string_t& uuid, const web::http::http_request& request);
+
+    /**
+     * \brief Sends a request creating a blob
+     * @return the response and the index of the endpoint that answered it, for AssignCreator()
+     */
+    pplx::task<std::pair<web::http::http_response, size_t>> SendCreate(const web::http::http_request& request);
+
+    /**
+     * \brief Routes the later requests for a blob to the endpoint that created it
+     *
+     * Only consistent hashing keeps the assignment, the other policies spread every request.
+     */
+    void AssignCreator(const utility::string_t& uuid, size_t endpoint);
+
+    RoutingPolicy Policy() const { return policy_; }
+    size_t Size() const { return endpoints_.size(); }
+    const Endpoint& At(size_t index) const { return *endpoints_[index]; }
+}; // EndpointRouter
+
+} // namespace TestClient
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "cpprest/http_client.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace TestClient {
+
+static const size_t DEFAULT_CONNECTION_POOL_SIZE = 8;
+
+/**
+ * \brief A fixed-size pool of long-lived http_client instances for one endpoint
+ *
+ * Every http_client keeps its own keep-alive connections, so handing the same
+ * clients out to all requests lets consecutive calls run over warm connections
+ * instead of opening a new one each time. All clients are created with the
+ * pool, a client opens its connections on first use, and requests take them
+ * round-robin without a lock.
+ */
+class HttpClientPool {
+    utility::string_t                                               uri_;
+    std::vector<std::shared_ptr<web::http::client::http_client>>    clients_;  // never changed after construction
+    std::atomic<size_t>                                             next_;
+    std::atomic<uint64_t>                                           acquires_;
+
+public:
+    HttpClientPool() = delete;
+    HttpClientPool(const HttpClientPool&) = delete;
+    HttpClientPool& operator=(const HttpClientPool&) = delete;
+
+    /**
+     * \brief Creates the pool and all its clients
+     * @param uri   base URI of the endpoint, i.e., server:port
+     * @param size  number of http_client instances
+     */
+    HttpClientPool(const utility::string_t& uri, size_t size);
+
+    /**
+     * \brief Returns the next client for the endpoint
+     */
+    std::shared_ptr<web::http::client::http_client> Acquire();
+
+    const utility::string_t& URI() const { return uri_; }
+    size_t Size() const { return clients_.size(); }
+
+    /**
+     * \brief Number of requests handed a client
+     */
+    uint64_t Acquires() const { return acquires_.load(std::memory_order_relaxed); }
+}; // HttpClientPool
+
+} // namespace TestClient
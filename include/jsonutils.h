@@ -1,9 +1,26 @@
 #pragma once
 
 #include "cpprest/json.h"
+#include "cpprest/http_msg.h"
 
 namespace TestClient {
 
 web::json::value JsonCreateBlob(uint64_t size);
 
+/**
+ * \brief Text of a JSON string, e.g. a blob uuid
+ * @return empty if value is not a string
+ */
+utility::string_t JsonUnquote(const web::json::value& value);
+
+/**
+ * \brief Blob resource as the content service returns it, with its id
+ */
+web::json::value JsonBlob(const utility::string_t& id, uint64_t size);
+
+/**
+ * \brief Error document as the content service returns it
+ */
+web::json::value JsonError(web::http::status_code status, const utility::string_t& title);
+
 } // namespace TestClient
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace TestClient {
+
+/**
+ * \brief Fixed-memory, log-linear latency histogram in the spirit of HdrHistogram
+ *
+ * Values below SUB_BUCKETS are counted exactly, larger values fall into one of
+ * SUB_BUCKETS / 2 linear buckets per power of two, i.e. about 1.5% resolution over
+ * the whole 64-bit range. Record() assumes a single writing thread and uses relaxed
+ * atomics only so other threads can read a snapshot while it records. Histograms
+ * with the same layout are merged by adding counts.
+ */
+class LatencyHistogram {
+public:
+    static const int        SUB_BUCKET_BITS = 7;
+    static const size_t     SUB_BUCKETS = size_t(1) << SUB_BUCKET_BITS;
+    static const size_t     HALF_SUB_BUCKETS = SUB_BUCKETS / 2;
+    static const size_t     NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 2) * HALF_SUB_BUCKETS;
+    static const size_t     RAW_SIZE = NUM_BUCKETS + 4;     // buckets, total count, sum, min, max
+
+private:
+    std::string             name_;
+    std::atomic<uint64_t>   counts_[NUM_BUCKETS];
+    std::atomic<uint64_t>   totalCount_;
+    std::atomic<uint64_t>   sum_;
+    std::atomic<uint64_t>   min_;
+    std::atomic<uint64_t>   max_;
+
+public:
+    explicit LatencyHistogram(const std::string& name = std::string());
+    LatencyHistogram(const LatencyHistogram& other);
+    LatencyHistogram& operator=(const LatencyHistogram& other);
+
+    /**
+     * \brief Bucket index of a value
+     */
+    static size_t IndexOf(uint64_t value);
+
+    /**
+     * \brief Smallest value counted in a bucket
+     */
+    static uint64_t LowestValueAt(size_t index);
+
+    /**
+     * \brief Largest value counted in a bucket
+     */
+    static uint64_t HighestValueAt(size_t index);
+
+    /**
+     * \brief Counts one value, only one thread may record into a histogram
+     */
+    void Record(uint64_t value);
+
+    /**
+     * \brief Adds the counts of another histogram, other may still be recording
+     */
+    void Merge(const LatencyHistogram& other);
+
+    /**
+     * \brief Copies the counts to RAW_SIZE words, e.g. in memory shared with another process
+     */
+    void CopyTo(std::atomic<uint64_t>* raw) const;
+
+    /**
+     * \brief Adds counts written by CopyTo()
+     */
+    void Merge(const std::atomic<uint64_t>* raw);
+
+    void Reset();
+
+    const std::string& Name() const { return name_; }
+    void SetName(const std::string& name) { name_ = name; }
+
+    uint64_t TotalCount() const { return totalCount_.load(std::memory_order_relaxed); }
+    uint64_t Min() const;
+    uint64_t Max() const { return max_.load(std::memory_order_relaxed); }
+    double Mean() const;
+
+    /**
+     * \brief Value at a percentile, e.g. 99.9
+     * @return the highest value of the bucket holding the percentile, 0 if empty
+     */
+    uint64_t ValueAtPercentile(double percentile) const;
+
+    /**
+     * \brief Writes the raw, non-empty buckets in a text format Load() reads back
+     */
+    void Save(std::ostream& os) const;
+
+    /**
+     * \brief Reads one histogram written by Save()
+     * @return false at end of input or on malformed input
+     */
+    bool Load(std::istream& is);
+}; // LatencyHistogram
+
+/**
+ * \brief Writes histograms to a file with LatencyHistogram::Save()
+ * @return false if the file cannot be written
+ */
+bool SaveHistograms(const std::string& filePath, const std::vector<LatencyHistogram>& histograms);
+
+/**
+ * \brief Reads histograms from a file, merging them into those with the same name
+ * @param histograms    histograms with new names are appended
+ * @return false if the file cannot be read or is malformed
+ */
+bool LoadHistograms(const std::string& filePath, std::vector<LatencyHistogram>& histograms);
+
+/**
+ * \brief Prints a percentile table header matching PrintPercentiles()
+ */
+void PrintPercentileHeader(std::wostream& os);
+
+/**
+ * \brief Prints one row of count, min, p50, p90, p99, p99.9, max and mean in microseconds
+ * @param histogram     values in nanoseconds
+ */
+void PrintPercentiles(std::wostream& os, const LatencyHistogram& histogram);
+
+} // namespace TestClient
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "cpprest/asyncrt_utils.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace boost { namespace iostreams { class mapped_file_source; } }
+
+namespace TestClient {
+
+static const char MANIFEST_MAGIC[8] = { 'T', 'C', 'M', 'A', 'N', 'I', 'F', 'T' };
+static const uint32_t MANIFEST_VERSION = 1;
+
+/**
+ * \brief Start of a manifest file, followed by fixed-size records
+ */
+struct ManifestHeader {
+    char        magic_[8];
+    uint32_t    version_;
+    uint32_t    recordSize_;
+    uint64_t    count_;     // records written when the manifest was last closed
+}; // ManifestHeader
+
+/**
+ * \brief One uploaded blob, read in place from the mapped manifest
+ */
+struct ManifestRecord {
+    static const uint32_t FLAG_CHECKSUM = 1;
+
+    char        uuid_[40];  // ASCII, zero padded
+    uint64_t    size_;
+    uint32_t    checksum_;  // CRC32C, valid if FLAG_CHECKSUM is set
+    uint32_t    flags_;
+
+    utility::string_t UUID() const {
+        auto length = std::find(uuid_, uuid_ + sizeof(uuid_), '\0') - uuid_;
+        return utility::conversions::to_string_t(std::string(uuid_, length));
+    }
+
+    bool HasChecksum() const { return (flags_ & FLAG_CHECKSUM) != 0; }
+}; // ManifestRecord
+
+static_assert(sizeof(ManifestHeader) == 24, "manifest header layout");
+static_assert(sizeof(ManifestRecord) == 56, "manifest record layout");
+
+/**
+ * \brief Appends uploaded blobs to a manifest file
+ *
+ * Records have a fixed size, so a reader maps the file and indexes it
+ * directly without parsing. Thread-safe.
+ */
+class ManifestWriter {
+    std::mutex      mutex_;
+    std::fstream    file_;
+    uint64_t        count_;
+
+public:
+    ManifestWriter();
+    ManifestWriter(const ManifestWriter&) = delete;
+    ManifestWriter& operator=(const ManifestWriter&) = delete;
+    ~ManifestWriter();
+
+    /**
+     * \brief Creates the manifest, or appends to it if it already exists
+     * @return false if the file cannot be written or is not a manifest
+     */
+    bool Open(const std::string& fileName);
+
+    /**
+     * \brief Appends one blob
+     * @return false if the manifest is closed or the uuid does not fit a record
+     */
+    bool Append(const utility::string_t& uuid, uint64_t size, uint32_t checksum, bool hasChecksum);
+
+    /**
+     * \brief Writes the record count into the header and closes the file
+     */
+    void Close();
+
+    uint64_t Count();
+}; // ManifestWriter
+
+/**
+ * \brief Read-only, memory-mapped view of a manifest
+ *
+ * Opening costs the same for any number of records, pages are read as
+ * records are touched.
+ */
+class ManifestReader {
+    std::unique_ptr<boost::iostreams::mapped_file_source>   file_;
+    const ManifestRecord*                                   records_;
+    uint64_t                                                count_;
+
+public:
+    ManifestReader();
+    ManifestReader(const ManifestReader&) = delete;
+    ManifestReader& operator=(const ManifestReader&) = delete;
+    ~ManifestReader();
+
+    /**
+     * \brief Maps a manifest
+     * @return false if the file cannot be read or is not a manifest
+     */
+    bool Open(const std::string& fileName);
+
+    /**
+     * \brief Number of complete records, a record cut short by a crash is ignored
+     */
+    uint64_t Count() const { return count_; }
+
+    const ManifestRecord& Record(uint64_t index) const { return records_[index]; }
+}; // ManifestReader
+
+} // namespace TestClient
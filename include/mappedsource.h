@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace TestClient {
+
+/**
+ * \brief How upload bodies were read, totals since the start of the run
+ */
+struct SourceReadStats {
+    uint64_t    uploads_;
+    uint64_t    mappedUploads_;     // sent straight out of a shared MappedSourceFile
+    uint64_t    bytesCopied_;       // read from disk into a file stream buffer before sending
+
+    SourceReadStats()
+        : uploads_(0), mappedUploads_(0), bytesCopied_(0)
+    { }
+}; // SourceReadStats
+
+/**
+ * \brief A source file mapped read-only once and shared by every upload of it
+ *
+ * Uploads of a mapped file send straight out of the mapping through a raw
+ * pointer stream. However many uploads of the file are in flight, its bytes
+ * are read from disk once and kept once in the page cache, and no upload
+ * copies them into a buffer of its own.
+ */
+class MappedSourceFile {
+    struct Mapping;
+
+    std::unique_ptr<Mapping>    mapping_;
+    const uint8_t*              data_;
+    uint64_t                    size_;
+
+public:
+    MappedSourceFile() = delete;
+    MappedSourceFile(const MappedSourceFile&) = delete;
+    MappedSourceFile& operator=(const MappedSourceFile&) = delete;
+
+    /**
+     * \brief Maps the whole file read-only
+     * @throw std::exception if the file cannot be opened or mapped
+     */
+    explicit MappedSourceFile(const std::string& fileName);
+    ~MappedSourceFile();
+
+    const uint8_t* Data() const { return data_; }
+    uint64_t Size() const { return size_; }
+
+    /**
+     * \brief Bytes of the mapping currently in physical memory
+     * @return false where the OS cannot be asked
+     */
+    bool ResidentBytes(uint64_t& bytes) const;
+
+    /**
+     * \brief Asks the OS to start reading [offset, offset + length) in, returns at once
+     */
+    void Prefetch(uint64_t offset, uint64_t length) const;
+}; // MappedSourceFile
+
+/**
+ * \brief Counts one upload body
+ * @param mapped        sent from a shared MappedSourceFile
+ * @param bytesCopied   bytes read into a stream buffer of its own
+ */
+void RecordSourceRead(bool mapped, uint64_t bytesCopied);
+
+/**
+ * \brief Totals of every RecordSourceRead() so far
+ */
+SourceReadStats SourceReads();
+
+} // namespace TestClient
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "cpprest/asyncrt_utils.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace TestClient {
+
+static const size_t DEFAULT_METADATA_CACHE_SIZE = 65536;
+
+/**
+ * \brief Bounded uuid -> content length cache, filled by uploads
+ *
+ * A download that finds its blob here skips GET /blob/{uuid} and checks the
+ * Content-Length of the download response instead. Blobs never change after
+ * upload, so an entry only leaves the cache when it is evicted or found wrong.
+ * Checksums stay in ChecksumRegistry, which is never evicted, so a full cache
+ * costs a round trip but never skips a verification.
+ *
+ * Keys are spread over independently locked shards, each evicting its oldest
+ * entry once full.
+ */
+class BlobMetadataCache {
+    static const size_t NUM_SHARDS = 16;
+
+    typedef std::list<utility::string_t> Order;
+
+    struct Entry {
+        uint64_t            size_;
+        Order::iterator     position_;  // the key in order_, removed with the entry
+    }; // Entry
+
+    struct Shard {
+        std::mutex                                          mutex_;
+        std::unordered_map<utility::string_t, Entry>        sizes_;
+        Order                                               order_;     // insertion order of the keys in sizes_
+        uint64_t                                            hits_;
+        uint64_t                                            misses_;
+        uint64_t                                            evictions_;
+        char                                                padding_[64];
+
+        Shard() : hits_(0), misses_(0), evictions_(0) { }
+    }; // Shard
+
+    std::unique_ptr<Shard[]>    shards_;
+    size_t                      shardCapacity_;
+
+    Shard& ShardOf(const utility::string_t& uuid) const;
+
+public:
+    /**
+     * @param capacity  entries kept at most, 0 disables the cache
+     */
+    explicit BlobMetadataCache(size_t capacity = DEFAULT_METADATA_CACHE_SIZE);
+    BlobMetadataCache(const BlobMetadataCache&) = delete;
+    BlobMetadataCache& operator=(const BlobMetadataCache&) = delete;
+
+    void Put(const utility::string_t& uuid, uint64_t size);
+
+    /**
+     * \brief Looks up the content length of a blob, counting a hit or a miss
+     */
+    bool Get(const utility::string_t& uuid, uint64_t& size);
+
+    /**
+     * \brief Drops an entry the server disagreed with
+     */
+    void Erase(const utility::string_t& uuid);
+
+    bool Enabled() const { return shardCapacity_ > 0; }
+    size_t Capacity() const { return shardCapacity_ * NUM_SHARDS; }
+
+    uint64_t Hits() const;
+    uint64_t Misses() const;
+    uint64_t Evictions() const;
+    size_t Size() const;
+}; // BlobMetadataCache
+
+} // namespace TestClient
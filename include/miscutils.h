@@ -1,7 +1,16 @@
 #pragma once
 
+#include "cpprest/asyncrt_utils.h"
+
 #include <string>
 
+// thread_local is missing before VS2015, __declspec(thread) covers the POD cases we need
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define TESTCLIENT_THREAD_LOCAL __declspec(thread)
+#else
+#define TESTCLIENT_THREAD_LOCAL thread_local
+#endif
+
 namespace TestClient {
 
 /**
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "cpprest/asyncrt_utils.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace TestClient {
+
+/**
+ * \brief How reads pick among the blobs uploaded so far
+ */
+enum Popularity {
+    POPULARITY_UNIFORM = 0,     // every blob equally likely
+    POPULARITY_ZIPF,            // blob of rank k with probability ~ 1 / k^exponent, oldest blobs hottest
+    NUM_POPULARITIES
+};
+
+/**
+ * \brief Parses "uniform" or "zipf"
+ * @return NUM_POPULARITIES if the name is unknown
+ */
+Popularity PopularityFromName(const std::string& name);
+
+/**
+ * \brief Draws ranks in [0, n) from a Zipfian distribution whose n may grow
+ *
+ * The method of Gray et al., "Quickly Generating Billion-Record Synthetic
+ * Databases": each draw is O(1), and growing n only adds the new terms to the
+ * normalizing zeta sum.
+ */
+class ZipfianGenerator {
+    double      theta_;
+    double      alpha_;
+    double      zeta2_;
+    double      zetaN_;
+    double      eta_;
+    uint64_t    n_;
+
+public:
+    /**
+     * @param exponent  skew, 0 < exponent, 1 is replaced by a value just below it
+     */
+    explicit ZipfianGenerator(double exponent = 0.99);
+
+    /**
+     * \brief Extends the range to [0, n), n never shrinks
+     */
+    void Grow(uint64_t n);
+
+    uint64_t Count() const { return n_; }
+
+    /**
+     * \brief Rank for a uniform draw u in [0, 1), 0 is the most popular
+     */
+    uint64_t Next(double u) const;
+}; // ZipfianGenerator
+
+/**
+ * \brief Settings of a mixed read/write run
+ */
+struct MixedWorkloadOptions {
+    size_t              workers_;           // closed-loop workers, each runs one operation at a time
+    uint64_t            operations_;        // operations per worker
+    uint64_t            preload_;           // blobs uploaded before the mix starts, readable by every worker
+    double              readRatio_;         // fraction of operations that are reads
+    Popularity          popularity_;
+    double              zipfExponent_;
+    uint64_t            seed_;              // worker w draws from seed_ + w
+    std::vector<double> writeWeights_;      // relative frequency of each upload source, empty = equal
+
+    MixedWorkloadOptions()
+        : workers_(1), operations_(1000), preload_(100), readRatio_(0.9),
+        popularity_(POPULARITY_ZIPF), zipfExponent_(0.99), seed_(0)
+    { }
+}; // MixedWorkloadOptions
+
+/**
+ * \brief Outcome of a mixed read/write run, summed over the workers
+ */
+struct MixedWorkloadResult {
+    uint64_t    preloaded_;
+    uint64_t    reads_;
+    uint64_t    writes_;
+    uint64_t    readFailures_;
+    uint64_t    writeFailures_;
+    uint64_t    readsAsWrites_;     // reads drawn while a worker had no blob to read
+    double      elapsedS_;          // duration of the mix, without the preload
+
+    MixedWorkloadResult()
+        : preloaded_(0), reads_(0), writes_(0), readFailures_(0), writeFailures_(0),
+        readsAsWrites_(0), elapsedS_(0.0)
+    { }
+}; // MixedWorkloadResult
+
+/**
+ * \brief Uploads the source with the given index
+ * @return the uuid of the new blob, empty on failure
+ */
+typedef std::function<utility::string_t(size_t worker, size_t source)> MixedWriteOperation;
+
+/**
+ * \brief Downloads a blob
+ * @return false on failure
+ */
+typedef std::function<bool(size_t worker, const utility::string_t& uuid)> MixedReadOperation;
+
+/**
+ * \brief Runs interleaved uploads and downloads from options.workers_ threads
+ *
+ * The preloaded blobs are shared read-only. Everything else a worker needs,
+ * its generators, counters and the uuids of its own uploads, lives in state
+ * only that worker touches, so drawing the next operation takes no lock and
+ * no shared cache line. Reads see the preloaded blobs and the worker's own
+ * uploads, in upload order, which is also the popularity order.
+ * Latencies are recorded as PHASE_MIXED_READ and PHASE_MIXED_WRITE.
+ * @param sources   number of upload sources, the write operation's source index is below it
+ */
+MixedWorkloadResult RunMixedWorkload(const MixedWorkloadOptions& options, size_t sources,
+    MixedWriteOperation write, MixedReadOperation read);
+
+} // namespace TestClient
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "testinputstream.h"
+
+#include "cpprest/http_listener.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace TestClient {
+
+/**
+ * \brief Behaviour of the mock content service
+ */
+struct MockContentServiceOptions {
+    bool        storeData_;         // keep uploads in memory, otherwise discard them and serve generated data
+    PayloadType payloadType_;       // generated data served when not storing
+    uint64_t    payloadSeed_;
+    int64_t     createDelayMS_;     // added before answering each route
+    int64_t     metadataDelayMS_;
+    int64_t     uploadDelayMS_;
+    int64_t     downloadDelayMS_;
+    int         gzipLevel_;         // whole downloads asking for gzip get it at this level, -1 = never
+
+    MockContentServiceOptions()
+        : storeData_(true), payloadType_(PAYLOAD_PATTERN), payloadSeed_(0),
+        createDelayMS_(0), metadataDelayMS_(0), uploadDelayMS_(0), downloadDelayMS_(0), gzipLevel_(6)
+    { }
+}; // MockContentServiceOptions
+
+/**
+ * \brief In-process stand-in for the content service
+ *
+ * Serves the routes TestClient uses, i.e., POST /blob, PUT /blob/{id}/upload
+ * (single and Content-Range resumable), GET /blob/{id} and GET /blob/{id}/download
+ * (whole and ranged), with the same JSON documents. Whole uploads and
+ * downloads may be gzip encoded. Running the client
+ * against it on loopback measures what the client can drive on its own.
+ */
+class MockContentService {
+    struct Blob;
+    class DelayQueue;
+
+    MockContentServiceOptions                                       options_;
+    web::http::experimental::listener::http_listener                listener_;
+    std::shared_ptr<const TestDataPattern>                          pattern_;
+    std::unique_ptr<DelayQueue>                                     delays_;
+    std::mutex                                                      mutex_;
+    std::unordered_map<utility::string_t, std::shared_ptr<Blob>>    blobs_;
+    std::atomic<uint64_t>                                           nextId_;
+    std::atomic<uint64_t>                                           creates_;
+    std::atomic<uint64_t>                                           uploads_;
+    std::atomic<uint64_t>                                           metadataGets_;
+    std::atomic<uint64_t>                                           downloads_;
+    std::atomic<uint64_t>                                           bytesReceived_;
+    std::atomic<uint64_t>                                           bytesSent_;
+
+    void HandlePost(web::http::http_request request);
+    void HandlePut(web::http::http_request request);
+    void HandleGet(web::http::http_request request);
+
+    void CreateBlob(web::http::http_request request);
+    void Upload(web::http::http_request request, const utility::string_t& id);
+    void GetMetadata(web::http::http_request request, const utility::string_t& id);
+    void Download(web::http::http_request request, const utility::string_t& id);
+
+    std::shared_ptr<Blob> FindBlob(const utility::string_t& id);
+
+    /**
+     * \brief Replies after delayMS without holding a listener thread
+     * @param keepAlive     kept until the reply is sent, e.g. the blob a body streams from
+     */
+    void Reply(web::http::http_request request, web::http::http_response response, int64_t delayMS,
+        std::shared_ptr<void> keepAlive = std::shared_ptr<void>());
+    void ReplyError(web::http::http_request request, web::http::status_code status, const utility::string_t& title);
+
+public:
+    MockContentService() = delete;
+    MockContentService(const MockContentService&) = delete;
+    MockContentService& operator=(const MockContentService&) = delete;
+
+    /**
+     * \brief Creates a service listening on uri once opened
+     * @param uri   e.g. http://127.0.0.1:8080
+     */
+    MockContentService(const utility::string_t& uri, const MockContentServiceOptions& options);
+    ~MockContentService();
+
+    pplx::task<void> Open();
+    pplx::task<void> Close();
+
+    uint64_t Creates() const { return creates_.load(std::memory_order_relaxed); }
+    uint64_t Uploads() const { return uploads_.load(std::memory_order_relaxed); }
+    uint64_t MetadataGets() const { return metadataGets_.load(std::memory_order_relaxed); }
+    uint64_t Downloads() const { return downloads_.load(std::memory_order_relaxed); }
+    uint64_t BytesReceived() const { return bytesReceived_.load(std::memory_order_relaxed); }
+    uint64_t BytesSent() const { return bytesSent_.load(std::memory_order_relaxed); }
+}; // MockContentService
+
+} // namespace TestClient
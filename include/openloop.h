@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+#include "pplx/pplxtasks.h"
+
+namespace TestClient {
+
+/**
+ * \brief Settings of an open-loop run
+ *
+ * The target rate ramps linearly from startRate_ to endRate_ over the run.
+ */
+struct OpenLoopOptions {
+    double      startRate_;         // operations per second at the start
+    double      endRate_;           // operations per second at the end
+    double      durationS_;         // length of the run in seconds
+    size_t      maxOutstanding_;    // operations in flight before new ones are dropped
+
+    OpenLoopOptions()
+        : startRate_(100.0), endRate_(100.0), durationS_(10.0), maxOutstanding_(10000)
+    { }
+}; // OpenLoopOptions
+
+/**
+ * \brief Outcome of an open-loop run
+ */
+struct OpenLoopResult {
+    uint64_t    scheduled_;         // operations due according to the target rate
+    uint64_t    issued_;
+    uint64_t    succeeded_;
+    uint64_t    failed_;
+    uint64_t    dropped_;           // not issued because maxOutstanding_ was reached
+    double      targetRate_;        // scheduled / duration
+    double      achievedRate_;      // issued / time spent issuing
+    double      completionRate_;    // succeeded / time until the last completion
+    int64_t     maxLagUS_;          // worst delay between intended and actual start
+
+    OpenLoopResult()
+        : scheduled_(0), issued_(0), succeeded_(0), failed_(0), dropped_(0),
+        targetRate_(0.0), achievedRate_(0.0), completionRate_(0.0), maxLagUS_(0)
+    { }
+}; // OpenLoopResult
+
+/**
+ * \brief Issues operations at a target rate regardless of how fast they complete
+ *
+ * Every operation has an intended start time derived from the rate. The latency
+ * recorded as PHASE_OPERATION_INTENDED is measured from that time, not from when
+ * the operation actually started, so a stalled server or a late generator shows
+ * up in the percentiles instead of silently lowering the offered load
+ * (coordinated omission). PHASE_OPERATION holds the plain service time.
+ * Operations dropped at maxOutstanding_ never complete; they are recorded as
+ * PHASE_OPERATION_DROPPED, printed next to the other phases, so the count of
+ * intended starts missing from the percentiles is always in the report.
+ * @param options
+ * @param operation starts one operation, the task yields false on failure
+ * @return counts and rates, waits for every issued operation to finish
+ */
+OpenLoopResult RunOpenLoop(const OpenLoopOptions& options, std::function<pplx::task<bool>(uint64_t)> operation);
+
+/**
+ * \brief Seconds from the start of the run at which operation index is due
+ */
+double IntendedStartTime(const OpenLoopOptions& options, uint64_t index);
+
+} // namespace TestClient
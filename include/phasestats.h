@@ -0,0 +1,79 @@
+#pragma once
+
+#include "latencyhistogram.h"
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace TestClient {
+
+/**
+ * \brief Request phases timed separately
+ */
+enum LatencyPhase {
+    PHASE_CREATE_BLOB = 0,      // POST /blob
+    PHASE_UPLOAD_PUT,           // PUT /blob/{uuid}/upload with the whole body
+    PHASE_UPLOAD_CHUNK,         // one Content-Range chunk of a resumable upload
+    PHASE_METADATA_GET,         // GET /blob/{uuid}
+    PHASE_DOWNLOAD_BODY,        // GET /blob/{uuid}/download, request sent to last byte
+    PHASE_DOWNLOAD_CHUNK,       // one range of a multi-stream download
+    PHASE_OPERATION,            // a whole scheduled operation, from its actual start
+    PHASE_OPERATION_INTENDED,   // a whole scheduled operation, from its intended start
+    PHASE_OPERATION_DROPPED,    // a scheduled operation never issued, intended start to when it was dropped
+    PHASE_MIXED_READ,           // a download of the mixed workload
+    PHASE_MIXED_WRITE,          // an upload of the mixed workload
+    PHASE_PIPELINE_QUEUE,       // a pipelined blob, end of its upload to start of its download
+    PHASE_PIPELINE_BLOB,        // a pipelined blob, start of its upload to end of its download
+    PHASE_DOWNLOAD_TTFB,        // a download, request sent to response headers
+    PHASE_DOWNLOAD_FIRST_BYTE,  // a download, request sent to first body byte
+    PHASE_DOWNLOAD_STREAM,      // a download, first to last body byte
+    PHASE_UPLOAD_SEND,          // an upload, request sent to last body byte taken by the client
+    PHASE_UPLOAD_ACK,           // an upload, last body byte taken to response headers
+    NUM_LATENCY_PHASES
+};
+
+/**
+ * \brief Name of a phase as printed and exported
+ */
+const char* LatencyPhaseName(LatencyPhase phase);
+
+/**
+ * \brief Process-wide per-phase latency histograms
+ *
+ * Each thread records into its own set of histograms, created on its first
+ * Record(), so recording takes no lock and touches no shared cache line.
+ * Snapshot() merges the sets of all threads.
+ */
+class PhaseStats {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+     * \brief Records a latency in nanoseconds
+     */
+    static void Record(LatencyPhase phase, uint64_t latencyNS);
+
+    /**
+     * \brief Records the time elapsed since start
+     */
+    static void Record(LatencyPhase phase, Clock::time_point start);
+
+    /**
+     * \brief Merged histograms of all threads, one per phase
+     */
+    static std::vector<LatencyHistogram> Snapshot();
+
+    /**
+     * \brief Prints the percentile table of every phase with samples
+     */
+    static void Print(std::wostream& os);
+
+    /**
+     * \brief Prints the percentile table of histograms with samples, e.g. merged from several processes
+     */
+    static void Print(std::wostream& os, const std::vector<LatencyHistogram>& histograms);
+}; // PhaseStats
+
+} // namespace TestClient
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "cpprest/asyncrt_utils.h"
+#include "pplx/pplxtasks.h"
+
+#include <cstdint>
+#include <functional>
+
+namespace TestClient {
+
+/**
+ * \brief Settings of a pipelined upload -> download run
+ */
+struct PipelineOptions {
+    uint64_t    blobs_;                 // blobs uploaded, each downloaded once right after
+    size_t      uploadConcurrency_;     // uploads in flight
+    size_t      queueDepth_;            // uploaded blobs waiting for a download slot
+    size_t      downloadConcurrency_;   // downloads in flight
+
+    PipelineOptions()
+        : blobs_(100), uploadConcurrency_(4), queueDepth_(8), downloadConcurrency_(4)
+    { }
+}; // PipelineOptions
+
+/**
+ * \brief Outcome of a pipelined run
+ */
+struct PipelineResult {
+    uint64_t    uploaded_;
+    uint64_t    uploadFailures_;
+    uint64_t    downloaded_;
+    uint64_t    downloadFailures_;
+    double      elapsedS_;
+
+    PipelineResult()
+        : uploaded_(0), uploadFailures_(0), downloaded_(0), downloadFailures_(0), elapsedS_(0.0)
+    { }
+}; // PipelineResult
+
+/**
+ * \brief Starts the upload of blob index
+ * @return the task yields the uuid of the new blob, empty on failure
+ */
+typedef std::function<pplx::task<utility::string_t>(uint64_t index)> PipelineUpload;
+
+/**
+ * \brief Starts the download of a blob
+ * @return the task yields false on failure
+ */
+typedef std::function<pplx::task<bool>(const utility::string_t& uuid)> PipelineDownload;
+
+/**
+ * \brief Chains each blob's download onto its own upload
+ *
+ * There is no barrier between the stages: a blob is downloaded as soon as its
+ * upload is done and a download slot is free, so reads and writes overlap
+ * from the start and one slow upload delays only its own blob. The stages
+ * are bounded by AsyncSemaphores. An upload keeps its slot until its blob fits
+ * in the queue, so a slow download stage throttles the uploads instead of
+ * piling up blobs. Waiting happens in task continuations, not on threads.
+ * PHASE_PIPELINE_QUEUE records how long a blob waited for its download and
+ * PHASE_PIPELINE_BLOB the whole write-then-read latency.
+ * @return counts, waits for every blob to finish
+ */
+PipelineResult RunPipeline(const PipelineOptions& options, PipelineUpload upload, PipelineDownload download);
+
+} // namespace TestClient
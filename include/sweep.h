@@ -0,0 +1,95 @@
+#pragma once
+
+#include "latencyhistogram.h"
+
+#include "pplx/pplxtasks.h"
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace TestClient {
+
+/**
+ * \brief Settings of a blob size x concurrency sweep
+ */
+struct SweepOptions {
+    std::vector<uint64_t>   sizes_;         // blob sizes, one row of cells each
+    std::vector<uint64_t>   concurrency_;   // operations in flight, one cell each, ascending
+    double                  warmupS_;       // run before each cell is measured
+    double                  windowS_;       // shortest measured window of a cell
+    uint64_t                minOps_;        // operations a window must complete, lengthens it for large blobs
+    double                  minGain_;       // relative throughput gain a level must bring to count as scaling
+    double                  maxP99Growth_;  // p99 over the best cell's by this factor counts as inflated
+
+    SweepOptions()
+        : warmupS_(2.0), windowS_(10.0), minOps_(10), minGain_(0.05), maxP99Growth_(1.5)
+    { }
+}; // SweepOptions
+
+/**
+ * \brief Measured window of one size and concurrency
+ */
+struct SweepCell {
+    uint64_t            size_;
+    uint64_t            concurrency_;
+    uint64_t            ops_;           // succeeded within the window
+    uint64_t            failures_;
+    double              windowS_;
+    LatencyHistogram    latency_;       // of the succeeded operations, in nanoseconds
+    bool                knee_;          // last level that raised throughput before p99 inflated
+
+    SweepCell()
+        : size_(0), concurrency_(0), ops_(0), failures_(0), windowS_(0.0), latency_("sweep"), knee_(false)
+    { }
+
+    double OpsPerS() const { return windowS_ > 0.0 ? (double)ops_ / windowS_ : 0.0; }
+    double BytesPerS() const { return OpsPerS() * (double)size_; }
+}; // SweepCell
+
+/**
+ * \brief Cells of a sweep, row by row
+ */
+struct SweepResult {
+    std::vector<SweepCell>  cells_;     // ascending concurrency within each size, rows stop past their knee
+    std::vector<uint64_t>   knees_;     // concurrency at the knee of each size, 0 = not reached
+}; // SweepResult
+
+/**
+ * \brief Starts operation index on a blob of size bytes
+ * @return the task yields false on failure
+ */
+typedef std::function<pplx::task<bool>(uint64_t size, uint64_t index)> SweepOperation;
+
+/**
+ * \brief Runs every blob size at rising concurrency until it saturates
+ *
+ * Each cell is a closed loop keeping concurrency operations in flight: after
+ * warmupS_ it counts the operations completing in a window of at least
+ * windowS_ seconds and minOps_ operations. A level that raises throughput by
+ * less than minGain_ over the best level so far and pushes p99 above
+ * maxP99Growth_ times that level's p99 is past the knee. The best level is
+ * marked as the knee and the rest of that size's levels are skipped.
+ * @return every measured cell, waits for each cell to drain
+ */
+SweepResult RunSweep(const SweepOptions& options, SweepOperation operation);
+
+/**
+ * \brief Whether cell is past the knee of a row whose best level so far is best
+ */
+bool IsPastKnee(const SweepOptions& options, const SweepCell& best, const SweepCell& cell);
+
+/**
+ * \brief Prints one row per cell with throughput and latency percentiles
+ */
+void PrintSweep(std::wostream& os, const SweepResult& result);
+
+/**
+ * \brief Writes the cells as a JSON array for .json files, CSV with a header row otherwise
+ * @return false if the file cannot be written
+ */
+bool SaveSweep(const std::string& fileName, const SweepResult& result);
+
+} // namespace TestClient
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "pplx/pplxtasks.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace TestClient {
+
+/**
+ * \brief Size and placement of the task scheduler threads
+ */
+struct SchedulerOptions {
+    size_t              threads_;       // 0 = one per allowed CPU
+    std::vector<int>    cpus_;          // CPUs the threads are pinned to, one each, round-robin
+    int                 numaNode_;      // the CPUs of this node when cpus_ is empty, -1 = none
+
+    SchedulerOptions()
+        : threads_(0), numaNode_(-1)
+    { }
+
+    /**
+     * \brief Whether any option is set, otherwise the default pplx scheduler is kept
+     */
+    bool Enabled() const { return threads_ > 0 || !cpus_.empty() || numaNode_ >= 0; }
+}; // SchedulerOptions
+
+/**
+ * \brief Counters of a WorkStealingScheduler, totals since it started
+ */
+struct SchedulerStats {
+    uint64_t                scheduled_;     // tasks passed to schedule()
+    uint64_t                injected_;      // of those, from threads outside the pool
+    uint64_t                executed_;
+    uint64_t                stolen_;        // taken from the queue of another thread
+    uint64_t                parks_;         // times a thread found no work and slept
+    uint64_t                queued_;        // waiting to run now
+    uint64_t                maxQueued_;     // most waiting at once
+    std::vector<uint64_t>   executedPerThread_;
+
+    SchedulerStats()
+        : scheduled_(0), injected_(0), executed_(0), stolen_(0), parks_(0), queued_(0), maxQueued_(0)
+    { }
+}; // SchedulerStats
+
+/**
+ * \brief CPUs of a NUMA node as listed by the kernel
+ * @return empty if the node or the listing does not exist
+ */
+std::vector<int> NumaNodeCpus(int node);
+
+/**
+ * \brief Fixed-size, work-stealing pool running pplx task continuations
+ *
+ * Each thread has its own queue. Tasks scheduled from a pool thread go to the
+ * back of its queue and it runs them newest first, so a continuation usually
+ * runs on the thread that scheduled it, with warm caches. Tasks from other
+ * threads, e.g. the http client's I/O threads, go to a shared injection queue.
+ * A thread without work takes from the injection queue, then steals the oldest
+ * task of another thread, then sleeps. Every queue has its own lock, so
+ * contention shows up as steals and parks instead of one hot lock.
+ */
+class WorkStealingScheduler : public pplx::scheduler_interface {
+    struct Task {
+        pplx::TaskProc_t    proc_;
+        void*               param_;
+    }; // Task
+
+    struct WorkerQueue;
+
+    std::vector<std::unique_ptr<WorkerQueue>>   queues_;
+    std::vector<std::thread>                    threads_;
+    mutable std::mutex                          injectionMutex_;
+    std::deque<Task>                            injection_;
+    uint64_t                                    injected_;      // guarded by injectionMutex_
+    std::atomic<uint64_t>                       queued_;        // raised before a task is visible, never below the tasks queued
+    std::atomic<uint64_t>                       maxQueued_;
+    std::atomic<size_t>                         sleeping_;
+    std::mutex                                  idleMutex_;
+    std::condition_variable                     idle_;
+    std::atomic<bool>                           stopping_;      // set under idleMutex_
+
+    void Run(size_t index, int cpu);
+    bool TakeTask(size_t index, Task& task);
+    void CountQueued();
+    void WakeIdle();
+
+public:
+    WorkStealingScheduler() = delete;
+    WorkStealingScheduler(const WorkStealingScheduler&) = delete;
+    WorkStealingScheduler& operator=(const WorkStealingScheduler&) = delete;
+
+    /**
+     * \brief Starts the threads, pinned as the options say where the platform allows
+     */
+    explicit WorkStealingScheduler(const SchedulerOptions& options);
+
+    /**
+     * \brief Stops the threads, tasks still queued are not run
+     */
+    virtual ~WorkStealingScheduler();
+
+    virtual void schedule(pplx::TaskProc_t proc, void* param);
+
+    size_t Threads() const { return threads_.size(); }
+
+    SchedulerStats Stats() const;
+}; // WorkStealingScheduler
+
+} // namespace TestClient
@@ -1,21 +1,73 @@
 #pragma once
 
+#include "cpprest/streams.h"
+
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace TestClient {
 
-//class TestDataInputStream {
-//    uint64_t    size_;
-//    std::string filePath_;
-//
-//public:
-//    TestDataInputStream() = delete;
-//    TestDataInputStream(uint64_t size);
-//    TestDataInputStream(std::string filePath);
-//
-//    void Create();
-//    void Save();
-//
-//}; // TestDataInputStream
+/**
+ * \brief Kind of generated test data
+ */
+enum PayloadType {
+    PAYLOAD_PATTERN = 0,    // repeating byte ramp, compresses well
+    PAYLOAD_RANDOM,         // pseudo-random bytes, incompressible
+    NUM_PAYLOAD_TYPES
+};
+
+/**
+ * \brief Read-only block of generated bytes that synthetic payloads repeat
+ *
+ * The block is generated once from the seed and shared by every stream, so
+ * serving a payload of any size never allocates or touches the disk.
+ */
+class TestDataPattern {
+    std::vector<uint8_t>    block_;
+    PayloadType             type_;
+    uint64_t                seed_;
+
+public:
+    static const size_t BLOCK_SIZE = 4 * 1024 * 1024;
+
+    TestDataPattern() = delete;
+    TestDataPattern(PayloadType type, uint64_t seed);
+
+    const uint8_t* Data() const { return block_.data(); }
+    size_t Size() const { return block_.size(); }
+    PayloadType Type() const { return type_; }
+    uint64_t Seed() const { return seed_; }
+
+    /**
+     * \brief Copies count payload bytes starting at a payload offset
+     */
+    void Copy(uint64_t offset, uint8_t* dest, size_t count) const;
+}; // TestDataPattern
+
+/**
+ * \brief Parses "pattern" or "random"
+ * @return NUM_PAYLOAD_TYPES if the name is unknown
+ */
+PayloadType PayloadTypeFromName(const std::string& name);
+
+/**
+ * \brief Opens generated payloads as cpprest input streams
+ */
+class TestDataInputStream {
+public:
+    /**
+     * \brief Opens a read-only, seekable stream of size generated bytes
+     *
+     * The stream can be passed straight to http_request::set_body().
+     * @param pattern   generated data, kept alive by the stream
+     * @param size      length of the payload
+     * @param offset    payload offset the stream starts at, e.g. for a chunk of a larger blob
+     */
+    static Concurrency::streams::istream Open(
+        std::shared_ptr<const TestDataPattern> pattern,
+        uint64_t size,
+        uint64_t offset = 0);
+}; // TestDataInputStream
 
 } // namespace TestClient
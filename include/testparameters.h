@@ -1,5 +1,13 @@
 #pragma once
 
+#include "testinputstream.h"
+#include "compression.h"
+#include "mixedworkload.h"
+#include "endpointrouter.h"
+#include "taskscheduler.h"
+#include "uuidprefetcher.h"
+#include "sweep.h"
+
 #include "cpprest/json.h"
 #include "cpprest/streams.h"
 #include <string>
@@ -9,6 +17,10 @@ namespace TestClient {
 enum TestScenario {
     SCENARIOS_UPLOAD = 0,
     SCENARIOS_DOWNLOAD,
+    SCENARIOS_OPEN_LOOP,    // uploads issued at a target rate, see OpenLoopOptions
+    SCENARIOS_MIXED,        // interleaved uploads and downloads, see MixedWorkloadOptions
+    SCENARIOS_PIPELINE,     // each download chained onto its upload, see PipelineOptions
+    SCENARIOS_SWEEP,        // blob sizes x concurrency levels up to the knee, see SweepOptions
     NUM_SCENARIOS
 };
 
@@ -19,10 +31,54 @@ class TestParameters {
     utility::string_t               server_;
     utility::string_t               dataPath_;
     int                             port_;
+    std::vector<utility::string_t>  endpoints_;
+    RoutingPolicy                   routing_;
     size_t                          numInstances_;
+    size_t                          connectionPoolSize_;
+    size_t                          downloadStreams_;
+    uint64_t                        downloadChunkSize_;
+    uint64_t                        uploadChunkSize_;
+    size_t                          uploadChunksInFlight_;
+    bool                            uploadChunksOutOfOrder_;
+    size_t                          uploadMaxResumes_;
+    std::string                     histogramFile_;
+    std::string                     manifestFile_;
+    std::string                     timeSeriesFile_;
+    int64_t                         timeSeriesIntervalMS_;
+    std::string                     traceFile_;
+    size_t                          traceBufferEvents_;
+    bool                            hugePages_;
+    bool                            mapSources_;
+    bool                            verifyDownloads_;
+    size_t                          metadataCacheSize_;
     int                             scenarioType_;
-    //std::vector<int>                dataSize_;
+    double                          targetRate_;
+    double                          targetRateEnd_;
+    double                          duration_;
+    size_t                          maxOutstanding_;
+    uint64_t                        downloads_;
+    double                          readRatio_;
+    Popularity                      popularity_;
+    double                          zipfExponent_;
+    uint64_t                        mixSeed_;
+    uint64_t                        operations_;
+    uint64_t                        preload_;
+    uint64_t                        blobs_;
+    size_t                          uploadConcurrency_;
+    size_t                          queueDepth_;
+    size_t                          downloadConcurrency_;
+    PayloadType                     payloadType_;
+    uint64_t                        payloadSeed_;
+    SchedulerOptions                scheduler_;
+    UuidPrefetchOptions             uuidPrefetch_;
+    CompressionOptions              compression_;
+    SweepOptions                    sweep_;
+    std::string                     sweepFile_;
+    std::vector<uint64_t>           dataSize_;
+    std::vector<double>             dataWeight_;
     std::vector<utility::string_t>  dataFiles_;
+    size_t                          workerIndex_;
+    size_t                          workerCount_;
 
 
 public:
@@ -33,6 +89,26 @@ public:
 
 	void Parse();
 
+    /**
+     * \brief Narrows the scenario to the share of worker index of count worker processes
+     *
+     * Instances, rates, in-flight limits, blob counts and scheduler threads are
+     * divided, the first workers taking the remainders; per-instance counts stay
+     * as they are. Each worker gets its own part of the scheduler CPUs, if there
+     * are enough, and mixed runs get a different seed per worker.
+     */
+    void Slice(size_t index, size_t count);
+
+    /**
+     * \brief Worker process this run is a slice for, 0 when not sliced
+     */
+    size_t WorkerIndex() const { return workerIndex_; }
+
+    /**
+     * \brief Worker processes sharing the scenario, 1 when not sliced
+     */
+    size_t WorkerCount() const { return workerCount_; }
+
     const utility::string_t& Server() const;
     utility::string_t& Server();
     
@@ -46,13 +122,230 @@ public:
     utility::string_t& ServerURI();
     
     size_t NumInstances();
+
+    /**
+     * \brief Base URIs of the content service nodes, empty = the single server and port
+     */
+    const std::vector<utility::string_t>& Endpoints() const { return endpoints_; }
+
+    /**
+     * \brief How requests are spread over Endpoints()
+     */
+    RoutingPolicy Routing() const { return routing_; }
+
+    /**
+     * \brief Number of long-lived http clients kept per endpoint
+     */
+    size_t ConnectionPoolSize() const { return connectionPoolSize_; }
+
+    /**
+     * \brief Number of concurrent range requests per download, 1 = single stream
+     */
+    size_t DownloadStreams() const { return downloadStreams_; }
+
+    /**
+     * \brief Size of each range request of a multi-stream download
+     */
+    uint64_t DownloadChunkSize() const { return downloadChunkSize_; }
+
+    /**
+     * \brief Size of each Content-Range chunk of a resumable upload, 0 = single PUT
+     */
+    uint64_t UploadChunkSize() const { return uploadChunkSize_; }
+
+    /**
+     * \brief Upload chunks read ahead of the one being sent, or sent concurrently if out of order
+     */
+    size_t UploadChunksInFlight() const { return uploadChunksInFlight_; }
+
+    /**
+     * \brief Send upload chunks concurrently, only services buffering out-of-order ranges (the mock) accept them
+     */
+    bool UploadChunksOutOfOrder() const { return uploadChunksOutOfOrder_; }
+
+    /**
+     * \brief Number of times a failed chunked upload resumes before giving up
+     */
+    size_t UploadMaxResumes() const { return uploadMaxResumes_; }
+
+    /**
+     * \brief File receiving the raw latency histograms of the run, empty = none
+     */
+    const std::string& HistogramFile() const { return histogramFile_; }
+
+    /**
+     * \brief Manifest that uploads are appended to and download-only runs read, empty = none
+     */
+    const std::string& ManifestFile() const { return manifestFile_; }
+
+    /**
+     * \brief File receiving per-interval throughput, .json for JSON, CSV otherwise, empty = none
+     */
+    const std::string& TimeSeriesFile() const { return timeSeriesFile_; }
+
+    /**
+     * \brief Length of one time series interval in milliseconds
+     */
+    int64_t TimeSeriesIntervalMS() const { return timeSeriesIntervalMS_; }
+
+    /**
+     * \brief File receiving the request spans as Chrome trace-event JSON, empty = tracing off
+     */
+    const std::string& TraceFile() const { return traceFile_; }
+
+    /**
+     * \brief Spans kept per thread, the oldest are overwritten beyond that
+     */
+    size_t TraceBufferEvents() const { return traceBufferEvents_; }
+
+    /**
+     * \brief Whether in-memory download buffers are backed by huge pages
+     */
+    bool HugePages() const { return hugePages_; }
+
+    /**
+     * \brief Whether every input file is mapped once and all its uploads send from the mapping
+     */
+    bool MapSources() const { return mapSources_; }
+
+    /**
+     * \brief Whether downloads are checked against the checksums of their uploads
+     */
+    bool VerifyDownloads() const { return verifyDownloads_; }
+
+    /**
+     * \brief Blob content lengths kept to skip the metadata request of downloads, 0 = always ask
+     */
+    size_t MetadataCacheSize() const { return metadataCacheSize_; }
+
     int Scenario();
 
+    /**
+     * \brief Operations per second an open-loop run starts at
+     */
+    double TargetRate() const { return targetRate_; }
+
+    /**
+     * \brief Operations per second an open-loop run ramps to, equals TargetRate() without a ramp
+     */
+    double TargetRateEnd() const { return targetRateEnd_; }
+
+    /**
+     * \brief Length of a timed run in seconds
+     */
+    double Duration() const { return duration_; }
+
+    /**
+     * \brief Operations an open-loop run keeps in flight before dropping new ones
+     */
+    size_t MaxOutstanding() const { return maxOutstanding_; }
+
+    /**
+     * \brief Downloads of a download-only run, cycling through the manifest, 0 = one per blob
+     */
+    uint64_t Downloads() const { return downloads_; }
+
+    /**
+     * \brief Fraction of the operations of a mixed run that are downloads
+     */
+    double ReadRatio() const { return readRatio_; }
+
+    /**
+     * \brief How downloads of a mixed run pick among the uploaded blobs
+     */
+    Popularity BlobPopularity() const { return popularity_; }
+
+    /**
+     * \brief Skew of Zipfian blob popularity
+     */
+    double ZipfExponent() const { return zipfExponent_; }
+
+    /**
+     * \brief Seed of the operation and blob choices of a mixed run
+     */
+    uint64_t MixSeed() const { return mixSeed_; }
+
+    /**
+     * \brief Operations per instance of a mixed run
+     */
+    uint64_t Operations() const { return operations_; }
+
+    /**
+     * \brief Blobs a mixed run uploads before it starts mixing
+     */
+    uint64_t Preload() const { return preload_; }
+
+    /**
+     * \brief Blobs of a pipelined run, 0 = numInstances per scenario entry
+     */
+    uint64_t Blobs() const { return blobs_; }
+
+    /**
+     * \brief Uploads in flight of a pipelined run, 0 = numInstances
+     */
+    size_t UploadConcurrency() const { return uploadConcurrency_; }
+
+    /**
+     * \brief Uploaded blobs of a pipelined run waiting for a download, 0 = twice numInstances
+     */
+    size_t QueueDepth() const { return queueDepth_; }
+
+    /**
+     * \brief Downloads in flight of a pipelined run, 0 = numInstances
+     */
+    size_t DownloadConcurrency() const { return downloadConcurrency_; }
+
+    /**
+     * \brief Relative upload frequency of each scenario entry, default 1
+     */
+    const std::vector<double>& DataWeights() const { return dataWeight_; }
+
+    /**
+     * \brief Kind of data generated for entries given by size
+     */
+    PayloadType Payload() const { return payloadType_; }
+
+    /**
+     * \brief Seed of the generated data, the same seed gives the same bytes
+     */
+    uint64_t PayloadSeed() const { return payloadSeed_; }
+
+    /**
+     * \brief Threads and CPUs of the task scheduler, the default pplx scheduler unless set
+     */
+    const SchedulerOptions& Scheduler() const { return scheduler_; }
+
+    /**
+     * \brief Blob uuids kept ready per upload size and their creations in flight, off unless set
+     */
+    const UuidPrefetchOptions& UuidPrefetch() const { return uuidPrefetch_; }
+
+    /**
+     * \brief Gzip levels of the whole-blob uploads and whether downloads accept gzip, raw transfers unless set
+     */
+    const CompressionOptions& Compression() const { return compression_; }
+
+    /**
+     * \brief Sizes, levels, windows and knee thresholds of a sweep run
+     */
+    const SweepOptions& Sweep() const { return sweep_; }
+
+    /**
+     * \brief File receiving the cells of a sweep, .json for JSON, CSV otherwise, empty = none
+     */
+    const std::string& SweepFile() const { return sweepFile_; }
+
+    /**
+     * \brief Data file of each scenario entry, empty for entries given by size
+     */
     const std::vector<utility::string_t>& FileNames() const { return dataFiles_; }
     std::vector<utility::string_t>& FileNames() { return dataFiles_; }
 
-    /*const std::vector<int>& DataSizes() const;
-    std::vector<int>& DataSizes();*/
+    /**
+     * \brief Generated blob size of each scenario entry, 0 for entries given by file
+     */
+    const std::vector<uint64_t>& DataSizes() const;
+    std::vector<uint64_t>& DataSizes();
 }; // TestParameters
 
 }
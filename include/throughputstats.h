@@ -0,0 +1,110 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace TestClient {
+
+/**
+ * \brief Operations counted separately
+ */
+enum ThroughputOperation {
+    OPERATION_UPLOAD = 0,       // a whole blob, single PUT or chunked
+    OPERATION_DOWNLOAD,         // a whole blob, single stream or ranged
+    NUM_THROUGHPUT_OPERATIONS
+};
+
+/**
+ * \brief Name of an operation as written to the time series
+ */
+const char* ThroughputOperationName(ThroughputOperation operation);
+
+/**
+ * \brief Totals of one operation since the start of the process
+ */
+struct ThroughputTotals {
+    uint64_t    ops_;
+    uint64_t    bytes_;
+    uint64_t    errors_;
+
+    ThroughputTotals()
+        : ops_(0), bytes_(0), errors_(0)
+    { }
+}; // ThroughputTotals
+
+/**
+ * \brief Process-wide operation, byte and error counters
+ *
+ * Like PhaseStats each thread counts into its own cache-line padded block,
+ * created on its first Record(). Only the owning thread writes a block, so a
+ * count is a plain load and store, with no locked instruction and no shared
+ * cache line on the request path. Snapshot() sums the blocks of all threads.
+ */
+class ThroughputStats {
+public:
+    static void Record(ThroughputOperation operation, uint64_t bytes);
+    static void RecordError(ThroughputOperation operation);
+
+    /**
+     * \brief Totals of every operation, indexed by ThroughputOperation
+     */
+    static void Snapshot(ThroughputTotals (&totals)[NUM_THROUGHPUT_OPERATIONS]);
+}; // ThroughputStats
+
+/**
+ * \brief Fills totals indexed by ThroughputOperation, e.g. ThroughputStats::Snapshot
+ */
+typedef std::function<void(ThroughputTotals (&totals)[NUM_THROUGHPUT_OPERATIONS])> ThroughputSource;
+
+/**
+ * \brief Writes a time series of ThroughputStats from a background thread
+ *
+ * Every interval one row is appended with the counts of that interval and
+ * their rates, so the file plots directly. Files ending in .json get a JSON
+ * array of objects, anything else gets CSV with a header row.
+ */
+class ThroughputReporter {
+    typedef std::chrono::steady_clock Clock;
+
+    std::ofstream               file_;
+    ThroughputSource            source_;
+    bool                        json_;
+    bool                        firstRow_;
+    std::chrono::milliseconds   interval_;
+    Clock::time_point           start_;
+    Clock::time_point           last_;
+    ThroughputTotals            previous_[NUM_THROUGHPUT_OPERATIONS];
+    std::mutex                  mutex_;
+    std::condition_variable     stop_;
+    bool                        stopping_;
+    std::thread                 thread_;
+
+    void Run();
+    void WriteRow(Clock::time_point now);
+
+public:
+    ThroughputReporter();
+    ThroughputReporter(const ThroughputReporter&) = delete;
+    ThroughputReporter& operator=(const ThroughputReporter&) = delete;
+    ~ThroughputReporter();
+
+    /**
+     * \brief Creates the file and starts reporting
+     * @param source    totals to report, empty = ThroughputStats of this process
+     * @return false if the file cannot be written
+     */
+    bool Start(const std::string& fileName, int64_t intervalMS, ThroughputSource source = ThroughputSource());
+
+    /**
+     * \brief Writes the last, possibly shorter, interval and closes the file
+     */
+    void Stop();
+}; // ThroughputReporter
+
+} // namespace TestClient
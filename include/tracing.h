@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace TestClient {
+
+/**
+ * \brief Steps of a request traced as spans
+ */
+enum TraceSpanKind {
+    TRACE_CREATE_BLOB = 0,      // POST /blob
+    TRACE_UPLOAD_PUT,           // PUT /blob/{uuid}/upload, sending the body until the response headers
+    TRACE_UPLOAD_CHUNK,         // one Content-Range chunk of a resumable upload
+    TRACE_METADATA_GET,         // GET /blob/{uuid}
+    TRACE_RESPONSE_HEADERS,     // any request on an endpoint, sent until its response headers
+    TRACE_DOWNLOAD_BODY,        // GET /blob/{uuid}/download, request sent to last byte
+    TRACE_DOWNLOAD_CHUNK,       // one range of a multi-stream download
+    TRACE_FILE_OPEN,            // a source or destination file opened
+    TRACE_FILE_CLOSE,           // a destination file flushed and closed
+    TRACE_VERIFY,               // a download checksummed and compared
+    NUM_TRACE_SPANS
+};
+
+/**
+ * \brief Name of a span as exported
+ */
+const char* TraceSpanName(TraceSpanKind kind);
+
+/**
+ * \brief Identifies one asynchronous step from its issue to its completion, 0 = not traced
+ */
+typedef uint64_t TraceId;
+
+/**
+ * \brief Process-wide span recorder, exported as Chrome trace-event JSON
+ *
+ * Each thread records into a fixed-size ring of its own, created on its first
+ * span, so recording takes no lock and never allocates; once a ring is full
+ * the oldest spans are overwritten. Tracing is off until Enable(true) and can
+ * be switched at any time. Off, a span costs one relaxed load and a branch,
+ * so the calls stay compiled into every build. Export() is meant for the end
+ * of a run, spans recorded meanwhile may be torn.
+ *
+ * A step issued on one thread and completed on another, e.g. a request, takes
+ * a TraceId when it is issued and is exported as an async begin/end pair on a
+ * track of its own. Concurrent requests completing on one I/O thread overlap
+ * without nesting, as complete events of that thread they would be dropped.
+ * Only TraceSpan, which opens and closes on one thread, is exported as a
+ * complete event of its thread.
+ */
+class Tracer {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static const size_t DEFAULT_RING_EVENTS = 16384;
+
+private:
+    static std::atomic<bool> enabled_;
+    static std::atomic<TraceId> nextId_;
+
+    static void Append(TraceSpanKind kind, TraceId id, Clock::time_point start, Clock::time_point end, uint64_t bytes);
+
+public:
+    static void Enable(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+    static bool Enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    /**
+     * \brief Spans kept per thread, applies to rings created afterwards
+     */
+    static void SetRingEvents(size_t events);
+
+    /**
+     * \brief New id of an asynchronous step, taken when it is issued, 0 while tracing is off
+     */
+    static TraceId NewId() {
+        return Enabled() ? nextId_.fetch_add(1, std::memory_order_relaxed) : 0;
+    }
+
+    /**
+     * \brief Records an asynchronous step from start until now, on any thread
+     * @param id    from NewId() when the step was issued, 0 records nothing
+     * @param bytes payload of the step, 0 if none
+     */
+    static void Record(TraceSpanKind kind, TraceId id, Clock::time_point start, uint64_t bytes = 0) {
+        if (id != 0 && Enabled()) {
+            Append(kind, id, start, Clock::now(), bytes);
+        }
+    }
+
+    /**
+     * \brief Records a span opened and closed on the calling thread
+     */
+    static void RecordScoped(TraceSpanKind kind, Clock::time_point start, uint64_t bytes = 0) {
+        if (Enabled()) {
+            Append(kind, 0, start, Clock::now(), bytes);
+        }
+    }
+
+    /**
+     * \brief Spans lost because a ring wrapped around
+     */
+    static uint64_t Overwritten();
+
+    /**
+     * \brief Writes the spans of every thread as a Chrome trace-event JSON file, e.g. for Perfetto
+     * @param pid   process id written to the events, tells the files of worker processes apart
+     * @return false if the file cannot be written
+     */
+    static bool Export(const std::string& fileName, int pid = 0);
+}; // Tracer
+
+/**
+ * \brief Records a span over its own scope, for steps that run on one thread
+ */
+class TraceSpan {
+    TraceSpanKind       kind_;
+    uint64_t            bytes_;
+    bool                active_;
+    Tracer::Clock::time_point start_;
+
+public:
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    explicit TraceSpan(TraceSpanKind kind, uint64_t bytes = 0)
+        : kind_(kind), bytes_(bytes), active_(Tracer::Enabled())
+    {
+        if (active_) {
+            start_ = Tracer::Clock::now();
+        }
+    }
+
+    ~TraceSpan() {
+        if (active_) {
+            Tracer::RecordScoped(kind_, start_, bytes_);
+        }
+    }
+}; // TraceSpan
+
+} // namespace TestClient
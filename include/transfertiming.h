@@ -0,0 +1,124 @@
+#pragma once
+
+#include "phasestats.h"
+
+#include "cpprest/streams.h"
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+
+namespace TestClient {
+
+/**
+ * \brief Timestamps of one request body or response body transfer
+ *
+ * firstByte_ and lastByte_ are set by the stream wrappers of TimingStream as
+ * the body passes through them, sent_ and headers_ by the caller around
+ * Send(). Like the wrapped buffers it is used by one request at a time.
+ */
+struct TransferTiming {
+    typedef PhaseStats::Clock Clock;
+
+    Clock::time_point   sent_;          // request handed to the connection
+    Clock::time_point   headers_;       // response headers received
+    Clock::time_point   firstByte_;     // first body byte through the wrapper, valid if bytes_ > 0
+    Clock::time_point   lastByte_;      // latest body byte through the wrapper
+    uint64_t            bytes_;         // body bytes through the wrapper
+
+    TransferTiming()
+        : bytes_(0)
+    { }
+
+    void Count(size_t bytes) {
+        if (bytes == 0) {
+            return;
+        }
+
+        auto now = Clock::now();
+        if (bytes_ == 0) {
+            firstByte_ = now;
+        }
+        lastByte_ = now;
+        bytes_ += bytes;
+    }
+}; // TransferTiming
+
+/**
+ * \brief Wraps cpprest buffers to timestamp the first and last body byte through them
+ */
+class TimingStream {
+public:
+    /**
+     * \brief Returns a write-only buffer that counts every write and forwards it to target
+     *
+     * Pass the result to read_to_end() to time a response body as it streams in.
+     */
+    static Concurrency::streams::streambuf<uint8_t> WrapTarget(
+        Concurrency::streams::streambuf<uint8_t> target,
+        std::shared_ptr<TransferTiming> timing);
+
+    /**
+     * \brief Returns a read-only stream that counts every read from source
+     *
+     * Pass the result to set_body() to time a request body as the client takes it.
+     */
+    static Concurrency::streams::basic_istream<uint8_t> WrapSource(
+        Concurrency::streams::basic_istream<uint8_t> source,
+        std::shared_ptr<TransferTiming> timing);
+}; // TimingStream
+
+/**
+ * \brief Direction of a timed transfer
+ */
+enum TransferDirection {
+    TRANSFER_UPLOAD = 0,
+    TRANSFER_DOWNLOAD,
+    NUM_TRANSFER_DIRECTIONS
+};
+
+/**
+ * \brief Goodput of the transfers of one direction, totals and per-transfer distributions
+ */
+struct TransferStats {
+    uint64_t            transfers_;
+    uint64_t            bytes_;
+    uint64_t            streamingNS_;   // summed first to last body byte
+    uint64_t            totalNS_;       // summed request sent to last byte (downloads) or response headers (uploads)
+    LatencyHistogram    streaming_;     // bytes per second of each transfer while its body flows
+    LatencyHistogram    total_;         // bytes per second of each transfer including the waits for the server
+
+    TransferStats()
+        : transfers_(0), bytes_(0), streamingNS_(0), totalNS_(0)
+    { }
+
+    /**
+     * \brief All body bytes over all streaming time, i.e. weighted by transfer duration
+     */
+    double StreamingBytesPerS() const { return streamingNS_ > 0 ? (double)bytes_ * 1e9 / (double)streamingNS_ : 0.0; }
+
+    /**
+     * \brief All body bytes over all time including the waits for the server, weighted like StreamingBytesPerS()
+     */
+    double TotalBytesPerS() const { return totalNS_ > 0 ? (double)bytes_ * 1e9 / (double)totalNS_ : 0.0; }
+}; // TransferStats
+
+/**
+ * \brief Records the phases of a completed transfer and adds it to the goodput totals and distributions
+ *
+ * Downloads record PHASE_DOWNLOAD_TTFB, PHASE_DOWNLOAD_FIRST_BYTE and
+ * PHASE_DOWNLOAD_STREAM, uploads PHASE_UPLOAD_SEND and PHASE_UPLOAD_ACK.
+ */
+void RecordTransfer(TransferDirection direction, const TransferTiming& timing);
+
+/**
+ * \brief Goodput of the transfers recorded so far, the distributions merged over all threads
+ */
+TransferStats Transfers(TransferDirection direction);
+
+/**
+ * \brief Prints the aggregate goodput and the per-transfer percentiles of each direction with transfers
+ */
+void PrintTransferStats(std::wostream& os);
+
+} // namespace TestClient
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "cpprest/asyncrt_utils.h"
+#include "pplx/pplxtasks.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace TestClient {
+
+/**
+ * \brief Bounded multi-producer, multi-consumer queue of blob uuids that takes no lock
+ *
+ * A ring of cells, each with a sequence number telling producers and
+ * consumers whose turn it is (D. Vyukov's bounded MPMC queue). Push and pop
+ * each claim a position with one compare-and-swap and never wait on each
+ * other, a full or empty queue fails at once.
+ */
+class UuidQueue {
+    struct Cell {
+        std::atomic<uint64_t>   sequence_;
+        utility::string_t       uuid_;
+    }; // Cell
+
+    static const size_t CACHE_LINE = 64;
+
+    std::unique_ptr<Cell[]>     cells_;
+    uint64_t                    mask_;
+    char                        pad0_[CACHE_LINE];
+    std::atomic<uint64_t>       enqueue_;
+    char                        pad1_[CACHE_LINE];
+    std::atomic<uint64_t>       dequeue_;
+    char                        pad2_[CACHE_LINE];
+
+public:
+    UuidQueue() = delete;
+    UuidQueue(const UuidQueue&) = delete;
+    UuidQueue& operator=(const UuidQueue&) = delete;
+
+    /**
+     * \brief Holds at least capacity uuids, rounded up to a power of 2
+     */
+    explicit UuidQueue(size_t capacity);
+
+    /**
+     * \brief Adds a uuid, false if the queue is full
+     */
+    bool TryPush(const utility::string_t& uuid);
+
+    /**
+     * \brief Takes the oldest uuid, false if the queue is empty
+     */
+    bool TryPop(utility::string_t& uuid);
+
+    /**
+     * \brief Number of queued uuids, exact only while no push or pop runs
+     */
+    size_t Size() const;
+
+    size_t Capacity() const { return static_cast<size_t>(mask_ + 1); }
+}; // UuidQueue
+
+/**
+ * \brief Settings of the blob pre-creation
+ */
+struct UuidPrefetchOptions {
+    size_t  depth_;         // uuids kept ready per blob size, 0 = off
+    size_t  inFlight_;      // POST /blob requests outstanding per blob size
+
+    UuidPrefetchOptions()
+        : depth_(0), inFlight_(4)
+    { }
+}; // UuidPrefetchOptions
+
+/**
+ * \brief Counters of the queue of one blob size
+ */
+struct UuidPrefetchStats {
+    uint64_t    size_;
+    size_t      depth_;         // uuids ready now
+    double      meanDepth_;     // uuids ready when an upload looked, on average
+    uint64_t    created_;       // blobs pre-created
+    uint64_t    failures_;      // pre-creations that failed
+    uint64_t    taken_;         // uploads that took a ready uuid
+    uint64_t    misses_;        // uploads that found the queue empty and created their blob inline
+
+    UuidPrefetchStats()
+        : size_(0), depth_(0), meanDepth_(0.0), created_(0), failures_(0), taken_(0), misses_(0)
+    { }
+}; // UuidPrefetchStats
+
+/**
+ * \brief Creates a blob of size bytes
+ * @return the task yields its uuid, empty on failure
+ */
+typedef std::function<pplx::task<utility::string_t>(uint64_t size)> CreateBlobFunc;
+
+/**
+ * \brief Keeps pre-created blob uuids ready so uploads skip the POST /blob round trip
+ *
+ * A blob is created with its content length, so every upload size has a
+ * queue of its own. Each queue is refilled by up to inFlight_ pipelined
+ * creations whenever an upload takes a uuid, until depth_ are ready or being
+ * created. Uploads of sizes without a queue, or finding theirs empty, create
+ * their blob inline and count as misses. Blobs still queued at the end of a
+ * run stay empty on the service.
+ */
+class UuidPrefetcher : public std::enable_shared_from_this<UuidPrefetcher> {
+    struct SizeQueue;
+
+    std::vector<std::unique_ptr<SizeQueue>> queues_;    // set once by Start(), read-only afterwards
+    UuidPrefetchOptions                     options_;
+    CreateBlobFunc                          create_;
+    std::atomic<bool>                       started_;
+    std::atomic<bool>                       stopping_;
+
+    SizeQueue* Find(uint64_t size) const;
+    void Refill(SizeQueue& queue);
+
+public:
+    UuidPrefetcher();
+    UuidPrefetcher(const UuidPrefetcher&) = delete;
+    UuidPrefetcher& operator=(const UuidPrefetcher&) = delete;
+    ~UuidPrefetcher();
+
+    /**
+     * \brief Starts filling a queue for each distinct size, once per prefetcher
+     * @param create    creates one blob, must not hold a reference to this prefetcher
+     * @return false if already started or options.depth_ is 0
+     */
+    bool Start(const std::vector<uint64_t>& sizes, const UuidPrefetchOptions& options, CreateBlobFunc create);
+
+    /**
+     * \brief Stops refilling, creations still outstanding complete into their queues
+     */
+    void Stop();
+
+    bool Enabled() const { return started_.load(std::memory_order_acquire); }
+
+    /**
+     * \brief Takes a ready uuid of a blob of size bytes and tops the queue up
+     * @return false if none is ready, the caller then creates the blob itself
+     */
+    bool TryTake(uint64_t size, utility::string_t& uuid);
+
+    /**
+     * \brief Counters of every queue, in ascending size
+     */
+    std::vector<UuidPrefetchStats> Stats() const;
+}; // UuidPrefetcher
+
+} // namespace TestClient
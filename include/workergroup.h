@@ -0,0 +1,125 @@
+#pragma once
+
+#include "latencyhistogram.h"
+#include "throughputstats.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace TestClient {
+
+/**
+ * \brief Life cycle of a worker process, as published in its slot
+ */
+enum WorkerState {
+    WORKER_STARTING = 0,    // forked, setting up its connection and data
+    WORKER_READY,           // waiting at the start barrier
+    WORKER_RUNNING,
+    WORKER_DONE,            // published its final counts
+    NUM_WORKER_STATES
+};
+
+/**
+ * \brief Manifest part a worker appends its uploads to, merged by the coordinator at the end
+ */
+std::string WorkerManifestFile(const std::string& manifestFile, size_t index);
+
+/**
+ * \brief A coordinator process and the worker processes it forks
+ *
+ * A single process saturates on its own locks, allocator and scheduler long
+ * before the network does; forked workers share nothing but one MAP_SHARED
+ * region. It holds the start flag of the barrier and one page-aligned slot per
+ * worker with its ThroughputStats totals and PhaseStats histograms. Only the
+ * owning worker writes a slot, from a background thread, and the coordinator
+ * only reads, so no lock crosses processes. Start() must run before the first
+ * task, so every worker begins with a fresh pplx scheduler. Only POSIX systems
+ * fork, elsewhere Start() fails.
+ */
+class WorkerGroup {
+    size_t                      workers_;
+    size_t                      index_;         // of this worker, workers_ in the coordinator
+    char*                       region_;
+    size_t                      regionSize_;
+    size_t                      slotSize_;
+    int                         parent_;        // pid of the coordinator
+    std::vector<int>            pids_;          // of the workers, in the coordinator
+    std::vector<bool>           exited_;
+    size_t                      failed_;
+
+    // publishing thread of a worker
+    std::mutex                  mutex_;
+    std::condition_variable     stop_;
+    bool                        stopping_;
+    std::thread                 thread_;
+
+    void* Slot(size_t index) const;
+    void Publish(bool histograms);
+    void Run();
+
+public:
+    WorkerGroup() = delete;
+    WorkerGroup(const WorkerGroup&) = delete;
+    WorkerGroup& operator=(const WorkerGroup&) = delete;
+
+    explicit WorkerGroup(size_t workers);
+    ~WorkerGroup();
+
+    /**
+     * \brief Maps the shared region and forks the workers
+     *
+     * Returns in the coordinator and in every worker, IsWorker() tells them apart.
+     * @return false if the region cannot be mapped or a fork fails, no worker is left running
+     */
+    bool Start();
+
+    bool IsWorker() const { return index_ < workers_; }
+    size_t Index() const { return index_; }
+    size_t Size() const { return workers_; }
+
+    /**
+     * \brief In a worker, reports it is set up and blocks until the coordinator starts the run
+     *
+     * Then publishes the counts of this process until Finish().
+     * @return false if the coordinator exited
+     */
+    bool ArriveAndWait();
+
+    /**
+     * \brief In a worker, publishes the final counts and histograms
+     */
+    void Finish();
+
+    /**
+     * \brief In the coordinator, waits until every worker is ready or has exited and starts them together
+     * @return the number of workers started
+     */
+    size_t ReleaseWhenReady();
+
+    /**
+     * \brief In the coordinator, reaps exited workers
+     * @return the number of workers still running
+     */
+    size_t Running();
+
+    /**
+     * \brief Workers that exited with an error or a signal, final once Running() is 0
+     */
+    size_t Failed() const { return failed_; }
+
+    /**
+     * \brief Totals of all workers as last published, indexed by ThroughputOperation
+     */
+    void Snapshot(ThroughputTotals (&totals)[NUM_THROUGHPUT_OPERATIONS]) const;
+
+    /**
+     * \brief Histograms of all workers merged per phase, as last published
+     */
+    std::vector<LatencyHistogram> Histograms() const;
+}; // WorkerGroup
+
+} // namespace TestClient
@@ -0,0 +1,123 @@
+#include "asyncsemaphore.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace TestClient {
+
+AsyncSemaphore::AsyncSemaphore(size_t permits)
+    : available_(permits)
+{ }
+
+pplx::task<void> AsyncSemaphore::Acquire() {
+    pplx::task_completion_event<void> granted;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (available_ > 0) {
+            --available_;
+            return pplx::task_from_result();
+        }
+        waiters_.push_back(granted);
+    }
+
+    return pplx::create_task(granted);
+}
+
+bool AsyncSemaphore::TryAcquire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (available_ == 0) {
+        return false;
+    }
+
+    --available_;
+    return true;
+}
+
+void AsyncSemaphore::Release() {
+    pplx::task_completion_event<void> granted;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (waiters_.empty()) {
+            ++available_;
+            return;
+        }
+
+        // the permit passes straight to the waiter, available_ is unchanged
+        granted = waiters_.front();
+        waiters_.pop_front();
+    }
+
+    // continuations may run inline, never under the lock
+    granted.set();
+}
+
+size_t AsyncSemaphore::Available() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return available_;
+}
+
+/**
+ * \brief Admission state of one RunBounded() call
+ */
+struct BoundedRun {
+    AsyncSemaphore                      permits_;
+    BoundedOperation                    operation_;
+    uint64_t                            count_;
+    std::atomic<uint64_t>               finished_;
+    pplx::task_completion_event<void>   done_;
+
+    BoundedRun(uint64_t count, size_t inFlight, BoundedOperation operation)
+        : permits_(std::max<size_t>(inFlight, 1)), operation_(operation), count_(count), finished_(0)
+    { }
+}; // BoundedRun
+
+static void StartBounded(std::shared_ptr<BoundedRun> run, uint64_t index) {
+    if (index >= run->count_) {
+        return;
+    }
+
+    run->permits_.Acquire().then(
+        [run, index]()
+        {
+            // admit the next operation first, it waits for its own permit
+            StartBounded(run, index + 1);
+
+            pplx::task<void> operationTask;
+            try {
+                operationTask = run->operation_(index);
+            }
+            catch (...) {
+                operationTask = pplx::task_from_result();
+            }
+
+            operationTask.then(
+                [run](pplx::task<void> previousTask)
+                {
+                    try {
+                        previousTask.get();
+                    }
+                    catch (...) { }
+
+                    run->permits_.Release();
+                    if (run->finished_.fetch_add(1) + 1 == run->count_) {
+                        run->done_.set();
+                    }
+                }
+            );
+        }
+    );
+}
+
+pplx::task<void> RunBounded(uint64_t count, size_t inFlight, BoundedOperation operation) {
+    if (count == 0) {
+        return pplx::task_from_result();
+    }
+
+    auto run = std::make_shared<BoundedRun>(count, inFlight, operation);
+    StartBounded(run, 0);
+
+    return pplx::create_task(run->done_);
+}
+
+} // namespace TestClient
@@ -0,0 +1,200 @@
+#include "bufferpool.h"
+
+#include <new>
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif // _WIN32
+
+namespace TestClient {
+
+PooledBuffer::PooledBuffer()
+    : data_(nullptr),
+    size_(0),
+    sizeClass_(0)
+{ }
+
+PooledBuffer::PooledBuffer(std::shared_ptr<BufferPool> pool, uint8_t* data, size_t size, size_t sizeClass)
+    : pool_(pool),
+    data_(data),
+    size_(size),
+    sizeClass_(sizeClass)
+{ }
+
+PooledBuffer::PooledBuffer(PooledBuffer&& other)
+    : pool_(std::move(other.pool_)),
+    data_(other.data_),
+    size_(other.size_),
+    sizeClass_(other.sizeClass_)
+{
+    other.data_ = nullptr;
+    other.size_ = 0;
+}
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other) {
+    if (this != &other) {
+        Release();
+
+        pool_ = std::move(other.pool_);
+        data_ = other.data_;
+        size_ = other.size_;
+        sizeClass_ = other.sizeClass_;
+
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+PooledBuffer::~PooledBuffer() {
+    Release();
+}
+
+void PooledBuffer::Release() {
+    if (data_ != nullptr) {
+        pool_->Return(data_, sizeClass_);
+    }
+
+    pool_.reset();
+    data_ = nullptr;
+    size_ = 0;
+}
+
+size_t PooledBuffer::Capacity() const {
+    return data_ != nullptr ? BufferPool::ClassSize(sizeClass_) : 0;
+}
+
+BufferPool::BufferPool(bool hugePages /*= false*/)
+    : hugePages_(hugePages),
+    hits_(0),
+    misses_(0),
+    residentBytes_(0),
+    peakResidentBytes_(0)
+{ }
+
+BufferPool::~BufferPool() {
+    Trim();
+}
+
+size_t BufferPool::ClassSize(size_t sizeClass) {
+    auto doublings = sizeClass / CLASSES_PER_DOUBLING;
+    auto steps = sizeClass % CLASSES_PER_DOUBLING;
+    auto base = static_cast<uint64_t>(MIN_BUFFER_SIZE) << doublings;
+
+    return static_cast<size_t>(base + base / CLASSES_PER_DOUBLING * steps);
+}
+
+size_t BufferPool::ClassOf(size_t size) {
+    // a few dozen iterations at most, negligible next to filling the buffer
+    for (size_t sizeClass = 0; sizeClass < NUM_SIZE_CLASSES; ++sizeClass) {
+        if (ClassSize(sizeClass) >= size) {
+            return sizeClass;
+        }
+    }
+    return NUM_SIZE_CLASSES;
+}
+
+PooledBuffer BufferPool::Acquire(size_t size) {
+    if (size == 0) {
+        return PooledBuffer();
+    }
+
+    auto sizeClass = ClassOf(size);
+    if (sizeClass >= NUM_SIZE_CLASSES) {
+        throw std::bad_alloc();
+    }
+
+    uint8_t* data = nullptr;
+    {
+        auto& cls = classes_[sizeClass];
+        std::lock_guard<std::mutex> lock(cls.mutex_);
+        if (!cls.free_.empty()) {
+            data = cls.free_.back();
+            cls.free_.pop_back();
+        }
+    }
+
+    if (data != nullptr) {
+        hits_.fetch_add(1, std::memory_order_relaxed);
+    }
+    else {
+        data = Allocate(ClassSize(sizeClass));
+        misses_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    return PooledBuffer(shared_from_this(), data, size, sizeClass);
+}
+
+void BufferPool::Return(uint8_t* data, size_t sizeClass) {
+    auto& cls = classes_[sizeClass];
+    std::lock_guard<std::mutex> lock(cls.mutex_);
+    cls.free_.push_back(data);
+}
+
+void BufferPool::Trim() {
+    for (size_t sizeClass = 0; sizeClass < NUM_SIZE_CLASSES; ++sizeClass) {
+        std::vector<uint8_t*> buffers;
+        {
+            auto& cls = classes_[sizeClass];
+            std::lock_guard<std::mutex> lock(cls.mutex_);
+            buffers.swap(cls.free_);
+        }
+
+        auto bytes = ClassSize(sizeClass);
+        for (size_t i = 0; i < buffers.size(); ++i) {
+            Free(buffers[i], bytes);
+        }
+        residentBytes_.fetch_sub(static_cast<uint64_t>(bytes) * buffers.size(), std::memory_order_relaxed);
+    }
+}
+
+uint8_t* BufferPool::Allocate(size_t bytes) {
+    void* data = nullptr;
+
+#ifdef _WIN32
+    // large pages need SeLockMemoryPrivilege, fall back to normal pages without it
+    if (hugePages_) {
+        auto largePage = GetLargePageMinimum();
+        if (largePage > 0 && bytes % largePage == 0) {
+            data = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        }
+    }
+    if (data == nullptr) {
+        data = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    }
+#else
+    data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+        data = nullptr;
+    }
+#ifdef MADV_HUGEPAGE
+    else if (hugePages_) {
+        madvise(data, bytes, MADV_HUGEPAGE); // a hint, transparent huge pages may be off
+    }
+#endif // MADV_HUGEPAGE
+#endif // _WIN32
+
+    if (data == nullptr) {
+        throw std::bad_alloc();
+    }
+
+    auto resident = residentBytes_.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    auto peak = peakResidentBytes_.load(std::memory_order_relaxed);
+    while (peak < resident && !peakResidentBytes_.compare_exchange_weak(peak, resident, std::memory_order_relaxed)) { }
+
+    return static_cast<uint8_t*>(data);
+}
+
+void BufferPool::Free(uint8_t* data, size_t bytes) {
+#ifdef _WIN32
+    (void)bytes;
+    VirtualFree(data, 0, MEM_RELEASE);
+#else
+    munmap(data, bytes);
+#endif // _WIN32
+}
+
+} // namespace TestClient
@@ -0,0 +1,331 @@
+#include "checksum.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "boost/iostreams/device/mapped_file.hpp"
+
+// SSE4.2 is detected at run time, so the build does not need -msse4.2
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <nmmintrin.h>
+#define TESTCLIENT_CRC32C_SSE42 1
+#define TESTCLIENT_TARGET_SSE42
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#include <nmmintrin.h>
+#define TESTCLIENT_CRC32C_SSE42 1
+#define TESTCLIENT_TARGET_SSE42 __attribute__((target("sse4.2")))
+#else
+#define TESTCLIENT_CRC32C_SSE42 0
+#endif
+
+using namespace Concurrency::streams;
+
+namespace TestClient {
+
+static const uint32_t CRC32C_POLYNOMIAL = 0x82F63B78; // reflected 0x1EDC6F41
+
+/**
+ * \brief Slicing-by-8 tables of the software fallback
+ */
+struct Crc32cTables {
+    uint32_t table_[8][256];
+
+    Crc32cTables() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLYNOMIAL : 0);
+            }
+            table_[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int slice = 1; slice < 8; ++slice) {
+                auto previous = table_[slice - 1][i];
+                table_[slice][i] = (previous >> 8) ^ table_[0][previous & 0xFF];
+            }
+        }
+    }
+}; // Crc32cTables
+
+// built during static initialization, function-local statics are not thread-safe on VS2013
+static const Crc32cTables CRC32C_TABLES;
+
+static uint32_t Crc32cSoftware(uint32_t crc, const uint8_t* data, size_t length) {
+    const auto& t = CRC32C_TABLES.table_;
+    while (length >= 8) {
+        uint32_t low, high;
+        std::memcpy(&low, data, sizeof(low));
+        std::memcpy(&high, data + 4, sizeof(high));
+        low ^= crc;
+        crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24]
+            ^ t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+        data += 8;
+        length -= 8;
+    }
+    while (length > 0) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+        --length;
+    }
+    return crc;
+}
+
+#if TESTCLIENT_CRC32C_SSE42
+static bool DetectSse42() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2) != 0;
+#endif
+}
+
+static const bool HAS_SSE42 = DetectSse42();
+
+TESTCLIENT_TARGET_SSE42
+static uint32_t Crc32cSse42(uint32_t crc, const uint8_t* data, size_t length) {
+    // align to 8 bytes so the word loop never splits a cache line
+    while (length > 0 && (reinterpret_cast<uintptr_t>(data) & 7) != 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+        --length;
+    }
+
+#if defined(_M_X64) || defined(__x86_64__)
+    uint64_t crc64 = crc;
+    while (length >= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        length -= 8;
+    }
+    crc = static_cast<uint32_t>(crc64);
+#else
+    while (length >= 4) {
+        uint32_t word;
+        std::memcpy(&word, data, sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+        data += 4;
+        length -= 4;
+    }
+#endif
+
+    while (length > 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+        --length;
+    }
+    return crc;
+}
+#endif // TESTCLIENT_CRC32C_SSE42
+
+uint32_t Crc32c(const uint8_t* data, size_t length, uint32_t crc /*= 0*/) {
+    crc = ~crc;
+#if TESTCLIENT_CRC32C_SSE42
+    if (HAS_SSE42) {
+        return ~Crc32cSse42(crc, data, length);
+    }
+#endif
+    return ~Crc32cSoftware(crc, data, length);
+}
+
+uint32_t Crc32cPortable(const uint8_t* data, size_t length, uint32_t crc /*= 0*/) {
+    return ~Crc32cSoftware(~crc, data, length);
+}
+
+bool Crc32cHardware() {
+#if TESTCLIENT_CRC32C_SSE42
+    return HAS_SSE42;
+#else
+    return false;
+#endif
+}
+
+static uint32_t Gf2MatrixTimes(const uint32_t* matrix, uint32_t vector) {
+    uint32_t sum = 0;
+    while (vector != 0) {
+        if (vector & 1) {
+            sum ^= *matrix;
+        }
+        vector >>= 1;
+        ++matrix;
+    }
+    return sum;
+}
+
+static void Gf2MatrixSquare(uint32_t* square, const uint32_t* matrix) {
+    for (int n = 0; n < 32; ++n) {
+        square[n] = Gf2MatrixTimes(matrix, matrix[n]);
+    }
+}
+
+uint32_t Crc32cCombine(uint32_t crc1, uint32_t crc2, uint64_t length2) {
+    // zlib's crc32_combine(): apply length2 zero bytes to crc1 by repeated squaring
+    if (length2 == 0) {
+        return crc1;
+    }
+
+    uint32_t even[32];  // operator for an even power of two zero bits
+    uint32_t odd[32];   // operator for an odd power of two zero bits
+
+    odd[0] = CRC32C_POLYNOMIAL;
+    uint32_t row = 1;
+    for (int n = 1; n < 32; ++n) {
+        odd[n] = row;
+        row <<= 1;
+    }
+    Gf2MatrixSquare(even, odd);     // two zero bits
+    Gf2MatrixSquare(odd, even);     // four zero bits
+
+    do {
+        Gf2MatrixSquare(even, odd);
+        if (length2 & 1) {
+            crc1 = Gf2MatrixTimes(even, crc1);
+        }
+        length2 >>= 1;
+        if (length2 == 0) {
+            break;
+        }
+
+        Gf2MatrixSquare(odd, even);
+        if (length2 & 1) {
+            crc1 = Gf2MatrixTimes(odd, crc1);
+        }
+        length2 >>= 1;
+    } while (length2 != 0);
+
+    return crc1 ^ crc2;
+}
+
+bool Crc32cFile(const std::string& fileName, uint32_t& crc) {
+    namespace io = boost::iostreams;
+
+    try {
+        io::mapped_file_source file(fileName);
+        crc = Crc32c(reinterpret_cast<const uint8_t*>(file.data()), file.size());
+        return true;
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+}
+
+/**
+ * \brief Write-only stream buffer checksumming everything it forwards
+ *
+ * Writes go straight through to the target buffer, so the data is read once
+ * while still hot in cache and never copied. Like the other cpprest buffers
+ * it is written by one request at a time.
+ */
+class ChecksumStreamBuffer : public details::streambuf_state_manager<uint8_t> {
+    typedef details::streambuf_state_manager<uint8_t> base;
+
+    streambuf<uint8_t>          target_;
+    std::shared_ptr<uint32_t>   crc_;
+
+public:
+    typedef base::traits traits;
+    typedef base::int_type int_type;
+    typedef base::pos_type pos_type;
+    typedef base::off_type off_type;
+
+    ChecksumStreamBuffer(streambuf<uint8_t> target, std::shared_ptr<uint32_t> crc)
+        : base(std::ios_base::out),
+        target_(target),
+        crc_(crc)
+    { }
+
+    virtual ~ChecksumStreamBuffer() {
+        this->_close_write();
+    }
+
+    virtual bool can_seek() const { return false; }
+    virtual bool has_size() const { return false; }
+    virtual utility::size64_t size() const { return 0; }
+
+    virtual size_t buffer_size(std::ios_base::openmode = std::ios_base::out) const { return 0; }
+    virtual void set_buffer_size(size_t, std::ios_base::openmode = std::ios_base::out) { }
+
+    virtual size_t in_avail() const { return 0; }
+
+    virtual bool acquire(uint8_t*& ptr, size_t& count) {
+        ptr = nullptr;
+        count = 0;
+        return false;
+    }
+
+    virtual void release(uint8_t*, size_t) { }
+
+    virtual pos_type getpos(std::ios_base::openmode) const { return static_cast<pos_type>(traits::eof()); }
+    virtual pos_type seekpos(pos_type, std::ios_base::openmode) { return static_cast<pos_type>(traits::eof()); }
+    virtual pos_type seekoff(off_type, std::ios_base::seekdir, std::ios_base::openmode) { return static_cast<pos_type>(traits::eof()); }
+
+protected:
+    virtual pplx::task<bool> _sync() {
+        return target_.sync().then([]() { return true; });
+    }
+
+    virtual pplx::task<int_type> _putc(uint8_t ch) {
+        *crc_ = Crc32c(&ch, 1, *crc_);
+        return target_.putc(ch);
+    }
+
+    virtual pplx::task<size_t> _putn(const uint8_t* ptr, size_t count) {
+        *crc_ = Crc32c(ptr, count, *crc_);
+        return target_.putn_nocopy(ptr, count);
+    }
+
+    // no direct access to the target, every write has to be seen
+    virtual uint8_t* _alloc(size_t) { return nullptr; }
+    virtual void _commit(size_t) { }
+
+    // read side, the buffer is write-only
+    virtual pplx::task<size_t> _getn(uint8_t*, size_t) { return pplx::task_from_result<size_t>(0); }
+    virtual size_t _scopy(uint8_t*, size_t) { return 0; }
+    virtual pplx::task<int_type> _bumpc() { return pplx::task_from_result<int_type>(traits::eof()); }
+    virtual int_type _sbumpc() { return traits::eof(); }
+    virtual pplx::task<int_type> _getc() { return pplx::task_from_result<int_type>(traits::eof()); }
+    virtual int_type _sgetc() { return traits::eof(); }
+    virtual pplx::task<int_type> _nextc() { return pplx::task_from_result<int_type>(traits::eof()); }
+    virtual pplx::task<int_type> _ungetc() { return pplx::task_from_result<int_type>(traits::eof()); }
+}; // ChecksumStreamBuffer
+
+streambuf<uint8_t> ChecksumStream::Wrap(streambuf<uint8_t> target, std::shared_ptr<uint32_t> crc) {
+    return streambuf<uint8_t>(std::make_shared<ChecksumStreamBuffer>(target, crc));
+}
+
+ChecksumRegistry::ChecksumRegistry()
+    : verified_(0),
+    mismatches_(0),
+    unknown_(0)
+{ }
+
+void ChecksumRegistry::Record(const utility::string_t& uuid, uint32_t crc) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    checksums_[uuid] = crc;
+}
+
+bool ChecksumRegistry::Verify(const utility::string_t& uuid, uint32_t crc) {
+    uint32_t expected = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto iter = checksums_.find(uuid);
+        if (iter == checksums_.end()) {
+            unknown_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        expected = iter->second;
+    }
+
+    if (crc != expected) {
+        mismatches_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    verified_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+} // namespace TestClient
@@ -0,0 +1,498 @@
+// ahead of cpprest, its U() macro breaks the Boost templates with a parameter named U
+#include "boost/iostreams/device/back_inserter.hpp"
+#include "boost/iostreams/filter/gzip.hpp"
+#include "boost/iostreams/filtering_stream.hpp"
+
+#include "compression.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif // _WIN32
+
+using namespace Concurrency::streams;
+
+namespace TestClient {
+
+namespace io = boost::iostreams;
+
+/**
+ * \brief CPU time of the calling thread, wall-clock time where there is no such clock
+ *
+ * On Windows the thread times advance in scheduler ticks, so single chunks
+ * read as 0 or a whole tick and only totals over many chunks are meaningful.
+ */
+static uint64_t ThreadCpuNS() {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+    ULARGE_INTEGER kernelTime, userTime;
+    kernelTime.LowPart = kernel.dwLowDateTime;
+    kernelTime.HighPart = kernel.dwHighDateTime;
+    userTime.LowPart = user.dwLowDateTime;
+    userTime.HighPart = user.dwHighDateTime;
+    return (kernelTime.QuadPart + userTime.QuadPart) * 100;
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+    timespec now;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif // _WIN32
+}
+
+/**
+ * \brief Compressor of one body, shared by its stream buffer and the reads in flight
+ */
+struct GzipSourceState {
+    typedef char_traits<uint8_t> traits;
+    typedef traits::int_type int_type;
+
+    streambuf<uint8_t>                      source_;
+    std::shared_ptr<CompressionCounters>    counters_;
+    std::vector<uint8_t>                    chunk_;     // uncompressed input of one read
+    std::vector<char>                       pending_;   // compressed, not read yet
+    size_t                                  offset_;    // read position in pending_
+    io::filtering_ostream                   gzip_;      // appends to pending_
+    bool                                    finished_;  // trailer written
+
+    GzipSourceState(streambuf<uint8_t> source, int level, std::shared_ptr<CompressionCounters> counters)
+        : source_(source),
+        counters_(counters),
+        chunk_(GzipStream::CHUNK_SIZE),
+        offset_(0),
+        finished_(false)
+    {
+        gzip_.push(io::gzip_compressor(io::gzip_params(level)));
+        gzip_.push(io::back_inserter(pending_));
+    }
+
+    size_t Available() const { return pending_.size() - offset_; }
+
+    /**
+     * \brief Runs read bytes of chunk_ through the compressor, 0 = end of the source
+     */
+    void Compress(size_t read) {
+        auto before = pending_.size();
+        auto cpuStart = ThreadCpuNS();
+        if (read > 0) {
+            gzip_.write(reinterpret_cast<const char*>(chunk_.data()), static_cast<std::streamsize>(read));
+        }
+        else {
+            gzip_.reset(); // flushes the deflate stream and writes the trailer
+            finished_ = true;
+        }
+        counters_->cpuNS_ += ThreadCpuNS() - cpuStart;
+        counters_->rawBytes_ += read;
+        counters_->wireBytes_ += pending_.size() - before;
+    }
+
+    size_t Take(uint8_t* ptr, size_t count) {
+        auto n = std::min(count, Available());
+        if (n > 0) {
+            std::memcpy(ptr, pending_.data() + offset_, n);
+            offset_ += n;
+        }
+        if (offset_ == pending_.size()) {
+            pending_.clear();
+            offset_ = 0;
+        }
+        return n;
+    }
+
+    int_type Peek() const {
+        return Available() > 0 ? static_cast<int_type>(static_cast<uint8_t>(pending_[offset_])) : traits::eof();
+    }
+}; // GzipSourceState
+
+/**
+ * \brief Compresses chunks of the source until there is output or the source ended
+ * @return whether compressed bytes are available
+ */
+static pplx::task<bool> FillCompressed(std::shared_ptr<GzipSourceState> state) {
+    if (state->Available() > 0 || state->finished_) {
+        return pplx::task_from_result(state->Available() > 0);
+    }
+
+    return state->source_.getn(state->chunk_.data(), state->chunk_.size()).then(
+        [state](size_t read) -> pplx::task<bool>
+        {
+            state->Compress(read);
+            return FillCompressed(state);
+        }
+    );
+}
+
+/**
+ * \brief Read-only stream buffer producing the gzip of its source
+ *
+ * Each read that finds no compressed bytes left reads one chunk of the source
+ * and compresses it, so the body streams through without being buffered.
+ */
+class GzipSourceBuffer : public details::streambuf_state_manager<uint8_t> {
+    typedef details::streambuf_state_manager<uint8_t> base;
+
+    std::shared_ptr<GzipSourceState>    state_;
+
+public:
+    typedef base::traits traits;
+    typedef base::int_type int_type;
+    typedef base::pos_type pos_type;
+    typedef base::off_type off_type;
+
+    GzipSourceBuffer(streambuf<uint8_t> source, int level, std::shared_ptr<CompressionCounters> counters)
+        : base(std::ios_base::in),
+        state_(std::make_shared<GzipSourceState>(source, level, counters))
+    { }
+
+    virtual ~GzipSourceBuffer() {
+        this->_close_read();
+    }
+
+    virtual bool can_seek() const { return false; }
+    virtual bool has_size() const { return false; }
+    virtual utility::size64_t size() const { return 0; }
+
+    virtual size_t buffer_size(std::ios_base::openmode = std::ios_base::in) const { return 0; }
+    virtual void set_buffer_size(size_t, std::ios_base::openmode = std::ios_base::in) { }
+
+    virtual size_t in_avail() const { return state_->Available(); }
+
+    virtual bool acquire(uint8_t*& ptr, size_t& count) {
+        ptr = nullptr;
+        count = 0;
+        return false;
+    }
+
+    virtual void release(uint8_t*, size_t) { }
+
+    virtual pos_type getpos(std::ios_base::openmode) const { return static_cast<pos_type>(traits::eof()); }
+    virtual pos_type seekpos(pos_type, std::ios_base::openmode) { return static_cast<pos_type>(traits::eof()); }
+    virtual pos_type seekoff(off_type, std::ios_base::seekdir, std::ios_base::openmode) { return static_cast<pos_type>(traits::eof()); }
+
+protected:
+    virtual pplx::task<bool> _sync() { return pplx::task_from_result(true); }
+
+    // write side, the buffer is read-only
+    virtual pplx::task<int_type> _putc(uint8_t) { return pplx::task_from_result<int_type>(traits::eof()); }
+    virtual pplx::task<size_t> _putn(const uint8_t*, size_t) { return pplx::task_from_result<size_t>(0); }
+    virtual uint8_t* _alloc(size_t) { return nullptr; }
+    virtual void _commit(size_t) { }
+
+    virtual pplx::task<size_t> _getn(uint8_t* ptr, size_t count) {
+        auto state = state_;
+        return FillCompressed(state).then(
+            [state, ptr, count](bool) -> size_t
+            {
+                return state->Take(ptr, count);
+            }
+        );
+    }
+
+    // only what is compressed already, without reading the source
+    virtual size_t _scopy(uint8_t* ptr, size_t count) {
+        auto n = std::min(count, state_->Available());
+        if (n > 0) {
+            std::memcpy(ptr, state_->pending_.data() + state_->offset_, n);
+        }
+        return n;
+    }
+
+    virtual pplx::task<int_type> _bumpc() {
+        auto state = state_;
+        return FillCompressed(state).then(
+            [state](bool) -> int_type
+            {
+                auto ch = state->Peek();
+                uint8_t skipped;
+                state->Take(&skipped, 1);
+                return ch;
+            }
+        );
+    }
+
+    virtual int_type _sbumpc() {
+        if (state_->Available() == 0) {
+            return state_->finished_ ? traits::eof() : traits::requires_async();
+        }
+        auto ch = state_->Peek();
+        uint8_t skipped;
+        state_->Take(&skipped, 1);
+        return ch;
+    }
+
+    virtual pplx::task<int_type> _getc() {
+        auto state = state_;
+        return FillCompressed(state).then([state](bool) -> int_type { return state->Peek(); });
+    }
+
+    virtual int_type _sgetc() {
+        if (state_->Available() == 0) {
+            return state_->finished_ ? traits::eof() : traits::requires_async();
+        }
+        return state_->Peek();
+    }
+
+    virtual pplx::task<int_type> _nextc() {
+        auto state = state_;
+        return _bumpc().then(
+            [state](int_type ch) -> pplx::task<int_type>
+            {
+                if (ch == traits::eof()) {
+                    return pplx::task_from_result<int_type>(traits::eof());
+                }
+                return FillCompressed(state).then([state](bool) -> int_type { return state->Peek(); });
+            }
+        );
+    }
+
+    // compressed bytes are handed out once
+    virtual pplx::task<int_type> _ungetc() { return pplx::task_from_result<int_type>(traits::eof()); }
+}; // GzipSourceBuffer
+
+/**
+ * \brief Decompressor of one body, shared by its stream buffer and the writes in flight
+ */
+struct GzipTargetState {
+    streambuf<uint8_t>                      target_;    // null discards the decoded bytes
+    std::shared_ptr<CompressionCounters>    counters_;
+    std::vector<char>                       decoded_;   // not written to the target yet
+    io::filtering_ostream                   gunzip_;    // appends to decoded_
+    bool                                    finished_;
+
+    GzipTargetState(streambuf<uint8_t> target, std::shared_ptr<CompressionCounters> counters)
+        : target_(target),
+        counters_(counters),
+        finished_(false)
+    {
+        gunzip_.push(io::gzip_decompressor());
+        gunzip_.push(io::back_inserter(decoded_));
+    }
+}; // GzipTargetState
+
+/**
+ * \brief Hands the bytes decoded so far to the target
+ */
+static pplx::task<void> WriteDecoded(std::shared_ptr<GzipTargetState> state) {
+    if (state->decoded_.empty()) {
+        return pplx::task_from_result();
+    }
+
+    auto decoded = std::make_shared<std::vector<char>>();
+    decoded->swap(state->decoded_);
+    state->counters_->rawBytes_ += decoded->size();
+    if (!state->target_) {
+        return pplx::task_from_result();
+    }
+
+    return state->target_.putn_nocopy(reinterpret_cast<const uint8_t*>(decoded->data()), decoded->size()).then(
+        [decoded](size_t) { }
+    );
+}
+
+/**
+ * \brief Write-only stream buffer decoding the gzip written to it
+ *
+ * Every write is decoded at once and its output forwarded to the target, so
+ * the body streams through without being buffered.
+ */
+class GzipTargetBuffer : public details::streambuf_state_manager<uint8_t> {
+    typedef details::streambuf_state_manager<uint8_t> base;
+
+    std::shared_ptr<GzipTargetState>    state_;
+
+public:
+    typedef base::traits traits;
+    typedef base::int_type int_type;
+    typedef base::pos_type pos_type;
+    typedef base::off_type off_type;
+
+    GzipTargetBuffer(streambuf<uint8_t> target, std::shared_ptr<CompressionCounters> counters)
+        : base(std::ios_base::out),
+        state_(std::make_shared<GzipTargetState>(target, counters))
+    { }
+
+    virtual ~GzipTargetBuffer() {
+        this->_close_write();
+    }
+
+    virtual bool can_seek() const { return false; }
+    virtual bool has_size() const { return false; }
+    virtual utility::size64_t size() const { return 0; }
+
+    virtual size_t buffer_size(std::ios_base::openmode = std::ios_base::out) const { return 0; }
+    virtual void set_buffer_size(size_t, std::ios_base::openmode = std::ios_base::out) { }
+
+    virtual size_t in_avail() const { return 0; }
+
+    virtual bool acquire(uint8_t*& ptr, size_t& count) {
+        ptr = nullptr;
+        count = 0;
+        return false;
+    }
+
+    virtual void release(uint8_t*, size_t) { }
+
+    virtual pos_type getpos(std::ios_base::openmode) const { return static_cast<pos_type>(traits::eof()); }
+    virtual pos_type seekpos(pos_type, std::ios_base::openmode) { return static_cast<pos_type>(traits::eof()); }
+    virtual pos_type seekoff(off_type, std::ios_base::seekdir, std::ios_base::openmode) { return static_cast<pos_type>(traits::eof()); }
+
+protected:
+    // ends the gzip stream, a truncated or corrupt body throws here
+    virtual pplx::task<bool> _sync() {
+        auto state = state_;
+        if (!state->finished_) {
+            state->finished_ = true;
+            auto cpuStart = ThreadCpuNS();
+            state->gunzip_.reset();
+            state->counters_->cpuNS_ += ThreadCpuNS() - cpuStart;
+        }
+
+        return WriteDecoded(state).then(
+            [state]() -> pplx::task<bool>
+            {
+                if (!state->target_) {
+                    return pplx::task_from_result(true);
+                }
+                return state->target_.sync().then([]() { return true; });
+            }
+        );
+    }
+
+    virtual pplx::task<int_type> _putc(uint8_t ch) {
+        return _putn(&ch, 1).then([ch](size_t) { return static_cast<int_type>(ch); });
+    }
+
+    virtual pplx::task<size_t> _putn(const uint8_t* ptr, size_t count) {
+        auto state = state_;
+        auto cpuStart = ThreadCpuNS();
+        state->gunzip_.write(reinterpret_cast<const char*>(ptr), static_cast<std::streamsize>(count));
+        state->gunzip_.flush();
+        state->counters_->cpuNS_ += ThreadCpuNS() - cpuStart;
+        state->counters_->wireBytes_ += count;
+
+        return WriteDecoded(state).then([count]() { return count; });
+    }
+
+    // no direct access to the decoder, every write has to go through it
+    virtual uint8_t* _alloc(size_t) { return nullptr; }
+    virtual void _commit(size_t) { }
+
+    // read side, the buffer is write-only
+    virtual pplx::task<size_t> _getn(uint8_t*, size_t) { return pplx::task_from_result<size_t>(0); }
+    virtual size_t _scopy(uint8_t*, size_t) { return 0; }
+    virtual pplx::task<int_type> _bumpc() { return pplx::task_from_result<int_type>(traits::eof()); }
+    virtual int_type _sbumpc() { return traits::eof(); }
+    virtual pplx::task<int_type> _getc() { return pplx::task_from_result<int_type>(traits::eof()); }
+    virtual int_type _sgetc() { return traits::eof(); }
+    virtual pplx::task<int_type> _nextc() { return pplx::task_from_result<int_type>(traits::eof()); }
+    virtual pplx::task<int_type> _ungetc() { return pplx::task_from_result<int_type>(traits::eof()); }
+}; // GzipTargetBuffer
+
+basic_istream<uint8_t> GzipStream::Compress(basic_istream<uint8_t> source, int level, std::shared_ptr<CompressionCounters> counters) {
+    return basic_istream<uint8_t>(streambuf<uint8_t>(std::make_shared<GzipSourceBuffer>(source.streambuf(), level, counters)));
+}
+
+streambuf<uint8_t> GzipStream::Decompress(streambuf<uint8_t> target, std::shared_ptr<CompressionCounters> counters) {
+    return streambuf<uint8_t>(std::make_shared<GzipTargetBuffer>(target, counters));
+}
+
+// namespace scope, a function-local static is not initialized thread-safely on VS2013
+static std::atomic<uint64_t> nextCompressionLevel(0);
+
+int NextCompressionLevel(const CompressionOptions& options) {
+    if (options.levels_.empty()) {
+        return -1;
+    }
+    auto index = nextCompressionLevel.fetch_add(1, std::memory_order_relaxed) % options.levels_.size();
+    return options.levels_[static_cast<size_t>(index)];
+}
+
+/**
+ * \brief Totals of one level or of the downloads, one atomic add each per transfer
+ */
+struct CompressionTotals {
+    std::atomic<uint64_t>   transfers_;
+    std::atomic<uint64_t>   rawBytes_;
+    std::atomic<uint64_t>   wireBytes_;
+    std::atomic<uint64_t>   cpuNS_;
+    std::atomic<uint64_t>   transferNS_;
+}; // CompressionTotals
+
+static CompressionTotals compressedUploads[MAX_GZIP_LEVEL + 1];
+static CompressionTotals compressedDownloads;
+
+static void AddTransfer(CompressionTotals& totals, const CompressionCounters& counters, uint64_t transferNS) {
+    totals.transfers_.fetch_add(1, std::memory_order_relaxed);
+    totals.rawBytes_.fetch_add(counters.rawBytes_, std::memory_order_relaxed);
+    totals.wireBytes_.fetch_add(counters.wireBytes_, std::memory_order_relaxed);
+    totals.cpuNS_.fetch_add(counters.cpuNS_, std::memory_order_relaxed);
+    totals.transferNS_.fetch_add(transferNS, std::memory_order_relaxed);
+}
+
+static CompressionStats Load(const CompressionTotals& totals) {
+    CompressionStats stats;
+    stats.transfers_ = totals.transfers_.load(std::memory_order_relaxed);
+    stats.rawBytes_ = totals.rawBytes_.load(std::memory_order_relaxed);
+    stats.wireBytes_ = totals.wireBytes_.load(std::memory_order_relaxed);
+    stats.cpuNS_ = totals.cpuNS_.load(std::memory_order_relaxed);
+    stats.transferNS_ = totals.transferNS_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void RecordCompressedUpload(int level, const CompressionCounters& counters, uint64_t transferNS) {
+    if (level >= 0 && level <= MAX_GZIP_LEVEL) {
+        AddTransfer(compressedUploads[level], counters, transferNS);
+    }
+}
+
+void RecordCompressedDownload(const CompressionCounters& counters, uint64_t transferNS) {
+    AddTransfer(compressedDownloads, counters, transferNS);
+}
+
+CompressionStats CompressedUploads(int level) {
+    return level >= 0 && level <= MAX_GZIP_LEVEL ? Load(compressedUploads[level]) : CompressionStats();
+}
+
+CompressionStats CompressedDownloads() {
+    return Load(compressedDownloads);
+}
+
+static void PrintCompression(std::wostream& os, const CompressionStats& stats) {
+    auto toMB = [](double bytes) { return bytes / (1024.0 * 1024.0); };
+
+    os << stats.transfers_ << L" transfers, "
+        << stats.Ratio() << L":1, "
+        << (double)stats.cpuNS_ / 1e9 << L"s CPU at " << toMB(stats.CpuBytesPerS()) << L"MB/s, "
+        << toMB(stats.EffectiveBytesPerS()) << L"MB/s effective vs "
+        << toMB(stats.WireBytesPerS()) << L"MB/s on the wire per transfer" << std::endl;
+}
+
+void PrintCompressionStats(std::wostream& os) {
+    for (int level = 0; level <= MAX_GZIP_LEVEL; ++level) {
+        auto stats = CompressedUploads(level);
+        if (stats.transfers_ > 0) {
+            os << L"gzip level " << level << L" uploads: ";
+            PrintCompression(os, stats);
+        }
+    }
+
+    auto downloads = CompressedDownloads();
+    if (downloads.transfers_ > 0) {
+        os << L"gzip downloads: ";
+        PrintCompression(os, downloads);
+    }
+}
+
+} // namespace TestClient
@@ -1,5 +1,10 @@
 #include "contentservice.h"
 #include "jsonutils.h"
+#include "miscutils.h"
+#include "phasestats.h"
+#include "throughputstats.h"
+#include "tracing.h"
+#include "transfertiming.h"
 
 #include "cpprest/http_client.h"
 #include "cpprest/json.h"
@@ -8,7 +13,13 @@
 #include "cpprest/streams.h"
 #include "cpprest/rawptrstream.h"
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <string>
+#include <utility>
+
+#include "boost/iostreams/device/mapped_file.hpp"
 
 using namespace std;
 
@@ -32,18 +43,169 @@ void WErrorMessage(const wchar_t* msg) {
     std::wcout << msg << std::endl;
 }
 
+bool UploadSource::ComputeChecksum() {
+    if (!IsGenerated()) {
+        hasChecksum_ = Crc32cFile(utility::conversions::to_utf8string(fileName_), checksum_);
+        return hasChecksum_;
+    }
+
+    // the payload repeats the pattern block, checksum it block by block
+    uint32_t crc = 0;
+    for (uint64_t offset = 0; offset < size_; ) {
+        auto index = static_cast<size_t>(offset % pattern_->Size());
+        auto n = static_cast<size_t>(std::min<uint64_t>(size_ - offset, pattern_->Size() - index));
+        crc = Crc32c(pattern_->Data() + index, n, crc);
+        offset += n;
+    }
+
+    checksum_ = crc;
+    hasChecksum_ = true;
+    return true;
+}
+
+bool UploadSource::Map() {
+    if (IsGenerated() || size_ == 0) {
+        return false;
+    }
+
+    try {
+        mapping_ = std::make_shared<MappedSourceFile>(utility::conversions::to_utf8string(fileName_));
+        return true;
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+}
+
+/**
+ * \brief Shared state of all streams of one ranged download
+ */
+struct RangedDownloadState {
+    ContentServiceConnection    connection_;
+    utility::string_t           uuid_;
+    web::uri                    downloadURI_;
+    uint8_t*                    data_;
+    uint64_t                    dataLength_;
+    uint64_t                    chunkSize_;
+    size_t                      numChunks_;
+    std::atomic<size_t>         nextChunk_;
+    std::atomic<bool>           failed_;
+    std::vector<ChunkStats>     chunks_;    // each slot is written only by the stream owning the chunk
+    std::vector<uint32_t>       chunkChecksums_;
+    std::function<void(const char*)> errorFunc_;
+
+    explicit RangedDownloadState(const ContentServiceConnection& connection)
+        : connection_(connection)
+    { }
+}; // RangedDownloadState
+
+/**
+ * \brief Downloads chunks one after the other until none are left
+ *
+ * Every stream runs this loop, so the number of concurrent range requests
+ * equals the number of loops started. Errors are recorded in the state instead
+ * of being thrown, which lets the caller wait for every stream to stop writing.
+ */
+static pplx::task<void> DownloadNextChunk(std::shared_ptr<RangedDownloadState> state) {
+    auto index = state->nextChunk_.fetch_add(1);
+    if (index >= state->numChunks_ || state->failed_.load()) {
+        return pplx::task_from_result();
+    }
+
+    auto offset = index * state->chunkSize_;
+    auto length = std::min(state->chunkSize_, state->dataLength_ - offset);
+
+    utility::stringstream_t range;
+    range << U("bytes=") << offset << U("-") << (offset + length - 1);
+
+    http_request request;
+    request.set_method(web::http::methods::GET);
+    request.set_request_uri(state->downloadURI_);
+    request.headers().add(U("Range"), range.str());
+
+    auto tStart = std::chrono::steady_clock::now();
+    auto traceId = Tracer::NewId();
+
+    return state->connection_.Send(state->uuid_, request).then(
+        [state, offset, length](http_response response) -> pplx::task<size_t>
+        {
+            // a server ignoring the range header is fine only if the range is the whole blob
+            auto status = response.status_code();
+            if (status != status_codes::PartialContent
+                && !(status == status_codes::OK && length == state->dataLength_)) {
+                throw http_exception(U("Range request failed"));
+            }
+
+            rawptr_buffer<uint8_t> chunkBuffer(state->data_ + offset, static_cast<size_t>(length), std::ios::out);
+            return response.body().read_to_end(chunkBuffer);
+        }
+    ).then(
+        [state, index, offset, length, tStart, traceId](pplx::task<size_t> previousTask) -> pplx::task<void>
+        {
+            try {
+                auto received = previousTask.get();
+                if (received != length) {
+                    throw http_exception(U("contentLength mismatched!"));
+                }
+            }
+            catch (const std::exception& e) {
+                if (!state->failed_.exchange(true)) {
+                    state->errorFunc_(e.what());
+                }
+                return pplx::task_from_result();
+            }
+
+            auto tStop = std::chrono::steady_clock::now();
+            PhaseStats::Record(PHASE_DOWNLOAD_CHUNK, tStart);
+            Tracer::Record(TRACE_DOWNLOAD_CHUNK, traceId, tStart, length);
+
+            // the chunk was just written, checksum it while it is still in cache
+            {
+                TraceSpan span(TRACE_VERIFY, length);
+                state->chunkChecksums_[index] = Crc32c(state->data_ + offset, static_cast<size_t>(length));
+            }
+
+            auto& chunk = state->chunks_[index];
+            chunk.offset_ = offset;
+            chunk.length_ = length;
+            chunk.timeUS_ = std::chrono::duration_cast<std::chrono::microseconds>(tStop - tStart).count();
+
+            return DownloadNextChunk(state);
+        }
+    );
+}
+
+/**
+ * \brief Counts a finished download in ThroughputStats, negative lengths are failures
+ */
+static int64_t CountDownload(int64_t contentLength) {
+    if (contentLength >= 0) {
+        ThroughputStats::Record(OPERATION_DOWNLOAD, static_cast<uint64_t>(contentLength));
+    }
+    else {
+        ThroughputStats::RecordError(OPERATION_DOWNLOAD);
+    }
+    return contentLength;
+}
+
+static const RangedDownloadStats& CountDownload(const RangedDownloadStats& stats) {
+    CountDownload(stats.contentLength_);
+    return stats;
+}
+
 ContentService::ContentService(const utility::string_t& serverURI, int port) 
     : connection_(serverURI, port)
 { }
 
+ContentService::ContentService(const ContentServiceConnection& connection)
+    : connection_(connection)
+{ }
+
 pplx::task<utility::string_t> ContentService::GetBlobUUID(
-    const utility::string_t serverURI,
     uint64_t size, 
     std::function<void(const char *)> errorFunc, 
     std::function<void(const wchar_t*)> wErrorFunc)
 {
-    http::client::http_client client(serverURI);
-
     auto jsonBlob = JsonCreateBlob(size);
     
     http_request request;
@@ -52,9 +214,15 @@ pplx::task<utility::string_t> ContentService::GetBlobUUID(
     request.headers().set_content_type(U("application/vnd.api+json"));
     request.set_body(jsonBlob);
 
-    return client.request(request)
+    auto tStart = PhaseStats::Clock::now();
+    auto traceId = Tracer::NewId();
+    auto router = connection_.router_;
+    auto creator = std::make_shared<size_t>(0);
+    return router->SendCreate(request)
     .then(
-        [errorFunc](http_response response) -> pplx::task<web::json::value> {
+        [errorFunc, creator](std::pair<http_response, size_t> created) -> pplx::task<web::json::value> {
+            const auto& response = created.first;
+            *creator = created.second;
             if (response.status_code() == status_codes::Created) {
                 return response.extract_json(true); // ignore content-type
             }
@@ -62,14 +230,15 @@ pplx::task<utility::string_t> ContentService::GetBlobUUID(
             return pplx::task_from_result (web::json::value());
         }
     ).then(
-        [errorFunc](pplx::task<web::json::value> jsonResponse) -> pplx::task<utility::string_t> {
+        [errorFunc, router, creator, tStart, traceId](pplx::task<web::json::value> jsonResponse) -> pplx::task<utility::string_t> {
+            PhaseStats::Record(PHASE_CREATE_BLOB, tStart);
+            Tracer::Record(TRACE_CREATE_BLOB, traceId, tStart);
             try {
                 const auto& input = jsonResponse.get();
                 if (!input.is_null()) {
-                    auto responseData = input.at(U("data")).as_object();
-                    utility::string_t id = responseData.at(U("id")).serialize();
-                    id.pop_back();
-                    id = id.substr(1U);
+                    auto id = JsonUnquote(input.at(U("data")).at(U("id")));
+                    // the node that created the blob serves its upload and downloads
+                    router->AssignCreator(id, *creator);
 
                     return pplx::task_from_result(id);
                 }
@@ -87,8 +256,36 @@ pplx::task<utility::string_t> ContentService::GetBlobUUID(
     );
 }
 
+pplx::task<utility::string_t> ContentService::AcquireBlobUUID(
+    uint64_t size,
+    std::function<void(const char *)> errorFunc,
+    std::function<void(const wchar_t*)> wErrorFunc)
+{
+    utility::string_t uuid;
+    if (connection_.prefetcher_ && connection_.prefetcher_->TryTake(size, uuid)) {
+        return pplx::task_from_result(uuid);
+    }
+
+    return GetBlobUUID(size, errorFunc, wErrorFunc);
+}
+
+bool ContentService::StartUuidPrefetch(const std::vector<uint64_t>& sizes, const UuidPrefetchOptions& options) {
+    if (!connection_.prefetcher_) {
+        return false;
+    }
+
+    // creations run on a copy without the prefetcher, which would otherwise own itself
+    auto creator = connection_;
+    creator.prefetcher_.reset();
+    return connection_.prefetcher_->Start(sizes, options,
+        [creator](uint64_t size) -> pplx::task<utility::string_t>
+        {
+            return ContentService(creator).GetBlobUUID(size, ErrorMessage, WErrorMessage);
+        }
+    );
+}
+
 pplx::task<int64_t> ContentService::GetBlobContentLength(
-    const utility::string_t serverURI,
     const utility::string_t& uuid,
     std::function<void(const char*)> errorFunc,
     std::function<void(const wchar_t*)> wErrorFunc)
@@ -97,8 +294,6 @@ pplx::task<int64_t> ContentService::GetBlobContentLength(
     using Concurrency::streams::streambuf;
     using Concurrency::streams::file_buffer;
 
-    http_client client(serverURI);
-
     auto queryBlob = uri_builder();
     queryBlob.set_path(U("/blob/") + uuid);
 
@@ -106,27 +301,136 @@ pplx::task<int64_t> ContentService::GetBlobContentLength(
     requestBlob.set_method(web::http::methods::GET);
     requestBlob.set_request_uri(queryBlob.to_uri());
 
-    return client.request(requestBlob).then(
-    [wErrorFunc](pplx::task<web::http::http_response> previousTask) -> pplx::task<int64_t> {
-        const auto& response = previousTask.get();
-        const auto& responseJSON = response.extract_json(true).get();
+    auto tStart = PhaseStats::Clock::now();
+    auto traceId = Tracer::NewId();
+    return connection_.Send(uuid, requestBlob).then(
+    [](http_response response) -> pplx::task<web::json::value> {
+        return response.extract_json(true);
+    }).then(
+    [wErrorFunc, tStart, traceId](pplx::task<web::json::value> previousTask) -> int64_t {
+        const auto& responseJSON = previousTask.get();
+        PhaseStats::Record(PHASE_METADATA_GET, tStart);
+        Tracer::Record(TRACE_METADATA_GET, traceId, tStart);
 
         int64_t dataLength = -1;
         try {
             const auto& dataObj = responseJSON.at(U("data")).as_object();
             const auto& attributes = dataObj.at(U("attributes")).as_object();
-            dataLength = (int64_t)attributes.at(U("contentLength")).as_integer();
+            dataLength = attributes.at(U("contentLength")).as_number().to_int64();
         }
         catch (...) {
             wErrorFunc(responseJSON.serialize().c_str());
         }
 
-        return pplx::task_from_result(dataLength);
+        return dataLength;
     });
 }
 
+pplx::task<int64_t> ContentService::LookupContentLength(
+    const utility::string_t& uuid,
+    std::function<void(const char*)> errorFunc,
+    std::function<void(const wchar_t*)> wErrorFunc)
+{
+    uint64_t size = 0;
+    if (connection_.Metadata().Get(uuid, size)) {
+        return pplx::task_from_result(static_cast<int64_t>(size));
+    }
+
+    return RefreshContentLength(uuid, errorFunc, wErrorFunc);
+}
+
+pplx::task<int64_t> ContentService::RefreshContentLength(
+    const utility::string_t& uuid,
+    std::function<void(const char*)> errorFunc,
+    std::function<void(const wchar_t*)> wErrorFunc)
+{
+    auto connection = connection_;
+    return GetBlobContentLength(uuid, errorFunc, wErrorFunc).then(
+        [connection, uuid](int64_t dataLength) -> int64_t {
+            if (dataLength >= 0) {
+                connection.Metadata().Put(uuid, static_cast<uint64_t>(dataLength));
+            }
+            return dataLength;
+        }
+    );
+}
+
+/**
+ * \brief Passes the JSON body of an error response to wErrorFunc
+ * @return the task yields CONTENT_SERVICE_TASK_FAIL once the body is read
+ */
+static pplx::task<web::json::value> ReportErrorResponse(http_response response, const std::function<void(const wchar_t*)>& wErrorFunc) {
+    // only an error response carries a JSON body
+    return response.extract_json(true).then(
+        [wErrorFunc](web::json::value responseJSON) -> web::json::value
+        {
+            wErrorFunc(responseJSON.serialize().c_str());
+            return web::json::value(CONTENT_SERVICE_TASK_FAIL);
+        }
+    );
+}
+
+/**
+ * \brief Checks the Content-Length of a download against the expected length
+ *
+ * Drops the cached length on a mismatch, the caller asks the service for the current one.
+ */
+static bool CheckDownloadLength(const ContentServiceConnection& connection, const utility::string_t& uuid,
+    const http_response& response, int64_t dataLength)
+{
+    const auto& headers = response.headers();
+    if (!headers.has(header_names::content_length)
+        || headers.content_length() == static_cast<utility::size64_t>(dataLength)) {
+        return true;
+    }
+
+    connection.Metadata().Erase(uuid);
+    return false;
+}
+
+/**
+ * \brief Nanoseconds since start
+ */
+static uint64_t ElapsedNS(PhaseStats::Clock::time_point start) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(PhaseStats::Clock::now() - start).count());
+}
+
+/**
+ * \brief True if the service sent the body gzip encoded
+ */
+static bool IsGzipEncoded(const http_response& response) {
+    utility::string_t encoding;
+    return response.headers().match(header_names::content_encoding, encoding) && encoding == U("gzip");
+}
+
+/**
+ * \brief Reads a response body into target, decoding it on the fly if compression is set
+ * @return the task yields the length written to target
+ */
+static pplx::task<size_t> ReadBody(const http_response& response, Concurrency::streams::streambuf<uint8_t> target,
+    std::shared_ptr<TransferTiming> timing, std::shared_ptr<CompressionCounters> compression)
+{
+    if (!compression) {
+        return response.body().read_to_end(TimingStream::WrapTarget(target, timing));
+    }
+
+    // the timing sees the gzip as it arrives, the decoder its last bytes only once synced
+    auto decoder = GzipStream::Decompress(target, compression);
+    return response.body().read_to_end(TimingStream::WrapTarget(decoder, timing)).then(
+        [decoder, compression](size_t) mutable -> pplx::task<size_t>
+        {
+            return decoder.sync().then(
+                [compression]() -> size_t
+                {
+                    return static_cast<size_t>(compression->rawBytes_);
+                }
+            );
+        }
+    );
+}
+
 pplx::task<web::json::value> ContentService::UploadAsync(
-    const utility::string_t& InputFile, 
+    const UploadSource& source,
     std::function<void(const char*)> errorFunc,
     std::function<void(const wchar_t*)> wErrorFunc,
     const pplx::cancellation_token& token /*= pplx::cancellation_token::none()*/)
@@ -134,21 +438,38 @@ pplx::task<web::json::value> ContentService::UploadAsync(
     using Concurrency::streams::file_stream;
     using Concurrency::streams::basic_istream;
 
-    return file_stream<uint8_t>::open_istream(InputFile).then(
-    [=](pplx::task<basic_istream<uint8_t>> previousTask) -> pplx::task<web::json::value> {
+    // mapped files are sent from the shared mapping and generated payloads from memory,
+    // only other files are streamed from disk through a buffer of their own
+    auto mapping = source.mapping_;
+    auto streamed = !mapping && !source.IsGenerated();
+    auto tOpen = Tracer::Clock::now();
+    auto openId = Tracer::NewId();
+    auto openTask = mapping
+        ? pplx::task_from_result(rawptr_stream<uint8_t>::open_istream(mapping->Data(), static_cast<size_t>(mapping->Size())))
+        : source.IsGenerated()
+        ? pplx::task_from_result(TestDataInputStream::Open(source.pattern_, source.size_))
+        : file_stream<uint8_t>::open_istream(source.fileName_);
+
+    // the continuation may run after this service is gone, it works on a copy
+    auto service = *this;
+    return openTask.then(
+    [service, mapping, streamed, tOpen, openId, errorFunc, wErrorFunc, token](pplx::task<basic_istream<uint8_t>> previousTask) mutable -> pplx::task<web::json::value> {
         if (!token.is_canceled ()) {
             auto fileStream = previousTask.get();
+            if (streamed) {
+                Tracer::Record(TRACE_FILE_OPEN, openId, tOpen);
+            }
+
+            auto connection = service.connection_;
 
-            auto serverURI = connection_.GetURI();
-            
             // content-length
             fileStream.seek(0, std::ios::end);
-            auto dataLength = static_cast<size_t>(fileStream.tell());
+            auto dataLength = static_cast<uint64_t>(fileStream.tell());
             fileStream.seek(0, std::ios::beg);
 
             // get UUID for the blob
-            return GetBlobUUID(serverURI, dataLength, errorFunc, wErrorFunc).then(
-                [errorFunc, wErrorFunc, serverURI, dataLength, fileStream](pplx::task<utility::string_t> previousTask) -> pplx::task<web::json::value>
+            return service.AcquireBlobUUID(dataLength, errorFunc, wErrorFunc).then(
+                [errorFunc, wErrorFunc, connection, dataLength, fileStream, mapping, streamed](pplx::task<utility::string_t> previousTask) -> pplx::task<web::json::value>
                 {
                     auto uuid = previousTask.get();
                     //std::wcout << "uuid = " << uuid << std::endl;
@@ -156,8 +477,6 @@ pplx::task<web::json::value> ContentService::UploadAsync(
                         throw http_exception(U("Failed to get UUID"));
                     }
 
-                    http_client client(serverURI);
-
                     // upload file
                     // "/blob/${uuid}/upload?uploadType=resumable"
                     auto query = uri_builder();
@@ -165,28 +484,53 @@ pplx::task<web::json::value> ContentService::UploadAsync(
                     query.append_query(U("uploadType"), U("resumable"));
 
                     http_request request;
-                    request.headers().set_content_type(U("application/octet-stream"));
-                    request.headers().set_content_length(dataLength);
                     request.set_request_uri(query.to_uri());
                     request.set_method(web::http::methods::PUT);
-                    request.set_body(fileStream, dataLength);
-
-                    // perform upload
-                    return client.request(request).then(
-                        [uuid, dataLength, fileStream, wErrorFunc](pplx::task<http_response> previousTask) -> pplx::task<web::json::value>
+                    auto timing = std::make_shared<TransferTiming>();
+                    auto level = NextCompressionLevel(connection.compression_);
+                    auto compression = std::make_shared<CompressionCounters>();
+                    if (level >= 0) {
+                        // gzip streams as it is sent, the length is unknown up front, chunked transfer encoding
+                        request.headers().add(header_names::content_encoding, U("gzip"));
+                        request.set_body(TimingStream::WrapSource(GzipStream::Compress(fileStream, level, compression), timing), U("application/octet-stream"));
+                    }
+                    else {
+                        request.headers().set_content_type(U("application/octet-stream"));
+                        request.headers().set_content_length(dataLength);
+                        request.set_body(TimingStream::WrapSource(fileStream, timing), dataLength);
+                    }
+                    RecordSourceRead(mapping != nullptr, streamed ? dataLength : 0);
+
+                    // perform upload, the mapping outlives the request body reading from it
+                    auto tStart = PhaseStats::Clock::now();
+                    auto traceId = Tracer::NewId();
+                    timing->sent_ = tStart;
+                    return connection.Send(uuid, request).then(
+                        [uuid, dataLength, fileStream, mapping, wErrorFunc, tStart, traceId, timing, level, compression](pplx::task<http_response> previousTask) -> pplx::task<web::json::value>
                         {
                             fileStream.close();
 
                             auto response = previousTask.get();
-                            auto jsonResponse = response.extract_json().get(); // ignore content-type
-                            if (response.status_code() != status_codes::OK) {
-                                auto jsonResult = jsonResponse.serialize().c_str();
-                                wErrorFunc(jsonResult);
-
-                                throw http_exception(U("Failed to upload"));
+                            timing->headers_ = PhaseStats::Clock::now();
+                            PhaseStats::Record(PHASE_UPLOAD_PUT, tStart);
+                            RecordTransfer(TRANSFER_UPLOAD, *timing);
+                            if (level >= 0) {
+                                RecordCompressedUpload(level, *compression, ElapsedNS(tStart));
                             }
-
-                            return pplx::task_from_result(web::json::value(uuid));
+                            Tracer::Record(TRACE_UPLOAD_PUT, traceId, tStart, dataLength);
+                            auto status = response.status_code();
+                            return response.extract_json().then(
+                                [uuid, status, wErrorFunc](web::json::value jsonResponse) -> web::json::value
+                                {
+                                    if (status != status_codes::OK) {
+                                        wErrorFunc(jsonResponse.serialize().c_str());
+
+                                        throw http_exception(U("Failed to upload"));
+                                    }
+
+                                    return web::json::value(uuid);
+                                }
+                            );
                         }
                     );
                 }
@@ -202,23 +546,370 @@ pplx::task<utility::string_t> ContentService::Upload(
     std::function<void(const char*)> errorFunc,
     std::function<void(const wchar_t*)> wErrorFunc)
 {
+    return Upload(UploadSource(InputFile, GetFileSize(InputFile)), errorFunc, wErrorFunc);
+}
+
+pplx::task<utility::string_t> ContentService::Upload(
+    const UploadSource& source,
+    std::function<void(const char*)> errorFunc,
+    std::function<void(const wchar_t*)> wErrorFunc)
+{
+    auto connection = connection_;
+    auto hasChecksum = source.hasChecksum_;
+    auto checksum = source.checksum_;
+    auto size = source.size_;
+
     try {
-        return UploadAsync(InputFile, errorFunc, wErrorFunc).then(
-            [](pplx::task<web::json::value> previousTask) -> pplx::task<utility::string_t> {
-                auto response = previousTask.get();
-                auto uuid = response.serialize();
-                uuid.pop_back();
-                uuid = uuid.substr(1U);
+        return UploadAsync(source, errorFunc, wErrorFunc).then(
+            [connection, hasChecksum, checksum, size](pplx::task<web::json::value> previousTask) -> pplx::task<utility::string_t> {
+                utility::string_t uuid;
+                try {
+                    uuid = JsonUnquote(previousTask.get());
+                }
+                catch (...) {
+                    ThroughputStats::RecordError(OPERATION_UPLOAD);
+                    throw;
+                }
+
+                if (uuid.empty()) {
+                    ThroughputStats::RecordError(OPERATION_UPLOAD);
+                    return pplx::task_from_result(uuid);
+                }
+
+                ThroughputStats::Record(OPERATION_UPLOAD, size);
+                connection.Metadata().Put(uuid, size);
+                if (hasChecksum) {
+                    connection.Checksums().Record(uuid, checksum);
+                }
                 return pplx::task_from_result(uuid);
             }
         );
     }
     catch (const http_exception& e) {
         errorFunc(e.what());
+        ThroughputStats::RecordError(OPERATION_UPLOAD);
         return pplx::task_from_result(utility::string_t());
     }
 }
 
+// a resumable upload answers 308 until it has every byte
+static const web::http::status_code STATUS_RESUME_INCOMPLETE = 308;
+
+/**
+ * \brief Shared state of all in-flight chunks of one resumable upload
+ */
+struct ChunkedUploadState {
+    ContentServiceConnection                                connection_;
+    web::uri                                                uploadURI_;
+    std::shared_ptr<const MappedSourceFile>                 source_;
+    const uint8_t*                                          data_;
+    std::shared_ptr<const TestDataPattern>                  pattern_;   // replaces source_ for generated data
+    uint64_t                                                dataLength_;
+    uint64_t                                                chunkSize_;
+    size_t                                                  chunksInFlight_;
+    size_t                                                  maxResumes_;
+    bool                                                    outOfOrder_;
+    std::atomic<uint64_t>                                   nextOffset_;
+    std::atomic<uint64_t>                                   sentEnd_;   // end of the furthest chunk ever sent
+    uint64_t                                                resendEnd_; // sentEnd_ when the round started, chunks below it are resent
+    std::atomic<uint64_t>                                   resentBytes_;
+    std::atomic<size_t>                                     chunks_;
+    std::atomic<bool>                                       failed_;
+    std::atomic<bool>                                       completed_; // service confirmed the whole blob
+    std::chrono::steady_clock::time_point                   tFailure_;  // set by the chunk that failed the round first
+    ChunkedUploadStats                                      stats_;     // updated between rounds only
+    std::function<void(const char*)>                        errorFunc_;
+
+    explicit ChunkedUploadState(const ContentServiceConnection& connection)
+        : connection_(connection)
+    { }
+}; // ChunkedUploadState
+
+/**
+ * \brief Formats a Content-Range header value
+ *
+ * A zero length gives the status query form, with '*' in place of the range.
+ */
+static utility::string_t ContentRange(uint64_t offset, uint64_t length, uint64_t total) {
+    utility::stringstream_t ss;
+    ss << U("bytes ");
+    if (length > 0) {
+        ss << offset << U("-") << (offset + length - 1);
+    }
+    else {
+        ss << U("*");
+    }
+    ss << U("/") << total;
+
+    return ss.str();
+}
+
+/**
+ * \brief Asks the service how many bytes of the upload it has committed
+ *
+ * Sends an empty PUT with a status query Content-Range. An incomplete upload
+ * answers 308 with "Range: bytes=0-last", a complete one answers 200 or 201.
+ */
+static pplx::task<uint64_t> QueryCommittedOffset(std::shared_ptr<ChunkedUploadState> state) {
+    http_request request;
+    request.set_method(web::http::methods::PUT);
+    request.set_request_uri(state->uploadURI_);
+    request.headers().add(U("Content-Range"), ContentRange(0, 0, state->dataLength_));
+    request.headers().set_content_length(0);
+
+    return state->connection_.Send(state->stats_.uuid_, request).then(
+        [state](http_response response) -> uint64_t
+        {
+            auto status = response.status_code();
+            if (status == status_codes::OK || status == status_codes::Created) {
+                return state->dataLength_;
+            }
+            if (status != STATUS_RESUME_INCOMPLETE) {
+                throw http_exception(U("Failed to query upload offset"));
+            }
+
+            utility::string_t range;
+            if (!response.headers().match(U("Range"), range)) {
+                return 0; // nothing committed yet
+            }
+
+            auto separator = range.find(U('-'));
+            if (separator == utility::string_t::npos) {
+                throw http_exception(U("Malformed Range header"));
+            }
+
+            return std::stoull(range.substr(separator + 1)) + 1;
+        }
+    );
+}
+
+/**
+ * \brief Marks the round as failed, the first failure reports and stamps the time
+ */
+static void FailChunkRound(const std::shared_ptr<ChunkedUploadState>& state, const char* message) {
+    if (!state->failed_.exchange(true)) {
+        state->tFailure_ = std::chrono::steady_clock::now();
+        state->errorFunc_(message);
+    }
+}
+
+/**
+ * \brief Sends chunks one after the other until none are left
+ *
+ * Every in-flight slot runs this loop, in order there is a single slot. A
+ * failed chunk marks the whole round as failed so the other slots stop taking
+ * chunks.
+ */
+static pplx::task<void> UploadNextChunk(std::shared_ptr<ChunkedUploadState> state) {
+    auto offset = state->nextOffset_.fetch_add(state->chunkSize_);
+    // an empty blob still takes one empty PUT to complete
+    auto emptyBlob = state->dataLength_ == 0 && offset == 0;
+    if ((offset >= state->dataLength_ && !emptyBlob) || state->failed_.load()) {
+        return pplx::task_from_result();
+    }
+
+    auto length = std::min(state->chunkSize_, state->dataLength_ - offset);
+    auto end = offset + length;
+    auto sentEnd = state->sentEnd_.load();
+    while (sentEnd < end && !state->sentEnd_.compare_exchange_weak(sentEnd, end)) { }
+    if (offset < state->resendEnd_) {
+        state->resentBytes_.fetch_add(std::min(end, state->resendEnd_) - offset);
+    }
+    state->chunks_.fetch_add(1);
+
+    // the disk reads the next chunks while this one is on the wire
+    if (state->source_ && !state->outOfOrder_ && state->chunksInFlight_ > 1) {
+        state->source_->Prefetch(end, (state->chunksInFlight_ - 1) * state->chunkSize_);
+    }
+
+    http_request request;
+    request.set_method(web::http::methods::PUT);
+    request.set_request_uri(state->uploadURI_);
+    request.headers().set_content_type(U("application/octet-stream"));
+    request.headers().add(U("Content-Range"), ContentRange(offset, length, state->dataLength_));
+    if (emptyBlob) {
+        request.headers().set_content_length(0);
+    }
+    else if (state->pattern_) {
+        request.set_body(TestDataInputStream::Open(state->pattern_, length, offset), length);
+    }
+    else {
+        request.set_body(rawptr_stream<uint8_t>::open_istream(state->data_ + offset, static_cast<size_t>(length)), length);
+    }
+
+    auto tStart = PhaseStats::Clock::now();
+    auto traceId = Tracer::NewId();
+    return state->connection_.Send(state->stats_.uuid_, request).then(
+        [state, length, tStart, traceId](pplx::task<http_response> previousTask) -> pplx::task<void>
+        {
+            try {
+                auto status = previousTask.get().status_code();
+                PhaseStats::Record(PHASE_UPLOAD_CHUNK, tStart);
+                Tracer::Record(TRACE_UPLOAD_CHUNK, traceId, tStart, length);
+                if (status == status_codes::OK || status == status_codes::Created) {
+                    state->completed_ = true;
+                }
+                else if (status != STATUS_RESUME_INCOMPLETE) {
+                    throw http_exception(U("Failed to upload chunk"));
+                }
+            }
+            catch (const std::exception& e) {
+                FailChunkRound(state, e.what());
+                return pplx::task_from_result();
+            }
+
+            return UploadNextChunk(state);
+        }
+    );
+}
+
+/**
+ * \brief Runs the in-flight slots until the upload completes or resuming gives up
+ */
+static pplx::task<void> UploadChunkRound(std::shared_ptr<ChunkedUploadState> state) {
+    auto remaining = state->dataLength_ - std::min(state->nextOffset_.load(), state->dataLength_);
+    auto numChunks = static_cast<size_t>((remaining + state->chunkSize_ - 1) / state->chunkSize_);
+    auto numSlots = state->outOfOrder_
+        ? std::min(std::max(state->chunksInFlight_, static_cast<size_t>(1)), std::max(numChunks, static_cast<size_t>(1)))
+        : 1;
+
+    std::vector<pplx::task<void>> slotTasks;
+    for (size_t i = 0; i < numSlots; ++i) {
+        slotTasks.push_back(UploadNextChunk(state));
+    }
+
+    return pplx::when_all(begin(slotTasks), end(slotTasks)).then(
+        [state]() -> pplx::task<void>
+        {
+            if (!state->failed_.load() && state->completed_.load()) {
+                return pplx::task_from_result();
+            }
+
+            // either a chunk failed, or chunks were acknowledged out of order and
+            // only the service knows whether it has the whole blob; recovery counts
+            // from the first failure, including the wait for the other slots
+            auto tFailure = state->failed_.load() ? state->tFailure_ : std::chrono::steady_clock::now();
+            return QueryCommittedOffset(state).then(
+                [state, tFailure](uint64_t committed) -> pplx::task<void>
+                {
+                    if (committed >= state->dataLength_) {
+                        state->completed_ = true;
+                        return pplx::task_from_result();
+                    }
+                    if (state->stats_.resumes_ >= state->maxResumes_) {
+                        throw http_exception(U("Failed to upload, out of resume attempts"));
+                    }
+
+                    auto tResume = std::chrono::steady_clock::now();
+                    state->stats_.resumes_++;
+                    state->stats_.recoveryUS_ += std::chrono::duration_cast<std::chrono::microseconds>(tResume - tFailure).count();
+
+                    state->nextOffset_ = committed;
+                    state->resendEnd_ = state->sentEnd_.load();
+                    state->failed_ = false;
+
+                    return UploadChunkRound(state);
+                }
+            );
+        }
+    );
+}
+
+pplx::task<ChunkedUploadStats> ContentService::UploadChunked(
+    const UploadSource& source,
+    const ChunkedUploadOptions& options,
+    std::function<void(const char*)> errorFunc,
+    std::function<void(const wchar_t*)> wErrorFunc)
+{
+    auto state = std::make_shared<ChunkedUploadState>(connection_);
+    if (source.IsGenerated()) {
+        state->data_ = nullptr;
+        state->pattern_ = source.pattern_;
+        state->dataLength_ = source.size_;
+    }
+    else {
+        // chunks are sent straight out of the mapping, the OS reads ahead while we send
+        state->source_ = source.mapping_;
+        if (!state->source_ && source.size_ > 0) {
+            try {
+                state->source_ = std::make_shared<MappedSourceFile>(utility::conversions::to_utf8string(source.fileName_));
+            }
+            catch (const std::exception& e) {
+                errorFunc(e.what());
+                ThroughputStats::RecordError(OPERATION_UPLOAD);
+                return pplx::task_from_result(ChunkedUploadStats());
+            }
+        }
+
+        // an empty file cannot be mapped, it is sent as a single empty chunk
+        state->data_ = state->source_ ? state->source_->Data() : nullptr;
+        state->dataLength_ = state->source_ ? state->source_->Size() : 0;
+    }
+    RecordSourceRead(source.IsMapped(), 0);
+
+    state->chunkSize_ = options.chunkSize_ > 0 ? options.chunkSize_ : DEFAULT_UPLOAD_CHUNK_SIZE;
+    state->chunksInFlight_ = options.chunksInFlight_;
+    state->outOfOrder_ = options.outOfOrder_;
+    state->maxResumes_ = options.maxResumes_;
+    state->nextOffset_ = 0;
+    state->sentEnd_ = 0;
+    state->resendEnd_ = 0;
+    state->resentBytes_ = 0;
+    state->chunks_ = 0;
+    state->failed_ = false;
+    state->completed_ = false;
+    state->errorFunc_ = errorFunc;
+
+    auto hasChecksum = source.hasChecksum_;
+    auto checksum = source.checksum_;
+    auto tStart = std::chrono::steady_clock::now();
+
+    return AcquireBlobUUID(state->dataLength_, errorFunc, wErrorFunc).then(
+        [state](utility::string_t uuid) -> pplx::task<void>
+        {
+            if (uuid.empty()) {
+                throw http_exception(U("Failed to get UUID"));
+            }
+
+            // "/blob/${uuid}/upload?uploadType=resumable"
+            auto query = uri_builder();
+            query.set_path(U("/blob/") + uuid + U("/upload"));
+            query.append_query(U("uploadType"), U("resumable"));
+
+            state->uploadURI_ = query.to_uri();
+            state->stats_.uuid_ = uuid;
+
+            return UploadChunkRound(state);
+        }
+    ).then(
+        [state, tStart, errorFunc, hasChecksum, checksum](pplx::task<void> previousTask) -> ChunkedUploadStats
+        {
+            auto stats = state->stats_;
+            stats.resentBytes_ = state->resentBytes_.load();
+            try {
+                previousTask.get();
+                stats.contentLength_ = static_cast<int64_t>(state->dataLength_);
+                if (hasChecksum) {
+                    state->connection_.Checksums().Record(stats.uuid_, checksum);
+                }
+                ThroughputStats::Record(OPERATION_UPLOAD, state->dataLength_);
+                state->connection_.Metadata().Put(stats.uuid_, state->dataLength_);
+            }
+            catch (const std::exception& e) {
+                errorFunc(e.what());
+                stats.uuid_.clear();
+                ThroughputStats::RecordError(OPERATION_UPLOAD);
+            }
+
+            auto tStop = std::chrono::steady_clock::now();
+            stats.chunks_ = state->chunks_.load();
+            stats.timeUS_ = std::chrono::duration_cast<std::chrono::microseconds>(tStop - tStart).count();
+
+            return stats;
+        }
+    );
+}
+
 pplx::task<web::json::value> ContentService::DownloadAsync(
     const utility::string_t& uuid,
     const utility::string_t& outFileName,
@@ -226,190 +917,472 @@ pplx::task<web::json::value> ContentService::DownloadAsync(
     std::function<void(const wchar_t*)> wErrorFunc,
     const pplx::cancellation_token& token /*= pplx::cancellation_token::none()*/)
 {
-    using Concurrency::streams::file_stream;
-    using Concurrency::streams::streambuf;
-    using Concurrency::streams::file_buffer;
-    
-    auto serverURI = connection_.GetURI();
+    auto service = *this;
 
-    return GetBlobContentLength(serverURI, uuid, errorFunc, wErrorFunc).then(
-    [serverURI, uuid, outFileName, errorFunc, wErrorFunc](pplx::task<int64_t> previousTask) -> pplx::task<web::json::value> 
+    return LookupContentLength(uuid, errorFunc, wErrorFunc).then(
+    [service, uuid, outFileName, errorFunc, wErrorFunc](pplx::task<int64_t> previousTask) mutable -> pplx::task<web::json::value> 
     {
         auto dataLength = previousTask.get();
 
         if (dataLength > -1) {
-            http_client client(serverURI);
-
-            auto query = uri_builder();
-            query.set_path(U("/blob/") + uuid + U("/download"));
-            http_request requestDownload;
-            requestDownload.set_method(web::http::methods::GET);
-            requestDownload.set_request_uri(query.to_uri());
+            return service.DownloadFileAsync(uuid, outFileName, dataLength, true, errorFunc, wErrorFunc);
+        }
+        else {
+            return pplx::task_from_result(web::json::value());
+        }
+    });
+}
 
-            return client.request(requestDownload).then(
-                [dataLength, outFileName, errorFunc, wErrorFunc](pplx::task<web::http::http_response> previousTask) -> pplx::task<web::json::value>
-                {
-                    auto response = previousTask.get();
-                    auto responseJSON = response.extract_json().get();
-                    if (response.status_code() != status_codes::OK) {
-                        wErrorFunc(responseJSON.serialize().c_str());
+pplx::task<web::json::value> ContentService::DownloadFileAsync(
+    const utility::string_t& uuid,
+    const utility::string_t& outFileName,
+    int64_t dataLength,
+    bool retry,
+    std::function<void(const char*)> errorFunc,
+    std::function<void(const wchar_t*)> wErrorFunc)
+{
+    using Concurrency::streams::file_stream;
+    using Concurrency::streams::streambuf;
+    using Concurrency::streams::file_buffer;
+    
+    auto service = *this;
+    auto connection = connection_;
+
+    auto query = uri_builder();
+    query.set_path(U("/blob/") + uuid + U("/download"));
+    http_request requestDownload;
+    requestDownload.set_method(web::http::methods::GET);
+    requestDownload.set_request_uri(query.to_uri());
+    if (connection.compression_.acceptGzip_) {
+        requestDownload.headers().add(header_names::accept_encoding, U("gzip"));
+    }
 
-                        return pplx::task_from_result(web::json::value(CONTENT_SERVICE_TASK_FAIL));
+    auto tStart = PhaseStats::Clock::now();
+    auto traceId = Tracer::NewId();
+    auto timing = std::make_shared<TransferTiming>();
+    timing->sent_ = tStart;
+    return connection.Send(uuid, requestDownload).then(
+        [service, connection, uuid, dataLength, retry, outFileName, errorFunc, wErrorFunc, tStart, traceId, timing](pplx::task<web::http::http_response> previousTask) mutable -> pplx::task<web::json::value>
+        {
+            auto response = previousTask.get();
+            timing->headers_ = PhaseStats::Clock::now();
+            if (response.status_code() != status_codes::OK) {
+                return ReportErrorResponse(response, wErrorFunc);
+            }
+            // a gzip body's Content-Length is its wire length, the decoded length is checked after reading
+            auto compression = IsGzipEncoded(response) ? std::make_shared<CompressionCounters>() : std::shared_ptr<CompressionCounters>();
+            if (!compression && !CheckDownloadLength(connection, uuid, response, dataLength)) {
+                if (!retry) {
+                    errorFunc("contentLength mismatched!");
+                    return pplx::task_from_result(web::json::value(CONTENT_SERVICE_TASK_FAIL));
+                }
+                // the cached length was stale, ask the service and download once more
+                return service.RefreshContentLength(uuid, errorFunc, wErrorFunc).then(
+                    [service, uuid, outFileName, errorFunc, wErrorFunc](int64_t dataLength) mutable -> pplx::task<web::json::value>
+                    {
+                        if (dataLength < 0) {
+                            return pplx::task_from_result(web::json::value(CONTENT_SERVICE_TASK_FAIL));
+                        }
+                        return service.DownloadFileAsync(uuid, outFileName, dataLength, false, errorFunc, wErrorFunc);
                     }
+                );
+            }
 
-                    int64_t downloadDataLength = -1;
-                    try {
-                        streambuf<uint8_t> localFile = file_buffer<uint8_t>::open(outFileName).get();
-                        return response.body().read_to_end(localFile).then(
-                            [dataLength, &downloadDataLength](pplx::task<size_t> previousTask) -> pplx::task<web::json::value>
-                            {
-                                downloadDataLength = previousTask.get();
+            auto tOpen = Tracer::Clock::now();
+            auto openId = Tracer::NewId();
+            return file_buffer<uint8_t>::open(outFileName).then(
+                [connection, uuid, dataLength, response, tStart, traceId, tOpen, openId, timing, compression](streambuf<uint8_t> localFile) -> pplx::task<web::json::value>
+                {
+                    Tracer::Record(TRACE_FILE_OPEN, openId, tOpen);
 
-                                if (downloadDataLength != dataLength) {
-                                    throw http_exception(U("contentLength mismatched!"));
-                                }
+                    auto crc = std::make_shared<uint32_t>(0);
+                    return ReadBody(response, ChecksumStream::Wrap(localFile, crc), timing, compression).then(
+                        [connection, uuid, dataLength, crc, tStart, traceId, timing, compression, localFile](pplx::task<size_t> previousTask) mutable -> pplx::task<web::json::value>
+                        {
+                            int64_t downloadDataLength = previousTask.get();
+                            PhaseStats::Record(PHASE_DOWNLOAD_BODY, tStart);
+                            RecordTransfer(TRANSFER_DOWNLOAD, *timing);
+                            if (compression) {
+                                RecordCompressedDownload(*compression, ElapsedNS(tStart));
+                            }
+                            Tracer::Record(TRACE_DOWNLOAD_BODY, traceId, tStart, downloadDataLength);
 
-                                return pplx::task_from_result(web::json::value(downloadDataLength));
+                            if (downloadDataLength != dataLength) {
+                                connection.Metadata().Erase(uuid);
+                                throw http_exception(U("contentLength mismatched!"));
                             }
-                        );
-                    }
-                    catch (const http_exception& e) {
-                        errorFunc(e.what());
-                    }
-                    catch (...) {
-                        // generic exception
-                    }
 
-                    return pplx::task_from_result(web::json::value(downloadDataLength));
+                            auto verified = true;
+                            if (connection.verifyDownloads_) {
+                                TraceSpan span(TRACE_VERIFY, downloadDataLength);
+                                verified = connection.Checksums().Verify(uuid, *crc);
+                            }
+                            if (!verified) {
+                                throw http_exception(U("checksum mismatched!"));
+                            }
+
+                            // flush here, a failed write surfaces as a failed download
+                            auto tClose = Tracer::Clock::now();
+                            auto closeId = Tracer::NewId();
+                            return localFile.close().then(
+                                [downloadDataLength, tClose, closeId]() -> web::json::value
+                                {
+                                    Tracer::Record(TRACE_FILE_CLOSE, closeId, tClose);
+                                    return web::json::value(downloadDataLength);
+                                }
+                            );
+                        }
+                    );
                 }
             );
         }
-        else {
-            return pplx::task_from_result(web::json::value());
-        }
-    });
+    );
 }
 
 pplx::task<web::json::value> ContentService::DownloadAsync(
     const utility::string_t& uuid,
-    uint8_t* data,
+    std::shared_ptr<PooledBuffer> buffer,
     std::function<void(const char*)> errorFunc,
     std::function<void(const wchar_t*)> wErrorFunc,
     const pplx::cancellation_token& token /*= pplx::cancellation_token::none()*/)
 {
-    using Concurrency::streams::file_stream;
-    using Concurrency::streams::streambuf;
-    using Concurrency::streams::file_buffer;
-
-    auto serverURI = connection_.GetURI();
+    auto service = *this;
 
-    auto outData = std::make_shared<uint8_t*>(data);
-
-    return GetBlobContentLength(serverURI, uuid, errorFunc, wErrorFunc).then(
-        [serverURI,uuid,outData,errorFunc,wErrorFunc](pplx::task<int64_t> previousTask) -> pplx::task<web::json::value> 
+    return LookupContentLength(uuid, errorFunc, wErrorFunc).then(
+        [service,uuid,buffer,errorFunc,wErrorFunc](pplx::task<int64_t> previousTask) mutable -> pplx::task<web::json::value> 
         {
             auto dataLength = previousTask.get();
 
             if (dataLength > -1) {
-                http_client client(serverURI);
+                return service.DownloadBufferAsync(uuid, buffer, dataLength, true, errorFunc, wErrorFunc);
+            } else {
+                return pplx::task_from_result(web::json::value());
+            }
+        }
+    );
+}
 
-                auto query = uri_builder();
-                query.set_path(U("/blob/") + uuid + U("/download"));
-                http_request requestDownload;
-                requestDownload.set_method(web::http::methods::GET);
-                requestDownload.set_request_uri(query.to_uri());
+pplx::task<web::json::value> ContentService::DownloadBufferAsync(
+    const utility::string_t& uuid,
+    std::shared_ptr<PooledBuffer> buffer,
+    int64_t dataLength,
+    bool retry,
+    std::function<void(const char*)> errorFunc,
+    std::function<void(const wchar_t*)> wErrorFunc)
+{
+    auto service = *this;
+    auto connection = connection_;
+    auto outData = buffer;
+
+    auto query = uri_builder();
+    query.set_path(U("/blob/") + uuid + U("/download"));
+    http_request requestDownload;
+    requestDownload.set_method(web::http::methods::GET);
+    requestDownload.set_request_uri(query.to_uri());
+    if (connection.compression_.acceptGzip_) {
+        requestDownload.headers().add(header_names::accept_encoding, U("gzip"));
+    }
 
-                return client.request(requestDownload).then(
-                    [dataLength,outData,errorFunc,wErrorFunc](pplx::task<web::http::http_response> previousTask) -> pplx::task<web::json::value>
+    auto tStart = PhaseStats::Clock::now();
+    auto traceId = Tracer::NewId();
+    auto timing = std::make_shared<TransferTiming>();
+    timing->sent_ = tStart;
+    return connection.Send(uuid, requestDownload).then(
+        [service,connection,uuid,dataLength,retry,outData,errorFunc,wErrorFunc,tStart,traceId,timing](pplx::task<web::http::http_response> previousTask) mutable -> pplx::task<web::json::value>
+        {
+            auto response = previousTask.get();
+            timing->headers_ = PhaseStats::Clock::now();
+            if (response.status_code() != status_codes::OK) {
+                return ReportErrorResponse(response, wErrorFunc);
+            }
+            auto compression = IsGzipEncoded(response) ? std::make_shared<CompressionCounters>() : std::shared_ptr<CompressionCounters>();
+            if (!compression && !CheckDownloadLength(connection, uuid, response, dataLength)) {
+                if (!retry) {
+                    errorFunc("contentLength mismatched!");
+                    return pplx::task_from_result(web::json::value(CONTENT_SERVICE_TASK_FAIL));
+                }
+                // the cached length was stale, ask the service and download once more
+                return service.RefreshContentLength(uuid, errorFunc, wErrorFunc).then(
+                    [service, uuid, outData, errorFunc, wErrorFunc](int64_t dataLength) mutable -> pplx::task<web::json::value>
                     {
-                        auto response = previousTask.get();
-                        auto responseJSON = response.extract_json().get();
-                        if (response.status_code() != status_codes::OK) {
-                            wErrorFunc(responseJSON.serialize().c_str());
-
+                        if (dataLength < 0) {
                             return pplx::task_from_result(web::json::value(CONTENT_SERVICE_TASK_FAIL));
                         }
+                        return service.DownloadBufferAsync(uuid, outData, dataLength, false, errorFunc, wErrorFunc);
+                    }
+                );
+            }
 
-                        int64_t downloadDataLength = -1;
-                        try {
-                            *outData = new uint8_t[dataLength];
-                            rawptr_buffer<uint8_t> rawOutputBuffer(*outData, dataLength);
-                            return response.body().read_to_end(rawOutputBuffer).then(
-                                [dataLength, &downloadDataLength](pplx::task<size_t> previousTask) -> pplx::task<web::json::value>
-                            {
-                                downloadDataLength = previousTask.get();
-
-                                if (downloadDataLength != dataLength) {
-                                    throw http_exception(U("contentLength mismatched!"));
-                                }
+            try {
+                *outData = connection.Buffers().Acquire(static_cast<size_t>(dataLength));
+                rawptr_buffer<uint8_t> rawOutputBuffer(outData->Data(), static_cast<size_t>(dataLength), std::ios::out);
+                auto crc = std::make_shared<uint32_t>(0);
+                return ReadBody(response, ChecksumStream::Wrap(rawOutputBuffer, crc), timing, compression).then(
+                    [connection, uuid, dataLength, crc, tStart, traceId, timing, compression](pplx::task<size_t> previousTask) -> pplx::task<web::json::value>
+                {
+                    int64_t downloadDataLength = previousTask.get();
+                    PhaseStats::Record(PHASE_DOWNLOAD_BODY, tStart);
+                    RecordTransfer(TRANSFER_DOWNLOAD, *timing);
+                    if (compression) {
+                        RecordCompressedDownload(*compression, ElapsedNS(tStart));
+                    }
+                    Tracer::Record(TRACE_DOWNLOAD_BODY, traceId, tStart, downloadDataLength);
 
-                                return pplx::task_from_result(web::json::value(downloadDataLength));
-                            }
-                            );
-                        }
-                        catch (const http_exception& e) {
-                            errorFunc(e.what());
-                        }
-                        catch (...) {
-                            // generic exception
-                        }
+                    if (downloadDataLength != dataLength) {
+                        connection.Metadata().Erase(uuid);
+                        throw http_exception(U("contentLength mismatched!"));
+                    }
 
-                        return pplx::task_from_result(web::json::value(downloadDataLength));
+                    auto verified = true;
+                    if (connection.verifyDownloads_) {
+                        TraceSpan span(TRACE_VERIFY, downloadDataLength);
+                        verified = connection.Checksums().Verify(uuid, *crc);
+                    }
+                    if (!verified) {
+                        throw http_exception(U("checksum mismatched!"));
                     }
+
+                    return pplx::task_from_result(web::json::value(downloadDataLength));
+                }
                 );
-            } else {
-                return pplx::task_from_result(web::json::value());
             }
+            catch (const std::bad_alloc&) {
+                // the buffer pool could not map the memory
+                errorFunc("Failed to allocate the download buffer");
+            }
+            catch (const std::exception& e) {
+                errorFunc(e.what());
+            }
+
+            return pplx::task_from_result(web::json::value(CONTENT_SERVICE_TASK_FAIL));
         }
     );
 }
 
-int64_t ContentService::Download(
+pplx::task<RangedDownloadStats> ContentService::DownloadRangesAsync(
     const utility::string_t& uuid,
-    const utility::string_t& outFileName,
+    uint8_t* data,
+    int64_t dataLength,
+    const RangedDownloadOptions& options,
     std::function<void(const char*)> errorFunc,
     std::function<void(const wchar_t*)> wErrorFunc)
 {
-    int64_t dataLength = -1;
-    try {
-        DownloadAsync(uuid, outFileName, errorFunc, wErrorFunc).then(
-            [&dataLength](pplx::task<web::json::value> previousTask) -> int64_t {
-                auto result = previousTask.get();
-                dataLength = result.as_integer();
-                return dataLength;
+    auto query = uri_builder();
+    query.set_path(U("/blob/") + uuid + U("/download"));
+
+    auto state = std::make_shared<RangedDownloadState>(connection_);
+    state->uuid_ = uuid;
+    state->downloadURI_ = query.to_uri();
+    state->data_ = data;
+    state->dataLength_ = static_cast<uint64_t>(dataLength);
+    state->chunkSize_ = options.chunkSize_ > 0 ? options.chunkSize_ : DEFAULT_DOWNLOAD_CHUNK_SIZE;
+    state->numChunks_ = static_cast<size_t>((state->dataLength_ + state->chunkSize_ - 1) / state->chunkSize_);
+    state->nextChunk_ = 0;
+    state->failed_ = false;
+    state->chunks_.resize(state->numChunks_);
+    state->chunkChecksums_.resize(state->numChunks_);
+    state->errorFunc_ = errorFunc;
+
+    auto tStart = std::chrono::steady_clock::now();
+
+    auto numStreams = std::min(std::max(options.streams_, static_cast<size_t>(1)), state->numChunks_);
+    std::vector<pplx::task<void>> streamTasks;
+    for (size_t i = 0; i < numStreams; ++i) {
+        streamTasks.push_back(DownloadNextChunk(state));
+    }
+
+    return pplx::when_all(begin(streamTasks), end(streamTasks)).then(
+        [state, uuid, tStart]() -> RangedDownloadStats
+        {
+            auto tStop = std::chrono::steady_clock::now();
+
+            RangedDownloadStats stats;
+            stats.timeUS_ = std::chrono::duration_cast<std::chrono::microseconds>(tStop - tStart).count();
+            if (!state->failed_.load()) {
+                auto verified = true;
+                if (state->connection_.verifyDownloads_) {
+                    TraceSpan span(TRACE_VERIFY);
+                    uint32_t crc = 0;
+                    for (size_t i = 0; i < state->chunks_.size(); ++i) {
+                        crc = Crc32cCombine(crc, state->chunkChecksums_[i], state->chunks_[i].length_);
+                    }
+                    verified = state->connection_.Checksums().Verify(uuid, crc);
+                }
+                if (!verified) {
+                    state->errorFunc_("checksum mismatched!");
+                    return stats;
+                }
+
+                stats.contentLength_ = static_cast<int64_t>(state->dataLength_);
+                stats.chunks_.swap(state->chunks_);
             }
-        ).wait();
 
-        return dataLength;
+            return stats;
+        }
+    );
+}
+
+/**
+ * \brief Counts a finished ranged download, a failed task counts as a failed download
+ */
+static RangedDownloadStats CountRangedDownload(pplx::task<RangedDownloadStats> previousTask, const std::function<void(const char*)>& errorFunc) {
+    RangedDownloadStats stats;
+    try {
+        stats = previousTask.get();
     }
-    catch (http_exception const& e) {
+    catch (const std::exception& e) {
         errorFunc(e.what());
+    }
 
-        return CONTENT_SERVICE_TASK_FAIL;
+    return CountDownload(stats);
+}
+
+/**
+ * \brief Counts a finished single-stream download, a failed task counts as a failed download
+ */
+static int64_t CountDownload(pplx::task<web::json::value> previousTask, const std::function<void(const char*)>& errorFunc) {
+    try {
+        auto result = previousTask.get();
+        if (result.is_number() && result.as_number().to_int64() >= 0) {
+            return CountDownload(result.as_number().to_int64());
+        }
+    }
+    catch (const std::exception& e) {
+        errorFunc(e.what());
     }
+
+    return CountDownload(CONTENT_SERVICE_TASK_FAIL);
 }
 
-int64_t ContentService::Download(
+pplx::task<RangedDownloadStats> ContentService::DownloadRanged(
     const utility::string_t& uuid,
-    uint8_t* data,
+    const utility::string_t& outFileName,
+    const RangedDownloadOptions& options,
     std::function<void(const char*)> errorFunc,
     std::function<void(const wchar_t*)> wErrorFunc)
 {
-    int64_t dataLength = -1;
-    try {
-        DownloadAsync(uuid, data, errorFunc, wErrorFunc).then(
-            [&dataLength](pplx::task<web::json::value> previousTask) -> int64_t {
-            auto result = previousTask.get();
-            dataLength = result.as_integer();
-            return dataLength;
+    namespace io = boost::iostreams;
+
+    auto service = *this;
+    return LookupContentLength(uuid, errorFunc, wErrorFunc).then(
+        [service, uuid, outFileName, options, errorFunc, wErrorFunc](int64_t dataLength) mutable -> pplx::task<RangedDownloadStats>
+        {
+            RangedDownloadStats stats;
+            if (dataLength < 0) {
+                return pplx::task_from_result(stats);
+            }
+
+            auto fileName = utility::conversions::to_utf8string(outFileName);
+            if (dataLength == 0) {
+                // nothing to map, an empty file is the whole download
+                std::ofstream emptyFile(fileName.c_str(), std::ios::binary | std::ios::trunc);
+                stats.contentLength_ = 0;
+                return pplx::task_from_result(stats);
+            }
+
+            // preallocate the output file and let every range write into its slice
+            io::mapped_file_params params(fileName);
+            params.flags = io::mapped_file::readwrite;
+            params.new_file_size = dataLength;
+            std::shared_ptr<io::mapped_file> outFile;
+            {
+                TraceSpan span(TRACE_FILE_OPEN, dataLength);
+                outFile = std::make_shared<io::mapped_file>(params);
+            }
+
+            auto data = reinterpret_cast<uint8_t*>(outFile->data());
+            return service.DownloadRangesAsync(uuid, data, dataLength, options, errorFunc, wErrorFunc).then(
+                [outFile](RangedDownloadStats stats) -> RangedDownloadStats
+                {
+                    TraceSpan span(TRACE_FILE_CLOSE, outFile->size());
+                    outFile->close();
+                    return stats;
+                }
+            );
+        }
+    ).then(
+        [errorFunc](pplx::task<RangedDownloadStats> previousTask) -> RangedDownloadStats
+        {
+            return CountRangedDownload(previousTask, errorFunc);
+        }
+    );
+}
+
+pplx::task<RangedDownloadStats> ContentService::DownloadRanged(
+    const utility::string_t& uuid,
+    std::shared_ptr<PooledBuffer> buffer,
+    const RangedDownloadOptions& options,
+    std::function<void(const char*)> errorFunc,
+    std::function<void(const wchar_t*)> wErrorFunc)
+{
+    auto service = *this;
+    return LookupContentLength(uuid, errorFunc, wErrorFunc).then(
+        [service, uuid, buffer, options, errorFunc, wErrorFunc](int64_t dataLength) mutable -> pplx::task<RangedDownloadStats>
+        {
+            RangedDownloadStats stats;
+            if (dataLength < 0) {
+                return pplx::task_from_result(stats);
+            }
+
+            *buffer = service.connection_.Buffers().Acquire(static_cast<size_t>(dataLength));
+            if (dataLength == 0) {
+                stats.contentLength_ = 0;
+                return pplx::task_from_result(stats);
+            }
+
+            return service.DownloadRangesAsync(uuid, buffer->Data(), dataLength, options, errorFunc, wErrorFunc).then(
+                [buffer](RangedDownloadStats stats) -> RangedDownloadStats
+                {
+                    return stats;
+                }
+            );
+        }
+    ).then(
+        [errorFunc](pplx::task<RangedDownloadStats> previousTask) -> RangedDownloadStats
+        {
+            return CountRangedDownload(previousTask, errorFunc);
         }
-        ).wait();
+    );
+}
+
+pplx::task<int64_t> ContentService::Download(
+    const utility::string_t& uuid,
+    const utility::string_t& outFileName,
+    std::function<void(const char*)> errorFunc,
+    std::function<void(const wchar_t*)> wErrorFunc)
+{
+    try {
+        return DownloadAsync(uuid, outFileName, errorFunc, wErrorFunc).then(
+            [errorFunc](pplx::task<web::json::value> previousTask) -> int64_t {
+                return CountDownload(previousTask, errorFunc);
+            }
+        );
+    }
+    catch (const std::exception& e) {
+        errorFunc(e.what());
+    }
+
+    return pplx::task_from_result(CountDownload(CONTENT_SERVICE_TASK_FAIL));
+}
+
+pplx::task<int64_t> ContentService::Download(
+    const utility::string_t& uuid,
+    std::shared_ptr<PooledBuffer> buffer,
+    std::function<void(const char*)> errorFunc,
+    std::function<void(const wchar_t*)> wErrorFunc)
+{
+    try {
+        return DownloadAsync(uuid, buffer, errorFunc, wErrorFunc).then(
+            [errorFunc](pplx::task<web::json::value> previousTask) -> int64_t {
+                return CountDownload(previousTask, errorFunc);
+            }
+        );
     }
-    catch (http_exception const& e) {
+    catch (const std::exception& e) {
         errorFunc(e.what());
     }
 
-    return CONTENT_SERVICE_TASK_FAIL;
+    return pplx::task_from_result(CountDownload(CONTENT_SERVICE_TASK_FAIL));
 }
 
 } // namespace TestClient
@@ -0,0 +1,217 @@
+#include "endpointrouter.h"
+#include "miscutils.h"
+#include "tracing.h"
+
+#include <algorithm>
+
+using namespace web::http;
+
+namespace TestClient {
+
+// slots handed to endpoints, never reused so a thread's entry for a gone endpoint stays unused
+static std::atomic<size_t> nextEndpointSlot(0);
+
+// each thread's latency histogram of every endpoint with a slot, owned by the endpoint
+static TESTCLIENT_THREAD_LOCAL LatencyHistogram* threadEndpointLatency[Endpoint::MAX_SLOTS];
+
+/**
+ * \brief 64-bit FNV-1a, stable across processes unlike std::hash
+ *
+ * ASCII code units hash as one byte, so narrow and wide builds agree on uuids and URIs.
+ */
+static uint64_t HashString(const utility::string_t& value) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < value.size(); ++i) {
+        auto c = static_cast<uint64_t>(value[i]) & ((uint64_t(1) << (8 * sizeof(value[i]))) - 1);
+        do {
+            hash ^= c & 0xFF;
+            hash *= 0x100000001B3ULL;
+            c >>= 8;
+        } while (c != 0);
+    }
+    return hash;
+}
+
+RoutingPolicy RoutingPolicyFromName(const std::string& name) {
+    if (name == "round-robin") {
+        return ROUTING_ROUND_ROBIN;
+    }
+    if (name == "least-outstanding") {
+        return ROUTING_LEAST_OUTSTANDING;
+    }
+    if (name == "consistent-hash") {
+        return ROUTING_CONSISTENT_HASH;
+    }
+    return NUM_ROUTING_POLICIES;
+}
+
+Endpoint::Endpoint(const utility::string_t& uri, size_t poolSize)
+    : pool_(uri, poolSize),
+    outstanding_(0),
+    requests_(0),
+    failures_(0),
+    slot_(nextEndpointSlot.fetch_add(1)),
+    latency_(utility::conversions::to_utf8string(uri))
+{ }
+
+void Endpoint::RecordLatency(uint64_t latencyNS) {
+    if (slot_ >= MAX_SLOTS) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        latency_.Record(latencyNS);
+        return;
+    }
+
+    auto& histogram = threadEndpointLatency[slot_];
+    if (histogram == nullptr) {
+        std::unique_ptr<LatencyHistogram> local(new LatencyHistogram(latency_.Name()));
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        histogram = local.get();
+        threadLatency_.push_back(std::move(local));
+    }
+    histogram->Record(latencyNS);
+}
+
+pplx::task<http_response> Endpoint::Send(const http_request& request) {
+    outstanding_.fetch_add(1, std::memory_order_relaxed);
+    requests_.fetch_add(1, std::memory_order_relaxed);
+    auto tStart = Clock::now();
+    auto traceId = Tracer::NewId();
+
+    // the router keeps the endpoint alive until every response is handled
+    return Client()->request(request).then(
+        [this, tStart, traceId](pplx::task<http_response> previousTask) -> http_response
+        {
+            auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - tStart).count();
+            outstanding_.fetch_sub(1, std::memory_order_relaxed);
+            Tracer::Record(TRACE_RESPONSE_HEADERS, traceId, tStart);
+            RecordLatency(static_cast<uint64_t>(latency > 0 ? latency : 0));
+
+            try {
+                auto response = previousTask.get();
+                if (response.status_code() >= 400) {
+                    failures_.fetch_add(1, std::memory_order_relaxed);
+                }
+                return response;
+            }
+            catch (...) {
+                failures_.fetch_add(1, std::memory_order_relaxed);
+                throw;
+            }
+        }
+    );
+}
+
+LatencyHistogram Endpoint::Latency() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    LatencyHistogram merged(latency_);
+    for (size_t i = 0; i < threadLatency_.size(); ++i) {
+        merged.Merge(*threadLatency_[i]);
+    }
+
+    return merged;
+}
+
+EndpointRouter::EndpointRouter(const std::vector<utility::string_t>& uris, size_t poolSize, RoutingPolicy policy)
+    : policy_(policy),
+    next_(0)
+{
+    for (size_t i = 0; i < uris.size(); ++i) {
+        endpoints_.push_back(std::unique_ptr<Endpoint>(new Endpoint(uris[i], poolSize)));
+
+        for (size_t v = 0; v < VIRTUAL_NODES; ++v) {
+            utility::stringstream_t ss;
+            ss << uris[i] << U("#") << v;
+            ring_.push_back(std::make_pair(HashString(ss.str()), i));
+        }
+    }
+    std::sort(ring_.begin(), ring_.end());
+}
+
+size_t EndpointRouter::NextRoundRobin() {
+    return next_.fetch_add(1, std::memory_order_relaxed) % endpoints_.size();
+}
+
+size_t EndpointRouter::RingOwner(uint64_t hash) const {
+    auto point = std::make_pair(hash, size_t(0));
+    auto iter = std::lower_bound(ring_.begin(), ring_.end(), point);
+    if (iter == ring_.end()) {
+        iter = ring_.begin();
+    }
+    return iter->second;
+}
+
+Endpoint& EndpointRouter::Select(const utility::string_t& uuid) {
+    return *endpoints_[SelectIndex(uuid)];
+}
+
+size_t EndpointRouter::SelectIndex(const utility::string_t& uuid) {
+    if (endpoints_.size() == 1) {
+        return 0;
+    }
+
+    if (policy_ == ROUTING_CONSISTENT_HASH && !uuid.empty()) {
+        auto hash = HashString(uuid);
+        auto& shard = creators_[hash % CREATOR_SHARDS];
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex_);
+            auto iter = shard.creators_.find(uuid);
+            if (iter != shard.creators_.end()) {
+                return iter->second;
+            }
+        }
+        return RingOwner(hash);
+    }
+
+    if (policy_ == ROUTING_LEAST_OUTSTANDING) {
+        // start the scan at a rotating offset so ties spread evenly
+        auto start = NextRoundRobin();
+        auto best = start;
+        for (size_t i = 1; i < endpoints_.size(); ++i) {
+            auto index = (start + i) % endpoints_.size();
+            if (endpoints_[index]->Outstanding() < endpoints_[best]->Outstanding()) {
+                best = index;
+            }
+        }
+        return best;
+    }
+
+    return NextRoundRobin();
+}
+
+pplx::task<http_response> EndpointRouter::Send(const utility::string_t& uuid, const http_request& request) {
+    auto self = shared_from_this();
+    return Select(uuid).Send(request).then(
+        [self](http_response response) -> http_response {
+            return response;
+        }
+    );
+}
+
+pplx::task<std::pair<http_response, size_t>> EndpointRouter::SendCreate(const http_request& request) {
+    auto self = shared_from_this();
+    auto index = SelectIndex(utility::string_t());
+    return endpoints_[index]->Send(request).then(
+        [self, index](http_response response) -> std::pair<http_response, size_t> {
+            return std::make_pair(response, index);
+        }
+    );
+}
+
+void EndpointRouter::AssignCreator(const utility::string_t& uuid, size_t endpoint) {
+    if (policy_ != ROUTING_CONSISTENT_HASH || endpoints_.size() == 1 || uuid.empty()) {
+        return;
+    }
+
+    // the ring already sends the blob to its creator, keep the map to the others
+    auto hash = HashString(uuid);
+    if (RingOwner(hash) == endpoint) {
+        return;
+    }
+
+    auto& shard = creators_[hash % CREATOR_SHARDS];
+    std::lock_guard<std::mutex> lock(shard.mutex_);
+    shard.creators_[uuid] = endpoint;
+}
+
+} // namespace TestClient
@@ -0,0 +1,25 @@
+#include "httpclientpool.h"
+
+using namespace web::http::client;
+
+namespace TestClient {
+
+HttpClientPool::HttpClientPool(const utility::string_t& uri, size_t size)
+    : uri_(uri),
+    clients_(size > 0 ? size : 1),
+    next_(0),
+    acquires_(0)
+{
+    for (size_t i = 0; i < clients_.size(); ++i) {
+        clients_[i] = std::make_shared<http_client>(uri_);
+    }
+}
+
+std::shared_ptr<http_client> HttpClientPool::Acquire() {
+    auto index = next_.fetch_add(1, std::memory_order_relaxed) % clients_.size();
+    acquires_.fetch_add(1, std::memory_order_relaxed);
+
+    return clients_[index];
+}
+
+} // namespace TestClient
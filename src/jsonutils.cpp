@@ -18,4 +18,33 @@ web::json::value JsonCreateBlob(uint64_t size) {
     return blob;
 }
 
+utility::string_t JsonUnquote(const web::json::value& value) {
+    if (!value.is_string()) {
+        return utility::string_t();
+    }
+
+    return value.as_string();
+}
+
+web::json::value JsonBlob(const utility::string_t& id, uint64_t size) {
+    auto blob = JsonCreateBlob(size);
+    blob[U("data")][U("id")] = web::json::value::string(id);
+
+    return blob;
+}
+
+web::json::value JsonError(web::http::status_code status, const utility::string_t& title) {
+    web::json::value error = web::json::value::object(true);
+    error[U("status")] = web::json::value::number(static_cast<int32_t>(status));
+    error[U("title")] = web::json::value::string(title);
+
+    web::json::value errors = web::json::value::array(1);
+    errors[0] = error;
+
+    web::json::value document = web::json::value::object(true);
+    document[U("errors")] = errors;
+
+    return document;
+}
+
 } // namespace TestClient
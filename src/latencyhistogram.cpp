@@ -0,0 +1,291 @@
+#include "latencyhistogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <vector>
+
+namespace TestClient {
+
+/**
+ * \brief Position of the most significant set bit, value must not be 0
+ */
+static int MostSignificantBit(uint64_t value) {
+    int msb = 0;
+    while (value >>= 1) {
+        ++msb;
+    }
+    return msb;
+}
+
+LatencyHistogram::LatencyHistogram(const std::string& name /*= std::string()*/)
+    : name_(name)
+{
+    Reset();
+}
+
+LatencyHistogram::LatencyHistogram(const LatencyHistogram& other)
+    : name_(other.name_)
+{
+    Reset();
+    Merge(other);
+}
+
+LatencyHistogram& LatencyHistogram::operator=(const LatencyHistogram& other) {
+    if (this != &other) {
+        name_ = other.name_;
+        Reset();
+        Merge(other);
+    }
+    return *this;
+}
+
+size_t LatencyHistogram::IndexOf(uint64_t value) {
+    if (value < SUB_BUCKETS) {
+        return static_cast<size_t>(value);
+    }
+
+    // value >> shift lands in [HALF_SUB_BUCKETS, SUB_BUCKETS)
+    auto shift = MostSignificantBit(value) - SUB_BUCKET_BITS + 1;
+    return static_cast<size_t>(shift) * HALF_SUB_BUCKETS + static_cast<size_t>(value >> shift);
+}
+
+uint64_t LatencyHistogram::LowestValueAt(size_t index) {
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+
+    auto shift = index / HALF_SUB_BUCKETS - 1;
+    auto subBucket = index - shift * HALF_SUB_BUCKETS;
+    return static_cast<uint64_t>(subBucket) << shift;
+}
+
+uint64_t LatencyHistogram::HighestValueAt(size_t index) {
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+
+    auto shift = index / HALF_SUB_BUCKETS - 1;
+    return LowestValueAt(index) + ((uint64_t(1) << shift) - 1);
+}
+
+void LatencyHistogram::Record(uint64_t value) {
+    // single writer: plain read-modify-write, atomics only keep readers tear-free
+    auto& count = counts_[IndexOf(value)];
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    totalCount_.store(totalCount_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    sum_.store(sum_.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    if (value < min_.load(std::memory_order_relaxed)) {
+        min_.store(value, std::memory_order_relaxed);
+    }
+    if (value > max_.load(std::memory_order_relaxed)) {
+        max_.store(value, std::memory_order_relaxed);
+    }
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+        auto count = other.counts_[i].load(std::memory_order_relaxed);
+        if (count > 0) {
+            counts_[i].fetch_add(count, std::memory_order_relaxed);
+        }
+    }
+    totalCount_.fetch_add(other.totalCount_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    sum_.fetch_add(other.sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+    auto otherMin = other.min_.load(std::memory_order_relaxed);
+    auto currentMin = min_.load(std::memory_order_relaxed);
+    while (otherMin < currentMin && !min_.compare_exchange_weak(currentMin, otherMin)) { }
+
+    auto otherMax = other.max_.load(std::memory_order_relaxed);
+    auto currentMax = max_.load(std::memory_order_relaxed);
+    while (otherMax > currentMax && !max_.compare_exchange_weak(currentMax, otherMax)) { }
+}
+
+void LatencyHistogram::CopyTo(std::atomic<uint64_t>* raw) const {
+    for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+        raw[i].store(counts_[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    raw[NUM_BUCKETS].store(totalCount_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    raw[NUM_BUCKETS + 1].store(sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    raw[NUM_BUCKETS + 2].store(min_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    raw[NUM_BUCKETS + 3].store(max_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void LatencyHistogram::Merge(const std::atomic<uint64_t>* raw) {
+    // nothing copied yet, the zero min would stick
+    if (raw[NUM_BUCKETS].load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+
+    LatencyHistogram other;
+    for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+        other.counts_[i].store(raw[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    other.totalCount_.store(raw[NUM_BUCKETS].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    other.sum_.store(raw[NUM_BUCKETS + 1].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    other.min_.store(raw[NUM_BUCKETS + 2].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    other.max_.store(raw[NUM_BUCKETS + 3].load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+    Merge(other);
+}
+
+void LatencyHistogram::Reset() {
+    for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+        counts_[i].store(0, std::memory_order_relaxed);
+    }
+    totalCount_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    min_.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Min() const {
+    return TotalCount() > 0 ? min_.load(std::memory_order_relaxed) : 0;
+}
+
+double LatencyHistogram::Mean() const {
+    auto count = TotalCount();
+    return count > 0 ? (double)sum_.load(std::memory_order_relaxed) / (double)count : 0.0;
+}
+
+uint64_t LatencyHistogram::ValueAtPercentile(double percentile) const {
+    auto total = TotalCount();
+    if (total == 0) {
+        return 0;
+    }
+
+    percentile = std::min(std::max(percentile, 0.0), 100.0);
+    auto target = static_cast<uint64_t>(std::ceil(percentile / 100.0 * (double)total));
+    target = std::max<uint64_t>(target, 1);
+
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+        cumulative += counts_[i].load(std::memory_order_relaxed);
+        if (cumulative >= target) {
+            return std::min(HighestValueAt(i), Max());
+        }
+    }
+
+    return Max();
+}
+
+void LatencyHistogram::Save(std::ostream& os) const {
+    std::vector<size_t> nonEmpty;
+    for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+        if (counts_[i].load(std::memory_order_relaxed) > 0) {
+            nonEmpty.push_back(i);
+        }
+    }
+
+    os << "histogram " << (name_.empty() ? std::string("-") : name_)
+        << " " << TotalCount()
+        << " " << sum_.load(std::memory_order_relaxed)
+        << " " << Min()
+        << " " << Max()
+        << " " << nonEmpty.size() << "\n";
+    for (size_t i = 0; i < nonEmpty.size(); ++i) {
+        os << nonEmpty[i] << " " << counts_[nonEmpty[i]].load(std::memory_order_relaxed) << "\n";
+    }
+}
+
+bool LatencyHistogram::Load(std::istream& is) {
+    std::string tag, name;
+    uint64_t totalCount = 0, sum = 0, minValue = 0, maxValue = 0;
+    size_t numBuckets = 0;
+    if (!(is >> tag >> name >> totalCount >> sum >> minValue >> maxValue >> numBuckets) || tag != "histogram") {
+        return false;
+    }
+
+    Reset();
+    name_ = (name == "-") ? std::string() : name;
+    for (size_t i = 0; i < numBuckets; ++i) {
+        size_t index = 0;
+        uint64_t count = 0;
+        if (!(is >> index >> count) || index >= NUM_BUCKETS) {
+            return false;
+        }
+        counts_[index].store(count, std::memory_order_relaxed);
+    }
+
+    totalCount_.store(totalCount, std::memory_order_relaxed);
+    sum_.store(sum, std::memory_order_relaxed);
+    min_.store(totalCount > 0 ? minValue : std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+    max_.store(maxValue, std::memory_order_relaxed);
+
+    return true;
+}
+
+bool SaveHistograms(const std::string& filePath, const std::vector<LatencyHistogram>& histograms) {
+    std::ofstream ofs(filePath.c_str(), std::ios::trunc);
+    if (!ofs) {
+        return false;
+    }
+
+    for (size_t i = 0; i < histograms.size(); ++i) {
+        histograms[i].Save(ofs);
+    }
+
+    return static_cast<bool>(ofs);
+}
+
+bool LoadHistograms(const std::string& filePath, std::vector<LatencyHistogram>& histograms) {
+    std::ifstream ifs(filePath.c_str());
+    if (!ifs) {
+        return false;
+    }
+
+    // only running out of input before a histogram header is a clean end,
+    // a file truncated inside a histogram fails instead of dropping it
+    LatencyHistogram histogram;
+    while (!(ifs >> std::ws).eof()) {
+        if (!histogram.Load(ifs)) {
+            return false;
+        }
+
+        auto iter = std::find_if(histograms.begin(), histograms.end(),
+            [&histogram](const LatencyHistogram& h) { return h.Name() == histogram.Name(); });
+        if (iter != histograms.end()) {
+            iter->Merge(histogram);
+        }
+        else {
+            histograms.push_back(histogram);
+        }
+    }
+
+    return true;
+}
+
+void PrintPercentileHeader(std::wostream& os) {
+    os << std::left << std::setw(16) << L"phase" << std::right
+        << std::setw(10) << L"count"
+        << std::setw(12) << L"min(us)"
+        << std::setw(12) << L"p50(us)"
+        << std::setw(12) << L"p90(us)"
+        << std::setw(12) << L"p99(us)"
+        << std::setw(12) << L"p99.9(us)"
+        << std::setw(12) << L"max(us)"
+        << std::setw(12) << L"mean(us)" << std::endl;
+}
+
+void PrintPercentiles(std::wostream& os, const LatencyHistogram& histogram) {
+    const auto& name = histogram.Name();
+    auto toUS = [](double ns) { return ns / 1000.0; };
+
+    os << std::left << std::setw(16) << std::wstring(name.begin(), name.end()) << std::right
+        << std::setw(10) << histogram.TotalCount()
+        << std::fixed << std::setprecision(1)
+        << std::setw(12) << toUS((double)histogram.Min())
+        << std::setw(12) << toUS((double)histogram.ValueAtPercentile(50.0))
+        << std::setw(12) << toUS((double)histogram.ValueAtPercentile(90.0))
+        << std::setw(12) << toUS((double)histogram.ValueAtPercentile(99.0))
+        << std::setw(12) << toUS((double)histogram.ValueAtPercentile(99.9))
+        << std::setw(12) << toUS((double)histogram.Max())
+        << std::setw(12) << toUS(histogram.Mean())
+        << std::endl;
+    os.unsetf(std::ios::floatfield);
+}
+
+} // namespace TestClient
@@ -1,15 +1,35 @@
 #include "testparameters.h"
 #include "contentservice.h"
 #include "miscutils.h"
+#include "phasestats.h"
+#include "openloop.h"
+#include "throughputstats.h"
+#include "manifest.h"
+#include "mixedworkload.h"
+#include "pipeline.h"
+#include "sweep.h"
+#include "asyncsemaphore.h"
+#include "workergroup.h"
+#include "taskscheduler.h"
+#include "tracing.h"
+#include "transfertiming.h"
 
 #include <ppltasks.h>
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <string>
 #include <iostream>
 #include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <map>
+#include <thread>
 
 #if _WIN32
 #include <conio.h>
+#else
+#include <csignal>
 #endif
 
 using namespace std;
@@ -29,6 +49,48 @@ void GetInputDataFiles(const utility::string_t& dataPath,
     }
 }
 
+/**
+ * \brief Builds the upload source of every scenario entry
+ *
+ * Entries given by file are read from dataPath, entries given by size share one
+ * generated pattern. With mapSources every file is mapped once for all its uploads.
+ */
+void GetUploadSources(const utility::string_t& dataPath,
+                      const std::vector<utility::string_t>& fileNames,
+                      const std::vector<uint64_t>& dataSizes,
+                      PayloadType payloadType,
+                      uint64_t payloadSeed,
+                      bool mapSources,
+                      std::vector<UploadSource>& sources)
+{
+    std::vector<utility::string_t> dataFiles;
+    GetInputDataFiles(dataPath, fileNames, dataFiles);
+
+    std::shared_ptr<const TestDataPattern> pattern;
+    sources.resize(0);
+    for (size_t i = 0; i < fileNames.size(); ++i) {
+        if (!fileNames[i].empty()) {
+            sources.push_back(UploadSource(dataFiles[i], GetFileSize(dataFiles[i])));
+            continue;
+        }
+
+        if (!pattern) {
+            pattern = std::make_shared<TestDataPattern>(payloadType, payloadSeed);
+        }
+        sources.push_back(UploadSource(pattern, dataSizes[i]));
+    }
+
+    // downloads are verified against these while they stream in
+    for (size_t i = 0; i < sources.size(); ++i) {
+        if (!sources[i].ComputeChecksum()) {
+            std::wcout << U("Failed to checksum ") << sources[i].Name() << U(", downloads are not verified") << std::endl;
+        }
+        if (mapSources && !sources[i].IsGenerated() && !sources[i].Map()) {
+            std::wcout << U("Failed to map ") << sources[i].Name() << U(", it is streamed from disk") << std::endl;
+        }
+    }
+}
+
 void GetOutputDataFiles(int taskId,
                         const utility::string_t& dataPath,
                         const std::vector<utility::string_t>& fileNames,
@@ -43,152 +105,911 @@ void GetOutputDataFiles(int taskId,
     }
 }
 
-utility::string_t TestUpload(const utility::string_t& dataFile,
-               const utility::string_t& server,
-               int port,
-               const int taskId)
+pplx::task<utility::string_t> TestChunkedUpload(ContentService& service,
+                                                const UploadSource& source,
+                                                const ChunkedUploadOptions& chunkedOptions,
+                                                const int taskId)
+{
+    auto errorFunc = [](const char* msg) { ErrorMessage(msg); };
+    auto wErrorFunc = [](const wchar_t* msg) { WErrorMessage(msg); };
+
+    return service.UploadChunked(source, chunkedOptions, errorFunc, wErrorFunc).then(
+        [source, taskId](ChunkedUploadStats stats) -> utility::string_t
+        {
+            utility::stringstream_t ss;
+            if (!stats.uuid_.empty()) {
+                ss << U("Task ") << taskId
+                    << U(", upload file ") << source.Name()
+                    << U(" in ") << stats.chunks_ << U(" chunks, ")
+                    << (stats.timeUS_ / 1000.0) << U("ms. ")
+                    << ((double)stats.contentLength_ / (double)std::max<int64_t>(stats.timeUS_, 1)) << U("MB/s");
+                if (stats.resumes_ > 0) {
+                    ss << U(", ") << stats.resumes_ << U(" resumes, ")
+                        << stats.resentBytes_ << U(" bytes resent, ")
+                        << (stats.recoveryUS_ / 1000.0) << U("ms recovering");
+                }
+                ss << std::endl;
+            }
+            else {
+                ss << "Failed to upload file " << source.Name() << std::endl;
+            }
+
+            std::wcout << ss.str();
+
+            return stats.uuid_;
+        }
+    );
+}
+
+/**
+ * \brief Appends a successful upload to the manifest, if there is one
+ */
+void RecordUpload(ManifestWriter* manifest, const UploadSource& source, const utility::string_t& uuid) {
+    if (manifest == nullptr || uuid.empty()) {
+        return;
+    }
+    if (!manifest->Append(uuid, source.size_, source.checksum_, source.hasChecksum_)) {
+        std::wcout << U("Failed to add blob ") << uuid << U(" to the manifest") << std::endl;
+    }
+}
+
+pplx::task<utility::string_t> TestUpload(const UploadSource& source,
+                                         const ContentServiceConnection& connection,
+                                         const ChunkedUploadOptions& chunkedOptions,
+                                         const int taskId,
+                                         ManifestWriter* manifest)
 {
-    ContentService service(server, port);
+    ContentService service(connection);
+
+    if (chunkedOptions.chunkSize_ > 0) {
+        return TestChunkedUpload(service, source, chunkedOptions, taskId).then(
+            [source, manifest](utility::string_t uuid) -> utility::string_t
+            {
+                RecordUpload(manifest, source, uuid);
+                return uuid;
+            }
+        );
+    }
 
     auto errorFunc = [](const char* msg) { ErrorMessage(msg); };
     auto wErrorFunc = [](const wchar_t* msg) { WErrorMessage(msg); };
 
-    auto tStart = std::chrono::high_resolution_clock::now();
-    auto uuid = service.Upload(dataFile, errorFunc, wErrorFunc).get();
-    auto tStop = std::chrono::high_resolution_clock::now();
-    auto timeMS = std::chrono::duration_cast<std::chrono::milliseconds>(tStop - tStart).count();
+    auto tStart = std::chrono::steady_clock::now();
+    return service.Upload(source, errorFunc, wErrorFunc).then(
+        [source, taskId, manifest, tStart](utility::string_t uuid) -> utility::string_t
+        {
+            auto tStop = std::chrono::steady_clock::now();
+            auto timeUS = std::chrono::duration_cast<std::chrono::microseconds>(tStop - tStart).count();
+
+            auto fileLength = source.size_;
+
+            // bytes per microsecond is MB/s
+            utility::stringstream_t ss;
+            if (!uuid.empty()) {
+                ss << U("Task ") << taskId 
+                    << U(", upload file ") << source.Name()
+                    << U(" in ") << (timeUS / 1000.0) << U("ms. ") 
+                    << ((double)fileLength / (double)std::max<int64_t>(timeUS, 1)) << U("MB/s")<< std::endl;
+            }
+            else {
+                ss << "Failed to upload file " << source.Name() << std::endl;
+            }
+
+            std::wcout << ss.str();
 
-    auto fileLength = GetFileSize(dataFile);
+            RecordUpload(manifest, source, uuid);
+
+            return uuid;
+        }
+    );
+}
 
+void PrintRangedDownloadStats(const utility::string_t& uuid, int taskId, const RangedDownloadStats& stats) {
     utility::stringstream_t ss;
-    if (!uuid.empty()) {
-        ss << U("Task ") << taskId 
-            << U(", upload file ") << dataFile
-            << U(" in ") << timeMS << U("ms. ") 
-            << ((double)fileLength / (double)timeMS / 1000.0) << U("MB/s")<< std::endl;
-    }
-    else {
-        ss << "Failed to upload file " << dataFile << std::endl;
+    if (stats.contentLength_ < 0) {
+        ss << "Failed to download blob " << uuid << std::endl;
         std::wcout << ss.str();
+        return;
     }
 
+    // bytes per microsecond is MB/s
+    double minMBs = 0.0, maxMBs = 0.0, sumMBs = 0.0;
+    for (size_t i = 0; i < stats.chunks_.size(); ++i) {
+        const auto& chunk = stats.chunks_[i];
+        auto chunkMBs = (double)chunk.length_ / (double)std::max<int64_t>(chunk.timeUS_, 1);
+        minMBs = (i == 0) ? chunkMBs : std::min(minMBs, chunkMBs);
+        maxMBs = std::max(maxMBs, chunkMBs);
+        sumMBs += chunkMBs;
+    }
+    auto avgMBs = stats.chunks_.empty() ? 0.0 : sumMBs / (double)stats.chunks_.size();
+
+    ss << U("Task ") << taskId
+        << U(", download blob ") << uuid
+        << U(" in ") << stats.chunks_.size() << U(" chunks, ")
+        << (stats.timeUS_ / 1000.0) << U("ms. ")
+        << ((double)stats.contentLength_ / (double)std::max<int64_t>(stats.timeUS_, 1)) << U("MB/s")
+        << U(" (per chunk min/avg/max ") << minMBs << U("/") << avgMBs << U("/") << maxMBs << U("MB/s)")
+        << std::endl;
+
     std::wcout << ss.str();
+}
+
+pplx::task<int> TestDownloadToBuffer(const utility::string_t& uuid,
+                                     const ContentServiceConnection& connection,
+                                     const RangedDownloadOptions& rangedOptions,
+                                     int taskId)
+{
+    ContentService service(connection);
+    auto errorFunc = [](const char* msg) { ErrorMessage(msg); };
+    auto wErrorFunc = [](const wchar_t* msg) { WErrorMessage(msg); };
+
+    // the buffer goes back to the pool when the last continuation lets go of it
+    auto buffer = std::make_shared<PooledBuffer>();
+    if (rangedOptions.streams_ > 1) {
+        return service.DownloadRanged(uuid, buffer, rangedOptions, errorFunc, wErrorFunc).then(
+            [uuid, taskId, buffer](RangedDownloadStats stats) -> int
+            {
+                PrintRangedDownloadStats(uuid, taskId, stats);
+                return 0;
+            }
+        );
+    }
+
+    auto tStart = std::chrono::steady_clock::now();
+    return service.Download(uuid, buffer, errorFunc, wErrorFunc).then(
+        [uuid, taskId, buffer, tStart](int64_t contentLength) -> int
+        {
+            auto tStop = std::chrono::steady_clock::now();
+            auto timeUS = std::chrono::duration_cast<std::chrono::microseconds>(tStop - tStart).count();
+
+            utility::stringstream_t ss;
+            if (contentLength >= 0) {
+                ss << U("Task ") << taskId
+                    << U(", download blob ") << uuid
+                    << U(" to memory in ") << (timeUS / 1000.0) << U("ms. ")
+                    << ((double)contentLength / (double)std::max<int64_t>(timeUS, 1)) << U("MB/s") << std::endl;
+            }
+            else {
+                ss << "Failed to download blob " << uuid << std::endl;
+            }
 
-    return uuid;
+            std::wcout << ss.str();
+
+            return 0;
+        }
+    );
 }
 
-int TestDownload(const utility::string_t& uuid,
-                 const utility::string_t& server,
-                 int port,
-                 const utility::string_t& dataPath,
-                 int taskId)
+pplx::task<int> TestDownload(const utility::string_t& uuid,
+                             const ContentServiceConnection& connection,
+                             const utility::string_t& dataPath,
+                             const RangedDownloadOptions& rangedOptions,
+                             int taskId)
 {
-    ContentService service(server, port);
+    ContentService service(connection);
     auto errorFunc = [](const char* msg) { ErrorMessage(msg); };
     auto wErrorFunc = [](const wchar_t* msg) { WErrorMessage(msg); };
 
     utility::stringstream_t ss;
     ss << dataPath << U("//") << taskId << uuid << ".bin";
 
-    auto tStart = std::chrono::high_resolution_clock::now();
-    auto contentLength = service.Download(uuid, ss.str(), errorFunc, wErrorFunc);
-    auto tStop = std::chrono::high_resolution_clock::now();
-    auto timeMS = std::chrono::duration_cast<std::chrono::milliseconds>(tStop - tStart).count();
+    if (rangedOptions.streams_ > 1) {
+        return service.DownloadRanged(uuid, ss.str(), rangedOptions, errorFunc, wErrorFunc).then(
+            [uuid, taskId](RangedDownloadStats stats) -> int
+            {
+                PrintRangedDownloadStats(uuid, taskId, stats);
+                return 0;
+            }
+        );
+    }
+
+    auto tStart = std::chrono::steady_clock::now();
+    return service.Download(uuid, ss.str(), errorFunc, wErrorFunc).then(
+        [uuid, taskId, tStart](int64_t contentLength) -> int
+        {
+            auto tStop = std::chrono::steady_clock::now();
+            auto timeUS = std::chrono::duration_cast<std::chrono::microseconds>(tStop - tStart).count();
+
+            utility::stringstream_t ss;
+            if (contentLength > 0) {
+                ss << U("Task ") << taskId
+                    << U(", download blob ") << uuid
+                    << U(" in ") << (timeUS / 1000.0) << U("ms. ")
+                    << ((double)contentLength / (double)std::max<int64_t>(timeUS, 1)) << U("MB/s") << std::endl;
+            }
+            else {
+                ss << "Failed to download blob " << uuid << std::endl;
+            }
+
+            std::wcout << ss.str();
 
-    ss.str(utility::string_t());
-    if (contentLength > 0) {
-        ss << U("Task ") << taskId
-            << U(", download blob ") << uuid
-            << U(" in ") << timeMS << U("ms. ")
-            << ((double)contentLength / (double)timeMS / 1000.0) << U("MB/s") << std::endl;
+            return 0;
+        }
+    );
+}
+
+/**
+ * \brief Prints per-phase latency percentiles and optionally exports the raw histograms
+ */
+void ReportPhaseLatencies(const std::string& histogramFile) {
+    std::wcout << std::endl;
+    PhaseStats::Print(std::wcout);
+
+    if (!histogramFile.empty() && !SaveHistograms(histogramFile, PhaseStats::Snapshot())) {
+        cout << "Failed to write histograms to " << histogramFile << endl;
     }
-    else {
-        ss << "Failed to download blob " << uuid << std::endl;
+}
+
+/**
+ * \brief Merges histogram files exported by earlier runs
+ */
+int MergeHistogramFiles(const std::string& outputFile, const std::vector<std::string>& inputFiles) {
+    std::vector<LatencyHistogram> histograms;
+    for (size_t i = 0; i < inputFiles.size(); ++i) {
+        if (!LoadHistograms(inputFiles[i], histograms)) {
+            cout << "Failed to read histograms from " << inputFiles[i] << endl;
+            return -1;
+        }
     }
 
-    std::wcout << ss.str();
+    PrintPercentileHeader(std::wcout);
+    for (size_t i = 0; i < histograms.size(); ++i) {
+        PrintPercentiles(std::wcout, histograms[i]);
+    }
+
+    if (!SaveHistograms(outputFile, histograms)) {
+        cout << "Failed to write histograms to " << outputFile << endl;
+        return -1;
+    }
 
     return 0;
 }
 
-int TestUploadThreads(const std::vector<utility::string_t>& dataFiles, const utility::string_t& server, int port, size_t numTasks) {
-    pplx::task_group tg;
-    for (auto i = 0; i < numTasks; ++i) {
-        for (auto j = 0; j < dataFiles.size(); ++j) {
-            auto dataFile = dataFiles[j];
-            tg.run(
-                [dataFile,server,port,i]() -> utility::string_t {
-                    return TestUpload(dataFile, server, port, i);
+void PrintConnectionPoolStats(const ContentServiceConnection& connection) {
+    const auto& router = connection.Router();
+    for (size_t i = 0; i < router.Size(); ++i) {
+        const auto& pool = router.At(i).Pool();
+        std::wcout << U("Connection pool ") << pool.URI()
+            << U(": ") << pool.Size() << U(" clients, ")
+            << pool.Acquires() << U(" requests") << std::endl;
+    }
+
+    // one slow node shows up here instead of disappearing into the phase totals
+    if (router.Size() > 1) {
+        std::wcout << std::endl << U("Requests per endpoint, response headers latency") << std::endl;
+        PrintPercentileHeader(std::wcout);
+        for (size_t i = 0; i < router.Size(); ++i) {
+            PrintPercentiles(std::wcout, router.At(i).Latency());
+        }
+        for (size_t i = 0; i < router.Size(); ++i) {
+            const auto& endpoint = router.At(i);
+            std::wcout << endpoint.URI() << U(": ") << endpoint.Requests() << U(" requests, ")
+                << endpoint.Failures() << U(" failed") << std::endl;
+        }
+    }
+}
+
+void PrintChecksumStats(const ContentServiceConnection& connection) {
+    if (!connection.verifyDownloads_) {
+        std::wcout << U("CRC32C: downloads not verified") << std::endl;
+        return;
+    }
+
+    const auto& checksums = connection.Checksums();
+    std::wcout << U("CRC32C") << (Crc32cHardware() ? U(" (SSE4.2)") : U(""))
+        << U(": ") << checksums.Verified() << U(" verified, ")
+        << checksums.Mismatches() << U(" mismatches, ")
+        << checksums.Unknown() << U(" unverified") << std::endl;
+}
+
+void PrintMetadataCacheStats(const ContentServiceConnection& connection) {
+    auto& metadata = connection.Metadata();
+    if (!metadata.Enabled()) {
+        return;
+    }
+
+    auto hits = metadata.Hits();
+    auto lookups = hits + metadata.Misses();
+    std::wcout << U("Metadata cache of ") << metadata.Capacity()
+        << U(": ") << hits << U(" hits, ")
+        << metadata.Misses() << U(" misses, ")
+        << (lookups > 0 ? 100.0 * (double)hits / (double)lookups : 0.0) << U("% hit rate, ")
+        << metadata.Evictions() << U(" evictions") << std::endl;
+}
+
+void PrintUuidPrefetchStats(const ContentServiceConnection& connection) {
+    auto& prefetcher = connection.Prefetcher();
+    if (!prefetcher.Enabled()) {
+        return;
+    }
+
+    prefetcher.Stop();
+    auto stats = prefetcher.Stats();
+    for (size_t i = 0; i < stats.size(); ++i) {
+        auto lookups = stats[i].taken_ + stats[i].misses_;
+        std::wcout << U("Blob prefetch of ") << stats[i].size_ << U(" bytes: ")
+            << stats[i].taken_ << U(" taken, ")
+            << stats[i].misses_ << U(" created inline (")
+            << (lookups > 0 ? 100.0 * (double)stats[i].misses_ / (double)lookups : 0.0) << U("%), ")
+            << stats[i].meanDepth_ << U(" ready on average, ")
+            << stats[i].depth_ << U(" left unused, ")
+            << stats[i].failures_ << U(" failed") << std::endl;
+    }
+}
+
+void PrintSchedulerStats(const WorkStealingScheduler& scheduler) {
+    auto stats = scheduler.Stats();
+    uint64_t minExecuted = 0, maxExecuted = 0;
+    for (size_t i = 0; i < stats.executedPerThread_.size(); ++i) {
+        minExecuted = (i == 0) ? stats.executedPerThread_[i] : std::min(minExecuted, stats.executedPerThread_[i]);
+        maxExecuted = std::max(maxExecuted, stats.executedPerThread_[i]);
+    }
+
+    std::wcout << U("Scheduler: ") << scheduler.Threads() << U(" threads, ")
+        << stats.scheduled_ << U(" tasks (") << stats.injected_ << U(" from outside the pool), ")
+        << stats.stolen_ << U(" stolen, ") << stats.parks_ << U(" parks, ")
+        << stats.maxQueued_ << U(" max queued, ")
+        << minExecuted << U("-") << maxExecuted << U(" run per thread") << std::endl;
+}
+
+void PrintSourceStats(const std::vector<UploadSource>& sources) {
+    auto reads = SourceReads();
+    if (reads.uploads_ == 0) {
+        return;
+    }
+
+    size_t mapped = 0;
+    uint64_t mappedBytes = 0, residentBytes = 0;
+    bool resident = true;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        if (!sources[i].IsMapped()) {
+            continue;
+        }
+
+        uint64_t bytes = 0;
+        resident = sources[i].mapping_->ResidentBytes(bytes) && resident;
+        ++mapped;
+        mappedBytes += sources[i].mapping_->Size();
+        residentBytes += bytes;
+    }
+
+    utility::stringstream_t ss;
+    ss << U("Upload sources: ") << reads.mappedUploads_ << U(" of ") << reads.uploads_ << U(" uploads from shared mappings, ")
+        << ((double)reads.bytesCopied_ / (double)reads.uploads_) << U(" bytes copied per upload");
+    if (mapped > 0) {
+        ss << U(", ") << mapped << U(" files mapped, ") << (mappedBytes / (1024.0 * 1024.0)) << U("MB");
+        if (resident) {
+            ss << U(", ") << (residentBytes / (1024.0 * 1024.0)) << U("MB resident");
+        }
+    }
+    std::wcout << ss.str() << std::endl;
+}
+
+void PrintBufferPoolStats(const ContentServiceConnection& connection) {
+    const auto& buffers = connection.Buffers();
+    std::wcout << U("Buffer pool") << (buffers.HugePages() ? U(" (huge pages)") : U(""))
+        << U(": ") << buffers.Hits() << U(" hits, ")
+        << buffers.Misses() << U(" misses, peak ")
+        << (buffers.PeakResidentBytes() / (1024.0 * 1024.0)) << U("MB resident") << std::endl;
+}
+
+/**
+ * \brief Uploads every source numTasks times, numTasks uploads in flight
+ */
+int TestUploadThreads(const std::vector<UploadSource>& sources, const ContentServiceConnection& connection, const ChunkedUploadOptions& chunkedOptions, size_t numTasks, ManifestWriter* manifest) {
+    RunBounded(numTasks * sources.size(), numTasks,
+        [&sources, connection, chunkedOptions, manifest](uint64_t index) -> pplx::task<void> {
+            auto taskId = static_cast<int>(index / sources.size());
+            return TestUpload(sources[index % sources.size()], connection, chunkedOptions, taskId, manifest).then(
+                [](utility::string_t) { }
+            );
+        }
+    ).wait();
+
+    std::wcout << U("Finished!") << std::endl;
+    PrintConnectionPoolStats(connection);
+
+    return 0;
+}
+
+/**
+ * \brief Uploads every source numTasks times, then downloads every uploaded blob, numTasks operations in flight
+ */
+int TestUploadAndDownloadThreads(const std::vector<UploadSource>& sources, const ContentServiceConnection& connection, const utility::string_t& dataPath, const ChunkedUploadOptions& chunkedOptions, const RangedDownloadOptions& rangedOptions, size_t numTasks, bool toBuffer, ManifestWriter* manifest) {
+    auto totalTask = numTasks * sources.size();
+    auto pUploadUUIDs = std::make_shared<std::vector<utility::string_t>>(totalTask);
+
+    // upload files
+    RunBounded(totalTask, numTasks,
+        [&sources, connection, chunkedOptions, manifest, pUploadUUIDs](uint64_t index) -> pplx::task<void> {
+            auto taskId = static_cast<int>(index / sources.size());
+            return TestUpload(sources[index % sources.size()], connection, chunkedOptions, taskId, manifest).then(
+                [pUploadUUIDs, index](utility::string_t uuid) {
+                    (*pUploadUUIDs)[index] = uuid;
                 }
             );
         }
+    ).then(
+        [totalTask, numTasks, pUploadUUIDs, connection, dataPath, rangedOptions, toBuffer]() -> pplx::task<void> {
+            return RunBounded(totalTask, numTasks,
+                [pUploadUUIDs, connection, dataPath, rangedOptions, toBuffer](uint64_t index) -> pplx::task<void> {
+                    const auto& uuid = (*pUploadUUIDs)[index];
+                    auto taskId = static_cast<int>(index);
+                    auto downloadTask = toBuffer
+                        ? TestDownloadToBuffer(uuid, connection, rangedOptions, taskId)
+                        : TestDownload(uuid, connection, dataPath, rangedOptions, taskId);
+                    return downloadTask.then([](int) { });
+                }
+            );
+        }
+    ).wait();
+
+    std::wcout << U("Finished!") << std::endl;
+    PrintConnectionPoolStats(connection);
+    PrintChecksumStats(connection);
+    PrintMetadataCacheStats(connection);
+    if (toBuffer) {
+        PrintBufferPoolStats(connection);
+    }
+
+    return 0;
+}
+
+/**
+ * \brief Downloads the blobs of a manifest written by an earlier upload run
+ *
+ * numTasks workers take the next record until downloads blobs are fetched,
+ * cycling through the manifest. Sizes and checksums of the manifest are
+ * registered as their blobs are first fetched, so start-up does not depend on
+ * its size and downloads skip the metadata request. Worker processes of a
+ * sliced run take every workers-th record, starting at their own index.
+ */
+int TestDownloadManifest(const std::string& manifestFile, const ContentServiceConnection& connection, const RangedDownloadOptions& rangedOptions, size_t numTasks, uint64_t downloads, size_t worker, size_t workers) {
+    auto manifest = std::make_shared<ManifestReader>();
+    if (manifestFile.empty() || !manifest->Open(manifestFile)) {
+        cout << "Failed to open manifest " << manifestFile << endl;
+        return -1;
     }
-    tg.wait();
+
+    auto count = manifest->Count();
+    if (count == 0) {
+        cout << "No blobs to download!" << endl;
+        return -1;
+    }
+    if (downloads == 0) {
+        downloads = count / workers + (worker < count % workers ? 1 : 0);
+    }
+
+    std::wcout << U("Downloading ") << downloads << U(" of ") << count << U(" blobs in the manifest") << std::endl;
+
+    RunBounded(downloads, numTasks,
+        [manifest, count, worker, workers, connection, rangedOptions](uint64_t taken) -> pplx::task<void> {
+            auto index = taken * workers + worker;
+            const auto& record = manifest->Record(index % count);
+            auto uuid = record.UUID();
+            if (index < count) {
+                connection.Metadata().Put(uuid, record.size_);
+                if (record.HasChecksum()) {
+                    connection.Checksums().Record(uuid, record.checksum_);
+                }
+            }
+            return TestDownloadToBuffer(uuid, connection, rangedOptions, static_cast<int>(taken)).then([](int) { });
+        }
+    ).wait();
 
     std::wcout << U("Finished!") << std::endl;
+    PrintConnectionPoolStats(connection);
+    PrintChecksumStats(connection);
+    PrintMetadataCacheStats(connection);
+    PrintBufferPoolStats(connection);
 
     return 0;
 }
 
-int TestUploadAndDownloadThreads(const std::vector<utility::string_t>& dataFiles, const utility::string_t& server, int port, const utility::string_t& dataPath, size_t numTasks) {
-    pplx::task_group tg;
+/**
+ * \brief Interleaves uploads and downloads, see RunMixedWorkload
+ *
+ * Operations are not printed one by one, per-operation output would throttle
+ * the workers; latencies go to the mixed_read and mixed_write histograms.
+ */
+int TestMixedWorkload(const std::vector<UploadSource>& sources, const ContentServiceConnection& connection, const RangedDownloadOptions& rangedOptions, const MixedWorkloadOptions& options, ManifestWriter* manifest) {
+    if (sources.empty()) {
+        cout << "No files to upload!" << endl;
+        return -1;
+    }
+
+    auto errorFunc = [](const char* msg) { ErrorMessage(msg); };
+    auto wErrorFunc = [](const wchar_t* msg) { WErrorMessage(msg); };
 
-    // upload files
-    auto totalTask = numTasks*dataFiles.size();
-    std::vector<pplx::task<utility::string_t>> uploadTasks;
-    for (auto i = 0; i < numTasks; ++i) {
-        for (auto j = 0; j < dataFiles.size(); ++j) {
-            auto dataFile = dataFiles[j];
-            uploadTasks.push_back(
-                create_task(
-                [dataFile,server,port,i]() -> utility::string_t {
-                    return TestUpload(dataFile, server, port, i);
-                })
+    std::wcout << U("Mixed workload: ") << options.workers_ << U(" workers x ") << options.operations_
+        << U(" operations, ") << (options.readRatio_ * 100.0) << U("% reads, ")
+        << (options.popularity_ == POPULARITY_ZIPF ? U("zipfian") : U("uniform")) << U(" popularity, ")
+        << options.preload_ << U(" blobs preloaded") << std::endl;
+
+    auto result = RunMixedWorkload(options, sources.size(),
+        [&sources, &connection, manifest, errorFunc, wErrorFunc](size_t, size_t index) -> utility::string_t {
+            ContentService service(connection);
+            const auto& source = sources[index];
+
+            // mixed workers are closed-loop threads of their own, waiting here parks no pool thread
+            auto uuid = service.Upload(source, errorFunc, wErrorFunc).get();
+            RecordUpload(manifest, source, uuid);
+            return uuid;
+        },
+        [&connection, &rangedOptions, errorFunc, wErrorFunc](size_t, const utility::string_t& uuid) -> bool {
+            ContentService service(connection);
+
+            // the buffer goes back to the pool when it leaves scope
+            auto buffer = std::make_shared<PooledBuffer>();
+            if (rangedOptions.streams_ > 1) {
+                return service.DownloadRanged(uuid, buffer, rangedOptions, errorFunc, wErrorFunc).get().contentLength_ >= 0;
+            }
+            return service.Download(uuid, buffer, errorFunc, wErrorFunc).get() >= 0;
+        }
+    );
+
+    auto operations = result.reads_ + result.writes_;
+    std::wcout << U("Preloaded ") << result.preloaded_ << U(" blobs") << std::endl
+        << U("Reads ") << result.reads_ << U(" (") << result.readFailures_ << U(" failed), writes ")
+        << result.writes_ << U(" (") << result.writeFailures_ << U(" failed, ")
+        << result.readsAsWrites_ << U(" in place of reads with nothing to read)") << std::endl
+        << U("Throughput ") << ((double)operations / std::max(result.elapsedS_, 1e-9)) << U(" operations/s over ")
+        << result.elapsedS_ << U("s") << std::endl;
+
+    std::wcout << U("Finished!") << std::endl;
+    PrintConnectionPoolStats(connection);
+    PrintChecksumStats(connection);
+    PrintMetadataCacheStats(connection);
+    PrintBufferPoolStats(connection);
+
+    return 0;
+}
+
+/**
+ * \brief Uploads blobs and downloads each one to memory as soon as it is uploaded, see RunPipeline
+ */
+int TestPipeline(const std::vector<UploadSource>& sources, const ContentServiceConnection& connection, const PipelineOptions& options, ManifestWriter* manifest) {
+    if (sources.empty()) {
+        cout << "No files to upload!" << endl;
+        return -1;
+    }
+
+    auto errorFunc = [](const char* msg) { ErrorMessage(msg); };
+    auto wErrorFunc = [](const wchar_t* msg) { WErrorMessage(msg); };
+
+    std::wcout << U("Pipeline: ") << options.blobs_ << U(" blobs, ")
+        << options.uploadConcurrency_ << U(" uploads -> queue of ")
+        << options.queueDepth_ << U(" -> ")
+        << options.downloadConcurrency_ << U(" downloads") << std::endl;
+
+    auto result = RunPipeline(options,
+        [&sources, connection, manifest, errorFunc, wErrorFunc](uint64_t index) -> pplx::task<utility::string_t> {
+            ContentService service(connection);
+            const auto& source = sources[index % sources.size()];
+
+            return service.Upload(source, errorFunc, wErrorFunc).then(
+                [source, manifest](utility::string_t uuid) -> utility::string_t {
+                    RecordUpload(manifest, source, uuid);
+                    return uuid;
+                }
+            );
+        },
+        [connection, errorFunc, wErrorFunc](const utility::string_t& uuid) -> pplx::task<bool> {
+            ContentService service(connection);
+
+            // the buffer goes back to the pool once the download is checked
+            auto buffer = std::make_shared<PooledBuffer>();
+            return service.Download(uuid, buffer, errorFunc, wErrorFunc).then(
+                [buffer](int64_t contentLength) -> bool {
+                    return contentLength >= 0;
+                }
+            );
+        }
+    );
+
+    std::wcout << U("Uploaded ") << result.uploaded_ << U(" (") << result.uploadFailures_ << U(" failed), downloaded ")
+        << result.downloaded_ << U(" (") << result.downloadFailures_ << U(" failed) in ")
+        << result.elapsedS_ << U("s, ")
+        << ((double)result.downloaded_ / std::max(result.elapsedS_, 1e-9)) << U(" blobs/s") << std::endl;
+
+    std::wcout << U("Finished!") << std::endl;
+    PrintConnectionPoolStats(connection);
+    PrintChecksumStats(connection);
+    PrintMetadataCacheStats(connection);
+    PrintBufferPoolStats(connection);
+
+    return 0;
+}
+
+int TestOpenLoop(const std::vector<UploadSource>& sources, const ContentServiceConnection& connection, const OpenLoopOptions& options, ManifestWriter* manifest) {
+    if (sources.empty()) {
+        cout << "No files to upload!" << endl;
+        return -1;
+    }
+
+    auto errorFunc = [](const char* msg) { ErrorMessage(msg); };
+    auto wErrorFunc = [](const wchar_t* msg) { WErrorMessage(msg); };
+
+    std::wcout << U("Open loop: ") << options.startRate_ << U(" -> ") << options.endRate_
+        << U(" uploads/s for ") << options.durationS_ << U("s") << std::endl;
+
+    auto result = RunOpenLoop(options,
+        [&sources, connection, errorFunc, wErrorFunc, manifest](uint64_t index) -> pplx::task<bool> {
+            ContentService service(connection);
+            const auto& source = sources[index % sources.size()];
+
+            return service.Upload(source, errorFunc, wErrorFunc).then(
+                [source, manifest](utility::string_t uuid) -> bool {
+                    RecordUpload(manifest, source, uuid);
+                    return !uuid.empty();
+                }
             );
         }
+    );
+
+    std::wcout << U("Scheduled ") << result.scheduled_
+        << U(", issued ") << result.issued_
+        << U(", succeeded ") << result.succeeded_
+        << U(", failed ") << result.failed_
+        << U(", dropped ") << result.dropped_ << std::endl
+        << U("Target rate ") << result.targetRate_ << U("/s, achieved ") << result.achievedRate_
+        << U("/s, completed ") << result.completionRate_ << U("/s, max schedule lag ")
+        << (result.maxLagUS_ / 1000.0) << U("ms") << std::endl;
+
+    std::wcout << U("Finished!") << std::endl;
+    PrintConnectionPoolStats(connection);
+
+    return 0;
+}
+
+/**
+ * \brief Sweeps blob sizes and concurrency levels, uploading generated blobs or downloading one blob per size
+ */
+int TestSweep(const ContentServiceConnection& connection, const SweepOptions& options, std::shared_ptr<const TestDataPattern> pattern,
+    bool downloads, const std::string& sweepFile, ManifestWriter* manifest)
+{
+    if (options.sizes_.empty() || options.concurrency_.empty()) {
+        cout << "No sizes or concurrency levels to sweep!" << endl;
+        return -1;
+    }
+
+    auto errorFunc = [](const char* msg) { ErrorMessage(msg); };
+    auto wErrorFunc = [](const wchar_t* msg) { WErrorMessage(msg); };
+
+    // downloads read back one blob of each size, uploaded and checksummed up front
+    auto blobs = std::make_shared<std::map<uint64_t, utility::string_t>>();
+    if (downloads) {
+        for (size_t i = 0; i < options.sizes_.size(); ++i) {
+            UploadSource source(pattern, options.sizes_[i]);
+            source.ComputeChecksum();
+            auto uuid = ContentService(connection).Upload(source, errorFunc, wErrorFunc).get();
+            if (uuid.empty()) {
+                cout << "Failed to upload the blob of " << options.sizes_[i] << " bytes" << endl;
+                return -1;
+            }
+            RecordUpload(manifest, source, uuid);
+            (*blobs)[options.sizes_[i]] = uuid;
+        }
     }
 
-    auto pUploadUUIDs = std::make_shared<std::vector<utility::string_t>>(std::vector<utility::string_t>(totalTask));
-    auto joinUploadTasks = when_all(begin(uploadTasks), end(uploadTasks)).then(
-        [pUploadUUIDs](std::vector<utility::string_t> uploadResults) {
-            for (auto i = 0; i < uploadResults.size(); ++i) {
-                const auto& uuid = uploadResults[i];
-                (*pUploadUUIDs)[i] = uuid;
+    std::wcout << U("Sweep: ") << options.sizes_.size() << U(" sizes x ") << options.concurrency_.size()
+        << U(" concurrency levels of ") << (downloads ? U("downloads") : U("uploads"))
+        << U(", ") << options.warmupS_ << U("s warm-up, ") << options.windowS_ << U("s window") << std::endl;
 
-                //std::wcout << U("uuid = ") << uuid << std::endl;
+    auto result = RunSweep(options,
+        [connection, pattern, downloads, blobs, errorFunc, wErrorFunc, manifest](uint64_t size, uint64_t) -> pplx::task<bool> {
+            ContentService service(connection);
+            if (downloads) {
+                // the buffer goes back to the pool once the download is checked
+                auto buffer = std::make_shared<PooledBuffer>();
+                return service.Download(blobs->at(size), buffer, errorFunc, wErrorFunc).then(
+                    [buffer](int64_t contentLength) -> bool {
+                        return contentLength >= 0;
+                    }
+                );
             }
+
+            UploadSource source(pattern, size);
+            return service.Upload(source, errorFunc, wErrorFunc).then(
+                [source, manifest](utility::string_t uuid) -> bool {
+                    RecordUpload(manifest, source, uuid);
+                    return !uuid.empty();
+                }
+            );
         }
     );
-    joinUploadTasks.wait();
-
-    std::vector<pplx::task<int>> downloadTasks;
-    for (auto j = 0; j < pUploadUUIDs->size(); ++j) {
-        const auto& uuid = (*pUploadUUIDs)[j];
-        downloadTasks.push_back(
-            create_task (
-            [uuid,server,port,dataPath,j]() -> int {
-                return TestDownload(uuid, server, port, dataPath, j);
-            })
-        );
+
+    std::wcout << std::endl;
+    PrintSweep(std::wcout, result);
+    for (size_t i = 0; i < result.knees_.size(); ++i) {
+        std::wcout << U("Size ") << options.sizes_[i] << U(": ");
+        if (result.knees_[i] > 0) {
+            std::wcout << U("saturates at ") << result.knees_[i] << U(" in flight") << std::endl;
+        }
+        else {
+            std::wcout << U("no knee found") << std::endl;
+        }
     }
 
-    auto joinDownloadTask = when_all(begin(downloadTasks), end(downloadTasks));
-    joinDownloadTask.wait();
+    if (!sweepFile.empty() && !SaveSweep(sweepFile, result)) {
+        cout << "Failed to write sweep to " << sweepFile << endl;
+    }
 
     std::wcout << U("Finished!") << std::endl;
+    PrintConnectionPoolStats(connection);
 
     return 0;
 }
 
+#if !_WIN32
+/**
+ * \brief SIGUSR2 handler, switches tracing on and off while a run goes on
+ */
+static void ToggleTracing(int) {
+    Tracer::Enable(!Tracer::Enabled());
+}
+#endif
+
+/**
+ * \brief Starts recording request spans if the run has a trace file
+ */
+void StartTracing(const TestParameters& testParams) {
+    if (testParams.TraceFile().empty()) {
+        return;
+    }
+
+    Tracer::SetRingEvents(testParams.TraceBufferEvents());
+    Tracer::Enable(true);
+#if !_WIN32
+    std::signal(SIGUSR2, ToggleTracing);
+#endif
+}
+
+/**
+ * \brief Writes the recorded spans, a worker to a file of its own with its index + 1 as the pid
+ */
+void ExportTrace(const std::string& traceFile, const WorkerGroup* workerGroup) {
+    if (traceFile.empty()) {
+        return;
+    }
+
+    Tracer::Enable(false);
+
+    auto fileName = traceFile;
+    auto pid = 0;
+    if (workerGroup) {
+        std::ostringstream oss;
+        oss << traceFile << ".worker" << workerGroup->Index();
+        fileName = oss.str();
+        pid = static_cast<int>(workerGroup->Index()) + 1;
+    }
+
+    if (!Tracer::Export(fileName, pid)) {
+        cout << "Failed to write trace to " << fileName << endl;
+        return;
+    }
+    if (Tracer::Overwritten() > 0) {
+        std::wcout << Tracer::Overwritten() << U(" oldest spans overwritten, raise traceBufferEvents to keep them") << std::endl;
+    }
+}
+
+/**
+ * \brief Appends the manifest parts written by worker processes to the manifest and deletes them
+ */
+int MergeWorkerManifests(const std::string& manifestFile, size_t workers) {
+    ManifestWriter writer;
+    if (!writer.Open(manifestFile)) {
+        cout << "Failed to open manifest " << manifestFile << endl;
+        return -1;
+    }
+
+    for (size_t w = 0; w < workers; ++w) {
+        auto partFile = WorkerManifestFile(manifestFile, w);
+        {
+            ManifestReader part;
+            if (!part.Open(partFile)) {
+                continue;
+            }
+            for (uint64_t i = 0; i < part.Count(); ++i) {
+                const auto& record = part.Record(i);
+                writer.Append(record.UUID(), record.size_, record.checksum_, record.HasChecksum());
+            }
+        }
+        std::remove(partFile.c_str());
+    }
+
+    writer.Close();
+    std::wcout << writer.Count() << U(" blobs in manifest ") << utility::conversions::to_string_t(manifestFile) << std::endl;
+
+    return 0;
+}
+
+/**
+ * \brief Runs the coordinator of a multi-process run
+ *
+ * Starts the forked workers together, prints their merged throughput every
+ * second and, once all have exited, their merged latencies. The time series
+ * and histogram files cover all workers.
+ */
+int CoordinateWorkers(WorkerGroup& group, TestParameters& testParams, int testMode) {
+    auto ready = group.ReleaseWhenReady();
+    std::wcout << ready << U(" of ") << group.Size() << U(" worker processes started") << std::endl;
+
+    ThroughputReporter throughputReporter;
+    if (!testParams.TimeSeriesFile().empty()
+        && !throughputReporter.Start(testParams.TimeSeriesFile(), testParams.TimeSeriesIntervalMS(),
+            [&group](ThroughputTotals (&totals)[NUM_THROUGHPUT_OPERATIONS]) { group.Snapshot(totals); })) {
+        cout << "Failed to open time series file " << testParams.TimeSeriesFile() << endl;
+    }
+
+    ThroughputTotals previous[NUM_THROUGHPUT_OPERATIONS];
+    auto tLast = std::chrono::steady_clock::now();
+    size_t running = 0;
+    while ((running = group.Running()) > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        auto now = std::chrono::steady_clock::now();
+        auto seconds = std::chrono::duration<double>(now - tLast).count();
+        if (seconds < 1.0) {
+            continue;
+        }
+
+        ThroughputTotals totals[NUM_THROUGHPUT_OPERATIONS];
+        group.Snapshot(totals);
+
+        utility::stringstream_t ss;
+        ss << running << U(" workers running");
+        for (int i = 0; i < NUM_THROUGHPUT_OPERATIONS; ++i) {
+            ss << U(", ") << ThroughputOperationName(static_cast<ThroughputOperation>(i)) << U(" ")
+                << totals[i].ops_ << U(" (")
+                << std::fixed << std::setprecision(1) << (double)(totals[i].ops_ - previous[i].ops_) / seconds << U("/s, ")
+                << (double)(totals[i].bytes_ - previous[i].bytes_) / seconds / 1e6 << U("MB/s, ")
+                << totals[i].errors_ << U(" errors)");
+            previous[i] = totals[i];
+        }
+        std::wcout << ss.str() << std::endl;
+        tLast = now;
+    }
+
+    throughputReporter.Stop();
+
+    if (group.Failed() > 0) {
+        std::wcout << group.Failed() << U(" worker processes failed") << std::endl;
+    }
+
+    if (!testParams.ManifestFile().empty() && testMode != 1) {
+        MergeWorkerManifests(testParams.ManifestFile(), group.Size());
+    }
+
+    auto histograms = group.Histograms();
+    std::wcout << std::endl;
+    PhaseStats::Print(std::wcout, histograms);
+    if (!testParams.HistogramFile().empty() && !SaveHistograms(testParams.HistogramFile(), histograms)) {
+        cout << "Failed to write histograms to " << testParams.HistogramFile() << endl;
+    }
+
+    return group.Failed() > 0 ? -1 : 0;
+}
+
 int main(int argc, char** argv) {
 
 	cout << "Test CppRestSDK" << endl;
 
+    if (argc >= 4 && std::string(argv[1]) == "--merge-histograms") {
+        return MergeHistogramFiles(argv[2], std::vector<std::string>(argv + 3, argv + argc));
+    }
+
     if (argc < 3) {
         cout << "Usage:" << endl
             << "TestClient <config_file> <testMode>" 
             << endl
-            << "testMode: 0 = upload, 1 = download, 2 = upload and download, 3 = upload and download to buffer"
+            << "testMode: 0 = upload, 1 = download the manifest to buffer, 2 = upload and download, 3 = upload and download to buffer"
+            << endl
+            << "TestClient <config_file> <testMode> --workers <N>"
+            << endl
+            << "  splits the scenario over N forked worker processes"
+            << endl
+            << "TestClient --merge-histograms <output_file> <histogram_file>..."
             << endl;
         return -1;
     }
@@ -197,31 +1018,192 @@ int main(int argc, char** argv) {
     int testMode = 0;
     iss >> testMode;
 
+    size_t workers = 0;
+    if (argc >= 5 && std::string(argv[3]) == "--workers") {
+        std::istringstream(argv[4]) >> workers;
+    }
+
 	std::string configPath(argv[1]);
     TestParameters testParams(configPath);
     testParams.Parse();
 
+    // forked before the first task, a worker must not inherit scheduler threads
+    std::unique_ptr<WorkerGroup> workerGroup;
+    // the knee is found from the combined latencies of one process
+    if (workers > 1 && testParams.Scenario() == SCENARIOS_SWEEP) {
+        cout << "A sweep runs in one process, --workers is ignored" << endl;
+        workers = 0;
+    }
+    if (workers > 1) {
+        workerGroup.reset(new WorkerGroup(workers));
+        if (!workerGroup->Start()) {
+            cout << "Failed to start " << workers << " worker processes" << endl;
+            return -1;
+        }
+        if (!workerGroup->IsWorker()) {
+            return CoordinateWorkers(*workerGroup, testParams, testMode);
+        }
+        testParams.Slice(workerGroup->Index(), workerGroup->Size());
+    }
+
+    // continuations run on a dedicated pool instead of the default scheduler
+    std::shared_ptr<WorkStealingScheduler> scheduler;
+    if (testParams.Scheduler().Enabled()) {
+        scheduler = std::make_shared<WorkStealingScheduler>(testParams.Scheduler());
+        pplx::set_ambient_scheduler(scheduler);
+        std::wcout << U("Running tasks on ") << scheduler->Threads() << U(" scheduler threads") << std::endl;
+    }
+
     auto numTasks = testParams.NumInstances();
     const auto& server = testParams.Server();
     const auto& port = testParams.Port();
     const auto& dataPath = testParams.DataPath();
     const auto& fileNames = testParams.FileNames();
-    std::vector<utility::string_t> dataFiles;
-    GetInputDataFiles(dataPath, fileNames, dataFiles);
+    std::vector<UploadSource> sources;
+    GetUploadSources(dataPath, fileNames, testParams.DataSizes(), testParams.Payload(), testParams.PayloadSeed(), testParams.MapSources(), sources);
 
-    switch (testMode) {
-    case 0: // upload
-        TestUploadThreads(dataFiles, server, port, numTasks);
-        break;
-    case 1: // download
-        cout << "Not implemented yet!" << endl;
-        break;
+    // one connection (and client pool per node) shared by every task
+    ContentServiceConnection connection = testParams.Endpoints().empty()
+        ? ContentServiceConnection(server, port, testParams.ConnectionPoolSize(), testParams.HugePages(), testParams.MetadataCacheSize())
+        : ContentServiceConnection(testParams.Endpoints(), testParams.Routing(), testParams.ConnectionPoolSize(), testParams.HugePages(), testParams.MetadataCacheSize());
+    connection.compression_ = testParams.Compression();
+    connection.verifyDownloads_ = testParams.VerifyDownloads();
+    RangedDownloadOptions rangedOptions(testParams.DownloadStreams(), testParams.DownloadChunkSize());
+    ChunkedUploadOptions chunkedOptions(testParams.UploadChunkSize(), testParams.UploadChunksInFlight(), testParams.UploadMaxResumes(), testParams.UploadChunksOutOfOrder());
 
-    case 2: // upload and download
-        TestUploadAndDownloadThreads(dataFiles, server, port, dataPath, numTasks);
-        break;
+    // blobs of every upload size are created while the run sets up, uploads then skip the POST
+    if (testParams.UuidPrefetch().depth_ > 0 && testMode != 1) {
+        std::vector<uint64_t> sizes;
+        for (size_t i = 0; i < sources.size(); ++i) {
+            sizes.push_back(sources[i].size_);
+        }
+        if (testParams.Scenario() == SCENARIOS_SWEEP) {
+            sizes.insert(sizes.end(), testParams.Sweep().sizes_.begin(), testParams.Sweep().sizes_.end());
+        }
+        ContentService(connection).StartUuidPrefetch(sizes, testParams.UuidPrefetch());
     }
 
+    // uploads of every mode are appended to the manifest, download-only runs read it instead
+    // workers write parts of their own, the coordinator merges them
+    std::unique_ptr<ManifestWriter> manifest;
+    if (!testParams.ManifestFile().empty() && testMode != 1) {
+        auto manifestFile = workerGroup ? WorkerManifestFile(testParams.ManifestFile(), workerGroup->Index()) : testParams.ManifestFile();
+        manifest.reset(new ManifestWriter());
+        if (!manifest->Open(manifestFile)) {
+            cout << "Failed to open manifest " << manifestFile << endl;
+            return -1;
+        }
+    }
+
+    ThroughputReporter throughputReporter;
+    if (!workerGroup && !testParams.TimeSeriesFile().empty()
+        && !throughputReporter.Start(testParams.TimeSeriesFile(), testParams.TimeSeriesIntervalMS())) {
+        cout << "Failed to open time series file " << testParams.TimeSeriesFile() << endl;
+    }
+
+    if (workerGroup && !workerGroup->ArriveAndWait()) {
+        return -1;
+    }
+
+    StartTracing(testParams);
+
+    // rate-driven scenarios replace the test mode
+    if (testParams.Scenario() == SCENARIOS_OPEN_LOOP) {
+        OpenLoopOptions openLoopOptions;
+        openLoopOptions.startRate_ = testParams.TargetRate();
+        openLoopOptions.endRate_ = testParams.TargetRateEnd();
+        openLoopOptions.durationS_ = testParams.Duration();
+        openLoopOptions.maxOutstanding_ = testParams.MaxOutstanding();
+
+        TestOpenLoop(sources, connection, openLoopOptions, manifest.get());
+    }
+    else if (testParams.Scenario() == SCENARIOS_MIXED) {
+        MixedWorkloadOptions mixedOptions;
+        mixedOptions.workers_ = numTasks;
+        mixedOptions.operations_ = testParams.Operations();
+        mixedOptions.preload_ = testParams.Preload();
+        mixedOptions.readRatio_ = testParams.ReadRatio();
+        mixedOptions.popularity_ = testParams.BlobPopularity();
+        mixedOptions.zipfExponent_ = testParams.ZipfExponent();
+        mixedOptions.seed_ = testParams.MixSeed();
+        mixedOptions.writeWeights_ = testParams.DataWeights();
+
+        TestMixedWorkload(sources, connection, rangedOptions, mixedOptions, manifest.get());
+    }
+    else if (testParams.Scenario() == SCENARIOS_PIPELINE) {
+        PipelineOptions pipelineOptions;
+        pipelineOptions.blobs_ = testParams.Blobs() > 0 ? testParams.Blobs() : numTasks * sources.size();
+        pipelineOptions.uploadConcurrency_ = testParams.UploadConcurrency() > 0 ? testParams.UploadConcurrency() : numTasks;
+        pipelineOptions.queueDepth_ = testParams.QueueDepth() > 0 ? testParams.QueueDepth() : 2 * numTasks;
+        pipelineOptions.downloadConcurrency_ = testParams.DownloadConcurrency() > 0 ? testParams.DownloadConcurrency() : numTasks;
+
+        TestPipeline(sources, connection, pipelineOptions, manifest.get());
+    }
+    else if (testParams.Scenario() == SCENARIOS_SWEEP) {
+        // without levels, the generated sizes of the scenario at 1, 2, 4, ... numInstances in flight
+        auto sweepOptions = testParams.Sweep();
+        if (sweepOptions.sizes_.empty()) {
+            for (size_t i = 0; i < sources.size(); ++i) {
+                if (sources[i].IsGenerated()) {
+                    sweepOptions.sizes_.push_back(sources[i].size_);
+                }
+            }
+        }
+        if (sweepOptions.concurrency_.empty()) {
+            for (uint64_t level = 1; level <= numTasks; level *= 2) {
+                sweepOptions.concurrency_.push_back(level);
+            }
+            if (!sweepOptions.concurrency_.empty() && sweepOptions.concurrency_.back() < numTasks) {
+                sweepOptions.concurrency_.push_back(numTasks);
+            }
+        }
+
+        auto pattern = std::make_shared<TestDataPattern>(testParams.Payload(), testParams.PayloadSeed());
+        TestSweep(connection, sweepOptions, pattern, testMode == 1 || testMode == 3, testParams.SweepFile(), manifest.get());
+    }
+    else {
+        switch (testMode) {
+        case 0: // upload
+            TestUploadThreads(sources, connection, chunkedOptions, numTasks, manifest.get());
+            break;
+        case 1: // download
+            TestDownloadManifest(testParams.ManifestFile(), connection, rangedOptions, numTasks, testParams.Downloads(), testParams.WorkerIndex(), testParams.WorkerCount());
+            break;
+
+        case 2: // upload and download
+            TestUploadAndDownloadThreads(sources, connection, dataPath, chunkedOptions, rangedOptions, numTasks, false, manifest.get());
+            break;
+
+        case 3: // upload and download to buffer
+            TestUploadAndDownloadThreads(sources, connection, dataPath, chunkedOptions, rangedOptions, numTasks, true, manifest.get());
+            break;
+        }
+    }
+
+    throughputReporter.Stop();
+    ExportTrace(testParams.TraceFile(), workerGroup.get());
+
+    if (manifest) {
+        manifest->Close();
+        std::wcout << manifest->Count() << U(" blobs in manifest ") << utility::conversions::to_string_t(testParams.ManifestFile()) << std::endl;
+    }
+
+    PrintSourceStats(sources);
+    PrintTransferStats(std::wcout);
+    PrintCompressionStats(std::wcout);
+    PrintUuidPrefetchStats(connection);
+    if (scheduler) {
+        PrintSchedulerStats(*scheduler);
+    }
+
+    // the coordinator prints and exports the counts of all workers
+    if (workerGroup) {
+        workerGroup->Finish();
+        return 0;
+    }
+
+    ReportPhaseLatencies(testParams.HistogramFile());
+
 #if _WIN32
     cout << "Press any key to continue...";
     _getch();
@@ -0,0 +1,133 @@
+#include "manifest.h"
+
+#include <cstddef>
+#include <utility>
+
+#include "boost/iostreams/device/mapped_file.hpp"
+
+namespace TestClient {
+
+static bool IsManifestHeader(const ManifestHeader& header) {
+    return std::equal(MANIFEST_MAGIC, MANIFEST_MAGIC + sizeof(MANIFEST_MAGIC), header.magic_)
+        && header.version_ == MANIFEST_VERSION
+        && header.recordSize_ == sizeof(ManifestRecord);
+}
+
+ManifestWriter::ManifestWriter()
+    : count_(0)
+{ }
+
+ManifestWriter::~ManifestWriter() {
+    Close();
+}
+
+bool ManifestWriter::Open(const std::string& fileName) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // append to an existing manifest, rewriting a record cut short by a crash
+    file_.open(fileName.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    if (file_) {
+        ManifestHeader header;
+        file_.seekg(0, std::ios::end);
+        auto fileSize = static_cast<uint64_t>(file_.tellg());
+        file_.seekg(0, std::ios::beg);
+        if (fileSize < sizeof(header)
+            || !file_.read(reinterpret_cast<char*>(&header), sizeof(header))
+            || !IsManifestHeader(header)) {
+            file_.close();
+            return false;
+        }
+
+        count_ = (fileSize - sizeof(header)) / sizeof(ManifestRecord);
+        file_.seekp(sizeof(header) + count_ * sizeof(ManifestRecord), std::ios::beg);
+        return true;
+    }
+
+    file_.clear();
+    file_.open(fileName.c_str(), std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file_) {
+        return false;
+    }
+
+    ManifestHeader header;
+    std::copy(MANIFEST_MAGIC, MANIFEST_MAGIC + sizeof(MANIFEST_MAGIC), header.magic_);
+    header.version_ = MANIFEST_VERSION;
+    header.recordSize_ = sizeof(ManifestRecord);
+    header.count_ = 0;
+    count_ = 0;
+
+    return static_cast<bool>(file_.write(reinterpret_cast<const char*>(&header), sizeof(header)));
+}
+
+bool ManifestWriter::Append(const utility::string_t& uuid, uint64_t size, uint32_t checksum, bool hasChecksum) {
+    auto id = utility::conversions::to_utf8string(uuid);
+
+    ManifestRecord record;
+    if (id.empty() || id.size() >= sizeof(record.uuid_)) {
+        return false;
+    }
+
+    std::fill(record.uuid_, record.uuid_ + sizeof(record.uuid_), '\0');
+    std::copy(id.begin(), id.end(), record.uuid_);
+    record.size_ = size;
+    record.checksum_ = hasChecksum ? checksum : 0;
+    record.flags_ = hasChecksum ? ManifestRecord::FLAG_CHECKSUM : 0;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!file_.is_open() || !file_.write(reinterpret_cast<const char*>(&record), sizeof(record))) {
+        return false;
+    }
+
+    ++count_;
+    return true;
+}
+
+void ManifestWriter::Close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!file_.is_open()) {
+        return;
+    }
+
+    file_.seekp(offsetof(ManifestHeader, count_), std::ios::beg);
+    file_.write(reinterpret_cast<const char*>(&count_), sizeof(count_));
+    file_.close();
+}
+
+uint64_t ManifestWriter::Count() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return count_;
+}
+
+ManifestReader::ManifestReader()
+    : records_(nullptr),
+    count_(0)
+{ }
+
+ManifestReader::~ManifestReader() { }
+
+bool ManifestReader::Open(const std::string& fileName) {
+    namespace io = boost::iostreams;
+
+    try {
+        std::unique_ptr<io::mapped_file_source> file(new io::mapped_file_source(fileName));
+        if (file->size() < sizeof(ManifestHeader)) {
+            return false;
+        }
+
+        const auto* header = reinterpret_cast<const ManifestHeader*>(file->data());
+        if (!IsManifestHeader(*header)) {
+            return false;
+        }
+
+        // the file size, not the header, is authoritative after a crash
+        count_ = (file->size() - sizeof(ManifestHeader)) / sizeof(ManifestRecord);
+        records_ = reinterpret_cast<const ManifestRecord*>(file->data() + sizeof(ManifestHeader));
+        file_ = std::move(file);
+        return true;
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+}
+
+} // namespace TestClient
@@ -0,0 +1,92 @@
+#include "mappedsource.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "boost/iostreams/device/mapped_file.hpp"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif // __linux__
+
+namespace TestClient {
+
+static std::atomic<uint64_t> sourceUploads(0);
+static std::atomic<uint64_t> sourceMappedUploads(0);
+static std::atomic<uint64_t> sourceBytesCopied(0);
+
+struct MappedSourceFile::Mapping {
+    boost::iostreams::mapped_file_source    file_;
+}; // Mapping
+
+MappedSourceFile::MappedSourceFile(const std::string& fileName)
+    : mapping_(new Mapping()),
+    data_(nullptr),
+    size_(0)
+{
+    mapping_->file_.open(fileName);
+    data_ = reinterpret_cast<const uint8_t*>(mapping_->file_.data());
+    size_ = mapping_->file_.size();
+}
+
+MappedSourceFile::~MappedSourceFile()
+{ }
+
+bool MappedSourceFile::ResidentBytes(uint64_t& bytes) const {
+    bytes = 0;
+#if defined(__linux__)
+    auto pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    std::vector<unsigned char> pages(static_cast<size_t>((size_ + pageSize - 1) / pageSize));
+    if (pages.empty()) {
+        return true;
+    }
+
+    // the mapping starts on a page boundary
+    if (mincore(const_cast<uint8_t*>(data_), static_cast<size_t>(size_), pages.data()) != 0) {
+        return false;
+    }
+
+    for (size_t i = 0; i < pages.size(); ++i) {
+        if (pages[i] & 1) {
+            bytes += pageSize;
+        }
+    }
+    bytes = std::min(bytes, size_);
+    return true;
+#else
+    return false;
+#endif // __linux__
+}
+
+void MappedSourceFile::Prefetch(uint64_t offset, uint64_t length) const {
+    if (offset >= size_) {
+        return;
+    }
+    length = std::min(length, size_ - offset);
+#if defined(__linux__)
+    // advice applies to whole pages, start on the page holding offset
+    auto pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    auto start = offset - offset % pageSize;
+    posix_madvise(const_cast<uint8_t*>(data_) + start, static_cast<size_t>(offset + length - start), POSIX_MADV_WILLNEED);
+#endif // __linux__
+}
+
+void RecordSourceRead(bool mapped, uint64_t bytesCopied) {
+    sourceUploads.fetch_add(1, std::memory_order_relaxed);
+    if (mapped) {
+        sourceMappedUploads.fetch_add(1, std::memory_order_relaxed);
+    }
+    sourceBytesCopied.fetch_add(bytesCopied, std::memory_order_relaxed);
+}
+
+SourceReadStats SourceReads() {
+    SourceReadStats stats;
+    stats.uploads_ = sourceUploads.load(std::memory_order_relaxed);
+    stats.mappedUploads_ = sourceMappedUploads.load(std::memory_order_relaxed);
+    stats.bytesCopied_ = sourceBytesCopied.load(std::memory_order_relaxed);
+    return stats;
+}
+
+} // namespace TestClient
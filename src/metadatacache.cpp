@@ -0,0 +1,111 @@
+#include "metadatacache.h"
+
+#include <functional>
+
+namespace TestClient {
+
+BlobMetadataCache::BlobMetadataCache(size_t capacity)
+    : shards_(new Shard[NUM_SHARDS]),
+    shardCapacity_((capacity + NUM_SHARDS - 1) / NUM_SHARDS)
+{ }
+
+BlobMetadataCache::Shard& BlobMetadataCache::ShardOf(const utility::string_t& uuid) const {
+    return shards_[std::hash<utility::string_t>()(uuid) % NUM_SHARDS];
+}
+
+void BlobMetadataCache::Put(const utility::string_t& uuid, uint64_t size) {
+    if (!Enabled()) {
+        return;
+    }
+
+    auto& shard = ShardOf(uuid);
+    std::lock_guard<std::mutex> lock(shard.mutex_);
+
+    auto iter = shard.sizes_.find(uuid);
+    if (iter != shard.sizes_.end()) {
+        iter->second.size_ = size;
+        return;
+    }
+
+    while (shard.sizes_.size() >= shardCapacity_ && !shard.order_.empty()) {
+        shard.sizes_.erase(shard.order_.front());
+        shard.order_.pop_front();
+        ++shard.evictions_;
+    }
+
+    Entry entry;
+    entry.size_ = size;
+    entry.position_ = shard.order_.insert(shard.order_.end(), uuid);
+    shard.sizes_.insert(std::make_pair(uuid, entry));
+}
+
+bool BlobMetadataCache::Get(const utility::string_t& uuid, uint64_t& size) {
+    if (!Enabled()) {
+        return false;
+    }
+
+    auto& shard = ShardOf(uuid);
+    std::lock_guard<std::mutex> lock(shard.mutex_);
+
+    auto iter = shard.sizes_.find(uuid);
+    if (iter == shard.sizes_.end()) {
+        ++shard.misses_;
+        return false;
+    }
+
+    ++shard.hits_;
+    size = iter->second.size_;
+    return true;
+}
+
+void BlobMetadataCache::Erase(const utility::string_t& uuid) {
+    if (!Enabled()) {
+        return;
+    }
+
+    auto& shard = ShardOf(uuid);
+    std::lock_guard<std::mutex> lock(shard.mutex_);
+    auto iter = shard.sizes_.find(uuid);
+    if (iter != shard.sizes_.end()) {
+        shard.order_.erase(iter->second.position_);
+        shard.sizes_.erase(iter);
+    }
+}
+
+uint64_t BlobMetadataCache::Hits() const {
+    uint64_t hits = 0;
+    for (size_t i = 0; i < NUM_SHARDS; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex_);
+        hits += shards_[i].hits_;
+    }
+    return hits;
+}
+
+uint64_t BlobMetadataCache::Misses() const {
+    uint64_t misses = 0;
+    for (size_t i = 0; i < NUM_SHARDS; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex_);
+        misses += shards_[i].misses_;
+    }
+    return misses;
+}
+
+uint64_t BlobMetadataCache::Evictions() const {
+    uint64_t evictions = 0;
+    for (size_t i = 0; i < NUM_SHARDS; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex_);
+        evictions += shards_[i].evictions_;
+    }
+    return evictions;
+}
+
+size_t BlobMetadataCache::Size() const {
+    size_t size = 0;
+    for (size_t i = 0; i < NUM_SHARDS; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex_);
+        size += shards_[i].sizes_.size();
+    }
+    return size;
+}
+
+} // namespace TestClient
@@ -1,12 +1,13 @@
 #include "miscutils.h"
+#include "checksum.h"
 
 #include <iostream>
+#include <fstream>
 #include <string>
 #include <stdio.h>
 #include <chrono>
 
 #include "boost/iostreams/device/mapped_file.hpp"
-#include "boost/crc.hpp"
 
 #ifdef _WIN32
 #include <windows.h>
@@ -31,15 +32,10 @@ bool CompareFileContent(const std::string& fileName1, const std::string& fileNam
             return false; // different
     }
     else {
-        boost::crc_optimal<64, 0x04C11DB7, 0, 0, false, false> crc;
-        crc.process_block(f1.data(), f1.data() + f1.size());
-        auto checksum1 = crc.checksum();
+        auto checksum1 = Crc32c(reinterpret_cast<const uint8_t*>(f1.data()), f1.size());
+        auto checksum2 = Crc32c(reinterpret_cast<const uint8_t*>(f2.data()), f2.size());
 
-        crc.reset();
-        crc.process_block(f2.data(), f2.data() + f2.size());
-        auto checksum2 = crc.checksum();
-
-        return (checksum1 == checksum2);
+        return (f1.size() == f2.size() && checksum1 == checksum2);
     }
 }
 
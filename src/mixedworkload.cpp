@@ -0,0 +1,219 @@
+#include "mixedworkload.h"
+#include "phasestats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <thread>
+
+namespace TestClient {
+
+/**
+ * \brief splitmix64, one state word per worker
+ */
+static uint64_t NextRandom(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * \brief Uniform double in [0, 1) from the top 53 bits
+ */
+static double NextUniform(uint64_t& state) {
+    return (double)(NextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+Popularity PopularityFromName(const std::string& name) {
+    if (name == "uniform") {
+        return POPULARITY_UNIFORM;
+    }
+    if (name == "zipf" || name == "zipfian") {
+        return POPULARITY_ZIPF;
+    }
+    return NUM_POPULARITIES;
+}
+
+ZipfianGenerator::ZipfianGenerator(double exponent)
+    : theta_(std::fabs(exponent - 1.0) < 1e-3 ? 1.0 - 1e-3 : exponent),
+    zetaN_(0.0),
+    eta_(0.0),
+    n_(0)
+{
+    alpha_ = 1.0 / (1.0 - theta_);
+    zeta2_ = 1.0 + std::pow(0.5, theta_);
+}
+
+void ZipfianGenerator::Grow(uint64_t n) {
+    if (n <= n_) {
+        return;
+    }
+    for (auto i = n_ + 1; i <= n; ++i) {
+        zetaN_ += 1.0 / std::pow((double)i, theta_);
+    }
+    n_ = n;
+    eta_ = (1.0 - std::pow(2.0 / (double)n_, 1.0 - theta_)) / (1.0 - zeta2_ / zetaN_);
+}
+
+uint64_t ZipfianGenerator::Next(double u) const {
+    if (n_ <= 1) {
+        return 0;
+    }
+
+    auto uz = u * zetaN_;
+    if (uz < 1.0) {
+        return 0;
+    }
+    if (uz < zeta2_) {
+        return 1;
+    }
+
+    auto rank = (uint64_t)((double)n_ * std::pow(eta_ * u - eta_ + 1.0, alpha_));
+    return std::min(rank, n_ - 1);
+}
+
+/**
+ * \brief Everything one worker touches while it runs
+ *
+ * Allocated separately per worker and padded, so counters of neighbouring
+ * workers never share a cache line.
+ */
+struct MixedWorker {
+    uint64_t                        random_;
+    ZipfianGenerator                zipf_;
+    std::vector<utility::string_t>  blobs_;     // own uploads, reserved up front
+    MixedWorkloadResult             result_;
+    char                            padding_[64];
+
+    MixedWorker(uint64_t seed, double zipfExponent)
+        : random_(seed), zipf_(zipfExponent)
+    { }
+}; // MixedWorker
+
+/**
+ * \brief Index of the source to upload, drawn from the cumulative weights
+ */
+static size_t PickSource(const std::vector<double>& cumulative, uint64_t& random) {
+    if (cumulative.size() <= 1) {
+        return 0;
+    }
+    auto u = NextUniform(random) * cumulative.back();
+    auto iter = std::upper_bound(cumulative.begin(), cumulative.end(), u);
+    return std::min<size_t>(iter - cumulative.begin(), cumulative.size() - 1);
+}
+
+static void RunWorker(MixedWorker& worker, size_t workerId, const MixedWorkloadOptions& options,
+    const std::vector<double>& cumulative, const std::vector<utility::string_t>& preloaded,
+    const MixedWriteOperation& write, const MixedReadOperation& read)
+{
+    auto& result = worker.result_;
+    for (uint64_t op = 0; op < options.operations_; ++op) {
+        auto available = (uint64_t)(preloaded.size() + worker.blobs_.size());
+        auto isRead = NextUniform(worker.random_) < options.readRatio_;
+        if (isRead && available == 0) {
+            ++result.readsAsWrites_;
+            isRead = false;
+        }
+
+        auto tStart = PhaseStats::Clock::now();
+        if (isRead) {
+            uint64_t index;
+            if (options.popularity_ == POPULARITY_ZIPF) {
+                worker.zipf_.Grow(available);
+                index = worker.zipf_.Next(NextUniform(worker.random_));
+            }
+            else {
+                index = NextRandom(worker.random_) % available;
+            }
+
+            const auto& uuid = (index < preloaded.size())
+                ? preloaded[(size_t)index]
+                : worker.blobs_[(size_t)(index - preloaded.size())];
+            if (!read(workerId, uuid)) {
+                ++result.readFailures_;
+            }
+            PhaseStats::Record(PHASE_MIXED_READ, tStart);
+            ++result.reads_;
+        }
+        else {
+            auto uuid = write(workerId, PickSource(cumulative, worker.random_));
+            if (uuid.empty()) {
+                ++result.writeFailures_;
+            }
+            else {
+                worker.blobs_.push_back(uuid);
+            }
+            PhaseStats::Record(PHASE_MIXED_WRITE, tStart);
+            ++result.writes_;
+        }
+    }
+}
+
+MixedWorkloadResult RunMixedWorkload(const MixedWorkloadOptions& options, size_t sources,
+    MixedWriteOperation write, MixedReadOperation read)
+{
+    MixedWorkloadResult result;
+    if (options.workers_ == 0 || sources == 0) {
+        return result;
+    }
+
+    std::vector<double> cumulative(sources, 1.0);
+    for (size_t i = 0; i < sources && i < options.writeWeights_.size(); ++i) {
+        cumulative[i] = std::max(options.writeWeights_[i], 0.0);
+    }
+    for (size_t i = 1; i < sources; ++i) {
+        cumulative[i] += cumulative[i - 1];
+    }
+
+    std::vector<std::unique_ptr<MixedWorker>> workers;
+    for (size_t w = 0; w < options.workers_; ++w) {
+        workers.push_back(std::unique_ptr<MixedWorker>(new MixedWorker(options.seed_ + w, options.zipfExponent_)));
+        // a worker writes at most every operation, its array never reallocates
+        workers.back()->blobs_.reserve((size_t)options.operations_);
+    }
+
+    // each worker uploads its share of the preload into disjoint slots
+    std::vector<utility::string_t> preloaded((size_t)options.preload_);
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < options.workers_; ++w) {
+        threads.push_back(std::thread([&, w]() {
+            auto& worker = *workers[w];
+            for (auto i = w; i < preloaded.size(); i += options.workers_) {
+                preloaded[i] = write(w, PickSource(cumulative, worker.random_));
+            }
+        }));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+
+    preloaded.erase(std::remove(preloaded.begin(), preloaded.end(), utility::string_t()), preloaded.end());
+    result.preloaded_ = preloaded.size();
+
+    auto tStart = PhaseStats::Clock::now();
+    for (size_t w = 0; w < options.workers_; ++w) {
+        threads.push_back(std::thread([&, w]() {
+            RunWorker(*workers[w], w, options, cumulative, preloaded, write, read);
+        }));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    result.elapsedS_ = std::chrono::duration<double>(PhaseStats::Clock::now() - tStart).count();
+
+    for (size_t w = 0; w < workers.size(); ++w) {
+        const auto& counts = workers[w]->result_;
+        result.reads_ += counts.reads_;
+        result.writes_ += counts.writes_;
+        result.readFailures_ += counts.readFailures_;
+        result.writeFailures_ += counts.writeFailures_;
+        result.readsAsWrites_ += counts.readsAsWrites_;
+    }
+
+    return result;
+}
+
+} // namespace TestClient
@@ -0,0 +1,503 @@
+#include "mockcontentservice.h"
+#include "compression.h"
+#include "jsonutils.h"
+
+#include "cpprest/rawptrstream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Concurrency::streams;
+
+using namespace web;
+using namespace web::http;
+using namespace web::http::experimental::listener;
+
+namespace TestClient {
+
+// a resumable upload answers 308 until it has every byte
+static const web::http::status_code STATUS_RESUME_INCOMPLETE = 308;
+
+// uploads are read through this much scratch memory when they are discarded
+static const size_t DISCARD_BUFFER_SIZE = 256 * 1024;
+
+/**
+ * \brief One blob, its data and the ranges of it uploaded so far
+ */
+struct MockContentService::Blob {
+    std::mutex                      mutex_;
+    uint64_t                        contentLength_;
+    std::vector<uint8_t>            data_;      // allocated on first use when storing
+    uint64_t                        committed_; // bytes received contiguously from offset 0
+    std::map<uint64_t, uint64_t>    pending_;   // ranges received past committed_, start -> end
+
+    explicit Blob(uint64_t contentLength)
+        : contentLength_(contentLength),
+        committed_(0)
+    { }
+
+    uint8_t* Data() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (data_.size() != contentLength_) {
+            data_.resize(static_cast<size_t>(contentLength_));
+        }
+        return data_.data();
+    }
+
+    /**
+     * \brief Marks [offset, end) as received
+     * @return bytes committed contiguously from offset 0
+     */
+    uint64_t Commit(uint64_t offset, uint64_t end) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (end > offset) {
+            auto& pendingEnd = pending_[offset];
+            pendingEnd = std::max(pendingEnd, end);
+        }
+
+        auto iter = pending_.begin();
+        while (iter != pending_.end() && iter->first <= committed_) {
+            committed_ = std::max(committed_, iter->second);
+            iter = pending_.erase(iter);
+        }
+
+        return committed_;
+    }
+}; // Blob
+
+/**
+ * \brief Runs delayed replies on one timer thread
+ *
+ * Sleeping in a handler would hold one of the listener's threads per request
+ * and cap the request rate, so delayed replies wait here instead.
+ */
+class MockContentService::DelayQueue {
+    typedef std::chrono::steady_clock Clock;
+
+    std::mutex                                              mutex_;
+    std::condition_variable                                 wake_;
+    std::multimap<Clock::time_point, std::function<void()>> queue_;
+    bool                                                    stop_;
+    std::thread                                             thread_;
+
+    void Run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stop_) {
+            if (queue_.empty()) {
+                wake_.wait(lock);
+                continue;
+            }
+
+            auto first = queue_.begin();
+            if (first->first > Clock::now()) {
+                wake_.wait_until(lock, first->first);
+                continue;
+            }
+
+            auto func = first->second;
+            queue_.erase(first);
+
+            lock.unlock();
+            func();
+            lock.lock();
+        }
+    }
+
+public:
+    DelayQueue()
+        : stop_(false)
+    {
+        thread_ = std::thread([this]() { Run(); });
+    }
+
+    ~DelayQueue() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+
+    void Post(int64_t delayMS, std::function<void()> func) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.insert(std::make_pair(Clock::now() + std::chrono::milliseconds(delayMS), func));
+        }
+        wake_.notify_one();
+    }
+}; // DelayQueue
+
+/**
+ * \brief Parses "bytes first-last/total", a '*' range is a status query and gives length 0
+ */
+static bool ParseContentRange(const utility::string_t& value, uint64_t& offset, uint64_t& length, uint64_t& total) {
+    auto space = value.find(U(' '));
+    auto slash = value.find(U('/'));
+    if (space == utility::string_t::npos || slash == utility::string_t::npos || slash < space) {
+        return false;
+    }
+
+    try {
+        total = std::stoull(value.substr(slash + 1));
+
+        auto range = value.substr(space + 1, slash - space - 1);
+        if (range == U("*")) {
+            offset = 0;
+            length = 0;
+            return true;
+        }
+
+        auto dash = range.find(U('-'));
+        if (dash == utility::string_t::npos) {
+            return false;
+        }
+
+        offset = std::stoull(range.substr(0, dash));
+        auto last = std::stoull(range.substr(dash + 1));
+        if (last < offset || last >= total) {
+            return false;
+        }
+
+        length = last - offset + 1;
+        return true;
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+}
+
+/**
+ * \brief Parses "bytes=first-last" or "bytes=first-" against a blob of total bytes
+ */
+static bool ParseRange(const utility::string_t& value, uint64_t total, uint64_t& offset, uint64_t& length) {
+    auto equals = value.find(U('='));
+    auto dash = value.find(U('-'));
+    if (equals == utility::string_t::npos || dash == utility::string_t::npos || dash < equals) {
+        return false;
+    }
+
+    try {
+        offset = std::stoull(value.substr(equals + 1, dash - equals - 1));
+        auto last = total > 0 ? total - 1 : 0;
+        if (dash + 1 < value.size()) {
+            last = std::min(last, static_cast<uint64_t>(std::stoull(value.substr(dash + 1))));
+        }
+        if (offset >= total || last < offset) {
+            return false;
+        }
+
+        length = last - offset + 1;
+        return true;
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+}
+
+/**
+ * \brief Reads and drops a request body
+ */
+static pplx::task<uint64_t> DrainBody(istream body, std::shared_ptr<std::vector<uint8_t>> scratch, uint64_t received) {
+    rawptr_buffer<uint8_t> target(scratch->data(), scratch->size(), std::ios::out);
+    return body.read(target, scratch->size()).then(
+        [body, scratch, received](size_t count) -> pplx::task<uint64_t>
+        {
+            if (count == 0) {
+                return pplx::task_from_result(received);
+            }
+            return DrainBody(body, scratch, received + count);
+        }
+    );
+}
+
+MockContentService::MockContentService(const utility::string_t& uri, const MockContentServiceOptions& options)
+    : options_(options),
+    listener_(uri),
+    delays_(new DelayQueue()),
+    nextId_(1),
+    creates_(0),
+    uploads_(0),
+    metadataGets_(0),
+    downloads_(0),
+    bytesReceived_(0),
+    bytesSent_(0)
+{
+    if (!options_.storeData_) {
+        pattern_ = std::make_shared<TestDataPattern>(options_.payloadType_, options_.payloadSeed_);
+    }
+
+    listener_.support(methods::POST, [this](http_request request) { HandlePost(request); });
+    listener_.support(methods::PUT, [this](http_request request) { HandlePut(request); });
+    listener_.support(methods::GET, [this](http_request request) { HandleGet(request); });
+}
+
+MockContentService::~MockContentService() { }
+
+pplx::task<void> MockContentService::Open() {
+    return listener_.open();
+}
+
+pplx::task<void> MockContentService::Close() {
+    return listener_.close();
+}
+
+void MockContentService::HandlePost(http_request request) {
+    auto path = uri::split_path(uri::decode(request.relative_uri().path()));
+    if (path.size() == 1 && path[0] == U("blob")) {
+        CreateBlob(request);
+        return;
+    }
+
+    ReplyError(request, status_codes::NotFound, U("Unknown route"));
+}
+
+void MockContentService::HandlePut(http_request request) {
+    auto path = uri::split_path(uri::decode(request.relative_uri().path()));
+    if (path.size() == 3 && path[0] == U("blob") && path[2] == U("upload")) {
+        Upload(request, path[1]);
+        return;
+    }
+
+    ReplyError(request, status_codes::NotFound, U("Unknown route"));
+}
+
+void MockContentService::HandleGet(http_request request) {
+    auto path = uri::split_path(uri::decode(request.relative_uri().path()));
+    if (path.size() == 2 && path[0] == U("blob")) {
+        GetMetadata(request, path[1]);
+        return;
+    }
+    if (path.size() == 3 && path[0] == U("blob") && path[2] == U("download")) {
+        Download(request, path[1]);
+        return;
+    }
+
+    ReplyError(request, status_codes::NotFound, U("Unknown route"));
+}
+
+void MockContentService::CreateBlob(http_request request) {
+    request.extract_json(true).then(
+        [this, request](pplx::task<json::value> previousTask)
+        {
+            uint64_t size = 0;
+            try {
+                auto document = previousTask.get();
+                size = document.at(U("data")).at(U("attributes")).at(U("contentLength")).as_number().to_uint64();
+            }
+            catch (const std::exception&) {
+                ReplyError(request, status_codes::BadRequest, U("Malformed blob document"));
+                return;
+            }
+
+            // uuid-shaped, unique within the run
+            utility::stringstream_t ss;
+            ss << U("00000000-0000-4000-8000-") << std::hex << std::setfill(U('0')) << std::setw(12)
+                << nextId_.fetch_add(1, std::memory_order_relaxed);
+            auto id = ss.str();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                blobs_[id] = std::make_shared<Blob>(size);
+            }
+            creates_.fetch_add(1, std::memory_order_relaxed);
+
+            http_response response(status_codes::Created);
+            response.set_body(JsonBlob(id, size));
+            Reply(request, response, options_.createDelayMS_);
+        }
+    );
+}
+
+void MockContentService::Upload(http_request request, const utility::string_t& id) {
+    auto blob = FindBlob(id);
+    if (!blob) {
+        ReplyError(request, status_codes::NotFound, U("Blob not found"));
+        return;
+    }
+
+    uint64_t offset = 0;
+    uint64_t length = blob->contentLength_;
+    utility::string_t contentRange;
+    auto ranged = request.headers().match(U("Content-Range"), contentRange);
+    if (ranged) {
+        uint64_t total = 0;
+        if (!ParseContentRange(contentRange, offset, length, total) || total != blob->contentLength_) {
+            ReplyError(request, status_codes::BadRequest, U("Invalid Content-Range"));
+            return;
+        }
+    }
+
+    utility::string_t encoding;
+    auto gzipped = !ranged && request.headers().match(U("Content-Encoding"), encoding) && encoding == U("gzip");
+
+    pplx::task<uint64_t> receiveTask = pplx::task_from_result<uint64_t>(0);
+    if (gzipped) {
+        // decoded as it arrives, the length checked is the decoded one
+        auto counters = std::make_shared<CompressionCounters>();
+        auto decoder = GzipStream::Decompress(options_.storeData_
+            ? streambuf<uint8_t>(rawptr_buffer<uint8_t>(blob->Data(), static_cast<size_t>(length), std::ios::out))
+            : streambuf<uint8_t>(), counters);
+        receiveTask = request.body().read_to_end(decoder).then(
+            [decoder, counters](size_t) mutable -> pplx::task<uint64_t>
+            {
+                return decoder.sync().then([counters]() { return counters->rawBytes_; });
+            }
+        );
+    }
+    else if (length > 0) {
+        if (options_.storeData_) {
+            rawptr_buffer<uint8_t> target(blob->Data() + offset, static_cast<size_t>(length), std::ios::out);
+            receiveTask = request.body().read_to_end(target).then([](size_t count) { return static_cast<uint64_t>(count); });
+        }
+        else {
+            receiveTask = DrainBody(request.body(), std::make_shared<std::vector<uint8_t>>(DISCARD_BUFFER_SIZE), 0);
+        }
+    }
+
+    receiveTask.then(
+        [this, request, id, blob, offset, length, ranged](pplx::task<uint64_t> previousTask)
+        {
+            uint64_t received = 0;
+            try {
+                received = previousTask.get();
+            }
+            catch (const std::exception&) {
+                ReplyError(request, status_codes::BadRequest, U("Failed to read body"));
+                return;
+            }
+
+            if (received != length) {
+                ReplyError(request, status_codes::BadRequest, U("Content-Length mismatched"));
+                return;
+            }
+
+            bytesReceived_.fetch_add(received, std::memory_order_relaxed);
+            uploads_.fetch_add(1, std::memory_order_relaxed);
+
+            auto committed = blob->Commit(offset, offset + length);
+            if (!ranged || committed >= blob->contentLength_) {
+                http_response response(status_codes::OK);
+                response.set_body(JsonBlob(id, blob->contentLength_));
+                Reply(request, response, options_.uploadDelayMS_);
+                return;
+            }
+
+            http_response response(STATUS_RESUME_INCOMPLETE);
+            if (committed > 0) {
+                utility::stringstream_t ss;
+                ss << U("bytes=0-") << (committed - 1);
+                response.headers().add(U("Range"), ss.str());
+            }
+            Reply(request, response, options_.uploadDelayMS_);
+        }
+    );
+}
+
+void MockContentService::GetMetadata(http_request request, const utility::string_t& id) {
+    auto blob = FindBlob(id);
+    if (!blob) {
+        ReplyError(request, status_codes::NotFound, U("Blob not found"));
+        return;
+    }
+
+    metadataGets_.fetch_add(1, std::memory_order_relaxed);
+
+    http_response response(status_codes::OK);
+    response.set_body(JsonBlob(id, blob->contentLength_));
+    Reply(request, response, options_.metadataDelayMS_);
+}
+
+void MockContentService::Download(http_request request, const utility::string_t& id) {
+    auto blob = FindBlob(id);
+    if (!blob) {
+        ReplyError(request, status_codes::NotFound, U("Blob not found"));
+        return;
+    }
+
+    uint64_t offset = 0;
+    uint64_t length = blob->contentLength_;
+    http_response response(status_codes::OK);
+
+    utility::string_t range;
+    if (request.headers().match(U("Range"), range)) {
+        if (!ParseRange(range, blob->contentLength_, offset, length)) {
+            ReplyError(request, status_codes::RangeNotSatisfiable, U("Invalid Range"));
+            return;
+        }
+
+        utility::stringstream_t ss;
+        ss << U("bytes ") << offset << U("-") << (offset + length - 1) << U("/") << blob->contentLength_;
+        response.set_status_code(status_codes::PartialContent);
+        response.headers().add(U("Content-Range"), ss.str());
+    }
+
+    // only whole downloads are encoded, a range of a gzip body could not be decoded on its own
+    utility::string_t accepted;
+    auto gzipped = options_.gzipLevel_ >= 0 && response.status_code() == status_codes::OK
+        && request.headers().match(U("Accept-Encoding"), accepted) && accepted.find(U("gzip")) != utility::string_t::npos;
+
+    if (length > 0) {
+        auto body = options_.storeData_
+            ? rawptr_stream<uint8_t>::open_istream(blob->Data() + offset, static_cast<size_t>(length))
+            : TestDataInputStream::Open(pattern_, length, offset);
+        if (gzipped) {
+            response.headers().add(U("Content-Encoding"), U("gzip"));
+            response.set_body(GzipStream::Compress(body, options_.gzipLevel_, std::make_shared<CompressionCounters>()), U("application/octet-stream"));
+        }
+        else {
+            response.set_body(body, length, U("application/octet-stream"));
+        }
+    }
+
+    downloads_.fetch_add(1, std::memory_order_relaxed);
+    bytesSent_.fetch_add(length, std::memory_order_relaxed);
+
+    // the body streams out of the blob, keep it alive until the reply is sent
+    Reply(request, response, options_.downloadDelayMS_, blob);
+}
+
+std::shared_ptr<MockContentService::Blob> MockContentService::FindBlob(const utility::string_t& id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto iter = blobs_.find(id);
+    return iter != blobs_.end() ? iter->second : std::shared_ptr<Blob>();
+}
+
+void MockContentService::Reply(http_request request, http_response response, int64_t delayMS,
+    std::shared_ptr<void> keepAlive /*= std::shared_ptr<void>()*/)
+{
+    auto send = [request, response, keepAlive]() {
+        request.reply(response).then(
+            [keepAlive](pplx::task<void> previousTask) {
+                try {
+                    previousTask.get();
+                }
+                catch (const std::exception&) {
+                    // the client went away, nothing to do
+                }
+            }
+        );
+    };
+
+    if (delayMS > 0) {
+        delays_->Post(delayMS, send);
+    }
+    else {
+        send();
+    }
+}
+
+void MockContentService::ReplyError(http_request request, status_code status, const utility::string_t& title) {
+    http_response response(status);
+    response.set_body(JsonError(status, title));
+    Reply(request, response, 0);
+}
+
+} // namespace TestClient
@@ -0,0 +1,116 @@
+#include "compression.h"
+#include "mockcontentservice.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace std;
+using namespace TestClient;
+
+void PrintUsage() {
+    cout << "Usage:" << endl
+        << "mockcontentservice [options]" << endl
+        << "  --host <name>              listen address, default 127.0.0.1" << endl
+        << "  --port <port>              listen port, default 8080" << endl
+        << "  --discard                  drop uploads, serve generated data on download" << endl
+        << "  --payload <pattern|random> generated data when discarding, default pattern" << endl
+        << "  --seed <n>                 seed of the generated data" << endl
+        << "  --delay-ms <ms>            delay every reply" << endl
+        << "  --create-delay-ms <ms>     delay replies to POST /blob" << endl
+        << "  --metadata-delay-ms <ms>   delay replies to GET /blob/{id}" << endl
+        << "  --upload-delay-ms <ms>     delay replies to PUT /blob/{id}/upload" << endl
+        << "  --download-delay-ms <ms>   delay replies to GET /blob/{id}/download" << endl
+        << "  --gzip-level <n>           gzip level of downloads asking for it, -1 never, default 6" << endl;
+}
+
+int main(int argc, char** argv) {
+    std::string host("127.0.0.1");
+    int port = 8080;
+    MockContentServiceOptions options;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        bool hasValue = (i + 1 < argc);
+
+        if (arg == "--discard") {
+            options.storeData_ = false;
+        }
+        else if (arg == "--host" && hasValue) {
+            host = argv[++i];
+        }
+        else if (arg == "--port" && hasValue) {
+            port = atoi(argv[++i]);
+        }
+        else if (arg == "--payload" && hasValue) {
+            options.payloadType_ = PayloadTypeFromName(argv[++i]);
+            if (options.payloadType_ == NUM_PAYLOAD_TYPES) {
+                PrintUsage();
+                return -1;
+            }
+        }
+        else if (arg == "--seed" && hasValue) {
+            options.payloadSeed_ = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--delay-ms" && hasValue) {
+            auto delayMS = atoll(argv[++i]);
+            options.createDelayMS_ = delayMS;
+            options.metadataDelayMS_ = delayMS;
+            options.uploadDelayMS_ = delayMS;
+            options.downloadDelayMS_ = delayMS;
+        }
+        else if (arg == "--create-delay-ms" && hasValue) {
+            options.createDelayMS_ = atoll(argv[++i]);
+        }
+        else if (arg == "--metadata-delay-ms" && hasValue) {
+            options.metadataDelayMS_ = atoll(argv[++i]);
+        }
+        else if (arg == "--upload-delay-ms" && hasValue) {
+            options.uploadDelayMS_ = atoll(argv[++i]);
+        }
+        else if (arg == "--download-delay-ms" && hasValue) {
+            options.downloadDelayMS_ = atoll(argv[++i]);
+        }
+        else if (arg == "--gzip-level" && hasValue) {
+            options.gzipLevel_ = atoi(argv[++i]);
+            if (options.gzipLevel_ > MAX_GZIP_LEVEL) {
+                PrintUsage();
+                return -1;
+            }
+        }
+        else {
+            PrintUsage();
+            return -1;
+        }
+    }
+
+    utility::stringstream_t uri;
+    uri << U("http://") << utility::conversions::to_string_t(host) << U(":") << port;
+
+    MockContentService service(uri.str(), options);
+    try {
+        service.Open().wait();
+    }
+    catch (const std::exception& e) {
+        cout << "Failed to listen: " << e.what() << endl;
+        return -1;
+    }
+
+    std::wcout << U("Mock content service listening on ") << uri.str()
+        << (options.storeData_ ? U(", storing uploads") : U(", discarding uploads")) << std::endl;
+    cout << "Press ENTER to stop..." << endl;
+
+    std::string line;
+    std::getline(std::cin, line);
+
+    service.Close().wait();
+
+    std::wcout << service.Creates() << U(" blobs created, ")
+        << service.Uploads() << U(" upload requests, ")
+        << service.MetadataGets() << U(" metadata requests, ")
+        << service.Downloads() << U(" download requests") << std::endl
+        << service.BytesReceived() << U(" bytes received, ")
+        << service.BytesSent() << U(" bytes sent") << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include "openloop.h"
+#include "phasestats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace TestClient {
+
+// sleep until this close to the intended start, then spin for precision
+static const std::chrono::microseconds SPIN_WINDOW(200);
+
+/**
+ * \brief Completion bookkeeping shared with the operations' continuations
+ */
+struct OpenLoopState {
+    std::atomic<uint64_t>       outstanding_;
+    std::atomic<uint64_t>       succeeded_;
+    std::atomic<uint64_t>       failed_;
+    std::mutex                  mutex_;
+    std::condition_variable     done_;
+    PhaseStats::Clock::time_point lastCompletion_;
+}; // OpenLoopState
+
+double IntendedStartTime(const OpenLoopOptions& options, uint64_t index) {
+    // operations due by time t: N(t) = r0 * t + a * t^2 / 2, with a = (r1 - r0) / T
+    auto r0 = options.startRate_;
+    auto a = (options.endRate_ - options.startRate_) / options.durationS_;
+    auto n = (double)index;
+
+    if (std::fabs(a) < 1e-12) {
+        return n / r0;
+    }
+
+    return (-r0 + std::sqrt(std::max(r0 * r0 + 2.0 * a * n, 0.0))) / a;
+}
+
+OpenLoopResult RunOpenLoop(const OpenLoopOptions& options, std::function<pplx::task<bool>(uint64_t)> operation) {
+    typedef PhaseStats::Clock Clock;
+
+    OpenLoopResult result;
+    if (options.durationS_ <= 0.0 || options.startRate_ < 0.0 || options.endRate_ < 0.0
+        || (options.startRate_ <= 0.0 && options.endRate_ <= 0.0)) {
+        return result;
+    }
+
+    // N(T) = T * (r0 + r1) / 2
+    auto totalOps = static_cast<uint64_t>(options.durationS_ * (options.startRate_ + options.endRate_) / 2.0);
+
+    auto state = std::make_shared<OpenLoopState>();
+    state->outstanding_ = 0;
+    state->succeeded_ = 0;
+    state->failed_ = 0;
+
+    auto tStart = Clock::now();
+    state->lastCompletion_ = tStart;
+
+    for (uint64_t i = 0; i < totalOps; ++i) {
+        auto offset = std::chrono::duration<double>(IntendedStartTime(options, i));
+        auto intended = tStart + std::chrono::duration_cast<Clock::duration>(offset);
+
+        auto now = Clock::now();
+        if (now + SPIN_WINDOW < intended) {
+            std::this_thread::sleep_until(intended - SPIN_WINDOW);
+        }
+        while ((now = Clock::now()) < intended) { }
+
+        auto lagUS = std::chrono::duration_cast<std::chrono::microseconds>(now - intended).count();
+        result.maxLagUS_ = std::max<int64_t>(result.maxLagUS_, lagUS);
+
+        // never completes, so it has no place in op_intended; its own phase keeps
+        // it next to the percentiles instead of letting it vanish from them
+        if (state->outstanding_.load() >= options.maxOutstanding_) {
+            PhaseStats::Record(PHASE_OPERATION_DROPPED, intended);
+            ++result.dropped_;
+            continue;
+        }
+
+        state->outstanding_.fetch_add(1);
+        ++result.issued_;
+
+        pplx::task<bool> task;
+        try {
+            task = operation(i);
+        }
+        catch (...) {
+            task = pplx::task_from_result(false);
+        }
+
+        task.then(
+            [state, intended, now](pplx::task<bool> previousTask)
+            {
+                auto success = false;
+                try {
+                    success = previousTask.get();
+                }
+                catch (...) {
+                }
+
+                if (success) {
+                    PhaseStats::Record(PHASE_OPERATION, now);
+                    PhaseStats::Record(PHASE_OPERATION_INTENDED, intended);
+                    state->succeeded_.fetch_add(1);
+                }
+                else {
+                    state->failed_.fetch_add(1);
+                }
+
+                std::lock_guard<std::mutex> lock(state->mutex_);
+                state->lastCompletion_ = Clock::now();
+                if (state->outstanding_.fetch_sub(1) == 1) {
+                    state->done_.notify_all();
+                }
+            }
+        );
+    }
+
+    auto tIssued = Clock::now();
+
+    {
+        std::unique_lock<std::mutex> lock(state->mutex_);
+        state->done_.wait(lock, [&state]() { return state->outstanding_.load() == 0; });
+    }
+
+    auto issueS = std::chrono::duration<double>(tIssued - tStart).count();
+    auto completionS = std::chrono::duration<double>(state->lastCompletion_ - tStart).count();
+
+    result.scheduled_ = totalOps;
+    result.succeeded_ = state->succeeded_.load();
+    result.failed_ = state->failed_.load();
+    result.targetRate_ = (double)totalOps / options.durationS_;
+    result.achievedRate_ = issueS > 0.0 ? (double)result.issued_ / issueS : 0.0;
+    result.completionRate_ = completionS > 0.0 ? (double)result.succeeded_ / completionS : 0.0;
+
+    return result;
+}
+
+} // namespace TestClient
@@ -0,0 +1,96 @@
+#include "phasestats.h"
+#include "miscutils.h"
+
+#include <memory>
+#include <mutex>
+
+namespace TestClient {
+
+/**
+ * \brief Histograms of one thread
+ */
+struct ThreadPhaseHistograms {
+    LatencyHistogram histograms_[NUM_LATENCY_PHASES];
+}; // ThreadPhaseHistograms
+
+// every thread's histograms, kept until exit so late snapshots still see them
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<ThreadPhaseHistograms>> registry;
+
+static TESTCLIENT_THREAD_LOCAL ThreadPhaseHistograms* threadHistograms = nullptr;
+
+static ThreadPhaseHistograms& LocalHistograms() {
+    if (threadHistograms == nullptr) {
+        std::unique_ptr<ThreadPhaseHistograms> histograms(new ThreadPhaseHistograms());
+
+        std::lock_guard<std::mutex> lock(registryMutex);
+        threadHistograms = histograms.get();
+        registry.push_back(std::move(histograms));
+    }
+
+    return *threadHistograms;
+}
+
+const char* LatencyPhaseName(LatencyPhase phase) {
+    switch (phase) {
+    case PHASE_CREATE_BLOB:         return "create_blob";
+    case PHASE_UPLOAD_PUT:          return "upload_put";
+    case PHASE_UPLOAD_CHUNK:        return "upload_chunk";
+    case PHASE_METADATA_GET:        return "metadata_get";
+    case PHASE_DOWNLOAD_BODY:       return "download_body";
+    case PHASE_DOWNLOAD_CHUNK:      return "download_chunk";
+    case PHASE_OPERATION:           return "operation";
+    case PHASE_OPERATION_INTENDED:  return "op_intended";
+    case PHASE_OPERATION_DROPPED:   return "op_dropped";
+    case PHASE_MIXED_READ:          return "mixed_read";
+    case PHASE_MIXED_WRITE:         return "mixed_write";
+    case PHASE_PIPELINE_QUEUE:      return "pipeline_queue";
+    case PHASE_PIPELINE_BLOB:       return "pipeline_blob";
+    case PHASE_DOWNLOAD_TTFB:       return "download_ttfb";
+    case PHASE_DOWNLOAD_FIRST_BYTE: return "download_first";
+    case PHASE_DOWNLOAD_STREAM:     return "download_stream";
+    case PHASE_UPLOAD_SEND:         return "upload_send";
+    case PHASE_UPLOAD_ACK:          return "upload_ack";
+    default:                        return "unknown";
+    }
+}
+
+void PhaseStats::Record(LatencyPhase phase, uint64_t latencyNS) {
+    LocalHistograms().histograms_[phase].Record(latencyNS);
+}
+
+void PhaseStats::Record(LatencyPhase phase, Clock::time_point start) {
+    auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    Record(phase, static_cast<uint64_t>(latency > 0 ? latency : 0));
+}
+
+std::vector<LatencyHistogram> PhaseStats::Snapshot() {
+    std::vector<LatencyHistogram> histograms;
+    for (int i = 0; i < NUM_LATENCY_PHASES; ++i) {
+        histograms.push_back(LatencyHistogram(LatencyPhaseName(static_cast<LatencyPhase>(i))));
+    }
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (size_t t = 0; t < registry.size(); ++t) {
+        for (int i = 0; i < NUM_LATENCY_PHASES; ++i) {
+            histograms[i].Merge(registry[t]->histograms_[i]);
+        }
+    }
+
+    return histograms;
+}
+
+void PhaseStats::Print(std::wostream& os) {
+    Print(os, Snapshot());
+}
+
+void PhaseStats::Print(std::wostream& os, const std::vector<LatencyHistogram>& histograms) {
+    PrintPercentileHeader(os);
+    for (size_t i = 0; i < histograms.size(); ++i) {
+        if (histograms[i].TotalCount() > 0) {
+            PrintPercentiles(os, histograms[i]);
+        }
+    }
+}
+
+} // namespace TestClient
@@ -0,0 +1,152 @@
+#include "pipeline.h"
+#include "asyncsemaphore.h"
+#include "phasestats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+namespace TestClient {
+
+/**
+ * \brief Stage limits and counters shared by the continuations of every blob
+ */
+struct PipelineState {
+    AsyncSemaphore              uploads_;
+    AsyncSemaphore              queue_;
+    AsyncSemaphore              downloads_;
+    PipelineDownload            download_;
+    std::atomic<uint64_t>       uploaded_;
+    std::atomic<uint64_t>       uploadFailures_;
+    std::atomic<uint64_t>       downloaded_;
+    std::atomic<uint64_t>       downloadFailures_;
+    std::mutex                  mutex_;
+    std::condition_variable     done_;
+    uint64_t                    finished_;
+
+    PipelineState(const PipelineOptions& options, PipelineDownload download)
+        : uploads_(std::max<size_t>(options.uploadConcurrency_, 1)),
+        queue_(std::max<size_t>(options.queueDepth_, 1)),
+        downloads_(std::max<size_t>(options.downloadConcurrency_, 1)),
+        download_(download),
+        uploaded_(0), uploadFailures_(0), downloaded_(0), downloadFailures_(0),
+        finished_(0)
+    { }
+
+    void Finish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++finished_;
+        }
+        done_.notify_all();
+    }
+}; // PipelineState
+
+/**
+ * \brief Download stage of one blob, entered holding a queue slot
+ */
+static pplx::task<void> DownloadStage(std::shared_ptr<PipelineState> state, utility::string_t uuid,
+    PhaseStats::Clock::time_point tBlob)
+{
+    auto tQueued = PhaseStats::Clock::now();
+    return state->downloads_.Acquire().then(
+        [state, uuid, tBlob, tQueued]() -> pplx::task<void>
+        {
+            state->queue_.Release();
+            PhaseStats::Record(PHASE_PIPELINE_QUEUE, tQueued);
+
+            pplx::task<bool> downloadTask;
+            try {
+                downloadTask = state->download_(uuid);
+            }
+            catch (...) {
+                downloadTask = pplx::task_from_result(false);
+            }
+
+            return downloadTask.then(
+                [state, tBlob](pplx::task<bool> previousTask)
+                {
+                    auto succeeded = false;
+                    try {
+                        succeeded = previousTask.get();
+                    }
+                    catch (...) { }
+
+                    state->downloads_.Release();
+                    if (succeeded) {
+                        PhaseStats::Record(PHASE_PIPELINE_BLOB, tBlob);
+                        ++state->downloaded_;
+                    }
+                    else {
+                        ++state->downloadFailures_;
+                    }
+                    state->Finish();
+                }
+            );
+        }
+    );
+}
+
+PipelineResult RunPipeline(const PipelineOptions& options, PipelineUpload upload, PipelineDownload download) {
+    auto state = std::make_shared<PipelineState>(options, download);
+
+    auto tStart = PhaseStats::Clock::now();
+    for (uint64_t i = 0; i < options.blobs_; ++i) {
+        // the only blocking wait, the driver starts no more uploads than there are slots
+        state->uploads_.Acquire().wait();
+
+        auto tBlob = PhaseStats::Clock::now();
+        pplx::task<utility::string_t> uploadTask;
+        try {
+            uploadTask = upload(i);
+        }
+        catch (...) {
+            uploadTask = pplx::task_from_result(utility::string_t());
+        }
+
+        uploadTask.then(
+            [state, tBlob](pplx::task<utility::string_t> previousTask) -> pplx::task<void>
+            {
+                utility::string_t uuid;
+                try {
+                    uuid = previousTask.get();
+                }
+                catch (...) { }
+
+                if (uuid.empty()) {
+                    ++state->uploadFailures_;
+                    state->uploads_.Release();
+                    state->Finish();
+                    return pplx::task_from_result();
+                }
+
+                ++state->uploaded_;
+                return state->queue_.Acquire().then(
+                    [state, uuid, tBlob]() -> pplx::task<void>
+                    {
+                        state->uploads_.Release();
+                        return DownloadStage(state, uuid, tBlob);
+                    }
+                );
+            }
+        );
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(state->mutex_);
+        state->done_.wait(lock, [&state, &options]() { return state->finished_ >= options.blobs_; });
+    }
+
+    PipelineResult result;
+    result.elapsedS_ = std::chrono::duration<double>(PhaseStats::Clock::now() - tStart).count();
+    result.uploaded_ = state->uploaded_.load();
+    result.uploadFailures_ = state->uploadFailures_.load();
+    result.downloaded_ = state->downloaded_.load();
+    result.downloadFailures_ = state->downloadFailures_.load();
+
+    return result;
+}
+
+} // namespace TestClient
@@ -0,0 +1,249 @@
+#include "sweep.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+
+namespace TestClient {
+
+typedef std::chrono::steady_clock SweepClock;
+
+/**
+ * \brief Counters of the cell being measured, shared by the continuations of every lane
+ */
+struct SweepCellState {
+    SweepOperation          operation_;
+    uint64_t                size_;
+    uint64_t                minOps_;
+    SweepClock::duration    window_;
+    SweepClock::time_point  measureStart_;
+    std::atomic<uint64_t>   next_;
+    std::atomic<bool>       finished_;      // window closed, lanes stop issuing
+    std::mutex              mutex_;
+    SweepCell               cell_;          // guarded by mutex_ while lanes run
+    SweepClock::time_point  measureEnd_;
+    std::condition_variable done_;
+    uint64_t                lanesDone_;
+
+    SweepCellState()
+        : size_(0), minOps_(0), next_(0), finished_(false), lanesDone_(0)
+    { }
+}; // SweepCellState
+
+/**
+ * \brief Runs operations back to back until the window of the cell closes
+ */
+static void RunLane(std::shared_ptr<SweepCellState> state) {
+    auto index = state->next_.fetch_add(1, std::memory_order_relaxed);
+    auto tStart = SweepClock::now();
+
+    pplx::task<bool> operationTask;
+    try {
+        operationTask = state->operation_(state->size_, index);
+    }
+    catch (...) {
+        operationTask = pplx::task_from_result(false);
+    }
+
+    operationTask.then(
+        [state, tStart](pplx::task<bool> previousTask)
+        {
+            auto succeeded = false;
+            try {
+                succeeded = previousTask.get();
+            }
+            catch (...) { }
+
+            auto now = SweepClock::now();
+            if (now >= state->measureStart_ && !state->finished_.load()) {
+                std::lock_guard<std::mutex> lock(state->mutex_);
+                if (!state->finished_.load()) {
+                    auto& cell = state->cell_;
+                    if (succeeded) {
+                        ++cell.ops_;
+                        cell.latency_.Record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - tStart).count()));
+                    }
+                    else {
+                        ++cell.failures_;
+                    }
+
+                    // large blobs complete few operations, their window grows until enough did
+                    if (now - state->measureStart_ >= state->window_ && cell.ops_ + cell.failures_ >= state->minOps_) {
+                        state->measureEnd_ = now;
+                        state->finished_ = true;
+                    }
+                }
+            }
+
+            if (!state->finished_.load()) {
+                RunLane(state);
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(state->mutex_);
+                ++state->lanesDone_;
+            }
+            state->done_.notify_all();
+        }
+    );
+}
+
+/**
+ * \brief Warms up and measures one cell, returns once every operation finished
+ */
+static SweepCell RunCell(const SweepOptions& options, SweepOperation operation, uint64_t size, uint64_t concurrency) {
+    auto state = std::make_shared<SweepCellState>();
+    state->operation_ = operation;
+    state->size_ = size;
+    state->minOps_ = options.minOps_;
+    state->window_ = std::chrono::duration_cast<SweepClock::duration>(std::chrono::duration<double>(options.windowS_));
+    state->measureStart_ = SweepClock::now()
+        + std::chrono::duration_cast<SweepClock::duration>(std::chrono::duration<double>(options.warmupS_));
+    state->cell_.size_ = size;
+    state->cell_.concurrency_ = concurrency;
+
+    for (uint64_t i = 0; i < concurrency; ++i) {
+        RunLane(state);
+    }
+
+    std::unique_lock<std::mutex> lock(state->mutex_);
+    state->done_.wait(lock, [&state, concurrency]() { return state->lanesDone_ == concurrency; });
+
+    auto cell = state->cell_;
+    cell.windowS_ = std::chrono::duration<double>(state->measureEnd_ - state->measureStart_).count();
+    return cell;
+}
+
+bool IsPastKnee(const SweepOptions& options, const SweepCell& best, const SweepCell& cell) {
+    auto scales = cell.BytesPerS() > best.BytesPerS() * (1.0 + options.minGain_);
+    auto inflated = (double)cell.latency_.ValueAtPercentile(99.0) > (double)best.latency_.ValueAtPercentile(99.0) * options.maxP99Growth_;
+    return !scales && inflated;
+}
+
+SweepResult RunSweep(const SweepOptions& options, SweepOperation operation) {
+    SweepResult result;
+    for (size_t s = 0; s < options.sizes_.size(); ++s) {
+        auto size = options.sizes_[s];
+        size_t best = result.cells_.size();
+        uint64_t knee = 0;
+
+        for (size_t c = 0; c < options.concurrency_.size(); ++c) {
+            auto concurrency = std::max<uint64_t>(options.concurrency_[c], 1);
+            result.cells_.push_back(RunCell(options, operation, size, concurrency));
+            const auto& cell = result.cells_.back();
+
+            // nothing succeeds at this level, higher ones will not either
+            if (cell.ops_ == 0) {
+                break;
+            }
+
+            if (best == result.cells_.size() - 1) {
+                continue;
+            }
+
+            if (IsPastKnee(options, result.cells_[best], cell)) {
+                result.cells_[best].knee_ = true;
+                knee = result.cells_[best].concurrency_;
+                break;
+            }
+            if (cell.BytesPerS() > result.cells_[best].BytesPerS()) {
+                best = result.cells_.size() - 1;
+            }
+        }
+
+        result.knees_.push_back(knee);
+    }
+
+    return result;
+}
+
+void PrintSweep(std::wostream& os, const SweepResult& result) {
+    auto toMS = [](uint64_t ns) { return (double)ns / 1e6; };
+
+    os << std::right
+        << std::setw(14) << L"size"
+        << std::setw(12) << L"inflight"
+        << std::setw(10) << L"ops"
+        << std::setw(10) << L"errors"
+        << std::setw(12) << L"ops/s"
+        << std::setw(12) << L"MB/s"
+        << std::setw(12) << L"p50(ms)"
+        << std::setw(12) << L"p99(ms)"
+        << std::setw(12) << L"p99.9(ms)" << std::endl;
+
+    for (size_t i = 0; i < result.cells_.size(); ++i) {
+        const auto& cell = result.cells_[i];
+        os << std::setw(14) << cell.size_
+            << std::setw(12) << cell.concurrency_
+            << std::setw(10) << cell.ops_
+            << std::setw(10) << cell.failures_
+            << std::fixed << std::setprecision(1)
+            << std::setw(12) << cell.OpsPerS()
+            << std::setw(12) << cell.BytesPerS() / 1e6
+            << std::setprecision(3)
+            << std::setw(12) << toMS(cell.latency_.ValueAtPercentile(50.0))
+            << std::setw(12) << toMS(cell.latency_.ValueAtPercentile(99.0))
+            << std::setw(12) << toMS(cell.latency_.ValueAtPercentile(99.9))
+            << (cell.knee_ ? L"  <- knee" : L"") << std::endl;
+        os.unsetf(std::ios::floatfield);
+    }
+}
+
+bool SaveSweep(const std::string& fileName, const SweepResult& result) {
+    std::ofstream file(fileName.c_str());
+    if (!file) {
+        return false;
+    }
+
+    auto json = fileName.size() >= 5 && fileName.compare(fileName.size() - 5, 5, ".json") == 0;
+    if (json) {
+        file << "[" << std::endl;
+    }
+    else {
+        file << "size,concurrency,ops,errors,window_s,ops_per_s,bytes_per_s,p50_us,p90_us,p99_us,p999_us,max_us,knee" << std::endl;
+    }
+
+    for (size_t i = 0; i < result.cells_.size(); ++i) {
+        const auto& cell = result.cells_[i];
+        const auto& latency = cell.latency_;
+        auto toUS = [](uint64_t ns) { return (double)ns / 1000.0; };
+
+        if (json) {
+            file << (i == 0 ? "" : ",\n")
+                << "{\"size\": " << cell.size_
+                << ", \"concurrency\": " << cell.concurrency_
+                << ", \"ops\": " << cell.ops_
+                << ", \"errors\": " << cell.failures_
+                << ", \"window_s\": " << cell.windowS_
+                << ", \"ops_per_s\": " << cell.OpsPerS()
+                << ", \"bytes_per_s\": " << cell.BytesPerS()
+                << ", \"p50_us\": " << toUS(latency.ValueAtPercentile(50.0))
+                << ", \"p90_us\": " << toUS(latency.ValueAtPercentile(90.0))
+                << ", \"p99_us\": " << toUS(latency.ValueAtPercentile(99.0))
+                << ", \"p999_us\": " << toUS(latency.ValueAtPercentile(99.9))
+                << ", \"max_us\": " << toUS(latency.Max())
+                << ", \"knee\": " << (cell.knee_ ? "true" : "false") << "}";
+        }
+        else {
+            file << cell.size_ << "," << cell.concurrency_ << "," << cell.ops_ << "," << cell.failures_ << ","
+                << cell.windowS_ << "," << cell.OpsPerS() << "," << cell.BytesPerS() << ","
+                << toUS(latency.ValueAtPercentile(50.0)) << "," << toUS(latency.ValueAtPercentile(90.0)) << ","
+                << toUS(latency.ValueAtPercentile(99.0)) << "," << toUS(latency.ValueAtPercentile(99.9)) << ","
+                << toUS(latency.Max()) << "," << (cell.knee_ ? 1 : 0) << std::endl;
+        }
+    }
+
+    if (json) {
+        file << std::endl << "]" << std::endl;
+    }
+
+    return static_cast<bool>(file);
+}
+
+} // namespace TestClient
@@ -0,0 +1,284 @@
+#include "taskscheduler.h"
+#include "miscutils.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif // _WIN32
+
+namespace TestClient {
+
+// larger than the cache line of every target, also covers adjacent-line prefetch
+static const size_t QUEUE_PADDING = 128;
+
+/**
+ * \brief Queue and counters of one pool thread
+ *
+ * The counters are written by the owning thread only, atomic so Stats() may
+ * read them meanwhile.
+ */
+struct WorkStealingScheduler::WorkerQueue {
+    char                    before_[QUEUE_PADDING];
+    mutable std::mutex      mutex_;
+    std::deque<Task>        tasks_;
+    std::atomic<uint64_t>   scheduled_;
+    std::atomic<uint64_t>   executed_;
+    std::atomic<uint64_t>   stolen_;
+    std::atomic<uint64_t>   parks_;
+    char                    after_[QUEUE_PADDING];
+
+    WorkerQueue()
+        : scheduled_(0), executed_(0), stolen_(0), parks_(0)
+    { }
+}; // WorkerQueue
+
+// the pool and queue index of a pool thread, null on any other thread
+static TESTCLIENT_THREAD_LOCAL WorkStealingScheduler* currentScheduler = nullptr;
+static TESTCLIENT_THREAD_LOCAL size_t currentIndex = 0;
+
+static void Increment(std::atomic<uint64_t>& counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+/**
+ * \brief Pins the calling thread to one CPU, ignored where unsupported
+ */
+static void PinCurrentThread(int cpu) {
+    if (cpu < 0) {
+        return;
+    }
+
+#ifdef _WIN32
+    if (cpu < static_cast<int>(8 * sizeof(DWORD_PTR))) {
+        SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu);
+    }
+#elif defined(__linux__)
+    if (cpu < CPU_SETSIZE) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+#endif // _WIN32
+}
+
+std::vector<int> NumaNodeCpus(int node) {
+    std::vector<int> cpus;
+    if (node < 0) {
+        return cpus;
+    }
+
+#ifdef _WIN32
+    ULONGLONG mask = 0;
+    if (node <= 0xFF && GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &mask)) {
+        for (int cpu = 0; cpu < 64; ++cpu) {
+            if ((mask >> cpu) & 1) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#else
+    // e.g. "0-7,16-23"
+    std::ostringstream path;
+    path << "/sys/devices/system/node/node" << node << "/cpulist";
+    std::ifstream ifs(path.str().c_str());
+    std::string list;
+    if (!std::getline(ifs, list)) {
+        return cpus;
+    }
+
+    std::istringstream iss(list);
+    std::string range;
+    while (std::getline(iss, range, ',')) {
+        int first = 0, last = 0;
+        char dash = 0;
+        std::istringstream rss(range);
+        if (!(rss >> first)) {
+            continue;
+        }
+        last = (rss >> dash >> last && dash == '-') ? last : first;
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+#endif // _WIN32
+
+    return cpus;
+}
+
+WorkStealingScheduler::WorkStealingScheduler(const SchedulerOptions& options)
+    : injected_(0),
+    queued_(0),
+    maxQueued_(0),
+    sleeping_(0),
+    stopping_(false)
+{
+    auto cpus = options.cpus_;
+    if (cpus.empty()) {
+        cpus = NumaNodeCpus(options.numaNode_);
+    }
+
+    auto threads = options.threads_;
+    if (threads == 0) {
+        threads = cpus.empty() ? std::thread::hardware_concurrency() : cpus.size();
+    }
+    threads = std::max<size_t>(threads, 1);
+
+    // every queue exists before any thread may steal from it
+    for (size_t i = 0; i < threads; ++i) {
+        queues_.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        auto cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+        threads_.push_back(std::thread([this, i, cpu]() { Run(i, cpu); }));
+    }
+}
+
+WorkStealingScheduler::~WorkStealingScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(idleMutex_);
+        stopping_ = true;
+    }
+    idle_.notify_all();
+
+    for (size_t i = 0; i < threads_.size(); ++i) {
+        // the last reference may be dropped by a continuation on the pool itself
+        if (threads_[i].get_id() == std::this_thread::get_id()) {
+            threads_[i].detach();
+        }
+        else {
+            threads_[i].join();
+        }
+    }
+}
+
+void WorkStealingScheduler::schedule(pplx::TaskProc_t proc, void* param) {
+    Task task = { proc, param };
+
+    // counted under the queue lock before the push, a thread taking the task
+    // decrements only after this increment and the count never wraps below zero
+    if (currentScheduler == this) {
+        auto& queue = *queues_[currentIndex];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex_);
+            CountQueued();
+            queue.tasks_.push_back(task);
+        }
+        Increment(queue.scheduled_);
+    }
+    else {
+        std::lock_guard<std::mutex> lock(injectionMutex_);
+        CountQueued();
+        injection_.push_back(task);
+        ++injected_;
+    }
+
+    WakeIdle();
+}
+
+void WorkStealingScheduler::CountQueued() {
+    auto queued = queued_.fetch_add(1) + 1;
+    auto maxQueued = maxQueued_.load(std::memory_order_relaxed);
+    while (queued > maxQueued && !maxQueued_.compare_exchange_weak(maxQueued, queued, std::memory_order_relaxed)) { }
+}
+
+void WorkStealingScheduler::WakeIdle() {
+    // pairs with the sleeping_ increment before a thread checks queued_ and parks
+    if (sleeping_.load() > 0) {
+        std::lock_guard<std::mutex> lock(idleMutex_);
+        idle_.notify_one();
+    }
+}
+
+bool WorkStealingScheduler::TakeTask(size_t index, Task& task) {
+    auto& own = *queues_[index];
+    {
+        // newest first, its data is most likely still in cache
+        std::lock_guard<std::mutex> lock(own.mutex_);
+        if (!own.tasks_.empty()) {
+            task = own.tasks_.back();
+            own.tasks_.pop_back();
+            queued_.fetch_sub(1);
+            return true;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(injectionMutex_);
+        if (!injection_.empty()) {
+            task = injection_.front();
+            injection_.pop_front();
+            queued_.fetch_sub(1);
+            return true;
+        }
+    }
+
+    // oldest first, the owner keeps working on the newest
+    for (size_t i = 1; i < queues_.size(); ++i) {
+        auto& victim = *queues_[(index + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex_);
+        if (!victim.tasks_.empty()) {
+            task = victim.tasks_.front();
+            victim.tasks_.pop_front();
+            queued_.fetch_sub(1);
+            Increment(own.stolen_);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void WorkStealingScheduler::Run(size_t index, int cpu) {
+    currentScheduler = this;
+    currentIndex = index;
+    PinCurrentThread(cpu);
+
+    auto& own = *queues_[index];
+    while (!stopping_.load(std::memory_order_relaxed)) {
+        Task task;
+        if (TakeTask(index, task)) {
+            task.proc_(task.param_);
+            Increment(own.executed_);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(idleMutex_);
+        sleeping_.fetch_add(1);
+        Increment(own.parks_);
+        idle_.wait(lock, [this]() { return stopping_ || queued_.load() > 0; });
+        sleeping_.fetch_sub(1);
+    }
+}
+
+SchedulerStats WorkStealingScheduler::Stats() const {
+    SchedulerStats stats;
+    for (size_t i = 0; i < queues_.size(); ++i) {
+        const auto& queue = *queues_[i];
+        auto executed = queue.executed_.load(std::memory_order_relaxed);
+        stats.scheduled_ += queue.scheduled_.load(std::memory_order_relaxed);
+        stats.executed_ += executed;
+        stats.stolen_ += queue.stolen_.load(std::memory_order_relaxed);
+        stats.parks_ += queue.parks_.load(std::memory_order_relaxed);
+        stats.executedPerThread_.push_back(executed);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(injectionMutex_);
+        stats.injected_ = injected_;
+    }
+    stats.scheduled_ += stats.injected_;
+    stats.queued_ = queued_.load(std::memory_order_relaxed);
+    stats.maxQueued_ = maxQueued_.load(std::memory_order_relaxed);
+
+    return stats;
+}
+
+} // namespace TestClient
@@ -0,0 +1,239 @@
+#include "contentservice.h"
+#include "jsonutils.h"
+#include "mockcontentservice.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace TestClient;
+
+// every allocation of the process is counted, including cpprest's and the mock service's
+static std::atomic<uint64_t> g_allocations(0);
+static std::atomic<uint64_t> g_allocatedBytes(0);
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    g_allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+
+    auto ptr = malloc(size > 0 ? size : 1);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) throw() {
+    free(ptr);
+}
+
+// results are folded in here so the compiler cannot drop the measured work
+static volatile size_t g_sink = 0;
+
+/**
+ * \brief Timing and allocations per operation of one benchmark
+ */
+struct BenchResult {
+    std::string name_;
+    uint64_t    iterations_;
+    double      nsPerOp_;
+    double      allocsPerOp_;
+    double      bytesPerOp_;
+}; // BenchResult
+
+/**
+ * \brief Runs func in batches of doubling size until a batch lasts minSeconds
+ * @param func  one operation, returns a value depending on its work
+ */
+BenchResult RunBenchmark(const std::string& name, std::function<size_t()> func, double minSeconds) {
+    typedef std::chrono::steady_clock Clock;
+
+    g_sink = g_sink + func(); // warm up caches and lazy initialization
+
+    BenchResult result;
+    result.name_ = name;
+    for (uint64_t iterations = 1; ; iterations *= 2) {
+        auto allocations = g_allocations.load(std::memory_order_relaxed);
+        auto allocatedBytes = g_allocatedBytes.load(std::memory_order_relaxed);
+        auto tStart = Clock::now();
+
+        size_t sink = 0;
+        for (uint64_t i = 0; i < iterations; ++i) {
+            sink += func();
+        }
+
+        auto tStop = Clock::now();
+        g_sink = g_sink + sink;
+
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(tStop - tStart).count();
+        if (ns >= minSeconds * 1e9 || iterations >= (uint64_t(1) << 40)) {
+            result.iterations_ = iterations;
+            result.nsPerOp_ = (double)ns / (double)iterations;
+            result.allocsPerOp_ = (double)(g_allocations.load(std::memory_order_relaxed) - allocations) / (double)iterations;
+            result.bytesPerOp_ = (double)(g_allocatedBytes.load(std::memory_order_relaxed) - allocatedBytes) / (double)iterations;
+            return result;
+        }
+    }
+}
+
+void PrintResult(const BenchResult& result) {
+    cout << std::left << std::setw(36) << result.name_ << std::right
+        << std::setw(12) << result.iterations_
+        << std::setw(14) << std::fixed << std::setprecision(1) << result.nsPerOp_
+        << std::setw(12) << std::setprecision(2) << result.allocsPerOp_
+        << std::setw(12) << std::setprecision(0) << result.bytesPerOp_ << endl;
+}
+
+void PrintUsage() {
+    cout << "Usage:" << endl
+        << "testclient_bench [--filter <substring>] [--min-time <seconds>] [--port <port>] [--no-roundtrip]" << endl
+        << "  round trips run against an in-process mock content service on 127.0.0.1:<port>, default 18080" << endl;
+}
+
+int main(int argc, char** argv) {
+    std::string filter;
+    double minSeconds = 0.5;
+    int port = 18080;
+    bool roundTrips = true;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        bool hasValue = (i + 1 < argc);
+
+        if (arg == "--filter" && hasValue) {
+            filter = argv[++i];
+        }
+        else if (arg == "--min-time" && hasValue) {
+            minSeconds = atof(argv[++i]);
+        }
+        else if (arg == "--port" && hasValue) {
+            port = atoi(argv[++i]);
+        }
+        else if (arg == "--no-roundtrip") {
+            roundTrips = false;
+        }
+        else {
+            PrintUsage();
+            return -1;
+        }
+    }
+
+    std::vector<std::pair<std::string, std::function<size_t()>>> benchmarks;
+
+    // request body of POST /blob
+    benchmarks.push_back(std::make_pair(std::string("JsonCreateBlob"), std::function<size_t()>(
+        []() -> size_t {
+            return JsonCreateBlob(100 * 1024 * 1024).size();
+        }
+    )));
+    benchmarks.push_back(std::make_pair(std::string("JsonCreateBlob + serialize"), std::function<size_t()>(
+        []() -> size_t {
+            return JsonCreateBlob(100 * 1024 * 1024).serialize().size();
+        }
+    )));
+
+    ContentServiceConnection connection(U("http://127.0.0.1"), port);
+    benchmarks.push_back(std::make_pair(std::string("ContentServiceConnection::GetURI"), std::function<size_t()>(
+        [connection]() -> size_t {
+            return connection.GetURI().size();
+        }
+    )));
+
+    // uuid out of the POST /blob response
+    auto createResponse = JsonBlob(U("0f8fad5b-d9cb-469f-a165-70867728950e"), 100 * 1024 * 1024);
+    // the extraction the client used before, kept here as the baseline
+    benchmarks.push_back(std::make_pair(std::string("uuid via serialize + unquote"), std::function<size_t()>(
+        [createResponse]() -> size_t {
+            auto responseData = createResponse.at(U("data")).as_object();
+            auto text = responseData.at(U("id")).serialize();
+            text.pop_back();
+            return text.substr(1U).size();
+        }
+    )));
+    benchmarks.push_back(std::make_pair(std::string("uuid via JsonUnquote"), std::function<size_t()>(
+        [createResponse]() -> size_t {
+            return JsonUnquote(createResponse.at(U("data")).at(U("id"))).size();
+        }
+    )));
+
+    // what every continuation capturing the error callbacks copies
+    std::function<void(const char*)> errorFunc = [](const char* msg) { ErrorMessage(msg); };
+    std::function<void(const wchar_t*)> wErrorFunc = [](const wchar_t* msg) { WErrorMessage(msg); };
+    benchmarks.push_back(std::make_pair(std::string("copy error callbacks"), std::function<size_t()>(
+        [errorFunc, wErrorFunc]() -> size_t {
+            auto continuation = [errorFunc, wErrorFunc]() { };
+            std::function<void()> stored(continuation);
+            return sizeof(stored);
+        }
+    )));
+
+    benchmarks.push_back(std::make_pair(std::string("build POST /blob request"), std::function<size_t()>(
+        []() -> size_t {
+            web::http::http_request request;
+            request.set_method(web::http::methods::POST);
+            request.set_request_uri(web::uri(U("/blob")));
+            request.headers().set_content_type(U("application/vnd.api+json"));
+            request.set_body(JsonCreateBlob(100 * 1024 * 1024));
+            return request.headers().size();
+        }
+    )));
+
+    std::unique_ptr<MockContentService> mock;
+    utility::string_t uploadedUUID;
+    auto pattern = std::make_shared<TestDataPattern>(PAYLOAD_PATTERN, 0);
+    if (roundTrips) {
+        utility::stringstream_t uri;
+        uri << U("http://127.0.0.1:") << port;
+        mock.reset(new MockContentService(uri.str(), MockContentServiceOptions()));
+        try {
+            mock->Open().wait();
+        }
+        catch (const std::exception& e) {
+            cout << "Failed to start the mock content service: " << e.what() << endl;
+            return -1;
+        }
+
+        ContentService service(connection);
+        uploadedUUID = service.Upload(UploadSource(pattern, 1024), errorFunc, wErrorFunc).get();
+
+        benchmarks.push_back(std::make_pair(std::string("round trip: upload 1KB"), std::function<size_t()>(
+            [connection, pattern, errorFunc, wErrorFunc]() -> size_t {
+                ContentService service(connection);
+                return service.Upload(UploadSource(pattern, 1024), errorFunc, wErrorFunc).get().size();
+            }
+        )));
+        benchmarks.push_back(std::make_pair(std::string("round trip: download 1KB"), std::function<size_t()>(
+            [connection, uploadedUUID, errorFunc, wErrorFunc]() -> size_t {
+                ContentService service(connection);
+                auto buffer = std::make_shared<PooledBuffer>();
+                return static_cast<size_t>(service.Download(uploadedUUID, buffer, errorFunc, wErrorFunc).get());
+            }
+        )));
+    }
+
+    cout << std::left << std::setw(36) << "benchmark" << std::right
+        << std::setw(12) << "iterations"
+        << std::setw(14) << "ns/op"
+        << std::setw(12) << "allocs/op"
+        << std::setw(12) << "bytes/op" << endl;
+
+    for (size_t i = 0; i < benchmarks.size(); ++i) {
+        if (!filter.empty() && benchmarks[i].first.find(filter) == std::string::npos) {
+            continue;
+        }
+        PrintResult(RunBenchmark(benchmarks[i].first, benchmarks[i].second, minSeconds));
+    }
+
+    if (mock) {
+        mock->Close().wait();
+    }
+
+    return 0;
+}
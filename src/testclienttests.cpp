@@ -0,0 +1,359 @@
+#include "checksum.h"
+#include "latencyhistogram.h"
+#include "manifest.h"
+#include "mixedworkload.h"
+#include "openloop.h"
+#include "sweep.h"
+#include "uuidprefetcher.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace TestClient;
+
+static int g_checks = 0;
+static int g_failures = 0;
+
+/**
+ * \brief Counts a check, prints the failing expression with its location
+ */
+#define CHECK(condition) \
+    do { \
+        ++g_checks; \
+        if (!(condition)) { \
+            ++g_failures; \
+            cout << "  FAILED " << __FILE__ << ":" << __LINE__ << ": " << #condition << endl; \
+        } \
+    } while (false)
+
+/**
+ * \brief Bytes of a test buffer, not a multiple of 8 so every tail path runs
+ */
+static std::vector<uint8_t> TestBytes(size_t length) {
+    std::vector<uint8_t> data(length);
+    uint32_t state = 12345;
+    for (size_t i = 0; i < length; ++i) {
+        state = state * 1103515245 + 12345;
+        data[i] = static_cast<uint8_t>(state >> 16);
+    }
+    return data;
+}
+
+void TestCrc32cKnownAnswer() {
+    // check value of CRC-32C, RFC 3720 B.4
+    const char* digits = "123456789";
+    auto data = reinterpret_cast<const uint8_t*>(digits);
+    CHECK(Crc32c(data, 9) == 0xE3069283);
+    CHECK(Crc32cPortable(data, 9) == 0xE3069283);
+    CHECK(Crc32c(data, 0) == 0);
+}
+
+void TestCrc32cHardwareMatchesPortable() {
+    cout << "  CRC32C on " << (Crc32cHardware() ? "SSE4.2" : "the portable table") << endl;
+
+    auto data = TestBytes(64 * 1024 + 7);
+    // every alignment and short length, then the long runs
+    for (size_t offset = 0; offset < 16; ++offset) {
+        for (size_t length = 0; length < 64; ++length) {
+            CHECK(Crc32c(&data[offset], length) == Crc32cPortable(&data[offset], length));
+        }
+    }
+    CHECK(Crc32c(data.data(), data.size()) == Crc32cPortable(data.data(), data.size()));
+}
+
+void TestCrc32cChainingAndCombine() {
+    auto data = TestBytes(1024 * 1024 + 13);
+    auto whole = Crc32c(data.data(), data.size());
+
+    size_t splits[] = { 0, 1, 7, 8, 4096, 1024 * 1024, data.size() };
+    for (size_t i = 0; i < sizeof(splits) / sizeof(splits[0]); ++i) {
+        auto split = splits[i];
+        auto crc1 = Crc32c(data.data(), split);
+        auto crc2 = Crc32c(data.data() + split, data.size() - split);
+
+        CHECK(Crc32c(data.data() + split, data.size() - split, crc1) == whole);
+        CHECK(Crc32cCombine(crc1, crc2, data.size() - split) == whole);
+    }
+
+    // chunks of a ranged download, combined in order
+    uint32_t combined = 0;
+    const size_t chunk = 300 * 1024;
+    for (size_t offset = 0; offset < data.size(); offset += chunk) {
+        auto length = std::min(chunk, data.size() - offset);
+        combined = Crc32cCombine(combined, Crc32c(data.data() + offset, length), length);
+    }
+    CHECK(combined == whole);
+}
+
+void TestHistogramExactValues() {
+    LatencyHistogram histogram("exact");
+    for (uint64_t value = 1; value <= 100; ++value) {
+        histogram.Record(value);
+    }
+
+    // below SUB_BUCKETS every value has a bucket of its own
+    CHECK(histogram.TotalCount() == 100);
+    CHECK(histogram.Min() == 1);
+    CHECK(histogram.Max() == 100);
+    CHECK(histogram.ValueAtPercentile(50.0) == 50);
+    CHECK(histogram.ValueAtPercentile(90.0) == 90);
+    CHECK(histogram.ValueAtPercentile(99.0) == 99);
+    CHECK(histogram.ValueAtPercentile(100.0) == 100);
+    CHECK(std::fabs(histogram.Mean() - 50.5) < 1e-9);
+}
+
+void TestHistogramRelativeError() {
+    LatencyHistogram histogram("relative");
+    std::vector<uint64_t> values;
+    for (uint64_t value = 1000; value < 1000000000; value = value * 11 / 10) {
+        histogram.Record(value);
+        values.push_back(value);
+    }
+
+    // each percentile lands within one bucket, about 1.5%, above the exact value
+    double percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+    for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); ++i) {
+        auto rank = static_cast<size_t>(std::ceil(percentiles[i] / 100.0 * values.size()));
+        auto exact = values[rank - 1];
+        auto reported = histogram.ValueAtPercentile(percentiles[i]);
+        CHECK(reported >= exact);
+        CHECK((double)reported <= (double)exact * (1.0 + 2.0 / LatencyHistogram::HALF_SUB_BUCKETS));
+    }
+
+    for (size_t i = 0; i < values.size(); ++i) {
+        auto index = LatencyHistogram::IndexOf(values[i]);
+        CHECK(LatencyHistogram::LowestValueAt(index) <= values[i]);
+        CHECK(LatencyHistogram::HighestValueAt(index) >= values[i]);
+    }
+}
+
+void TestHistogramMerge() {
+    LatencyHistogram low("low"), high("high"), all("all");
+    for (uint64_t value = 1; value <= 1000; ++value) {
+        (value <= 500 ? low : high).Record(value * 1000);
+        all.Record(value * 1000);
+    }
+
+    LatencyHistogram merged("merged");
+    merged.Merge(low);
+    merged.Merge(high);
+    CHECK(merged.TotalCount() == all.TotalCount());
+    CHECK(merged.Min() == all.Min());
+    CHECK(merged.Max() == all.Max());
+    CHECK(merged.ValueAtPercentile(50.0) == all.ValueAtPercentile(50.0));
+    CHECK(merged.ValueAtPercentile(99.0) == all.ValueAtPercentile(99.0));
+
+    LatencyHistogram empty("empty");
+    CHECK(empty.TotalCount() == 0);
+    CHECK(empty.ValueAtPercentile(99.0) == 0);
+}
+
+void TestUuidQueue() {
+    UuidQueue queue(5);
+    CHECK(queue.Capacity() == 8);
+
+    utility::string_t uuid;
+    CHECK(!queue.TryPop(uuid));
+
+    for (int i = 0; i < 8; ++i) {
+        CHECK(queue.TryPush(utility::conversions::to_string_t(std::to_string(i))));
+    }
+    CHECK(!queue.TryPush(U("full")));
+    CHECK(queue.Size() == 8);
+
+    // first in, first out, and the ring wraps around
+    for (int round = 0; round < 3; ++round) {
+        CHECK(queue.TryPop(uuid));
+        CHECK(queue.TryPush(U("again")));
+    }
+    CHECK(queue.TryPop(uuid));
+    CHECK(uuid == U("3"));
+    CHECK(queue.Size() == 7);
+}
+
+void TestZipfian() {
+    ZipfianGenerator zipf(0.99);
+    zipf.Grow(1000);
+    CHECK(zipf.Count() == 1000);
+
+    std::vector<uint64_t> counts(1000, 0);
+    const int draws = 100000;
+    for (int i = 0; i < draws; ++i) {
+        auto rank = zipf.Next((i + 0.5) / draws);
+        CHECK(rank < 1000);
+        if (rank < counts.size()) {
+            counts[rank]++;
+        }
+    }
+
+    // rank 0 is the most popular, and the head holds most of the draws
+    CHECK(counts[0] > counts[1]);
+    CHECK(counts[1] > counts[10]);
+    uint64_t head = 0;
+    for (size_t i = 0; i < 100; ++i) {
+        head += counts[i];
+    }
+    CHECK(head > draws / 2);
+
+    ZipfianGenerator single(0.99);
+    single.Grow(1);
+    CHECK(single.Next(0.999) == 0);
+}
+
+void TestIntendedStartTime() {
+    OpenLoopOptions constant;
+    constant.startRate_ = 100.0;
+    constant.endRate_ = 100.0;
+    constant.durationS_ = 10.0;
+    CHECK(IntendedStartTime(constant, 0) == 0.0);
+    CHECK(std::fabs(IntendedStartTime(constant, 250) - 2.5) < 1e-9);
+
+    // a ramp from 100/s to 300/s schedules 2000 operations in 10 s
+    OpenLoopOptions ramp;
+    ramp.startRate_ = 100.0;
+    ramp.endRate_ = 300.0;
+    ramp.durationS_ = 10.0;
+    CHECK(std::fabs(IntendedStartTime(ramp, 2000) - 10.0) < 1e-6);
+    CHECK(IntendedStartTime(ramp, 1000) > 5.0);
+    for (uint64_t i = 1; i < 2000; ++i) {
+        CHECK(IntendedStartTime(ramp, i) > IntendedStartTime(ramp, i - 1));
+    }
+}
+
+/**
+ * \brief Cell of a sweep with ops operations in one second, all of the same latency
+ */
+static SweepCell MakeCell(uint64_t ops, uint64_t latencyNS) {
+    SweepCell cell;
+    cell.size_ = 1024;
+    cell.ops_ = ops;
+    cell.windowS_ = 1.0;
+    for (uint64_t i = 0; i < 100; ++i) {
+        cell.latency_.Record(latencyNS);
+    }
+    return cell;
+}
+
+void TestIsPastKnee() {
+    SweepOptions options;
+    auto best = MakeCell(1000, 1000000);
+
+    // more throughput is scaling whatever the latency
+    CHECK(!IsPastKnee(options, best, MakeCell(1200, 5000000)));
+    // no gain and p99 inflated is past the knee
+    CHECK(IsPastKnee(options, best, MakeCell(1010, 2000000)));
+    // no gain but p99 steady is not, yet
+    CHECK(!IsPastKnee(options, best, MakeCell(1010, 1100000)));
+}
+
+void TestManifestRecovery() {
+    const std::string fileName = "testclient_tests.manifest";
+    std::remove(fileName.c_str());
+
+    {
+        ManifestWriter writer;
+        CHECK(writer.Open(fileName));
+        CHECK(writer.Append(U("blob-0"), 100, 0x1234, true));
+        CHECK(writer.Append(U("blob-1"), 200, 0, false));
+        CHECK(writer.Append(U("blob-2"), 300, 0x5678, true));
+        writer.Close();
+    }
+
+    // a crash in the middle of a record leaves part of it behind
+    {
+        std::ofstream file(fileName.c_str(), std::ios::binary | std::ios::app);
+        file.write("torn", 4);
+    }
+
+    {
+        ManifestReader reader;
+        CHECK(reader.Open(fileName));
+        CHECK(reader.Count() == 3);
+        if (reader.Count() == 3) {
+            CHECK(reader.Record(1).UUID() == U("blob-1"));
+            CHECK(reader.Record(1).size_ == 200);
+            CHECK(!reader.Record(1).HasChecksum());
+            CHECK(reader.Record(2).HasChecksum());
+            CHECK(reader.Record(2).checksum_ == 0x5678);
+        }
+    }
+
+    // appending again overwrites the torn record
+    {
+        ManifestWriter writer;
+        CHECK(writer.Open(fileName));
+        CHECK(writer.Count() == 3);
+        CHECK(writer.Append(U("blob-3"), 400, 0, false));
+        writer.Close();
+    }
+
+    {
+        ManifestReader reader;
+        CHECK(reader.Open(fileName));
+        CHECK(reader.Count() == 4);
+        if (reader.Count() == 4) {
+            CHECK(reader.Record(3).UUID() == U("blob-3"));
+            CHECK(reader.Record(3).size_ == 400);
+        }
+    }
+
+    std::remove(fileName.c_str());
+}
+
+void PrintUsage() {
+    cout << "Usage:" << endl
+        << "testclient_tests [--filter <substring>]" << endl;
+}
+
+int main(int argc, char** argv) {
+    std::string filter;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        bool hasValue = (i + 1 < argc);
+
+        if (arg == "--filter" && hasValue) {
+            filter = argv[++i];
+        }
+        else {
+            PrintUsage();
+            return -1;
+        }
+    }
+
+    std::vector<std::pair<std::string, std::function<void()>>> tests;
+    tests.push_back(std::make_pair(std::string("Crc32cKnownAnswer"), std::function<void()>(TestCrc32cKnownAnswer)));
+    tests.push_back(std::make_pair(std::string("Crc32cHardwareMatchesPortable"), std::function<void()>(TestCrc32cHardwareMatchesPortable)));
+    tests.push_back(std::make_pair(std::string("Crc32cChainingAndCombine"), std::function<void()>(TestCrc32cChainingAndCombine)));
+    tests.push_back(std::make_pair(std::string("HistogramExactValues"), std::function<void()>(TestHistogramExactValues)));
+    tests.push_back(std::make_pair(std::string("HistogramRelativeError"), std::function<void()>(TestHistogramRelativeError)));
+    tests.push_back(std::make_pair(std::string("HistogramMerge"), std::function<void()>(TestHistogramMerge)));
+    tests.push_back(std::make_pair(std::string("UuidQueue"), std::function<void()>(TestUuidQueue)));
+    tests.push_back(std::make_pair(std::string("Zipfian"), std::function<void()>(TestZipfian)));
+    tests.push_back(std::make_pair(std::string("IntendedStartTime"), std::function<void()>(TestIntendedStartTime)));
+    tests.push_back(std::make_pair(std::string("IsPastKnee"), std::function<void()>(TestIsPastKnee)));
+    tests.push_back(std::make_pair(std::string("ManifestRecovery"), std::function<void()>(TestManifestRecovery)));
+
+    for (size_t i = 0; i < tests.size(); ++i) {
+        if (!filter.empty() && tests[i].first.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        auto failures = g_failures;
+        cout << tests[i].first << endl;
+        tests[i].second();
+        if (g_failures != failures) {
+            cout << "  " << (g_failures - failures) << " failed" << endl;
+        }
+    }
+
+    cout << g_checks << " checks, " << g_failures << " failed" << endl;
+    return g_failures == 0 ? 0 : 1;
+}
@@ -1,5 +1,235 @@
 #include "testinputstream.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+using namespace Concurrency::streams;
+
 namespace TestClient {
 
+/**
+ * \brief splitmix64, a tiny generator good enough for incompressible test data
+ */
+static uint64_t NextRandom(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+TestDataPattern::TestDataPattern(PayloadType type, uint64_t seed)
+    : block_(BLOCK_SIZE),
+    type_(type),
+    seed_(seed)
+{
+    if (type_ == PAYLOAD_RANDOM) {
+        uint64_t state = seed_;
+        for (size_t i = 0; i < block_.size(); i += sizeof(uint64_t)) {
+            auto value = NextRandom(state);
+            std::memcpy(&block_[i], &value, sizeof(value));
+        }
+    }
+    else {
+        for (size_t i = 0; i < block_.size(); ++i) {
+            block_[i] = static_cast<uint8_t>(i + seed_);
+        }
+    }
+}
+
+void TestDataPattern::Copy(uint64_t offset, uint8_t* dest, size_t count) const {
+    while (count > 0) {
+        auto index = static_cast<size_t>(offset % block_.size());
+        auto n = std::min(count, block_.size() - index);
+        std::memcpy(dest, &block_[index], n);
+
+        dest += n;
+        offset += n;
+        count -= n;
+    }
+}
+
+PayloadType PayloadTypeFromName(const std::string& name) {
+    if (name == "pattern") {
+        return PAYLOAD_PATTERN;
+    }
+    if (name == "random") {
+        return PAYLOAD_RANDOM;
+    }
+    return NUM_PAYLOAD_TYPES;
+}
+
+/**
+ * \brief Read-only stream buffer serving a generated payload
+ *
+ * Reads copy straight out of the shared pattern block, acquire() hands out
+ * pointers into it. The buffer is not thread-safe, like the other cpprest
+ * buffers it is read by one request at a time.
+ */
+class TestDataStreamBuffer : public details::streambuf_state_manager<uint8_t> {
+    typedef details::streambuf_state_manager<uint8_t> base;
+
+    std::shared_ptr<const TestDataPattern>  pattern_;
+    uint64_t                                offset_;    // payload offset of position 0
+    uint64_t                                size_;
+    uint64_t                                position_;
+
+public:
+    typedef base::traits traits;
+    typedef base::int_type int_type;
+    typedef base::pos_type pos_type;
+    typedef base::off_type off_type;
+
+    TestDataStreamBuffer(std::shared_ptr<const TestDataPattern> pattern, uint64_t size, uint64_t offset)
+        : base(std::ios_base::in),
+        pattern_(pattern),
+        offset_(offset),
+        size_(size),
+        position_(0)
+    { }
+
+    virtual ~TestDataStreamBuffer() {
+        this->_close_read();
+    }
+
+    virtual bool can_seek() const { return this->is_open(); }
+    virtual bool has_size() const { return this->is_open(); }
+    virtual utility::size64_t size() const { return size_; }
+
+    virtual size_t buffer_size(std::ios_base::openmode = std::ios_base::in) const { return 0; }
+    virtual void set_buffer_size(size_t, std::ios_base::openmode = std::ios_base::in) { }
+
+    virtual size_t in_avail() const {
+        return static_cast<size_t>(std::min<uint64_t>(Remaining(), static_cast<uint64_t>(SIZE_MAX)));
+    }
+
+    virtual bool acquire(uint8_t*& ptr, size_t& count) {
+        ptr = nullptr;
+        count = 0;
+        if (!this->can_read()) {
+            return false;
+        }
+
+        auto remaining = Remaining();
+        if (remaining == 0) {
+            return true;
+        }
+
+        // never hand out a range that wraps around the end of the block
+        auto index = static_cast<size_t>((offset_ + position_) % pattern_->Size());
+        count = static_cast<size_t>(std::min<uint64_t>(remaining, pattern_->Size() - index));
+        ptr = const_cast<uint8_t*>(pattern_->Data() + index);
+        return true;
+    }
+
+    virtual void release(uint8_t* ptr, size_t count) {
+        if (ptr != nullptr) {
+            Advance(count);
+        }
+    }
+
+    virtual pos_type getpos(std::ios_base::openmode mode) const {
+        if (!(mode & std::ios_base::in) || !this->can_read()) {
+            return static_cast<pos_type>(traits::eof());
+        }
+        return static_cast<pos_type>(static_cast<off_type>(position_));
+    }
+
+    virtual pos_type seekpos(pos_type position, std::ios_base::openmode mode) {
+        auto target = static_cast<off_type>(position);
+        if (!(mode & std::ios_base::in) || !this->can_read()
+            || target < 0 || static_cast<uint64_t>(target) > size_) {
+            return static_cast<pos_type>(traits::eof());
+        }
+
+        position_ = static_cast<uint64_t>(target);
+        return position;
+    }
+
+    virtual pos_type seekoff(off_type offset, std::ios_base::seekdir way, std::ios_base::openmode mode) {
+        off_type origin = 0;
+        if (way == std::ios_base::cur) {
+            origin = static_cast<off_type>(position_);
+        }
+        else if (way == std::ios_base::end) {
+            origin = static_cast<off_type>(size_);
+        }
+
+        return seekpos(static_cast<pos_type>(origin + offset), mode);
+    }
+
+protected:
+    virtual pplx::task<bool> _sync() { return pplx::task_from_result(true); }
+
+    // write side, the buffer is read-only
+    virtual pplx::task<int_type> _putc(uint8_t) { return pplx::task_from_result<int_type>(traits::eof()); }
+    virtual pplx::task<size_t> _putn(const uint8_t*, size_t) { return pplx::task_from_result<size_t>(0); }
+    virtual uint8_t* _alloc(size_t) { return nullptr; }
+    virtual void _commit(size_t) { }
+
+    virtual pplx::task<size_t> _getn(uint8_t* ptr, size_t count) {
+        return pplx::task_from_result(CopyAndAdvance(ptr, count));
+    }
+
+    virtual size_t _scopy(uint8_t* ptr, size_t count) {
+        count = static_cast<size_t>(std::min<uint64_t>(count, Remaining()));
+        pattern_->Copy(offset_ + position_, ptr, count);
+        return count;
+    }
+
+    virtual pplx::task<int_type> _bumpc() { return pplx::task_from_result(_sbumpc()); }
+
+    virtual int_type _sbumpc() {
+        auto ch = _sgetc();
+        if (ch != traits::eof()) {
+            Advance(1);
+        }
+        return ch;
+    }
+
+    virtual pplx::task<int_type> _getc() { return pplx::task_from_result(_sgetc()); }
+
+    virtual int_type _sgetc() {
+        if (Remaining() == 0) {
+            return traits::eof();
+        }
+        return traits::to_int_type(pattern_->Data()[(offset_ + position_) % pattern_->Size()]);
+    }
+
+    virtual pplx::task<int_type> _nextc() {
+        Advance(1);
+        return pplx::task_from_result(_sgetc());
+    }
+
+    virtual pplx::task<int_type> _ungetc() {
+        if (position_ == 0) {
+            return pplx::task_from_result<int_type>(traits::eof());
+        }
+        --position_;
+        return pplx::task_from_result(_sgetc());
+    }
+
+private:
+    uint64_t Remaining() const { return size_ - position_; }
+
+    void Advance(size_t count) {
+        position_ += std::min<uint64_t>(count, Remaining());
+    }
+
+    size_t CopyAndAdvance(uint8_t* ptr, size_t count) {
+        auto n = _scopy(ptr, count);
+        Advance(n);
+        return n;
+    }
+}; // TestDataStreamBuffer
+
+istream TestDataInputStream::Open(
+    std::shared_ptr<const TestDataPattern> pattern,
+    uint64_t size,
+    uint64_t offset /*= 0*/)
+{
+    streambuf<uint8_t> buffer(std::make_shared<TestDataStreamBuffer>(pattern, size, offset));
+    return buffer.create_istream();
+}
+
 } // namespace TestClient
@@ -1,10 +1,13 @@
 #include "testparameters.h"
+#include "tracing.h"
 
 #include "cpprest/json.h"
 #include "cpprest/filestream.h"
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <stdexcept>
 #include <string>
 
 using namespace std;
@@ -14,7 +17,43 @@ using namespace web::json;
 namespace TestClient {
 
 TestParameters::TestParameters(const std::string& filePath) 
-		: filePath_(filePath)
+		: filePath_(filePath),
+        port_(0),
+        routing_(ROUTING_ROUND_ROBIN),
+        numInstances_(0),
+        connectionPoolSize_(0),
+        downloadStreams_(1),
+        downloadChunkSize_(8 * 1024 * 1024),
+        uploadChunkSize_(0),
+        uploadChunksInFlight_(1),
+        uploadChunksOutOfOrder_(false),
+        uploadMaxResumes_(3),
+        timeSeriesIntervalMS_(1000),
+        traceBufferEvents_(Tracer::DEFAULT_RING_EVENTS),
+        hugePages_(false),
+        mapSources_(false),
+        verifyDownloads_(true),
+        metadataCacheSize_(65536),
+        scenarioType_(SCENARIOS_UPLOAD),
+        targetRate_(100.0),
+        targetRateEnd_(100.0),
+        duration_(10.0),
+        maxOutstanding_(10000),
+        downloads_(0),
+        readRatio_(0.9),
+        popularity_(POPULARITY_ZIPF),
+        zipfExponent_(0.99),
+        mixSeed_(0),
+        operations_(1000),
+        preload_(100),
+        blobs_(0),
+        uploadConcurrency_(0),
+        queueDepth_(0),
+        downloadConcurrency_(0),
+        payloadType_(PAYLOAD_PATTERN),
+        payloadSeed_(0),
+        workerIndex_(0),
+        workerCount_(1)
 { }
 
 const utility::string_t& TestParameters::Server() const {
@@ -41,14 +80,87 @@ int TestParameters::Scenario() {
     return scenarioType_;
 }
 
-//const std::vector<int>& TestParameters::DataSizes() const {
-//    return dataSize_;
-//}
-//
-//std::vector<int>& TestParameters::DataSizes()
-//{
-//    return dataSize_;
-//}
+const std::vector<uint64_t>& TestParameters::DataSizes() const {
+    return dataSize_;
+}
+
+std::vector<uint64_t>& TestParameters::DataSizes()
+{
+    return dataSize_;
+}
+
+/**
+ * \brief Share of total taken by worker index of count, the first total % count workers take one more
+ */
+static uint64_t ShareOf(uint64_t total, size_t index, size_t count) {
+    return total / count + (index < total % count ? 1 : 0);
+}
+
+/**
+ * \brief Share of a limit, at least 1, 0 stays 0 = default
+ */
+static uint64_t LimitShareOf(uint64_t total, size_t index, size_t count) {
+    return total == 0 ? 0 : std::max<uint64_t>(ShareOf(total, index, count), 1);
+}
+
+/**
+ * \brief Levels of a sweep, either listed or a geometric range {"min", "max", "factor"}
+ */
+static std::vector<uint64_t> ParseSweepLevels(const web::json::value& levels) {
+    std::vector<uint64_t> values;
+    if (levels.is_array()) {
+        const auto& Levels = levels.as_array();
+        for (auto iter = Levels.cbegin(); iter != Levels.cend(); ++iter) {
+            values.push_back(iter->as_number().to_uint64());
+        }
+        return values;
+    }
+
+    const auto& Range = levels.as_object();
+    auto first = Range.at(U("min")).as_number().to_uint64();
+    auto last = Range.at(U("max")).as_number().to_uint64();
+    auto factor = Range.find(U("factor")) != Range.end() ? Range.at(U("factor")).as_double() : 2.0;
+    if (first == 0 || factor <= 1.0) {
+        throw std::invalid_argument("Sweep range needs min > 0 and factor > 1");
+    }
+
+    for (auto value = (double)first; value <= (double)last * (1.0 + 1e-9); value *= factor) {
+        values.push_back(static_cast<uint64_t>(value + 0.5));
+    }
+    return values;
+}
+
+void TestParameters::Slice(size_t index, size_t count) {
+    workerIndex_ = index;
+    workerCount_ = std::max<size_t>(count, 1);
+    if (workerCount_ == 1) {
+        return;
+    }
+
+    numInstances_ = static_cast<size_t>(ShareOf(numInstances_, index, workerCount_));
+    connectionPoolSize_ = static_cast<size_t>(LimitShareOf(connectionPoolSize_, index, workerCount_));
+    targetRate_ /= (double)workerCount_;
+    targetRateEnd_ /= (double)workerCount_;
+    maxOutstanding_ = static_cast<size_t>(LimitShareOf(maxOutstanding_, index, workerCount_));
+    downloads_ = LimitShareOf(downloads_, index, workerCount_);
+    preload_ = ShareOf(preload_, index, workerCount_);
+    blobs_ = LimitShareOf(blobs_, index, workerCount_);
+    uploadConcurrency_ = static_cast<size_t>(LimitShareOf(uploadConcurrency_, index, workerCount_));
+    queueDepth_ = static_cast<size_t>(LimitShareOf(queueDepth_, index, workerCount_));
+    downloadConcurrency_ = static_cast<size_t>(LimitShareOf(downloadConcurrency_, index, workerCount_));
+    uuidPrefetch_.depth_ = static_cast<size_t>(LimitShareOf(uuidPrefetch_.depth_, index, workerCount_));
+
+    // workers pinned to the same CPUs would compete for them
+    scheduler_.threads_ = static_cast<size_t>(LimitShareOf(scheduler_.threads_, index, workerCount_));
+    if (scheduler_.cpus_.size() >= workerCount_) {
+        auto first = scheduler_.cpus_.size() / workerCount_ * index + std::min(index, scheduler_.cpus_.size() % workerCount_);
+        auto cpus = static_cast<size_t>(ShareOf(scheduler_.cpus_.size(), index, workerCount_));
+        scheduler_.cpus_ = std::vector<int>(scheduler_.cpus_.begin() + first, scheduler_.cpus_.begin() + first + cpus);
+    }
+
+    // the same seed would make every worker draw the same operations and blobs
+    mixSeed_ += static_cast<uint64_t>(index) * 0x9E3779B97F4A7C15ULL;
+}
 
 void TestParameters::Parse() {
     std::ifstream ifs;
@@ -70,14 +182,264 @@ void TestParameters::Parse() {
             port_ = testParams.at(U("port")).as_integer();
             numInstances_ = testParams.at(U("numInstances")).as_integer();
 
+            // optional, a cluster replacing server and port
+            if (testParams.has_field(U("endpoints"))) {
+                const auto& Endpoints = testParams.at(U("endpoints")).as_array();
+                for (auto iter = Endpoints.cbegin(); iter != Endpoints.cend(); ++iter) {
+                    endpoints_.push_back(iter->as_string());
+                }
+            }
+            if (testParams.has_field(U("routing"))) {
+                auto routing = utility::conversions::to_utf8string(testParams.at(U("routing")).as_string());
+                routing_ = RoutingPolicyFromName(routing);
+                if (routing_ == NUM_ROUTING_POLICIES) {
+                    throw std::invalid_argument("Unknown routing " + routing);
+                }
+            }
+
+            // optional, defaults to one client per instance
+            connectionPoolSize_ = numInstances_;
+            if (testParams.has_field(U("connectionPoolSize"))) {
+                connectionPoolSize_ = testParams.at(U("connectionPoolSize")).as_integer();
+            }
+
+            // optional, ranged multi-stream download
+            if (testParams.has_field(U("downloadStreams"))) {
+                downloadStreams_ = testParams.at(U("downloadStreams")).as_integer();
+            }
+            if (testParams.has_field(U("downloadChunkSize"))) {
+                downloadChunkSize_ = testParams.at(U("downloadChunkSize")).as_number().to_uint64();
+            }
+
+            // optional, chunked resumable upload
+            if (testParams.has_field(U("uploadChunkSize"))) {
+                uploadChunkSize_ = testParams.at(U("uploadChunkSize")).as_number().to_uint64();
+            }
+            if (testParams.has_field(U("uploadChunksInFlight"))) {
+                uploadChunksInFlight_ = testParams.at(U("uploadChunksInFlight")).as_integer();
+            }
+            if (testParams.has_field(U("uploadChunksOutOfOrder"))) {
+                uploadChunksOutOfOrder_ = testParams.at(U("uploadChunksOutOfOrder")).as_bool();
+            }
+            if (testParams.has_field(U("uploadMaxResumes"))) {
+                uploadMaxResumes_ = testParams.at(U("uploadMaxResumes")).as_integer();
+            }
+
+            // optional, export of the raw latency histograms
+            if (testParams.has_field(U("histogramFile"))) {
+                histogramFile_ = utility::conversions::to_utf8string(testParams.at(U("histogramFile")).as_string());
+            }
+
+            // optional, generated data for entries given by size
+            if (testParams.has_field(U("payload"))) {
+                const auto& Payload = testParams.at(U("payload")).as_object();
+                if (Payload.find(U("type")) != Payload.end()) {
+                    auto type = utility::conversions::to_utf8string(Payload.at(U("type")).as_string());
+                    payloadType_ = PayloadTypeFromName(type);
+                    if (payloadType_ == NUM_PAYLOAD_TYPES) {
+                        throw std::invalid_argument("Unknown payload type " + type);
+                    }
+                }
+                if (Payload.find(U("seed")) != Payload.end()) {
+                    payloadSeed_ = Payload.at(U("seed")).as_number().to_uint64();
+                }
+            }
+
+            // optional, a dedicated pool running the task continuations
+            if (testParams.has_field(U("scheduler"))) {
+                const auto& Scheduler = testParams.at(U("scheduler")).as_object();
+                if (Scheduler.find(U("threads")) != Scheduler.end()) {
+                    scheduler_.threads_ = static_cast<size_t>(Scheduler.at(U("threads")).as_number().to_uint64());
+                }
+                if (Scheduler.find(U("cpus")) != Scheduler.end()) {
+                    const auto& Cpus = Scheduler.at(U("cpus")).as_array();
+                    for (auto iter = Cpus.cbegin(); iter != Cpus.cend(); ++iter) {
+                        scheduler_.cpus_.push_back(iter->as_integer());
+                    }
+                }
+                if (Scheduler.find(U("numaNode")) != Scheduler.end()) {
+                    scheduler_.numaNode_ = Scheduler.at(U("numaNode")).as_integer();
+                }
+            }
+
+            // optional, blobs created ahead of the uploads
+            if (testParams.has_field(U("uuidPrefetch"))) {
+                const auto& UuidPrefetch = testParams.at(U("uuidPrefetch")).as_object();
+                if (UuidPrefetch.find(U("depth")) != UuidPrefetch.end()) {
+                    uuidPrefetch_.depth_ = static_cast<size_t>(UuidPrefetch.at(U("depth")).as_number().to_uint64());
+                }
+                if (UuidPrefetch.find(U("inFlight")) != UuidPrefetch.end()) {
+                    uuidPrefetch_.inFlight_ = static_cast<size_t>(UuidPrefetch.at(U("inFlight")).as_number().to_uint64());
+                }
+            }
+
+            // optional, gzip encoded transfers
+            if (testParams.has_field(U("compression"))) {
+                const auto& Compression = testParams.at(U("compression")).as_object();
+                if (Compression.find(U("levels")) != Compression.end()) {
+                    const auto& Levels = Compression.at(U("levels")).as_array();
+                    for (auto iter = Levels.cbegin(); iter != Levels.cend(); ++iter) {
+                        auto level = iter->as_integer();
+                        if (level < 0 || level > MAX_GZIP_LEVEL) {
+                            throw std::invalid_argument("Unknown gzip level " + std::to_string(level));
+                        }
+                        compression_.levels_.push_back(level);
+                    }
+                }
+                if (Compression.find(U("acceptGzip")) != Compression.end()) {
+                    compression_.acceptGzip_ = Compression.at(U("acceptGzip")).as_bool();
+                }
+            }
+
+            // optional, cells of a sweep run
+            if (testParams.has_field(U("sweepFile"))) {
+                sweepFile_ = utility::conversions::to_utf8string(testParams.at(U("sweepFile")).as_string());
+            }
+
+            // optional, manifest of uploaded blobs for download-only runs
+            if (testParams.has_field(U("manifestFile"))) {
+                manifestFile_ = utility::conversions::to_utf8string(testParams.at(U("manifestFile")).as_string());
+            }
+
+            // optional, per-interval throughput
+            if (testParams.has_field(U("timeSeriesFile"))) {
+                timeSeriesFile_ = utility::conversions::to_utf8string(testParams.at(U("timeSeriesFile")).as_string());
+            }
+            if (testParams.has_field(U("timeSeriesIntervalMS"))) {
+                timeSeriesIntervalMS_ = testParams.at(U("timeSeriesIntervalMS")).as_number().to_int64();
+            }
+
+            // optional, spans of every request step
+            if (testParams.has_field(U("traceFile"))) {
+                traceFile_ = utility::conversions::to_utf8string(testParams.at(U("traceFile")).as_string());
+            }
+            if (testParams.has_field(U("traceBufferEvents"))) {
+                traceBufferEvents_ = static_cast<size_t>(testParams.at(U("traceBufferEvents")).as_number().to_uint64());
+            }
+
+            // optional, huge pages for the in-memory download buffers
+            if (testParams.has_field(U("hugePages"))) {
+                hugePages_ = testParams.at(U("hugePages")).as_bool();
+            }
+
+            // optional, zero-copy uploads out of one shared mapping per input file
+            if (testParams.has_field(U("mapSources"))) {
+                mapSources_ = testParams.at(U("mapSources")).as_bool();
+            }
+
+            // optional, off against a mock content service that discards uploads
+            if (testParams.has_field(U("verifyDownloads"))) {
+                verifyDownloads_ = testParams.at(U("verifyDownloads")).as_bool();
+            }
+
+            // optional, bound of the blob metadata cache
+            if (testParams.has_field(U("metadataCacheSize"))) {
+                metadataCacheSize_ = static_cast<size_t>(testParams.at(U("metadataCacheSize")).as_number().to_uint64());
+            }
+
             const auto& TestScenario = testParams.at(U("scenario")).as_object();
             scenarioType_ = TestScenario.at(U("type")).as_integer();
-            const auto& Files = TestScenario.at(U("files")).as_array();
+
+            // optional, timed and rate-driven scenarios
+            if (TestScenario.find(U("rate")) != TestScenario.end()) {
+                targetRate_ = TestScenario.at(U("rate")).as_double();
+            }
+            targetRateEnd_ = targetRate_;
+            if (TestScenario.find(U("rateEnd")) != TestScenario.end()) {
+                targetRateEnd_ = TestScenario.at(U("rateEnd")).as_double();
+            }
+            if (TestScenario.find(U("duration")) != TestScenario.end()) {
+                duration_ = TestScenario.at(U("duration")).as_double();
+            }
+            if (TestScenario.find(U("maxOutstanding")) != TestScenario.end()) {
+                maxOutstanding_ = TestScenario.at(U("maxOutstanding")).as_integer();
+            }
+            if (TestScenario.find(U("downloads")) != TestScenario.end()) {
+                downloads_ = TestScenario.at(U("downloads")).as_number().to_uint64();
+            }
+
+            // optional, mixed read/write scenario
+            if (TestScenario.find(U("readRatio")) != TestScenario.end()) {
+                readRatio_ = TestScenario.at(U("readRatio")).as_double();
+            }
+            if (TestScenario.find(U("popularity")) != TestScenario.end()) {
+                auto popularity = utility::conversions::to_utf8string(TestScenario.at(U("popularity")).as_string());
+                popularity_ = PopularityFromName(popularity);
+                if (popularity_ == NUM_POPULARITIES) {
+                    throw std::invalid_argument("Unknown popularity " + popularity);
+                }
+            }
+            if (TestScenario.find(U("zipfExponent")) != TestScenario.end()) {
+                zipfExponent_ = TestScenario.at(U("zipfExponent")).as_double();
+            }
+            if (TestScenario.find(U("seed")) != TestScenario.end()) {
+                mixSeed_ = TestScenario.at(U("seed")).as_number().to_uint64();
+            }
+            if (TestScenario.find(U("operations")) != TestScenario.end()) {
+                operations_ = TestScenario.at(U("operations")).as_number().to_uint64();
+            }
+            if (TestScenario.find(U("preload")) != TestScenario.end()) {
+                preload_ = TestScenario.at(U("preload")).as_number().to_uint64();
+            }
+
+            // optional, pipelined scenario
+            if (TestScenario.find(U("blobs")) != TestScenario.end()) {
+                blobs_ = TestScenario.at(U("blobs")).as_number().to_uint64();
+            }
+            if (TestScenario.find(U("uploadConcurrency")) != TestScenario.end()) {
+                uploadConcurrency_ = TestScenario.at(U("uploadConcurrency")).as_integer();
+            }
+            if (TestScenario.find(U("queueDepth")) != TestScenario.end()) {
+                queueDepth_ = TestScenario.at(U("queueDepth")).as_integer();
+            }
+            if (TestScenario.find(U("downloadConcurrency")) != TestScenario.end()) {
+                downloadConcurrency_ = TestScenario.at(U("downloadConcurrency")).as_integer();
+            }
+
+            // optional, sweep scenario
+            if (TestScenario.find(U("sizes")) != TestScenario.end()) {
+                sweep_.sizes_ = ParseSweepLevels(TestScenario.at(U("sizes")));
+            }
+            if (TestScenario.find(U("concurrency")) != TestScenario.end()) {
+                sweep_.concurrency_ = ParseSweepLevels(TestScenario.at(U("concurrency")));
+                std::sort(sweep_.concurrency_.begin(), sweep_.concurrency_.end());
+            }
+            if (TestScenario.find(U("warmup")) != TestScenario.end()) {
+                sweep_.warmupS_ = TestScenario.at(U("warmup")).as_double();
+            }
+            if (TestScenario.find(U("window")) != TestScenario.end()) {
+                sweep_.windowS_ = TestScenario.at(U("window")).as_double();
+            }
+            if (TestScenario.find(U("minOps")) != TestScenario.end()) {
+                sweep_.minOps_ = TestScenario.at(U("minOps")).as_number().to_uint64();
+            }
+            if (TestScenario.find(U("minGain")) != TestScenario.end()) {
+                sweep_.minGain_ = TestScenario.at(U("minGain")).as_double();
+            }
+            if (TestScenario.find(U("maxP99Growth")) != TestScenario.end()) {
+                sweep_.maxP99Growth_ = TestScenario.at(U("maxP99Growth")).as_double();
+            }
+
+            // a sweep generates its blobs and may list no files
+            auto noFiles = web::json::value::array();
+            const auto& Files = TestScenario.find(U("files")) != TestScenario.end()
+                ? TestScenario.at(U("files")).as_array()
+                : noFiles.as_array();
             for (auto iter = Files.cbegin(); iter != Files.cend(); ++iter) {
+                dataWeight_.push_back(iter->has_field(U("weight")) ? iter->at(U("weight")).as_double() : 1.0);
+
+                // either a file in dataPath or the size of a generated blob
+                if (iter->has_field(U("size"))) {
+                    dataFiles_.push_back(utility::string_t());
+                    dataSize_.push_back(iter->at(U("size")).as_number().to_uint64());
+                    continue;
+                }
+
                 auto file = iter->at(U("file")).serialize();
                 file.pop_back();
                 file = file.substr(1U);
                 dataFiles_.push_back(file);
+                dataSize_.push_back(0);
             }
 
             serverURI_ = server_;
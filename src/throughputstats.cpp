@@ -0,0 +1,216 @@
+#include "throughputstats.h"
+#include "miscutils.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace TestClient {
+
+// larger than the cache line of every target, also covers adjacent-line prefetch
+static const size_t COUNTER_PADDING = 128;
+
+/**
+ * \brief Counters of one thread
+ *
+ * Atomic only so the reporter may read them while the owner writes, the owner
+ * never needs a read-modify-write.
+ */
+struct ThreadThroughputCounters {
+    char                    before_[COUNTER_PADDING];
+    std::atomic<uint64_t>   ops_[NUM_THROUGHPUT_OPERATIONS];
+    std::atomic<uint64_t>   bytes_[NUM_THROUGHPUT_OPERATIONS];
+    std::atomic<uint64_t>   errors_[NUM_THROUGHPUT_OPERATIONS];
+    char                    after_[COUNTER_PADDING];
+
+    ThreadThroughputCounters() {
+        for (int i = 0; i < NUM_THROUGHPUT_OPERATIONS; ++i) {
+            ops_[i] = 0;
+            bytes_[i] = 0;
+            errors_[i] = 0;
+        }
+    }
+}; // ThreadThroughputCounters
+
+// every thread's counters, kept until exit so totals never go backwards
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<ThreadThroughputCounters>> registry;
+
+static TESTCLIENT_THREAD_LOCAL ThreadThroughputCounters* threadCounters = nullptr;
+
+static ThreadThroughputCounters& LocalCounters() {
+    if (threadCounters == nullptr) {
+        std::unique_ptr<ThreadThroughputCounters> counters(new ThreadThroughputCounters());
+
+        std::lock_guard<std::mutex> lock(registryMutex);
+        threadCounters = counters.get();
+        registry.push_back(std::move(counters));
+    }
+
+    return *threadCounters;
+}
+
+static void Add(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+const char* ThroughputOperationName(ThroughputOperation operation) {
+    switch (operation) {
+    case OPERATION_UPLOAD:      return "upload";
+    case OPERATION_DOWNLOAD:    return "download";
+    default:                    return "unknown";
+    }
+}
+
+void ThroughputStats::Record(ThroughputOperation operation, uint64_t bytes) {
+    auto& counters = LocalCounters();
+    Add(counters.ops_[operation], 1);
+    Add(counters.bytes_[operation], bytes);
+}
+
+void ThroughputStats::RecordError(ThroughputOperation operation) {
+    Add(LocalCounters().errors_[operation], 1);
+}
+
+void ThroughputStats::Snapshot(ThroughputTotals (&totals)[NUM_THROUGHPUT_OPERATIONS]) {
+    for (int i = 0; i < NUM_THROUGHPUT_OPERATIONS; ++i) {
+        totals[i] = ThroughputTotals();
+    }
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (size_t t = 0; t < registry.size(); ++t) {
+        const auto& counters = *registry[t];
+        for (int i = 0; i < NUM_THROUGHPUT_OPERATIONS; ++i) {
+            totals[i].ops_ += counters.ops_[i].load(std::memory_order_relaxed);
+            totals[i].bytes_ += counters.bytes_[i].load(std::memory_order_relaxed);
+            totals[i].errors_ += counters.errors_[i].load(std::memory_order_relaxed);
+        }
+    }
+}
+
+ThroughputReporter::ThroughputReporter()
+    : json_(false),
+    firstRow_(true),
+    interval_(1000),
+    stopping_(false)
+{ }
+
+ThroughputReporter::~ThroughputReporter() {
+    Stop();
+}
+
+bool ThroughputReporter::Start(const std::string& fileName, int64_t intervalMS, ThroughputSource source /*= ThroughputSource()*/) {
+    if (thread_.joinable()) {
+        return false;
+    }
+
+    file_.open(fileName, std::ios::out | std::ios::trunc);
+    if (!file_) {
+        return false;
+    }
+
+    source_ = source ? source : ThroughputSource(ThroughputStats::Snapshot);
+    json_ = fileName.size() >= 5 && fileName.compare(fileName.size() - 5, 5, ".json") == 0;
+    firstRow_ = true;
+    interval_ = std::chrono::milliseconds(intervalMS > 0 ? intervalMS : 1000);
+    stopping_ = false;
+
+    if (json_) {
+        file_ << "[" << std::endl;
+    }
+    else {
+        file_ << "time_s";
+        for (int i = 0; i < NUM_THROUGHPUT_OPERATIONS; ++i) {
+            auto name = ThroughputOperationName(static_cast<ThroughputOperation>(i));
+            file_ << "," << name << "_ops," << name << "_bytes," << name << "_errors,"
+                << name << "_ops_per_s," << name << "_mb_per_s";
+        }
+        file_ << std::endl;
+    }
+
+    source_(previous_);
+    start_ = Clock::now();
+    last_ = start_;
+    thread_ = std::thread([this]() { Run(); });
+
+    return true;
+}
+
+void ThroughputReporter::Stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    stop_.notify_all();
+    thread_.join();
+
+    WriteRow(Clock::now());
+    if (json_) {
+        file_ << std::endl << "]" << std::endl;
+    }
+    file_.close();
+}
+
+void ThroughputReporter::Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto next = start_ + interval_;
+    while (!stop_.wait_until(lock, next, [this]() { return stopping_; })) {
+        // rows are stamped with the tick, not when the thread woke up
+        WriteRow(next);
+        next += interval_;
+    }
+}
+
+void ThroughputReporter::WriteRow(Clock::time_point now) {
+    ThroughputTotals totals[NUM_THROUGHPUT_OPERATIONS];
+    source_(totals);
+
+    auto seconds = std::chrono::duration<double>(now - last_).count();
+    auto elapsed = std::chrono::duration<double>(now - start_).count();
+    if (seconds <= 0.0) {
+        return;
+    }
+
+    if (json_) {
+        file_ << (firstRow_ ? "" : ",\n") << "{\"time_s\": " << elapsed;
+    }
+    else {
+        file_ << elapsed;
+    }
+
+    for (int i = 0; i < NUM_THROUGHPUT_OPERATIONS; ++i) {
+        auto ops = totals[i].ops_ - previous_[i].ops_;
+        auto bytes = totals[i].bytes_ - previous_[i].bytes_;
+        auto errors = totals[i].errors_ - previous_[i].errors_;
+        auto opsPerS = (double)ops / seconds;
+        auto mbPerS = (double)bytes / seconds / 1e6;
+
+        if (json_) {
+            auto name = ThroughputOperationName(static_cast<ThroughputOperation>(i));
+            file_ << ", \"" << name << "\": {\"ops\": " << ops << ", \"bytes\": " << bytes
+                << ", \"errors\": " << errors << ", \"ops_per_s\": " << opsPerS
+                << ", \"mb_per_s\": " << mbPerS << "}";
+        }
+        else {
+            file_ << "," << ops << "," << bytes << "," << errors << "," << opsPerS << "," << mbPerS;
+        }
+        previous_[i] = totals[i];
+    }
+
+    if (json_) {
+        file_ << "}";
+    }
+    else {
+        file_ << std::endl;
+    }
+    file_.flush();
+
+    firstRow_ = false;
+    last_ = now;
+}
+
+} // namespace TestClient
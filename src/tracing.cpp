@@ -0,0 +1,173 @@
+#include "tracing.h"
+#include "miscutils.h"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace TestClient {
+
+/**
+ * \brief One completed span, times in nanoseconds of Tracer::Clock
+ */
+struct TraceEvent {
+    int64_t     startNS_;
+    int64_t     durationNS_;
+    uint64_t    bytes_;
+    TraceId     id_;        // 0 for a span of the recording thread
+    uint32_t    kind_;
+    uint32_t    reserved_;
+}; // TraceEvent
+
+/**
+ * \brief Ring of one thread, written only by that thread
+ */
+struct ThreadTraceRing {
+    std::vector<TraceEvent> events_;
+    std::atomic<uint64_t>   next_;      // spans ever recorded, the newest is at (next_ - 1) % size
+    size_t                  thread_;    // order of creation, the tid of the export
+
+    ThreadTraceRing(size_t events, size_t thread)
+        : events_(events), next_(0), thread_(thread)
+    { }
+}; // ThreadTraceRing
+
+std::atomic<bool> Tracer::enabled_(false);
+std::atomic<TraceId> Tracer::nextId_(1);
+
+static std::atomic<size_t> ringEvents(Tracer::DEFAULT_RING_EVENTS);
+
+// every thread's ring, kept until exit so the export still sees threads that ended
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<ThreadTraceRing>> registry;
+
+static TESTCLIENT_THREAD_LOCAL ThreadTraceRing* threadRing = nullptr;
+
+static ThreadTraceRing& LocalRing() {
+    if (threadRing == nullptr) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        std::unique_ptr<ThreadTraceRing> ring(new ThreadTraceRing(std::max<size_t>(ringEvents.load(), 1), registry.size()));
+        threadRing = ring.get();
+        registry.push_back(std::move(ring));
+    }
+
+    return *threadRing;
+}
+
+const char* TraceSpanName(TraceSpanKind kind) {
+    switch (kind) {
+    case TRACE_CREATE_BLOB:         return "create_blob";
+    case TRACE_UPLOAD_PUT:          return "upload_put";
+    case TRACE_UPLOAD_CHUNK:        return "upload_chunk";
+    case TRACE_METADATA_GET:        return "metadata_get";
+    case TRACE_RESPONSE_HEADERS:    return "response_headers";
+    case TRACE_DOWNLOAD_BODY:       return "download_body";
+    case TRACE_DOWNLOAD_CHUNK:      return "download_chunk";
+    case TRACE_FILE_OPEN:           return "file_open";
+    case TRACE_FILE_CLOSE:          return "file_close";
+    case TRACE_VERIFY:              return "verify";
+    default:                        return "unknown";
+    }
+}
+
+void Tracer::SetRingEvents(size_t events) {
+    ringEvents.store(events);
+}
+
+void Tracer::Append(TraceSpanKind kind, TraceId id, Clock::time_point start, Clock::time_point end, uint64_t bytes) {
+    auto& ring = LocalRing();
+    auto next = ring.next_.load(std::memory_order_relaxed);
+
+    auto& event = ring.events_[static_cast<size_t>(next % ring.events_.size())];
+    event.startNS_ = std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count();
+    event.durationNS_ = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    event.bytes_ = bytes;
+    event.id_ = id;
+    event.kind_ = static_cast<uint32_t>(kind);
+
+    ring.next_.store(next + 1, std::memory_order_release);
+}
+
+uint64_t Tracer::Overwritten() {
+    uint64_t overwritten = 0;
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (size_t t = 0; t < registry.size(); ++t) {
+        auto next = registry[t]->next_.load(std::memory_order_acquire);
+        auto size = static_cast<uint64_t>(registry[t]->events_.size());
+        overwritten += next > size ? next - size : 0;
+    }
+    return overwritten;
+}
+
+/**
+ * \brief Writes nanoseconds as the microseconds trace events count in, keeping every digit
+ */
+static void WriteMicroseconds(std::ostream& os, int64_t ns) {
+    if (ns < 0) {
+        os << "-";
+        ns = -ns;
+    }
+
+    auto fraction = ns % 1000;
+    os << ns / 1000 << "." << (fraction < 100 ? "0" : "") << (fraction < 10 ? "0" : "") << fraction;
+}
+
+bool Tracer::Export(const std::string& fileName, int pid /*= 0*/) {
+    std::ofstream file(fileName.c_str());
+    if (!file) {
+        return false;
+    }
+
+    file << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+
+    auto first = true;
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (size_t t = 0; t < registry.size(); ++t) {
+        const auto& ring = *registry[t];
+        auto next = ring.next_.load(std::memory_order_acquire);
+        if (next == 0) {
+            continue;
+        }
+
+        file << (first ? "\n" : ",\n")
+            << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << pid << ", \"tid\": " << ring.thread_
+            << ", \"args\": {\"name\": \"thread " << ring.thread_ << "\"}}";
+        first = false;
+
+        auto size = static_cast<uint64_t>(ring.events_.size());
+        for (auto i = next > size ? next - size : 0; i < next; ++i) {
+            const auto& event = ring.events_[static_cast<size_t>(i % size)];
+            auto name = TraceSpanName(static_cast<TraceSpanKind>(event.kind_));
+            if (event.id_ == 0) {
+                file << ",\n{\"name\": \"" << name
+                    << "\", \"cat\": \"contentservice\", \"ph\": \"X\", \"pid\": " << pid << ", \"tid\": " << ring.thread_
+                    << ", \"ts\": ";
+                WriteMicroseconds(file, event.startNS_);
+                file << ", \"dur\": ";
+                WriteMicroseconds(file, event.durationNS_);
+                file << ", \"args\": {\"bytes\": " << event.bytes_ << "}}";
+                continue;
+            }
+
+            // an async pair, its id gives the step a track of its own whatever thread completed it
+            file << ",\n{\"name\": \"" << name
+                << "\", \"cat\": \"contentservice\", \"ph\": \"b\", \"id\": " << event.id_
+                << ", \"pid\": " << pid << ", \"tid\": " << ring.thread_ << ", \"ts\": ";
+            WriteMicroseconds(file, event.startNS_);
+            file << ", \"args\": {\"bytes\": " << event.bytes_ << "}}";
+            file << ",\n{\"name\": \"" << name
+                << "\", \"cat\": \"contentservice\", \"ph\": \"e\", \"id\": " << event.id_
+                << ", \"pid\": " << pid << ", \"tid\": " << ring.thread_ << ", \"ts\": ";
+            WriteMicroseconds(file, event.startNS_ + event.durationNS_);
+            file << "}";
+        }
+    }
+
+    file << "\n]}" << std::endl;
+
+    return static_cast<bool>(file);
+}
+
+} // namespace TestClient
@@ -0,0 +1,333 @@
+#include "transfertiming.h"
+#include "miscutils.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+using namespace Concurrency::streams;
+
+namespace TestClient {
+
+/**
+ * \brief Goodput totals of one direction, one atomic add each per transfer
+ */
+struct TransferCounters {
+    std::atomic<uint64_t>   transfers_;
+    std::atomic<uint64_t>   bytes_;
+    std::atomic<uint64_t>   streamingNS_;
+    std::atomic<uint64_t>   totalNS_;
+}; // TransferCounters
+
+static TransferCounters transferCounters[NUM_TRANSFER_DIRECTIONS];
+
+/**
+ * \brief Per-transfer goodput of one thread, bytes per second while streaming and in total
+ */
+struct ThreadGoodputHistograms {
+    LatencyHistogram streaming_[NUM_TRANSFER_DIRECTIONS];
+    LatencyHistogram total_[NUM_TRANSFER_DIRECTIONS];
+}; // ThreadGoodputHistograms
+
+// every thread's histograms, kept until exit like those of PhaseStats
+static std::mutex goodputRegistryMutex;
+static std::vector<std::unique_ptr<ThreadGoodputHistograms>> goodputRegistry;
+
+static TESTCLIENT_THREAD_LOCAL ThreadGoodputHistograms* threadGoodput = nullptr;
+
+static ThreadGoodputHistograms& LocalGoodput() {
+    if (threadGoodput == nullptr) {
+        std::unique_ptr<ThreadGoodputHistograms> histograms(new ThreadGoodputHistograms());
+
+        std::lock_guard<std::mutex> lock(goodputRegistryMutex);
+        threadGoodput = histograms.get();
+        goodputRegistry.push_back(std::move(histograms));
+    }
+
+    return *threadGoodput;
+}
+
+static uint64_t BytesPerS(uint64_t bytes, uint64_t ns) {
+    return static_cast<uint64_t>((double)bytes * 1e9 / (double)ns);
+}
+
+/**
+ * \brief Write-only stream buffer timing everything it forwards
+ *
+ * Writes go straight through to the target buffer, the timing costs a clock
+ * read per write, i.e. per chunk of the response body.
+ */
+class TimingTargetBuffer : public details::streambuf_state_manager<uint8_t> {
+    typedef details::streambuf_state_manager<uint8_t> base;
+
+    streambuf<uint8_t>                  target_;
+    std::shared_ptr<TransferTiming>     timing_;
+
+public:
+    typedef base::traits traits;
+    typedef base::int_type int_type;
+    typedef base::pos_type pos_type;
+    typedef base::off_type off_type;
+
+    TimingTargetBuffer(streambuf<uint8_t> target, std::shared_ptr<TransferTiming> timing)
+        : base(std::ios_base::out),
+        target_(target),
+        timing_(timing)
+    { }
+
+    virtual ~TimingTargetBuffer() {
+        this->_close_write();
+    }
+
+    virtual bool can_seek() const { return false; }
+    virtual bool has_size() const { return false; }
+    virtual utility::size64_t size() const { return 0; }
+
+    virtual size_t buffer_size(std::ios_base::openmode = std::ios_base::out) const { return 0; }
+    virtual void set_buffer_size(size_t, std::ios_base::openmode = std::ios_base::out) { }
+
+    virtual size_t in_avail() const { return 0; }
+
+    virtual bool acquire(uint8_t*& ptr, size_t& count) {
+        ptr = nullptr;
+        count = 0;
+        return false;
+    }
+
+    virtual void release(uint8_t*, size_t) { }
+
+    virtual pos_type getpos(std::ios_base::openmode) const { return static_cast<pos_type>(traits::eof()); }
+    virtual pos_type seekpos(pos_type, std::ios_base::openmode) { return static_cast<pos_type>(traits::eof()); }
+    virtual pos_type seekoff(off_type, std::ios_base::seekdir, std::ios_base::openmode) { return static_cast<pos_type>(traits::eof()); }
+
+protected:
+    virtual pplx::task<bool> _sync() {
+        return target_.sync().then([]() { return true; });
+    }
+
+    virtual pplx::task<int_type> _putc(uint8_t ch) {
+        timing_->Count(1);
+        return target_.putc(ch);
+    }
+
+    virtual pplx::task<size_t> _putn(const uint8_t* ptr, size_t count) {
+        timing_->Count(count);
+        return target_.putn_nocopy(ptr, count);
+    }
+
+    // no direct access to the target, every write has to be seen
+    virtual uint8_t* _alloc(size_t) { return nullptr; }
+    virtual void _commit(size_t) { }
+
+    // read side, the buffer is write-only
+    virtual pplx::task<size_t> _getn(uint8_t*, size_t) { return pplx::task_from_result<size_t>(0); }
+    virtual size_t _scopy(uint8_t*, size_t) { return 0; }
+    virtual pplx::task<int_type> _bumpc() { return pplx::task_from_result<int_type>(traits::eof()); }
+    virtual int_type _sbumpc() { return traits::eof(); }
+    virtual pplx::task<int_type> _getc() { return pplx::task_from_result<int_type>(traits::eof()); }
+    virtual int_type _sgetc() { return traits::eof(); }
+    virtual pplx::task<int_type> _nextc() { return pplx::task_from_result<int_type>(traits::eof()); }
+    virtual pplx::task<int_type> _ungetc() { return pplx::task_from_result<int_type>(traits::eof()); }
+}; // TimingTargetBuffer
+
+/**
+ * \brief Read-only stream buffer timing everything read through it
+ *
+ * Reads and seeks go straight to the source buffer. Bytes taken with
+ * acquire() count once they are released. Closing it leaves the source open,
+ * the owner of the source closes that.
+ */
+class TimingSourceBuffer : public details::streambuf_state_manager<uint8_t> {
+    typedef details::streambuf_state_manager<uint8_t> base;
+
+    streambuf<uint8_t>                  source_;
+    std::shared_ptr<TransferTiming>     timing_;
+
+public:
+    typedef base::traits traits;
+    typedef base::int_type int_type;
+    typedef base::pos_type pos_type;
+    typedef base::off_type off_type;
+
+    TimingSourceBuffer(streambuf<uint8_t> source, std::shared_ptr<TransferTiming> timing)
+        : base(std::ios_base::in),
+        source_(source),
+        timing_(timing)
+    { }
+
+    virtual ~TimingSourceBuffer() {
+        this->_close_read();
+    }
+
+    virtual bool can_seek() const { return source_.can_seek(); }
+    virtual bool has_size() const { return source_.has_size(); }
+    virtual utility::size64_t size() const { return source_.size(); }
+
+    virtual size_t buffer_size(std::ios_base::openmode direction = std::ios_base::in) const { return source_.buffer_size(direction); }
+    virtual void set_buffer_size(size_t size, std::ios_base::openmode direction = std::ios_base::in) { source_.set_buffer_size(size, direction); }
+
+    virtual size_t in_avail() const { return source_.in_avail(); }
+
+    virtual bool acquire(uint8_t*& ptr, size_t& count) {
+        return source_.acquire(ptr, count);
+    }
+
+    virtual void release(uint8_t* ptr, size_t count) {
+        timing_->Count(count);
+        source_.release(ptr, count);
+    }
+
+    virtual pos_type getpos(std::ios_base::openmode direction) const { return source_.getpos(direction); }
+    virtual pos_type seekpos(pos_type pos, std::ios_base::openmode direction) { return source_.seekpos(pos, direction); }
+    virtual pos_type seekoff(off_type offset, std::ios_base::seekdir way, std::ios_base::openmode direction) { return source_.seekoff(offset, way, direction); }
+
+protected:
+    virtual pplx::task<bool> _sync() { return pplx::task_from_result(true); }
+
+    // write side, the buffer is read-only
+    virtual pplx::task<int_type> _putc(uint8_t) { return pplx::task_from_result<int_type>(traits::eof()); }
+    virtual pplx::task<size_t> _putn(const uint8_t*, size_t) { return pplx::task_from_result<size_t>(0); }
+    virtual uint8_t* _alloc(size_t) { return nullptr; }
+    virtual void _commit(size_t) { }
+
+    virtual pplx::task<size_t> _getn(uint8_t* ptr, size_t count) {
+        auto timing = timing_;
+        return source_.getn(ptr, count).then(
+            [timing](size_t read) -> size_t
+            {
+                timing->Count(read);
+                return read;
+            }
+        );
+    }
+
+    virtual size_t _scopy(uint8_t* ptr, size_t count) {
+        auto read = source_.scopy(ptr, count);
+        timing_->Count(read);
+        return read;
+    }
+
+    virtual pplx::task<int_type> _bumpc() {
+        auto timing = timing_;
+        return source_.bumpc().then(
+            [timing](int_type ch) -> int_type
+            {
+                if (ch != traits::eof()) {
+                    timing->Count(1);
+                }
+                return ch;
+            }
+        );
+    }
+
+    virtual int_type _sbumpc() {
+        auto ch = source_.sbumpc();
+        if (ch != traits::eof() && ch != traits::requires_async()) {
+            timing_->Count(1);
+        }
+        return ch;
+    }
+
+    // peeks, nothing is taken until bumped or read
+    virtual pplx::task<int_type> _getc() { return source_.getc(); }
+    virtual int_type _sgetc() { return source_.sgetc(); }
+    virtual pplx::task<int_type> _nextc() { return source_.nextc(); }
+    virtual pplx::task<int_type> _ungetc() { return source_.ungetc(); }
+}; // TimingSourceBuffer
+
+streambuf<uint8_t> TimingStream::WrapTarget(streambuf<uint8_t> target, std::shared_ptr<TransferTiming> timing) {
+    return streambuf<uint8_t>(std::make_shared<TimingTargetBuffer>(target, timing));
+}
+
+basic_istream<uint8_t> TimingStream::WrapSource(basic_istream<uint8_t> source, std::shared_ptr<TransferTiming> timing) {
+    return basic_istream<uint8_t>(streambuf<uint8_t>(std::make_shared<TimingSourceBuffer>(source.streambuf(), timing)));
+}
+
+static uint64_t ElapsedNS(TransferTiming::Clock::time_point from, TransferTiming::Clock::time_point to) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+    return ns > 0 ? static_cast<uint64_t>(ns) : 0;
+}
+
+void RecordTransfer(TransferDirection direction, const TransferTiming& timing) {
+    uint64_t streamingNS = 0, totalNS = 0;
+    if (direction == TRANSFER_DOWNLOAD) {
+        PhaseStats::Record(PHASE_DOWNLOAD_TTFB, ElapsedNS(timing.sent_, timing.headers_));
+        if (timing.bytes_ > 0) {
+            PhaseStats::Record(PHASE_DOWNLOAD_FIRST_BYTE, ElapsedNS(timing.sent_, timing.firstByte_));
+            PhaseStats::Record(PHASE_DOWNLOAD_STREAM, ElapsedNS(timing.firstByte_, timing.lastByte_));
+            streamingNS = ElapsedNS(timing.firstByte_, timing.lastByte_);
+            totalNS = ElapsedNS(timing.sent_, timing.lastByte_);
+        }
+    }
+    else {
+        if (timing.bytes_ > 0) {
+            PhaseStats::Record(PHASE_UPLOAD_SEND, ElapsedNS(timing.sent_, timing.lastByte_));
+            PhaseStats::Record(PHASE_UPLOAD_ACK, ElapsedNS(timing.lastByte_, timing.headers_));
+            streamingNS = ElapsedNS(timing.firstByte_, timing.lastByte_);
+            totalNS = ElapsedNS(timing.sent_, timing.headers_);
+        }
+    }
+
+    if (streamingNS > 0 && totalNS > 0) {
+        auto& goodput = LocalGoodput();
+        goodput.streaming_[direction].Record(BytesPerS(timing.bytes_, streamingNS));
+        goodput.total_[direction].Record(BytesPerS(timing.bytes_, totalNS));
+    }
+
+    auto& counters = transferCounters[direction];
+    counters.transfers_.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes_.fetch_add(timing.bytes_, std::memory_order_relaxed);
+    counters.streamingNS_.fetch_add(streamingNS, std::memory_order_relaxed);
+    counters.totalNS_.fetch_add(totalNS, std::memory_order_relaxed);
+}
+
+TransferStats Transfers(TransferDirection direction) {
+    const auto& counters = transferCounters[direction];
+    TransferStats stats;
+    stats.transfers_ = counters.transfers_.load(std::memory_order_relaxed);
+    stats.bytes_ = counters.bytes_.load(std::memory_order_relaxed);
+    stats.streamingNS_ = counters.streamingNS_.load(std::memory_order_relaxed);
+    stats.totalNS_ = counters.totalNS_.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(goodputRegistryMutex);
+    for (size_t t = 0; t < goodputRegistry.size(); ++t) {
+        stats.streaming_.Merge(goodputRegistry[t]->streaming_[direction]);
+        stats.total_.Merge(goodputRegistry[t]->total_[direction]);
+    }
+
+    return stats;
+}
+
+/**
+ * \brief Prints p10, p50 and p90 of a goodput distribution in MB/s, slow transfers are at the low end
+ */
+static void PrintGoodputPercentiles(std::wostream& os, const LatencyHistogram& histogram) {
+    static const double MB = 1024.0 * 1024.0;
+    os << L"p10 " << (histogram.ValueAtPercentile(10.0) / MB)
+        << L", p50 " << (histogram.ValueAtPercentile(50.0) / MB)
+        << L", p90 " << (histogram.ValueAtPercentile(90.0) / MB) << L" MB/s";
+}
+
+void PrintTransferStats(std::wostream& os) {
+    static const wchar_t* names[NUM_TRANSFER_DIRECTIONS] = { L"Upload", L"Download" };
+
+    for (int d = 0; d < NUM_TRANSFER_DIRECTIONS; ++d) {
+        auto stats = Transfers(static_cast<TransferDirection>(d));
+        if (stats.transfers_ == 0) {
+            continue;
+        }
+
+        os << names[d] << L" goodput: " << stats.transfers_ << L" transfers, "
+            << (stats.StreamingBytesPerS() / (1024.0 * 1024.0)) << L"MB/s aggregate while bodies stream, "
+            << (stats.TotalBytesPerS() / (1024.0 * 1024.0)) << L"MB/s aggregate including the wait for the server" << std::endl;
+        if (stats.streaming_.TotalCount() > 0) {
+            os << L"  per transfer while the body streams: ";
+            PrintGoodputPercentiles(os, stats.streaming_);
+            os << std::endl << L"  per transfer including the wait: ";
+            PrintGoodputPercentiles(os, stats.total_);
+            os << std::endl;
+        }
+    }
+}
+
+} // namespace TestClient
@@ -0,0 +1,224 @@
+#include "uuidprefetcher.h"
+
+#include <algorithm>
+
+namespace TestClient {
+
+UuidQueue::UuidQueue(size_t capacity)
+    : mask_(0),
+    enqueue_(0),
+    dequeue_(0)
+{
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    cells_.reset(new Cell[size]);
+    for (size_t i = 0; i < size; ++i) {
+        cells_[i].sequence_.store(i, std::memory_order_relaxed);
+    }
+    mask_ = size - 1;
+}
+
+bool UuidQueue::TryPush(const utility::string_t& uuid) {
+    auto position = enqueue_.load(std::memory_order_relaxed);
+    for (;;) {
+        auto& cell = cells_[static_cast<size_t>(position & mask_)];
+        auto sequence = cell.sequence_.load(std::memory_order_acquire);
+        auto difference = static_cast<int64_t>(sequence - position);
+
+        // the cell is free for this position once the consumer of the lap before has left it
+        if (difference == 0) {
+            if (enqueue_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                cell.uuid_ = uuid;
+                cell.sequence_.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (difference < 0) {
+            return false;
+        }
+        else {
+            position = enqueue_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool UuidQueue::TryPop(utility::string_t& uuid) {
+    auto position = dequeue_.load(std::memory_order_relaxed);
+    for (;;) {
+        auto& cell = cells_[static_cast<size_t>(position & mask_)];
+        auto sequence = cell.sequence_.load(std::memory_order_acquire);
+        auto difference = static_cast<int64_t>(sequence - (position + 1));
+
+        // the cell holds this position once its producer has published it
+        if (difference == 0) {
+            if (dequeue_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                uuid.swap(cell.uuid_);
+                cell.uuid_.clear();
+                cell.sequence_.store(position + mask_ + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (difference < 0) {
+            return false;
+        }
+        else {
+            position = dequeue_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+size_t UuidQueue::Size() const {
+    auto dequeued = dequeue_.load(std::memory_order_relaxed);
+    auto enqueued = enqueue_.load(std::memory_order_relaxed);
+    return enqueued > dequeued ? static_cast<size_t>(enqueued - dequeued) : 0;
+}
+
+/**
+ * \brief Ready uuids of one blob size and their counters
+ */
+struct UuidPrefetcher::SizeQueue {
+    uint64_t                size_;
+    UuidQueue               queue_;
+    std::atomic<size_t>     creating_;      // creations outstanding
+    std::atomic<uint64_t>   created_;
+    std::atomic<uint64_t>   failures_;
+    std::atomic<uint64_t>   taken_;
+    std::atomic<uint64_t>   misses_;
+    std::atomic<uint64_t>   depthSum_;      // ready uuids summed over the lookups
+
+    SizeQueue(uint64_t size, size_t capacity)
+        : size_(size), queue_(capacity), creating_(0), created_(0), failures_(0), taken_(0), misses_(0), depthSum_(0)
+    { }
+}; // SizeQueue
+
+UuidPrefetcher::UuidPrefetcher()
+    : started_(false),
+    stopping_(false)
+{ }
+
+UuidPrefetcher::~UuidPrefetcher()
+{ }
+
+bool UuidPrefetcher::Start(const std::vector<uint64_t>& sizes, const UuidPrefetchOptions& options, CreateBlobFunc create) {
+    if (options.depth_ == 0 || !create || started_.load() || !queues_.empty()) {
+        return false;
+    }
+
+    auto distinct = sizes;
+    std::sort(distinct.begin(), distinct.end());
+    distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+
+    options_ = options;
+    options_.inFlight_ = std::max<size_t>(options_.inFlight_, 1);
+    create_ = create;
+
+    // room for every creation outstanding on top of a full queue, a push never fails
+    for (size_t i = 0; i < distinct.size(); ++i) {
+        queues_.push_back(std::unique_ptr<SizeQueue>(new SizeQueue(distinct[i], options_.depth_ + options_.inFlight_)));
+    }
+    started_.store(true, std::memory_order_release);
+
+    for (size_t i = 0; i < queues_.size(); ++i) {
+        Refill(*queues_[i]);
+    }
+    return true;
+}
+
+void UuidPrefetcher::Stop() {
+    stopping_.store(true, std::memory_order_relaxed);
+}
+
+UuidPrefetcher::SizeQueue* UuidPrefetcher::Find(uint64_t size) const {
+    auto iter = std::lower_bound(queues_.begin(), queues_.end(), size,
+        [](const std::unique_ptr<SizeQueue>& queue, uint64_t size) { return queue->size_ < size; });
+    return iter != queues_.end() && (*iter)->size_ == size ? iter->get() : nullptr;
+}
+
+void UuidPrefetcher::Refill(SizeQueue& queue) {
+    while (!stopping_.load(std::memory_order_relaxed)) {
+        auto creating = queue.creating_.load(std::memory_order_relaxed);
+        if (creating >= options_.inFlight_ || queue.queue_.Size() + creating >= options_.depth_) {
+            return;
+        }
+        if (!queue.creating_.compare_exchange_weak(creating, creating + 1, std::memory_order_relaxed)) {
+            continue;
+        }
+
+        pplx::task<utility::string_t> createTask;
+        try {
+            createTask = create_(queue.size_);
+        }
+        catch (...) {
+            createTask = pplx::task_from_result(utility::string_t());
+        }
+
+        // the queues live as long as the prefetcher the continuation holds on to
+        auto self = shared_from_this();
+        auto target = &queue;
+        createTask.then(
+            [self, target](pplx::task<utility::string_t> previousTask)
+            {
+                utility::string_t uuid;
+                try {
+                    uuid = previousTask.get();
+                }
+                catch (...) { }
+
+                auto created = !uuid.empty() && target->queue_.TryPush(uuid);
+                (created ? target->created_ : target->failures_).fetch_add(1, std::memory_order_relaxed);
+                target->creating_.fetch_sub(1, std::memory_order_relaxed);
+
+                // a failed creation is retried on the next take, not in a loop against a failing service
+                if (created) {
+                    self->Refill(*target);
+                }
+            }
+        );
+    }
+}
+
+bool UuidPrefetcher::TryTake(uint64_t size, utility::string_t& uuid) {
+    if (!Enabled()) {
+        return false;
+    }
+
+    auto queue = Find(size);
+    if (queue == nullptr) {
+        return false;
+    }
+
+    queue->depthSum_.fetch_add(queue->queue_.Size(), std::memory_order_relaxed);
+    auto taken = queue->queue_.TryPop(uuid);
+    (taken ? queue->taken_ : queue->misses_).fetch_add(1, std::memory_order_relaxed);
+
+    Refill(*queue);
+    return taken;
+}
+
+std::vector<UuidPrefetchStats> UuidPrefetcher::Stats() const {
+    std::vector<UuidPrefetchStats> stats;
+    if (!Enabled()) {
+        return stats;
+    }
+
+    for (size_t i = 0; i < queues_.size(); ++i) {
+        const auto& queue = *queues_[i];
+        UuidPrefetchStats queueStats;
+        queueStats.size_ = queue.size_;
+        queueStats.depth_ = queue.queue_.Size();
+        queueStats.created_ = queue.created_.load(std::memory_order_relaxed);
+        queueStats.failures_ = queue.failures_.load(std::memory_order_relaxed);
+        queueStats.taken_ = queue.taken_.load(std::memory_order_relaxed);
+        queueStats.misses_ = queue.misses_.load(std::memory_order_relaxed);
+
+        auto lookups = queueStats.taken_ + queueStats.misses_;
+        queueStats.meanDepth_ = lookups > 0 ? (double)queue.depthSum_.load(std::memory_order_relaxed) / (double)lookups : 0.0;
+        stats.push_back(queueStats);
+    }
+    return stats;
+}
+
+} // namespace TestClient
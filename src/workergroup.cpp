@@ -0,0 +1,287 @@
+#include "workergroup.h"
+#include "phasestats.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <new>
+#include <sstream>
+
+#if !_WIN32
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace TestClient {
+
+// slots start on their own page, so workers never write the same cache line
+static const size_t REGION_PAGE_SIZE = 4096;
+
+static const int64_t PUBLISH_INTERVAL_MS = 100;
+
+// histograms are large, they are copied every few intervals and at the end
+static const size_t HISTOGRAM_PUBLISH_INTERVALS = 10;
+
+#if ATOMIC_LLONG_LOCK_FREE != 2
+#error "counters shared between processes need lock-free 64-bit atomics"
+#endif
+
+/**
+ * \brief Start of the shared region
+ */
+struct WorkerGroupHeader {
+    std::atomic<uint64_t>   start_;     // set once by the coordinator to release the barrier
+}; // WorkerGroupHeader
+
+/**
+ * \brief Counts published by one worker
+ */
+struct WorkerSlot {
+    std::atomic<uint64_t>   state_;
+    std::atomic<uint64_t>   ops_[NUM_THROUGHPUT_OPERATIONS];
+    std::atomic<uint64_t>   bytes_[NUM_THROUGHPUT_OPERATIONS];
+    std::atomic<uint64_t>   errors_[NUM_THROUGHPUT_OPERATIONS];
+    std::atomic<uint64_t>   histograms_[NUM_LATENCY_PHASES][LatencyHistogram::RAW_SIZE];
+}; // WorkerSlot
+
+std::string WorkerManifestFile(const std::string& manifestFile, size_t index) {
+    std::ostringstream oss;
+    oss << manifestFile << ".worker" << index;
+    return oss.str();
+}
+
+WorkerGroup::WorkerGroup(size_t workers)
+    : workers_(workers),
+    index_(workers),
+    region_(nullptr),
+    regionSize_(0),
+    slotSize_((sizeof(WorkerSlot) + REGION_PAGE_SIZE - 1) / REGION_PAGE_SIZE * REGION_PAGE_SIZE),
+    parent_(0),
+    failed_(0),
+    stopping_(false)
+{ }
+
+WorkerGroup::~WorkerGroup() {
+    if (thread_.joinable()) {
+        Finish();
+    }
+
+#if !_WIN32
+    if (region_ != nullptr) {
+        munmap(region_, regionSize_);
+    }
+#endif
+}
+
+void* WorkerGroup::Slot(size_t index) const {
+    return region_ + REGION_PAGE_SIZE + index * slotSize_;
+}
+
+bool WorkerGroup::Start() {
+#if _WIN32
+    return false;
+#else
+    if (region_ != nullptr || workers_ == 0) {
+        return false;
+    }
+
+    // anonymous shared memory is zero-filled and inherited by every fork
+    regionSize_ = REGION_PAGE_SIZE + workers_ * slotSize_;
+    auto region = mmap(nullptr, regionSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        return false;
+    }
+    region_ = static_cast<char*>(region);
+
+    new (region_) WorkerGroupHeader();
+    for (size_t i = 0; i < workers_; ++i) {
+        new (Slot(i)) WorkerSlot();
+    }
+
+    // buffered output would be written once by every process
+    std::cout.flush();
+    std::wcout.flush();
+    std::fflush(stdout);
+
+    parent_ = static_cast<int>(getpid());
+    for (size_t i = 0; i < workers_; ++i) {
+        auto pid = fork();
+        if (pid == 0) {
+            index_ = i;
+            pids_.clear();
+            return true;
+        }
+
+        if (pid < 0) {
+            for (size_t w = 0; w < pids_.size(); ++w) {
+                kill(pids_[w], SIGKILL);
+                waitpid(pids_[w], nullptr, 0);
+            }
+            pids_.clear();
+            return false;
+        }
+
+        pids_.push_back(static_cast<int>(pid));
+        exited_.push_back(false);
+    }
+
+    return true;
+#endif
+}
+
+bool WorkerGroup::ArriveAndWait() {
+#if _WIN32
+    return false;
+#else
+    auto& header = *reinterpret_cast<WorkerGroupHeader*>(region_);
+    auto& slot = *static_cast<WorkerSlot*>(Slot(index_));
+
+    slot.state_.store(WORKER_READY, std::memory_order_release);
+    while (header.start_.load(std::memory_order_acquire) == 0) {
+        if (static_cast<int>(getppid()) != parent_) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    slot.state_.store(WORKER_RUNNING, std::memory_order_release);
+
+    stopping_ = false;
+    thread_ = std::thread([this]() { Run(); });
+
+    return true;
+#endif
+}
+
+void WorkerGroup::Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    size_t intervals = 0;
+    while (!stop_.wait_for(lock, std::chrono::milliseconds(PUBLISH_INTERVAL_MS), [this]() { return stopping_; })) {
+        Publish(++intervals % HISTOGRAM_PUBLISH_INTERVALS == 0);
+    }
+}
+
+void WorkerGroup::Publish(bool histograms) {
+    auto& slot = *static_cast<WorkerSlot*>(Slot(index_));
+
+    ThroughputTotals totals[NUM_THROUGHPUT_OPERATIONS];
+    ThroughputStats::Snapshot(totals);
+    for (int i = 0; i < NUM_THROUGHPUT_OPERATIONS; ++i) {
+        slot.ops_[i].store(totals[i].ops_, std::memory_order_relaxed);
+        slot.bytes_[i].store(totals[i].bytes_, std::memory_order_relaxed);
+        slot.errors_[i].store(totals[i].errors_, std::memory_order_relaxed);
+    }
+
+    if (histograms) {
+        auto snapshot = PhaseStats::Snapshot();
+        for (int i = 0; i < NUM_LATENCY_PHASES; ++i) {
+            snapshot[i].CopyTo(slot.histograms_[i]);
+        }
+    }
+}
+
+void WorkerGroup::Finish() {
+    if (!IsWorker()) {
+        return;
+    }
+
+    if (thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        stop_.notify_all();
+        thread_.join();
+    }
+
+    Publish(true);
+    static_cast<WorkerSlot*>(Slot(index_))->state_.store(WORKER_DONE, std::memory_order_release);
+}
+
+size_t WorkerGroup::ReleaseWhenReady() {
+    auto& header = *reinterpret_cast<WorkerGroupHeader*>(region_);
+
+    for (;;) {
+        auto running = Running();
+        size_t ready = 0;
+        for (size_t i = 0; i < workers_; ++i) {
+            if (!exited_[i] && static_cast<WorkerSlot*>(Slot(i))->state_.load(std::memory_order_acquire) >= WORKER_READY) {
+                ++ready;
+            }
+        }
+
+        if (ready == running) {
+            header.start_.store(1, std::memory_order_release);
+            return ready;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+size_t WorkerGroup::Running() {
+    size_t running = 0;
+#if !_WIN32
+    for (size_t i = 0; i < pids_.size(); ++i) {
+        if (exited_[i]) {
+            continue;
+        }
+
+        int status = 0;
+        auto pid = waitpid(pids_[i], &status, WNOHANG);
+        if (pid == 0) {
+            ++running;
+            continue;
+        }
+
+        exited_[i] = true;
+        if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            ++failed_;
+        }
+    }
+#endif
+    return running;
+}
+
+void WorkerGroup::Snapshot(ThroughputTotals (&totals)[NUM_THROUGHPUT_OPERATIONS]) const {
+    for (int i = 0; i < NUM_THROUGHPUT_OPERATIONS; ++i) {
+        totals[i] = ThroughputTotals();
+    }
+
+    if (region_ == nullptr) {
+        return;
+    }
+
+    for (size_t w = 0; w < workers_; ++w) {
+        const auto& slot = *static_cast<const WorkerSlot*>(Slot(w));
+        for (int i = 0; i < NUM_THROUGHPUT_OPERATIONS; ++i) {
+            totals[i].ops_ += slot.ops_[i].load(std::memory_order_relaxed);
+            totals[i].bytes_ += slot.bytes_[i].load(std::memory_order_relaxed);
+            totals[i].errors_ += slot.errors_[i].load(std::memory_order_relaxed);
+        }
+    }
+}
+
+std::vector<LatencyHistogram> WorkerGroup::Histograms() const {
+    std::vector<LatencyHistogram> histograms;
+    for (int i = 0; i < NUM_LATENCY_PHASES; ++i) {
+        histograms.push_back(LatencyHistogram(LatencyPhaseName(static_cast<LatencyPhase>(i))));
+    }
+
+    if (region_ == nullptr) {
+        return histograms;
+    }
+
+    for (size_t w = 0; w < workers_; ++w) {
+        const auto& slot = *static_cast<const WorkerSlot*>(Slot(w));
+        for (int i = 0; i < NUM_LATENCY_PHASES; ++i) {
+            histograms[i].Merge(slot.histograms_[i]);
+        }
+    }
+
+    return histograms;
+}
+
+} // namespace TestClient